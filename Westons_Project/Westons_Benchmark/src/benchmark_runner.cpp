@@ -0,0 +1,353 @@
+#include "benchmark_runner.h"
+
+#include <algorithm>
+#include <cassert>
+#include <iomanip>
+#include <iostream>
+
+const int benchmark_runner::sample_rate = 44100;
+const std::vector<uint32_t> benchmark_runner::voice_counts = {1, 4, 16, 64, 256};
+const std::vector<uint32_t> benchmark_runner::buffer_sizes = {32, 64, 128, 256, 512, 1024, 2048, 4096};
+
+volatile float benchmark_runner::sink_ = 0.0f;
+
+benchmark_case::benchmark_case(const std::string& name, const std::string& variant, const uint32_t voices,
+                               const uint32_t frames) :
+    m_name(name),
+    m_variant(variant),
+    m_voices(voices),
+    m_frames(frames)
+{
+}
+
+benchmark_result::benchmark_result(const benchmark_case& measured) :
+    m_case(measured),
+    m_iterations(0),
+    m_median_ns(0.0),
+    m_min_ns(0.0),
+    m_ns_per_frame(0.0),
+    m_realtime_load(0.0)
+{
+}
+
+benchmark_runner::benchmark_runner() :
+    m_min_time_(100),
+    m_repetitions_(5),
+    m_progress_(false)
+{
+}
+
+/**
+ * \brief Registers a benchmark. Nothing is set up until it runs.
+ * \param measured What the benchmark measures.
+ * \param setup Makes whatever the benchmark needs and hands back the work to time.
+ */
+void benchmark_runner::add(const benchmark_case& measured, const fixture& setup)
+{
+    m_entries_.push_back({measured, setup});
+}
+
+/**
+ * \brief Only runs the cases whose label contains the filter.
+ * \param filter Part of the label to look for. Runs everything when empty.
+ */
+void benchmark_runner::set_filter(const std::string& filter)
+{
+    m_filter_ = filter;
+}
+
+/**
+ * \brief Sets how long each repetition of a case runs for at least. Longer is steadier.
+ * \param min_time Shortest a repetition can take.
+ */
+void benchmark_runner::set_min_time(const std::chrono::milliseconds min_time)
+{
+    assert(min_time.count() > 0);
+    m_min_time_ = min_time;
+}
+
+/**
+ * \brief Sets how many times each case is timed. The median is what gets reported.
+ * \param repetitions Number of repetitions. At least one.
+ */
+void benchmark_runner::set_repetitions(const uint32_t repetitions)
+{
+    assert(repetitions > 0);
+    m_repetitions_ = repetitions;
+}
+
+/**
+ * \brief Sets if a line is printed as each case finishes.
+ * \param progress If progress is printed.
+ */
+void benchmark_runner::set_progress(const bool progress)
+{
+    m_progress_ = progress;
+}
+
+/**
+ * \brief Runs every selected case, keeping the results for write.
+ * \return Number of cases run.
+ */
+uint32_t benchmark_runner::run()
+{
+    m_results_.clear();
+    for (const auto& benchmark : m_entries_)
+    {
+        if (!selected(benchmark.m_case))
+        {
+            continue;
+        }
+
+        m_results_.push_back(measure(benchmark));
+
+        if (m_progress_)
+        {
+            const auto& result = m_results_.back();
+            std::cout << std::left << std::setw(60) << case_label(result.m_case) << std::right << std::fixed <<
+                std::setprecision(1) << std::setw(14) << result.m_median_ns << " ns";
+            if (result.m_case.m_frames > 0)
+            {
+                std::cout << std::setprecision(3) << std::setw(10) << result.m_realtime_load * 100.0 <<
+                    " % of real time";
+            }
+            std::cout << std::endl;
+        }
+    }
+
+    return static_cast<uint32_t>(m_results_.size());
+}
+
+/**
+ * \brief Writes the results of the last run, along with the machine and build they came from.
+ * \param output Stream to write to.
+ * \param format Format to write in.
+ */
+void benchmark_runner::write(std::ostream& output, const output_format format) const
+{
+    if (format == csv)
+    {
+        write_csv(output);
+    }
+    else
+    {
+        write_json(output);
+    }
+}
+
+/**
+ * \brief Writes the label of every selected case, one per line.
+ * \param output Stream to write to.
+ */
+void benchmark_runner::list(std::ostream& output) const
+{
+    for (const auto& benchmark : m_entries_)
+    {
+        if (selected(benchmark.m_case))
+        {
+            output << case_label(benchmark.m_case) << std::endl;
+        }
+    }
+}
+
+/**
+ * \brief Keeps a value that was worked out while timing, so the work cannot be optimized away.
+ * \param value Any value that depends on the work.
+ */
+void benchmark_runner::keep(const float value)
+{
+    sink_ = value;
+}
+
+/**
+ * \brief Makes the label a case is known by, such as sound_data::render/sine/voices=16/frames=256.
+ * \param measured Case to label.
+ * \return Label of the case.
+ */
+std::string benchmark_runner::case_label(const benchmark_case& measured)
+{
+    auto label = measured.m_name;
+    if (!measured.m_variant.empty())
+    {
+        label += "/" + measured.m_variant;
+    }
+
+    if (measured.m_voices > 0)
+    {
+        label += "/voices=" + std::to_string(measured.m_voices);
+    }
+
+    if (measured.m_frames > 0)
+    {
+        label += "/frames=" + std::to_string(measured.m_frames);
+    }
+
+    return label;
+}
+
+bool benchmark_runner::selected(const benchmark_case& measured) const
+{
+    return m_filter_.empty() || case_label(measured).find(m_filter_) != std::string::npos;
+}
+
+/**
+ * \brief Times one case. Iterations are doubled until a batch takes a tenth of the minimum time, then scaled up so each
+ * repetition takes about the minimum time.
+ * \param benchmark Case to time.
+ * \return How long it took.
+ */
+benchmark_result benchmark_runner::measure(const entry& benchmark) const
+{
+    const auto work = benchmark.m_setup();
+    const auto min_ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(m_min_time_).count());
+
+    // Warm the caches and let anything that ramps in, like envelopes, settle.
+    time_iterations(work, 1);
+
+    uint64_t iterations = 1;
+    auto elapsed = time_iterations(work, iterations);
+    while (elapsed < min_ns / 10.0)
+    {
+        iterations *= 2;
+        elapsed = time_iterations(work, iterations);
+    }
+    iterations = std::max<uint64_t>(1, static_cast<uint64_t>(static_cast<double>(iterations) * min_ns / elapsed));
+
+    std::vector<double> samples;
+    samples.reserve(m_repetitions_);
+    for (uint32_t i = 0; i < m_repetitions_; ++i)
+    {
+        samples.push_back(time_iterations(work, iterations) / static_cast<double>(iterations));
+    }
+    std::sort(samples.begin(), samples.end());
+
+    auto result = benchmark_result(benchmark.m_case);
+    result.m_iterations = iterations;
+    result.m_median_ns = samples[samples.size() / 2];
+    result.m_min_ns = samples.front();
+
+    if (benchmark.m_case.m_frames > 0)
+    {
+        result.m_ns_per_frame = result.m_median_ns / benchmark.m_case.m_frames;
+
+        const auto buffer_ns = 1e9 * benchmark.m_case.m_frames / sample_rate;
+        result.m_realtime_load = result.m_median_ns / buffer_ns;
+    }
+
+    return result;
+}
+
+/**
+ * \brief Runs the work back to back.
+ * \param work Work to run.
+ * \param iterations Times to run it.
+ * \return Nanoseconds it took altogether.
+ */
+double benchmark_runner::time_iterations(const body& work, const uint64_t iterations)
+{
+    const auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < iterations; ++i)
+    {
+        work();
+    }
+    const auto end = std::chrono::steady_clock::now();
+
+    return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+}
+
+void benchmark_runner::write_json(std::ostream& output) const
+{
+#ifdef NDEBUG
+    const auto* build = "release";
+#else
+    const auto* build = "debug";
+#endif
+
+    output << std::setprecision(6) << std::defaultfloat;
+    output << "{\n  \"context\": {\"architecture\": \"" << architecture() << "\", \"compiler\": \"" <<
+        escape(compiler()) << "\", \"build\": \"" << build << "\", \"sample_rate\": " << sample_rate <<
+        ", \"min_time_ms\": " << m_min_time_.count() << ", \"repetitions\": " << m_repetitions_ << "},\n";
+    output << "  \"results\": [";
+
+    for (size_t i = 0; i < m_results_.size(); ++i)
+    {
+        const auto& result = m_results_[i];
+        output << (i == 0 ? "\n" : ",\n") << "    {\"name\": \"" << escape(result.m_case.m_name) << "\", \"variant\": \""
+            << escape(result.m_case.m_variant) << "\", \"voices\": " << result.m_case.m_voices << ", \"frames\": " <<
+            result.m_case.m_frames << ", \"iterations\": " << result.m_iterations << ", \"median_ns\": " <<
+            result.m_median_ns << ", \"min_ns\": " << result.m_min_ns << ", \"ns_per_frame\": " <<
+            result.m_ns_per_frame << ", \"realtime_load\": " << result.m_realtime_load << "}";
+    }
+
+    output << "\n  ]\n}" << std::endl;
+}
+
+void benchmark_runner::write_csv(std::ostream& output) const
+{
+    output << std::setprecision(6) << std::defaultfloat;
+    output << "architecture,name,variant,voices,frames,iterations,median_ns,min_ns,ns_per_frame,realtime_load\n";
+
+    const auto machine = architecture();
+    for (const auto& result : m_results_)
+    {
+        output << machine << "," << result.m_case.m_name << "," << result.m_case.m_variant << "," <<
+            result.m_case.m_voices << "," << result.m_case.m_frames << "," << result.m_iterations << "," <<
+            result.m_median_ns << "," << result.m_min_ns << "," << result.m_ns_per_frame << "," <<
+            result.m_realtime_load << "\n";
+    }
+
+    output.flush();
+}
+
+/**
+ * \brief Names the architecture this was built for, so ARM and x64 results can be told apart.
+ * \return Name of the architecture.
+ */
+std::string benchmark_runner::architecture()
+{
+#if defined(__aarch64__) || defined(_M_ARM64)
+    return "arm64";
+#elif defined(__arm__) || defined(_M_ARM)
+    return "arm";
+#elif defined(__x86_64__) || defined(_M_X64)
+    return "x64";
+#elif defined(__i386__) || defined(_M_IX86)
+    return "x86";
+#else
+    return "unknown";
+#endif
+}
+
+std::string benchmark_runner::compiler()
+{
+#if defined(__clang__)
+    return "clang " __clang_version__;
+#elif defined(__GNUC__)
+    return "gcc " __VERSION__;
+#elif defined(_MSC_VER)
+    return "msvc " + std::to_string(_MSC_VER);
+#else
+    return "unknown";
+#endif
+}
+
+/**
+ * \brief Escapes the characters that would break a JSON string.
+ * \param text Text to escape.
+ * \return Text that is safe inside quotes.
+ */
+std::string benchmark_runner::escape(const std::string& text)
+{
+    std::string escaped;
+    escaped.reserve(text.size());
+    for (const auto character : text)
+    {
+        if (character == '"' || character == '\\')
+        {
+            escaped += '\\';
+        }
+        escaped += character;
+    }
+
+    return escaped;
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * \brief What one benchmark measures. Cases with the same name are the same code run at different sizes.
+ */
+struct benchmark_case
+{
+    benchmark_case(const std::string& name, const std::string& variant, uint32_t voices, uint32_t frames);
+
+    // Code being measured, such as sound_data::render.
+    std::string m_name;
+
+    // Which path through the code, such as the wave. Empty when there is only one.
+    std::string m_variant;
+
+    // Voices playing while it runs. 0 when voices do not matter.
+    uint32_t m_voices;
+
+    // Frames handled by each iteration. Used to work out the cost per frame and against real time. 0 when each
+    // iteration is a single operation.
+    uint32_t m_frames;
+};
+
+/**
+ * \brief How long a case took.
+ */
+struct benchmark_result
+{
+    explicit benchmark_result(const benchmark_case& measured);
+
+    benchmark_case m_case;
+
+    // Iterations timed in each repetition.
+    uint64_t m_iterations;
+
+    // Median and fastest of the repetitions.
+    double m_median_ns;
+    double m_min_ns;
+
+    // Median time for one frame, and the fraction of the buffer's play time spent making it. 0 without frames.
+    double m_ns_per_frame;
+    double m_realtime_load;
+};
+
+/**
+ * \brief Runs registered benchmarks and writes the results out as JSON or CSV, so runs on different machines and builds
+ * can be compared by a script. Each case is timed for at least the minimum time, several times over, and the median is
+ * reported.
+ */
+class benchmark_runner
+{
+public:
+    // Work to time. Called once per iteration.
+    typedef std::function<void()> body;
+
+    // Sets up the case and hands back the work to time. Setup is not timed.
+    typedef std::function<body()> fixture;
+
+    enum output_format
+    {
+        json,
+        csv
+    };
+
+    benchmark_runner();
+
+    void add(const benchmark_case& measured, const fixture& setup);
+
+    void set_filter(const std::string& filter);
+
+    void set_min_time(std::chrono::milliseconds min_time);
+
+    void set_repetitions(uint32_t repetitions);
+
+    void set_progress(bool progress);
+
+    uint32_t run();
+
+    void write(std::ostream& output, output_format format) const;
+
+    void list(std::ostream& output) const;
+
+    static void keep(float value);
+
+    static std::string case_label(const benchmark_case& measured);
+
+    // Sample rate the real time load is worked out against. Same as sound_utilities::default_sample_rate.
+    const static int sample_rate;
+
+    // Voice counts and buffer sizes every synthesis benchmark is run across.
+    const static std::vector<uint32_t> voice_counts;
+    const static std::vector<uint32_t> buffer_sizes;
+
+private:
+    struct entry
+    {
+        benchmark_case m_case;
+        fixture m_setup;
+    };
+
+    bool selected(const benchmark_case& measured) const;
+
+    benchmark_result measure(const entry& benchmark) const;
+
+    static double time_iterations(const body& work, uint64_t iterations);
+
+    void write_json(std::ostream& output) const;
+
+    void write_csv(std::ostream& output) const;
+
+    static std::string architecture();
+
+    static std::string compiler();
+
+    static std::string escape(const std::string& text);
+
+    std::vector<entry> m_entries_;
+    std::vector<benchmark_result> m_results_;
+
+    // Only cases whose label contains this are run. Runs everything when empty.
+    std::string m_filter_;
+
+    std::chrono::milliseconds m_min_time_;
+    uint32_t m_repetitions_;
+    bool m_progress_;
+
+    // Written by keep so the compiler cannot drop the work being timed.
+    static volatile float sink_;
+};
@@ -0,0 +1,128 @@
+#include "benchmark_runner.h"
+#include "parser_benchmarks.h"
+#include "synthesis_benchmarks.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+/**
+ * \brief Runs the benchmarks and writes the results out for a script to compare against earlier runs.
+ *
+ * --filter TEXT only runs the cases whose label contains TEXT. --list prints the labels instead of running.
+ * --format json|csv picks the output format, JSON by default. --output FILE writes the results to FILE instead of
+ * standard output and prints progress as it goes. --min-time MS and --repetitions N trade run time for steadier numbers.
+ * --midi-capture FILE adds a case that parses the raw MIDI bytes in FILE, such as a capture from amidi -r.
+ */
+int main(const int argc, char* argv[])
+{
+    auto runner = benchmark_runner();
+    synthesis_benchmarks::add(runner);
+    parser_benchmarks::add(runner);
+
+    auto format = benchmark_runner::json;
+    std::string output_path;
+    auto list_only = false;
+
+    for (auto i = 1; i < argc; ++i)
+    {
+        const std::string argument = argv[i];
+        if (argument == "--filter" && i + 1 < argc)
+        {
+            ++i;
+            runner.set_filter(argv[i]);
+        }
+        else if (argument == "--format" && i + 1 < argc)
+        {
+            ++i;
+            const std::string name = argv[i];
+            if (name == "csv")
+            {
+                format = benchmark_runner::csv;
+            }
+            else if (name != "json")
+            {
+                std::cout << "Unknown format " << name << ", writing json." << std::endl;
+            }
+        }
+        else if (argument == "--output" && i + 1 < argc)
+        {
+            ++i;
+            output_path = argv[i];
+        }
+        else if (argument == "--min-time" && i + 1 < argc)
+        {
+            ++i;
+            try
+            {
+                runner.set_min_time(std::chrono::milliseconds(std::max(1, std::stoi(argv[i]))));
+            }
+            catch (const std::exception&)
+            {
+                std::cout << "Could not read min time " << argv[i] << ", keeping the default." << std::endl;
+            }
+        }
+        else if (argument == "--repetitions" && i + 1 < argc)
+        {
+            ++i;
+            try
+            {
+                runner.set_repetitions(static_cast<uint32_t>(std::max(1, std::stoi(argv[i]))));
+            }
+            catch (const std::exception&)
+            {
+                std::cout << "Could not read repetitions " << argv[i] << ", keeping the default." << std::endl;
+            }
+        }
+        else if (argument == "--midi-capture" && i + 1 < argc)
+        {
+            ++i;
+            if (!parser_benchmarks::add_midi_capture(runner, argv[i]))
+            {
+                std::cout << "Could not read MIDI capture " << argv[i] << std::endl;
+                return 1;
+            }
+        }
+        else if (argument == "--list")
+        {
+            list_only = true;
+        }
+        else
+        {
+            std::cout << "Unknown argument " << argument << std::endl;
+            return 1;
+        }
+    }
+
+    if (list_only)
+    {
+        runner.list(std::cout);
+        return 0;
+    }
+
+    // Progress would get mixed into the results if they both went to standard output.
+    runner.set_progress(!output_path.empty());
+    if (runner.run() == 0)
+    {
+        std::cout << "No benchmarks matched." << std::endl;
+        return 1;
+    }
+
+    if (output_path.empty())
+    {
+        runner.write(std::cout, format);
+        return 0;
+    }
+
+    std::ofstream output(output_path);
+    if (!output)
+    {
+        std::cout << "Could not open " << output_path << std::endl;
+        return 1;
+    }
+
+    runner.write(output, format);
+    std::cout << "Wrote results to " << output_path << std::endl;
+    return 0;
+}
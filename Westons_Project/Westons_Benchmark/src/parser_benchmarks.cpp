@@ -0,0 +1,268 @@
+#include "parser_benchmarks.h"
+#include "../../Westons_Solution/src/midi/midi_parser.h"
+#include "../../Westons_Solution/src/sound/generation_parser.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+const uint32_t parser_benchmarks::batch_size;
+
+/**
+ * \brief Registers every parser benchmark.
+ * \param runner Runner to register them with.
+ */
+void parser_benchmarks::add(benchmark_runner& runner)
+{
+    add_midi(runner);
+    add_generation(runner);
+}
+
+/**
+ * \brief Registers parsing a stream of note on and note off messages, with and without running status, and a stream
+ * laid out like a played performance.
+ * \param runner Runner to register them with.
+ */
+void parser_benchmarks::add_midi(benchmark_runner& runner)
+{
+    const auto batch = std::to_string(batch_size) + "_messages";
+    for (const auto running_status : {false, true})
+    {
+        const auto variant = (running_status ? "running_status_" : "full_status_") + batch;
+        runner.add(benchmark_case("midi_parser::parse", variant, 0, 0), [running_status]()
+        {
+            auto bytes = std::make_shared<std::vector<uint8_t>>();
+            for (uint32_t i = 0; i < batch_size; ++i)
+            {
+                // Note ons and offs as velocity 0 note ons, so one status covers the whole run.
+                if (!running_status || i == 0)
+                {
+                    bytes->push_back(0x90);
+                }
+                bytes->push_back(static_cast<uint8_t>(36 + i % 48));
+                bytes->push_back(static_cast<uint8_t>(i % 2 == 0 ? 100 : 0));
+            }
+
+            auto parser = std::make_shared<midi_parser>();
+            auto events = std::make_shared<std::vector<midi_event>>(batch_size);
+            return [bytes, parser, events]()
+            {
+                const auto count = parser->parse(bytes->data(), static_cast<uint32_t>(bytes->size()), events->data(),
+                                                 static_cast<uint32_t>(events->size()));
+                benchmark_runner::keep(static_cast<float>(count));
+            };
+        });
+    }
+
+    const auto performance = make_performance();
+    add_midi_stream(runner, "performance_" + std::to_string(performance.size()) + "_bytes", performance);
+}
+
+/**
+ * \brief Registers parsing a stream of MIDI bytes captured from a device, such as the raw file amidi -r writes.
+ * \param runner Runner to register it with.
+ * \param path File holding the bytes just as they came off the wire.
+ * \return If the file could be read and held any bytes.
+ */
+bool parser_benchmarks::add_midi_capture(benchmark_runner& runner, const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    const auto stream = std::vector<uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    if (!file.is_open() || stream.empty())
+    {
+        return false;
+    }
+
+    const auto name = path.substr(path.find_last_of("/\\") + 1);
+    add_midi_stream(runner, "capture_" + name + "_" + std::to_string(stream.size()) + "_bytes", stream);
+    return true;
+}
+
+/**
+ * \brief Registers parsing a whole stream of bytes each iteration.
+ * \param runner Runner to register it with.
+ * \param variant Name of the stream.
+ * \param stream Bytes to parse.
+ */
+void parser_benchmarks::add_midi_stream(benchmark_runner& runner, const std::string& variant,
+                                        const std::vector<uint8_t>& stream)
+{
+    runner.add(benchmark_case("midi_parser::parse", variant, 0, 0), [stream]()
+    {
+        // Every message is at least one byte, so this always has room.
+        auto bytes = std::make_shared<std::vector<uint8_t>>(stream);
+        auto parser = std::make_shared<midi_parser>();
+        auto events = std::make_shared<std::vector<midi_event>>(stream.size());
+        return [bytes, parser, events]()
+        {
+            const auto count = parser->parse(bytes->data(), static_cast<uint32_t>(bytes->size()), events->data(),
+                                             static_cast<uint32_t>(events->size()));
+            benchmark_runner::keep(static_cast<float>(count));
+        };
+    });
+}
+
+/**
+ * \brief Builds a stream laid out the way a keyboard sends a played passage, for when there is no capture to hand.
+ * Clock and active sensing bytes land anywhere, even inside a message. Running status carries across note ons, note
+ * offs as velocity 0 note ons, and controller bursts, and is broken by program changes, channel changes, time code,
+ * song position, and a SysEx reply, which senders follow with a fresh status.
+ * \return Bytes of the stream.
+ */
+std::vector<uint8_t> parser_benchmarks::make_performance()
+{
+    std::vector<uint8_t> bytes;
+    uint32_t sent = 0;
+
+    // Clock runs at 24 per beat. Drop one in every few bytes to stand in for that, sometimes mid message.
+    const auto put = [&bytes, &sent](const uint8_t byte)
+    {
+        bytes.push_back(byte);
+        ++sent;
+        if (sent % 7 == 0)
+        {
+            bytes.push_back(0xF8);
+        }
+        if (sent % 97 == 0)
+        {
+            bytes.push_back(0xFE);
+        }
+    };
+
+    // Start of the song: identity reply, song position, start, and the programs.
+    for (const uint8_t byte : {0xF0, 0x7E, 0x7F, 0x06, 0x02, 0x41, 0x42, 0x01, 0x00, 0x00, 0x01, 0x00, 0x00, 0xF7})
+    {
+        put(byte);
+    }
+    for (const uint8_t byte : {0xF2, 0x00, 0x00, 0xFA, 0xC0, 0x05, 0xC9, 0x00})
+    {
+        put(byte);
+    }
+
+    for (uint32_t bar = 0; bar < 16; ++bar)
+    {
+        // Time code quarter frames go out all through, and each one breaks running status.
+        put(0xF1);
+        put(static_cast<uint8_t>((bar % 8) << 4 | bar % 16));
+
+        // A chord on channel 1 under running status, held with the sustain pedal.
+        put(0x90);
+        for (const uint8_t key : {48, 52, 55, 60})
+        {
+            put(static_cast<uint8_t>(key + bar % 5));
+            put(static_cast<uint8_t>(70 + bar * 3 % 40));
+        }
+        put(0xB0);
+        put(64);
+        put(127);
+
+        // A mod wheel sweep, one controller message after another under the same status.
+        for (uint8_t value = 0; value < 128; value = static_cast<uint8_t>(value + 8))
+        {
+            put(1);
+            put(value);
+        }
+
+        // Drums on channel 10 between the melody notes.
+        for (uint32_t beat = 0; beat < 4; ++beat)
+        {
+            put(0x99);
+            put(beat % 2 == 0 ? 36 : 38);
+            put(100);
+            put(42);
+            put(80);
+
+            put(0x90);
+            put(static_cast<uint8_t>(72 + beat + bar % 3));
+            put(90);
+            put(0xD0);
+            put(static_cast<uint8_t>(20 + beat * 10));
+
+            put(0x99);
+            put(beat % 2 == 0 ? 36 : 38);
+            put(0);
+            put(42);
+            put(0);
+
+            put(0x90);
+            put(static_cast<uint8_t>(72 + beat + bar % 3));
+            put(0);
+        }
+
+        // Bend up and back on channel 2.
+        put(0xE1);
+        for (uint32_t step = 0; step <= 16; ++step)
+        {
+            const auto bend = 8192 + static_cast<int>(step <= 8 ? step : 16 - step) * 512;
+            put(static_cast<uint8_t>(bend & 0x7F));
+            put(static_cast<uint8_t>(std::min(bend >> 7, 127)));
+        }
+
+        // Let go of the pedal and the chord.
+        put(0xB0);
+        put(64);
+        put(0);
+        put(0x80);
+        for (const uint8_t key : {48, 52, 55, 60})
+        {
+            put(static_cast<uint8_t>(key + bar % 5));
+            put(64);
+        }
+    }
+
+    put(0xFC);
+    return bytes;
+}
+
+/**
+ * \brief Registers parsing frequency generator commands as they come from a script, with and without a start.
+ * \param runner Runner to register them with.
+ */
+void parser_benchmarks::add_generation(benchmark_runner& runner)
+{
+    const auto batch = std::to_string(batch_size) + "_lines";
+    for (const auto scheduled : {false, true})
+    {
+        const auto variant = (scheduled ? "scheduled_" : "immediate_") + batch;
+        runner.add(benchmark_case("generation_parser::parse", variant, 0, 0), [scheduled]()
+        {
+            // Every line back to back, with where each starts and how long it is.
+            auto text = std::make_shared<std::string>();
+            auto lines = std::make_shared<std::vector<std::pair<size_t, size_t>>>();
+            for (uint32_t i = 0; i < batch_size; ++i)
+            {
+                std::string line;
+                if (i % 2 == 0)
+                {
+                    line = "addNote:" + std::to_string(110.0 + i) + ":90:1000:sine";
+                }
+                else
+                {
+                    line = "removeNote:" + std::to_string(110.0 + i - 1);
+                }
+
+                if (scheduled)
+                {
+                    line += "@" + std::to_string(i * 10) + "ms";
+                }
+
+                lines->emplace_back(text->size(), line.size());
+                *text += line;
+            }
+
+            return [text, lines]()
+            {
+                generation_command command;
+                auto parsed = 0;
+                for (const auto& line : *lines)
+                {
+                    parsed += generation_parser::parse(text->data() + line.first, line.second, command) ? 1 : 0;
+                }
+                benchmark_runner::keep(static_cast<float>(parsed));
+            };
+        });
+    }
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "benchmark_runner.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * \brief Benchmarks for reading input, the MIDI byte parser and the frequency generator command parser. Each iteration
+ * reads a batch of messages, so divide by the batch size in the variant for the cost of one.
+ */
+class parser_benchmarks
+{
+public:
+    static void add(benchmark_runner& runner);
+
+    static bool add_midi_capture(benchmark_runner& runner, const std::string& path);
+
+private:
+    static void add_midi(benchmark_runner& runner);
+
+    static void add_midi_stream(benchmark_runner& runner, const std::string& variant,
+                                const std::vector<uint8_t>& stream);
+
+    static std::vector<uint8_t> make_performance();
+
+    static void add_generation(benchmark_runner& runner);
+
+    // Messages read by each iteration.
+    const static uint32_t batch_size = 256;
+};
@@ -0,0 +1,419 @@
+#include "synthesis_benchmarks.h"
+#include "../../Westons_Solution/generation_driver.h"
+#include "../../Westons_Solution/sound_data.h"
+#include "../../Westons_Solution/src/Audio Driver/audio_driver.h"
+#include "../../Westons_Solution/src/midi/midi_synth.h"
+#include "../../Westons_Solution/src/sound/envelope_data.h"
+
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+const uint32_t synthesis_benchmarks::num_channels;
+const uint32_t synthesis_benchmarks::control_period = 32;
+
+/**
+ * \brief Buffers for each channel of an output, laid out as one array per channel.
+ */
+struct channel_buffers
+{
+    channel_buffers(const uint32_t num_channels, const uint32_t frames) :
+        m_samples(num_channels * frames, 0.0f),
+        m_interleaved(num_channels * frames, 0.0f),
+        m_channels(num_channels, nullptr)
+    {
+        for (uint32_t channel = 0; channel < num_channels; ++channel)
+        {
+            m_channels[channel] = m_samples.data() + channel * frames;
+        }
+    }
+
+    std::vector<float> m_samples;
+    std::vector<float> m_interleaved;
+    std::vector<float*> m_channels;
+};
+
+/**
+ * \brief Registers every synthesis benchmark.
+ * \param runner Runner to register them with.
+ */
+void synthesis_benchmarks::add(benchmark_runner& runner)
+{
+    add_kernels(runner);
+    add_voice_management(runner);
+    add_renders(runner);
+    add_envelopes(runner);
+    add_callbacks(runner);
+}
+
+/**
+ * \brief Registers the per sample phase kernels. Each iteration handles a buffer worth of samples, as render_note does.
+ * \param runner Runner to register them with.
+ */
+void synthesis_benchmarks::add_kernels(benchmark_runner& runner)
+{
+    for (const auto frames : benchmark_runner::buffer_sizes)
+    {
+        runner.add(benchmark_case("sound_utilities::two_pi_wrapper", "", 0, frames), [frames]()
+        {
+            const auto phase_step = sound_utilities::two_pi * 440.0f / static_cast<float>(benchmark_runner::sample_rate);
+            auto phase = std::make_shared<float>(0.0f);
+            return [frames, phase_step, phase]()
+            {
+                auto current = *phase;
+                for (uint32_t i = 0; i < frames; ++i)
+                {
+                    current = sound_utilities::two_pi_wrapper(current + phase_step);
+                }
+                *phase = current;
+                benchmark_runner::keep(current);
+            };
+        });
+
+        runner.add(benchmark_case("sound_utilities::phase_to_index", "", 0, frames), [frames]()
+        {
+            // Phases spread over the whole table so every index path is taken.
+            auto phases = std::make_shared<std::vector<float>>(frames);
+            for (uint32_t i = 0; i < frames; ++i)
+            {
+                (*phases)[i] = sound_utilities::two_pi * static_cast<float>(i) / static_cast<float>(frames);
+            }
+
+            return [phases]()
+            {
+                auto sum = 0;
+                for (const auto phase : *phases)
+                {
+                    sum += sound_utilities::phase_to_index(phase, sound_utilities::table_size);
+                }
+                benchmark_runner::keep(static_cast<float>(sum));
+            };
+        });
+    }
+}
+
+/**
+ * \brief Registers adding and releasing notes. Adding a note works out the note volume again, so that cost shows up
+ * here, growing with the number of voices already playing.
+ * \param runner Runner to register them with.
+ */
+void synthesis_benchmarks::add_voice_management(benchmark_runner& runner)
+{
+    for (const auto voices : benchmark_runner::voice_counts)
+    {
+        runner.add(benchmark_case("sound_data::add_note", "", voices, 0), [voices]()
+        {
+            // Start one short so the sound holds the given number of voices while the note is added.
+            auto sound = make_sound(voices - 1, sound_utilities::sine, false);
+            const auto note = note_data(880.0f, 0.0f, -1.0f, 0.5f, sound_utilities::sine);
+            return [sound, note]()
+            {
+                sound->add_note(note);
+                benchmark_runner::keep(sound->m_note_volume);
+                sound->m_notes.pop_back();
+            };
+        });
+
+        runner.add(benchmark_case("sound_data::remove_notes", "", voices, 0), [voices]()
+        {
+            auto sound = make_sound(voices, sound_utilities::sine, false);
+            const auto frequency = sound->m_notes.back().m_frequency;
+            return [sound, frequency]()
+            {
+                sound->remove_notes(frequency);
+                benchmark_runner::keep(sound->m_notes.back().m_frequency);
+            };
+        });
+    }
+}
+
+/**
+ * \brief Registers rendering through sound_data, once for each wave table and once with the voice filters on.
+ * \param runner Runner to register them with.
+ */
+void synthesis_benchmarks::add_renders(benchmark_runner& runner)
+{
+    struct render_path
+    {
+        const char* m_name;
+        sound_utilities::wave_type m_wave;
+        bool m_filtered;
+    };
+
+    const render_path paths[] = {
+        {"sine", sound_utilities::sine, false},
+        {"square", sound_utilities::square, false},
+        {"triangle", sound_utilities::triangle, false},
+        {"sawtooth", sound_utilities::sawtooth, false},
+        {"sine_filtered", sound_utilities::sine, true}
+    };
+
+    for (const auto& path : paths)
+    {
+        for (const auto voices : benchmark_runner::voice_counts)
+        {
+            for (const auto frames : benchmark_runner::buffer_sizes)
+            {
+                runner.add(benchmark_case("sound_data::render", path.m_name, voices, frames), [path, voices, frames]()
+                {
+                    auto sound = make_sound(voices, path.m_wave, path.m_filtered);
+                    auto buffers = std::make_shared<channel_buffers>(num_channels, frames);
+                    return [sound, buffers, frames]()
+                    {
+                        render_buffer(*sound, buffers->m_channels.data(), num_channels, frames);
+                        benchmark_runner::keep(buffers->m_samples[0]);
+                    };
+                });
+            }
+        }
+    }
+}
+
+/**
+ * \brief Registers the control rate envelopes against the oscillators they scale. Both step the same voices over the
+ * same buffer, the envelopes once a control period and the oscillators once a sample, so the two show how much of a
+ * render each one is.
+ * \param runner Runner to register them with.
+ */
+void synthesis_benchmarks::add_envelopes(benchmark_runner& runner)
+{
+    for (const auto voices : benchmark_runner::voice_counts)
+    {
+        for (const auto frames : benchmark_runner::buffer_sizes)
+        {
+            runner.add(benchmark_case("envelope_vs_oscillator", "envelope", voices, frames), [voices, frames]()
+            {
+                // Short stages, so the envelopes keep going round every segment instead of resting on the sustain.
+                const auto settings = envelope_data(5.0f, 20.0f, 0.6f, 30.0f);
+                auto envelopes = std::make_shared<std::vector<envelope_generator>>(voices, envelope_generator(settings));
+                return [envelopes, settings, frames]()
+                {
+                    auto level = 0.0f;
+                    for (auto& envelope : *envelopes)
+                    {
+                        for (uint32_t frame = 0; frame < frames; frame += control_period)
+                        {
+                            level += envelope.advance(std::min(control_period, frames - frame),
+                                                      benchmark_runner::sample_rate);
+                        }
+
+                        if (envelope.is_finished())
+                        {
+                            envelope = envelope_generator(settings);
+                        }
+                        else if (envelope.get_stage() == envelope_generator::sustain)
+                        {
+                            envelope.note_off();
+                        }
+                    }
+                    benchmark_runner::keep(level);
+                };
+            });
+
+            runner.add(benchmark_case("envelope_vs_oscillator", "oscillator", voices, frames), [voices, frames]()
+            {
+                auto phases = std::make_shared<std::vector<float>>(voices, 0.0f);
+                auto output = std::make_shared<std::vector<float>>(frames, 0.0f);
+                return [phases, output, frames]()
+                {
+                    // The table lookup and phase step render_note does for every sample of every voice.
+                    const auto& table = sound_utilities::wave_lookup_tables.sine;
+                    auto* samples = output->data();
+                    for (uint32_t voice = 0; voice < phases->size(); ++voice)
+                    {
+                        const auto phase_step = sound_utilities::two_pi * (110.0f + 3.7f * static_cast<float>(voice)) /
+                            static_cast<float>(benchmark_runner::sample_rate);
+                        auto phase = (*phases)[voice];
+                        for (uint32_t i = 0; i < frames; ++i)
+                        {
+                            samples[i] += table[sound_utilities::phase_to_index(phase, sound_utilities::table_size)];
+                            phase = sound_utilities::two_pi_wrapper(phase + phase_step);
+                        }
+                        (*phases)[voice] = phase;
+                    }
+                    benchmark_runner::keep(samples[0]);
+                };
+            });
+        }
+    }
+}
+
+/**
+ * \brief Registers whole buffers played through the driver callbacks. The generation callback is the real one, handed
+ * buffers on a simulated clock as a device would, and the midi callback's work is mixing every part through the synth.
+ * \param runner Runner to register them with.
+ */
+void synthesis_benchmarks::add_callbacks(benchmark_runner& runner)
+{
+    struct buffer_layout
+    {
+        const char* m_name;
+        bool m_non_interleaved;
+    };
+
+    const buffer_layout layouts[] = {
+        {"non_interleaved", true},
+        {"interleaved", false}
+    };
+
+    for (const auto voices : benchmark_runner::voice_counts)
+    {
+        for (const auto frames : benchmark_runner::buffer_sizes)
+        {
+            for (const auto& layout : layouts)
+            {
+                runner.add(benchmark_case("generation_driver::callback", layout.m_name, voices, frames),
+                           [layout, voices, frames]()
+                {
+                    auto driver = make_generation_driver(voices, layout.m_non_interleaved);
+                    auto buffers = std::make_shared<channel_buffers>(num_channels, frames);
+                    auto* output = layout.m_non_interleaved
+                                       ? static_cast<void*>(buffers->m_channels.data())
+                                       : static_cast<void*>(buffers->m_interleaved.data());
+
+                    // Each buffer is due to play one buffer after it is asked for, the way a device with two buffers
+                    // of latency asks for them.
+                    const auto buffer_seconds = static_cast<double>(frames) / benchmark_runner::sample_rate;
+                    auto time_info = std::make_shared<PaStreamCallbackTimeInfo>();
+                    time_info->inputBufferAdcTime = 0.0;
+                    time_info->currentTime = 0.0;
+                    time_info->outputBufferDacTime = buffer_seconds;
+
+                    // The first buffer adds the notes, so it is played before timing starts.
+                    generation_driver::callback(nullptr, output, frames, time_info.get(), 0, driver.get());
+                    return [driver, buffers, output, time_info, buffer_seconds, frames]()
+                    {
+                        time_info->currentTime += buffer_seconds;
+                        time_info->outputBufferDacTime += buffer_seconds;
+                        generation_driver::callback(nullptr, output, frames, time_info.get(), 0, driver.get());
+                        benchmark_runner::keep(buffers->m_samples[0] + buffers->m_interleaved[0]);
+                    };
+                });
+            }
+
+            for (const auto parallel : {false, true})
+            {
+                const auto* variant = parallel ? "parallel" : "serial";
+                runner.add(benchmark_case("midi_synth::render", variant, voices, frames), [voices, frames, parallel]()
+                {
+                    auto synth = std::make_shared<midi_synth>(parallel ? midi_engine::default_worker_count() : 0);
+
+                    // Spread the voices over every channel, so each part has its own share to render.
+                    for (uint32_t i = 0; i < voices; ++i)
+                    {
+                        midi_event event;
+                        event.m_type = midi_note_on;
+                        event.m_channel = static_cast<uint8_t>(i % midi_engine::num_parts);
+                        event.m_number = static_cast<uint8_t>(36 + i / midi_engine::num_parts);
+                        event.m_value = 100;
+                        synth->process_event(event);
+                    }
+
+                    auto buffers = std::make_shared<channel_buffers>(num_channels, frames);
+                    return [synth, buffers, frames]()
+                    {
+                        float* block_channels[sound_data::max_channels];
+                        for (uint32_t frame = 0; frame < frames; frame += sound_data::max_block_size)
+                        {
+                            const auto block_size = std::min(frames - frame, sound_data::max_block_size);
+                            for (uint32_t channel = 0; channel < num_channels; ++channel)
+                            {
+                                block_channels[channel] = buffers->m_channels[channel] + frame;
+                            }
+
+                            synth->render(block_channels, num_channels, block_size, benchmark_runner::sample_rate);
+                        }
+                        benchmark_runner::keep(buffers->m_samples[0]);
+                    };
+                });
+            }
+        }
+    }
+}
+
+/**
+ * \brief Makes a sound playing the given number of voices, spread over the frequencies and across the channels. The
+ * voices never end, so the sound stays the same size however long it is rendered for.
+ * \param voices Number of voices to play.
+ * \param wave Wave every voice plays.
+ * \param filtered If every voice goes through its low pass filter.
+ * \return The sound.
+ */
+std::shared_ptr<sound_data> synthesis_benchmarks::make_sound(const uint32_t voices,
+                                                             const sound_utilities::wave_type wave,
+                                                             const bool filtered)
+{
+    auto sound = std::make_shared<sound_data>();
+    sound->set_control_period(control_period);
+    sound->set_master_volume(0.25f);
+
+    const auto filter = filtered ? filter_data(2000.0f, 0.707f) : filter_data();
+    for (uint32_t i = 0; i < voices; ++i)
+    {
+        const auto pan = voices > 1 ? -1.0f + 2.0f * static_cast<float>(i) / static_cast<float>(voices - 1) : 0.0f;
+        sound->add_note(note_data(110.0f + 3.7f * static_cast<float>(i), 0.0f, -1.0f, 0.5f, wave, envelope_data(), filter,
+                                  pan));
+    }
+
+    return sound;
+}
+
+/**
+ * \brief Makes a generation driver on the stand in device, playing the given number of endless sine voices once its
+ * callback has run.
+ * \param voices Number of voices to play.
+ * \param non_interleaved If the callback is handed one array per channel instead of interleaved frames.
+ * \return The driver.
+ */
+std::shared_ptr<generation_driver> synthesis_benchmarks::make_generation_driver(const uint32_t voices,
+                                                                                const bool non_interleaved)
+{
+    audio_driver::set_null_device(true);
+
+    auto driver = std::make_shared<generation_driver>();
+    driver->set_control_period(control_period);
+
+    auto data = sound_utilities::callback_data();
+    const auto initialized = driver->init(data);
+    assert(initialized && data.num_output_channels == static_cast<int>(num_channels));
+    static_cast<void>(initialized);
+    driver->set_buffer_layout(non_interleaved);
+
+    auto command = generation_command();
+    command.m_type = generation_command::add_note;
+    command.m_start_unit = generation_command::immediate;
+    command.m_start = 0.0;
+    command.m_phase = 0.0f;
+    command.m_duration = -1.0f;
+    command.m_wave = sound_utilities::sine;
+    for (uint32_t i = 0; i < voices; ++i)
+    {
+        command.m_frequency = 110.0f + 3.7f * static_cast<float>(i);
+        driver->send(command);
+    }
+
+    return driver;
+}
+
+/**
+ * \brief Renders a whole buffer, a block at a time since that is the most sound_data renders at once.
+ * \param sound Sound to render.
+ * \param channels One buffer per channel, each at least frames long.
+ * \param num_channels Number of channels.
+ * \param frames Number of frames to render.
+ */
+void synthesis_benchmarks::render_buffer(sound_data& sound, float* const* channels, const uint32_t num_channels,
+                                         const uint32_t frames)
+{
+    float* block_channels[sound_data::max_channels];
+    for (uint32_t frame = 0; frame < frames; frame += sound_data::max_block_size)
+    {
+        const auto block_size = std::min(frames - frame, sound_data::max_block_size);
+        for (uint32_t channel = 0; channel < num_channels; ++channel)
+        {
+            block_channels[channel] = channels[channel] + frame;
+        }
+
+        sound.render(block_channels, num_channels, block_size, benchmark_runner::sample_rate);
+    }
+}
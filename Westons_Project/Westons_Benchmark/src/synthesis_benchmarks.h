@@ -0,0 +1,43 @@
+#pragma once
+
+#include "benchmark_runner.h"
+#include "../../Westons_Solution/src/sound/sound_utilities.h"
+
+#include <memory>
+
+class generation_driver;
+class sound_data;
+
+/**
+ * \brief Benchmarks for everything between a note being added and a buffer being handed to the device. The phase and
+ * wave table kernels, voice management, and whole callback renders, each across the voice counts and buffer sizes in
+ * benchmark_runner.
+ */
+class synthesis_benchmarks
+{
+public:
+    static void add(benchmark_runner& runner);
+
+private:
+    static void add_kernels(benchmark_runner& runner);
+
+    static void add_voice_management(benchmark_runner& runner);
+
+    static void add_renders(benchmark_runner& runner);
+
+    static void add_envelopes(benchmark_runner& runner);
+
+    static void add_callbacks(benchmark_runner& runner);
+
+    static std::shared_ptr<sound_data> make_sound(uint32_t voices, sound_utilities::wave_type wave, bool filtered);
+
+    static std::shared_ptr<generation_driver> make_generation_driver(uint32_t voices, bool non_interleaved);
+
+    static void render_buffer(sound_data& sound, float* const* channels, uint32_t num_channels, uint32_t frames);
+
+    // Channels rendered by every benchmark, as the generation driver does on a stereo device.
+    const static uint32_t num_channels = 2;
+
+    // Samples between control ticks. Same as the generation driver.
+    const static uint32_t control_period;
+};
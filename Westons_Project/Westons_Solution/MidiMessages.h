@@ -1 +1,43 @@
 #pragma once
+
+#include <cstdint>
+
+/**
+ * \brief Kinds of MIDI 1.0 channel voice messages. The values match the status byte nibble.
+ */
+enum midi_event_type : uint8_t
+{
+    midi_none = 0x0,
+    midi_note_off = 0x8,
+    midi_note_on = 0x9,
+    midi_poly_aftertouch = 0xA,
+    midi_control_change = 0xB,
+    midi_program_change = 0xC,
+    midi_channel_aftertouch = 0xD,
+    midi_pitch_bend = 0xE
+};
+
+/**
+ * \brief One decoded channel voice message. Small enough to be copied around by value.
+ */
+struct midi_event
+{
+    midi_event_type m_type = midi_none;
+
+    // Channel the message was sent on. 0 <-> 15
+    uint8_t m_channel = 0;
+
+    // Key for note and poly aftertouch messages, controller for control changes, program for program changes.
+    uint8_t m_number = 0;
+
+    // Velocity, pressure, or controller value. 0 <-> 127. Pitch bend fills m_bend instead.
+    uint8_t m_value = 0;
+
+    // Pitch bend away from center. -8192 <-> 8191
+    int16_t m_bend = 0;
+};
+
+// Controller numbers with a fixed meaning in the MIDI spec.
+static const uint8_t midi_channel_volume_controller = 7;
+static const uint8_t midi_all_sound_off_controller = 120;
+static const uint8_t midi_all_notes_off_controller = 123;
@@ -0,0 +1,36 @@
+#include "driver_registry.h"
+
+#include <algorithm>
+#include <cassert>
+
+/**
+ * \brief Adds a driver. Drivers are listed in the order they are added.
+ * \param name Name used to pick the driver. Has to be unique.
+ * \param title Name shown to the user.
+ * \param create Makes the driver.
+ */
+void driver_registry::add(const std::string& name, const std::string& title, const factory& create)
+{
+    assert(!find(name));
+    m_entries_.push_back(entry{name, title, create});
+}
+
+/**
+ * \brief Finds a driver by name.
+ * \param name Name of the driver.
+ * \return The driver, or null if there is none with that name.
+ */
+const driver_registry::entry* driver_registry::find(const std::string& name) const
+{
+    const auto found = std::find_if(m_entries_.begin(), m_entries_.end(), [&](const entry& registered)
+    {
+        return registered.m_name == name;
+    });
+
+    return found == m_entries_.end() ? nullptr : &*found;
+}
+
+const std::vector<driver_registry::entry>& driver_registry::get_entries() const
+{
+    return m_entries_;
+}
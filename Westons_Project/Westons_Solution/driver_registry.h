@@ -0,0 +1,42 @@
+#pragma once
+
+#include "sound_driver.h"
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * \brief Every driver the program can run, by name. Drivers are only made when they are picked, so nothing is probed
+ * for the ones that are not used.
+ */
+class driver_registry
+{
+public:
+    // Makes a driver, ready to be initialized.
+    typedef std::function<std::unique_ptr<sound_driver>()> factory;
+
+    /**
+     * \brief A driver that can be picked.
+     */
+    struct entry
+    {
+        // Name used to pick the driver from the command line or config file.
+        std::string m_name;
+
+        // Name shown to the user.
+        std::string m_title;
+
+        factory m_create;
+    };
+
+    void add(const std::string& name, const std::string& title, const factory& create);
+
+    const entry* find(const std::string& name) const;
+
+    const std::vector<entry>& get_entries() const;
+
+private:
+    std::vector<entry> m_entries_;
+};
@@ -1,23 +1,92 @@
 #include "generation_driver.h"
 #include "sound_data.h"
 #include "src/Audio Driver/audio_driver.h"
+#include "src/sound/generation_parser.h"
+#include "src/utilities/startup_timer.h"
+#include "src/utilities/trace_profiler.h"
 
-#include <sstream>
-#include <regex>
+#include <algorithm>
+#include <cmath>
+#include <fstream>
 #include <memory>
+#include <thread>
 #include <cassert>
 #include <iostream>
 #include <chrono>
 
+#include <poll.h>
+#include <unistd.h>
 
-// Our data pointer.
-sound_utilities::callback_data generation_driver::data_ = sound_utilities::callback_data();
+// Samples between updates of the envelopes, gains, and note durations.
+static const uint32_t generation_control_period = 32;
 
-// values used in the callback.
-static float volume = 0.0f;
-static sound_data generation_sound = sound_data();
-static bool generation_initializied = false;
-static bool generation_callback_active = false;
+// How often a keyboard wait looks to see if a control client has said to exit.
+static const int keyboard_poll_milliseconds = 100;
+
+// How long the callback can go without running before the commands still waiting to play are given up on.
+static const int stalled_callback_milliseconds = 1000;
+
+// Number of output channels to render when the device has them.
+static const int32_t requested_output_channels = 2;
+
+/**
+ * \brief Adds a value to a binary reply as it sits in memory.
+ * \tparam T Type of the value.
+ * \param reply Reply to add to.
+ * \param value Value to add.
+ */
+template <typename T>
+static void append_binary(std::string& reply, const T value)
+{
+    reply.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+const uint32_t generation_driver::max_scheduled_commands = 131072;
+
+generation_driver::generation_driver() :
+    m_data_(sound_utilities::callback_data()),
+    m_initialized_(false),
+    m_control_period_(0),
+    m_schedule_(max_scheduled_commands),
+    m_sample_position_(0),
+    m_schedule_sequence_(0),
+    m_pending_commands_(0),
+    m_control_sequence_(0),
+    m_control_quit_(false),
+    m_script_read_(false),
+    m_waiting_senders_(0),
+    m_telemetry_(nullptr)
+{
+}
+
+/**
+* \brief Reads the commands from a script instead of the keyboard. Once the script is done the keyboard takes over.
+* \param path Script with commands separated by whitespace or new lines. "-" reads a pipe on stdin until it closes.
+* Empty reads from the keyboard.
+*/
+void generation_driver::set_script(const std::string& path)
+{
+    m_script_path_ = path;
+}
+
+/**
+* \brief Listens for commands on a Unix domain socket while the driver runs, alongside the keyboard or script.
+* \param path Path of the socket. Empty for none.
+*/
+void generation_driver::set_control_socket(const std::string& path)
+{
+    m_control_path_ = path;
+}
+
+/**
+* \brief Sets how many samples are rendered between updates of the envelopes, gains, and note durations. Has to be set
+* before init.
+* \param period Samples between control ticks. 0 keeps the default.
+*/
+void generation_driver::set_control_period(const uint32_t period)
+{
+    m_control_period_ = period;
+}
 
 /**
 * \brief Checks if the driver can be run at this time, and fills out the callback data.
@@ -31,21 +100,28 @@ bool generation_driver::init(sound_utilities::callback_data& data)
         return false;
     }
 
+    // Render in stereo if the device can take it.
+    const auto output_channels = std::min(requested_output_channels, audio_driver::max_output_channels());
+
     // Setup the values to what we allow them to be.
     data.num_input_channels = 0;
-    data.num_output_channels = 1;
+    data.num_output_channels = output_channels;
+    data.non_interleaved = true;
     data.sample_rate = sound_utilities::default_sample_rate;
 
     // Get our data pointer ready.
-    data_ = data;
+    m_data_ = data;
 
-    // Notes are so loud by themselves at max volume. Drop that down!
-    volume = 0.25f;
+    prepare(m_sound_);
+    if (m_control_period_ > 0)
+    {
+        m_sound_.set_control_period(m_control_period_);
+    }
 
     // Say that we have been initialized.
-    generation_initializied = true;
+    m_initialized_ = true;
 
-    return generation_initializied;
+    return m_initialized_;
 }
 
 /**
@@ -55,7 +131,7 @@ bool generation_driver::init(sound_utilities::callback_data& data)
 * \param frames_per_buffer Number of frames in each buffer.
 * \param time_info The time that the input values were captured, and the time the output values will be played.
 * \param status_flags Status bits that detail the current state of the streams.
-* \param user_data Pointer to some data that the callback expects.
+* \param user_data The driver that is playing.
 * \return If the passthrough worked correctly. 0 for success, !0 for failure.
 */
 int generation_driver::callback(const void* input_buffer, void* output_buffer,
@@ -65,90 +141,106 @@ int generation_driver::callback(const void* input_buffer, void* output_buffer,
                                 void* user_data)
 {
     // stop warnings by casting to void.
-    static_cast<void>(status_flags);
-    static_cast<void>(time_info);
     static_cast<void>(input_buffer);
 
-    // Get the data that we care about.
-    const auto data = static_cast<sound_utilities::callback_data*>(user_data);
+    TRACE_THREAD("audio callback");
+    TRACE_SCOPE("generation callback");
+
+    // Get the driver, and the data that we care about.
+    auto* driver = static_cast<generation_driver*>(user_data);
+    const auto data = &driver->m_data_;
 
     // Check for valid values.
     assert(data->num_input_channels == 0);
     assert(data->num_output_channels >= 1);
-    assert(generation_initializied);
+    assert(data->num_output_channels <= static_cast<int>(sound_data::max_channels));
+    assert(driver->m_initialized_);
 
-    // Do some checks for time.
-    const auto alloted_time = time_info->outputBufferDacTime - time_info->currentTime;
-    const auto start_time = std::chrono::system_clock::now();
+    // Time we have before the buffer plays. A late wakeup can leave none, which counts as a missed deadline.
+    const auto alloted_time = sound_utilities::time_to_output(time_info, frames_per_buffer, data->sample_rate);
+    const auto busy_start = std::chrono::steady_clock::now();
+    if (driver->m_telemetry_)
+    {
+        driver->m_telemetry_->begin_pass();
+    }
 
-    auto* out = static_cast<float*>(output_buffer);
+    startup_timer::mark_callback();
+    ++driver->m_stats_.callbacks;
 
-    generation_callback_active = true;
-    uint64_t tracker = 0;
-    for (unsigned int i = 0; i < frames_per_buffer; i++)
+    // Pick up anything the processor has scheduled since the last buffer.
     {
-        // Make sure nothing is wrong with volume_.
-        assert(volume >= 0.0f && volume <= 1.0f);
+        TRACE_SCOPE("take scheduled");
+        driver->take_scheduled();
+    }
 
-        auto play_val = 0.0f;
+    const auto buffer_start = driver->m_sample_position_;
+    const auto buffer_end = buffer_start + frames_per_buffer;
+    driver->m_sample_position_ = buffer_end;
 
-        // Go through all of the notes in the sound and advance their current phase.
-        for (auto& note : generation_sound.m_notes)
-        {
-            const auto note_volume = generation_sound.m_note_volume;
+    // Nothing to play and nothing due, so skip rendering and hand back silence.
+    if (driver->m_sound_.is_silent() && (driver->m_schedule_.empty() || driver->m_schedule_.top().m_sample >=
+        buffer_end))
+    {
+        ++driver->m_stats_.idle_callbacks;
+        driver->publish_voices();
+        sound_utilities::write_silence(output_buffer, data->num_output_channels, frames_per_buffer,
+                                       data->non_interleaved);
+        driver->finish_pass(busy_start, alloted_time, frames_per_buffer, status_flags, 0);
+        return 0;
+    }
 
-            switch (note.m_wave)
+    const auto num_channels = static_cast<uint32_t>(data->num_output_channels);
+    uint64_t tracker = 0;
+    uint32_t applied = 0;
+    unsigned long frame = 0;
+    while (frame < frames_per_buffer)
+    {
+        // Play every command that is due by now. Ones that were late play on the first sample of the buffer.
+        auto& schedule = driver->m_schedule_;
+        if (!schedule.empty() && schedule.top().m_sample <= buffer_start + frame)
+        {
+            TRACE_SCOPE("apply commands");
+            while (!schedule.empty() && schedule.top().m_sample <= buffer_start + frame)
             {
-            case sound_utilities::sine:
-                play_val += sound_utilities::wave_lookup_tables.sine[sound_utilities::phase_to_index(
-                    note.m_current_phase, sound_utilities::table_size)] * note_volume;
-                break;
-            case sound_utilities::square:
-                play_val += sound_utilities::wave_lookup_tables.square[sound_utilities::phase_to_index(
-                    note.m_current_phase, sound_utilities::table_size)] * note_volume;
-                break;
-            case sound_utilities::triangle:
-                play_val += sound_utilities::wave_lookup_tables.triangle[sound_utilities::phase_to_index(
-                    note.m_current_phase, sound_utilities::table_size)] * note_volume;
-                break;
-            case sound_utilities::sawtooth:
-                play_val += sound_utilities::wave_lookup_tables.sawtooth[sound_utilities::phase_to_index(
-                    note.m_current_phase, sound_utilities::table_size)] * note_volume;
-                break;
-            default:
-                assert(false); // We should never hit default.
-                break;
+                driver->apply(schedule.top().m_command);
+                schedule.pop();
+                driver->m_pending_commands_.fetch_sub(1, std::memory_order_relaxed);
+                ++applied;
             }
-
-            // Advance the phase.
-            note.m_current_phase = sound_utilities::two_pi_wrapper(
-                note.m_current_phase + sound_utilities::two_pi * note.m_frequency / static_cast<float>(data->sample_rate
-                ));
         }
 
-        // Process all the notes every sample.
-        generation_sound.process(data->sample_rate, 1);
-
-        // Apply the master volume_.
-        play_val = sound_utilities::clipped_output(play_val * volume * sound_utilities::non_clip_volume);
+        // Render the notes a block at a time, stopping at the next command so it starts on its sample. Envelopes,
+        // panning, and phase are all advanced for us.
+        auto block_size = static_cast<uint32_t>(std::min<unsigned long>(frames_per_buffer - frame,
+                                                                        sound_data::max_block_size));
+        if (!schedule.empty())
+        {
+            block_size = static_cast<uint32_t>(std::min<uint64_t>(block_size,
+                                                                  schedule.top().m_sample - (buffer_start + frame)));
+        }
 
-        // Playback to the output.
-        for (auto j = 0; j < data->num_output_channels; ++j)
+        if (!driver->m_sound_.is_silent())
         {
-            ++tracker;
-            out[data->num_output_channels * i + j] = play_val;
+            startup_timer::mark_audible();
         }
+
+        const auto* const* block_channels = driver->m_sound_.render(num_channels, block_size, data->sample_rate);
+        sound_utilities::write_output(block_channels, output_buffer, num_channels, block_size, frame,
+                                      data->non_interleaved);
+
+        tracker += block_size * num_channels;
+        frame += block_size;
+    }
+
+    {
+        TRACE_SCOPE("publish voices");
+        driver->publish_voices();
     }
 
     // Just a saftey to moke sure that we actually did fill up the channels.
     assert(tracker == frames_per_buffer * data->num_output_channels);
 
-    // See that we fulfiled the time requirements.
-    std::chrono::duration<double> elapsed_time = std::chrono::system_clock::now() - start_time;
-    const auto elapsed_seconds = elapsed_time.count();
-    assert(elapsed_seconds < alloted_time);
-
-    generation_callback_active = false;
+    driver->finish_pass(busy_start, alloted_time, frames_per_buffer, status_flags, applied);
 
     return 0;
 }
@@ -156,280 +248,667 @@ int generation_driver::callback(const void* input_buffer, void* output_buffer,
 void generation_driver::processor()
 {
     // If we were never initialized, quit.
-    if (!generation_initializied)
+    if (!m_initialized_)
     {
         std::cout << "Generation Driver was not initialized. Quitting driver." << std::endl;
         return;
     }
 
-    std::cout << std::endl << "Started Frequency Generator mode." << std::endl;
-
-    // string that will find {0 or 1 -}{1+ digits}{0 or 1 period}{0+ digits}
-    const std::string float_regex_string = R"(-?\d+\.?\d*)";
+    TRACE_THREAD("generation processor");
 
-    // Various regex values.
-    const std::string start_of_string_regex_string = "^";
-    const std::string end_of_string_regex_string = "$";
-    const std::string or_match_regex_string = "|";
-
-    const std::string set_volume_string = "setVolume:";
-
-    // regex that tests for setting the volume_.
-    const std::regex set_volume_regex(start_of_string_regex_string + set_volume_string // string identifier
-        + float_regex_string + end_of_string_regex_string); // volume_
-
-    // Tell them how to adjust the volume_.
-    std::cout << "To adjust volume_, enter: '" << set_volume_string << "{0.0 <-> 100.0}'" << std::endl;
-    std::cout << "Example. setVolume:10.0" << std::endl;
-
-    // strings needed for adding a note.
-    const std::string add_note_string = "addNote:";
-    const auto string_seperator = ':';
-
-    const std::string remove_note_string = "removeNote:";
-
-    // Strings for the wave types.
-    const std::string sine_string = "sine";
-    const std::string square_string = "square";
-    const std::string sawtooth_string = "sawtooth";
-    const std::string triangle_string = "triangle";
+    std::cout << std::endl << "Started Frequency Generator mode." << std::endl;
 
-    // regex string for finding the allowed wave types.
-    const auto valid_wave_regex_string = sine_string + or_match_regex_string // sine
-        + square_string + or_match_regex_string // square
-        + sawtooth_string + or_match_regex_string // sawtooth
-        + triangle_string; // triangle
+    m_stats_.reset();
 
-    const std::regex add_note_regex(start_of_string_regex_string + add_note_string // string identifier
-        + float_regex_string + string_seperator // frequency
-        + float_regex_string + string_seperator // phase
-        + float_regex_string + string_seperator // duration
-        + valid_wave_regex_string + end_of_string_regex_string); // wave
+    // Commands come from the script when there is one, otherwise from whoever is at the keyboard.
+    std::ifstream script;
+    auto* input = &std::cin;
+    auto interactive = m_script_path_.empty();
+    if (!interactive && m_script_path_ != "-")
+    {
+        script.open(m_script_path_);
+        if (script)
+        {
+            input = &script;
+        }
+        else
+        {
+            std::cout << "Could not open generation script " << m_script_path_ << ", reading from the keyboard." <<
+                std::endl;
+            interactive = true;
+        }
+    }
 
-    const std::regex remove_note_regex(start_of_string_regex_string + remove_note_string // string identifier
-        + float_regex_string + end_of_string_regex_string); // frequency
+    // The keyboard is read as it is typed, so nothing has to wait for it.
+    m_script_read_ = interactive;
 
-    // Regex for getting what notes are playing.
-    const std::regex get_current_notes_regex(start_of_string_regex_string + "getNotes" + end_of_string_regex_string);
+    if (interactive)
+    {
+        // Tell them how to adjust the volume_.
+        std::cout << "To adjust volume_, enter: 'setVolume:{0.0 <-> 100.0}'" << std::endl;
+        std::cout << "Example. setVolume:10.0" << std::endl;
 
-    // Tell them how to add a note.
-    std::cout << "To add a note, enter: '"
-        << add_note_string << "{Frequency in Hz}"
-        << string_seperator << "{Phase offset in Degrees}"
-        << string_seperator << "{Duration in milliseconds}"
-        << string_seperator << "{Wave Type}" << std::endl;
+        // Tell them how to add a note.
+        std::cout << "To add a note, enter: 'addNote:{Frequency in Hz}:{Phase offset in Degrees}"
+            ":{Duration in milliseconds}:{Wave Type}" << std::endl;
 
-    // Tell them how to remove a note.
-    std::cout << "To remove a note, enter: '"
-        << remove_note_string << "{Frequency in Hz}" << std::endl;
+        // Tell them how to remove a note.
+        std::cout << "To remove a note, enter: 'removeNote:{Frequency in Hz}" << std::endl;
 
-    std::cout << "Allowed Wave Types: [" << sine_string << "/" << square_string << "/" << sawtooth_string << "/" <<
-        triangle_string << "]" << std::endl;
+        std::cout << "Allowed Wave Types: [sine/square/sawtooth/triangle]" << std::endl;
 
-    std::cout << "Example. addNote:440.0:90:1000:sine" << std::endl;
-    std::cout << "Example. removeNote:440.0" << std::endl;
+        std::cout << "Example. addNote:440.0:90:1000:sine" << std::endl;
+        std::cout << "Example. removeNote:440.0" << std::endl;
 
-    // Regex for exiting.
-    const std::regex exit_regex(start_of_string_regex_string + "exit" + end_of_string_regex_string);
+        // Tell them how to get the current notes.
+        std::cout << "To get the current notes, enter 'getNotes'" << std::endl;
 
-    // Tell them how to get the current notes.
-    std::cout << "To get the current notes, enter 'getNotes'" << std::endl;
+        // Tell them how to exit.
+        std::cout << "To exit, enter 'exit'" << std::endl;
+    }
 
-    // Tell them how to exit.
-    std::cout << "To exit, enter 'exit'" << std::endl;
+    // Other programs can send the same commands over the socket. They all go through the callback.
+    m_control_quit_ = false;
+    if (!m_control_path_.empty())
+    {
+        if (m_control_server_.start(m_control_path_, [this](const char* line, const size_t length, std::string& reply)
+        {
+            return control(line, length, reply);
+        }, [this](const uint8_t* frame, const size_t length, std::string& reply)
+        {
+            return control_frame(frame, length, reply);
+        }))
+        {
+            std::cout << "Listening for commands on " << m_control_path_ << std::endl;
+        }
+        else
+        {
+            std::cout << m_control_server_.get_error() << std::endl;
+        }
+    }
 
     auto quit = false;
 
+    // Kept between lines so reading does not allocate once it is big enough.
+    std::string line;
+    auto command = generation_command();
+
     while (!quit)
     {
-        // Wait for an input, then process it.
-        std::string read_string;
-        std::cin >> read_string;
-
-        // Check for exiting.
-        if (std::regex_match(read_string, exit_regex))
+        // A client can say to exit while the keyboard is quiet.
+        if (input == &std::cin && !wait_for_keyboard())
         {
-            // Match, lets exit.
             quit = true;
             continue;
         }
 
-        if (std::regex_match(read_string, get_current_notes_regex))
+        // Wait for an input, then process it.
+        if (!std::getline(*input, line))
         {
-            // Wait for the callback to not be active then print out all of the notes.
+            m_script_read_ = true;
+
+            // A finished script hands over to the keyboard. When the keyboard or pipe is done, so are we.
+            if (input == &script)
+            {
+                input = &std::cin;
+                interactive = true;
+                std::cout << "Finished generation script " << m_script_path_ << ", reading from the keyboard." <<
+                    std::endl;
+                continue;
+            }
 
-            while (static_cast<volatile bool>(generation_callback_active))
+            // Without a keyboard the socket is in charge, so keep going until a client says to exit.
+            if (!m_control_path_.empty() && !m_control_quit_.load())
             {
-                // Wait for the callback to not be active.
+                std::cout << "Input has ended, send exit to " << m_control_path_ << " to stop." << std::endl;
+                while (!m_control_quit_.load())
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                }
             }
 
-            std::cout << "Current Notes:\n";
-            auto i = 0;
-            for (auto note : generation_sound.m_notes)
+            // Let everything that was scheduled play out before leaving.
+            if (m_pending_commands_.load() > 0)
             {
-                std::cout << i
-                    << " : [Frequency = " << note.m_frequency << "]"
-                    << " [Phase = " << note.m_phase_offset << "]"
-                    << " [Duration = " << note.m_duration << "]"
-                    << " [Wave Type = " << sound_utilities::to_string(note.m_wave) << "]\n";
-                ++i;
+                std::cout << "Waiting for " << m_pending_commands_.load() << " scheduled commands to play." <<
+                    std::endl;
+                // A card that has stopped, like a simulated one out of callbacks, would leave us waiting forever.
+                auto callbacks = m_stats_.callbacks.load();
+                auto last_callback = std::chrono::steady_clock::now();
+                while (m_pending_commands_.load() > 0)
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+                    const auto now = std::chrono::steady_clock::now();
+                    if (m_stats_.callbacks.load() != callbacks)
+                    {
+                        callbacks = m_stats_.callbacks.load();
+                        last_callback = now;
+                    }
+                    else if (now - last_callback > std::chrono::milliseconds(stalled_callback_milliseconds))
+                    {
+                        std::cout << "Audio stopped with " << m_pending_commands_.load() <<
+                            " scheduled commands left to play." << std::endl;
+                        break;
+                    }
+                }
             }
 
-            std::cout << std::endl;
+            quit = true;
             continue;
         }
 
-        // Check for setting the volume_.
-        if (std::regex_match(read_string, set_volume_regex))
+        // A client asked to exit while we were waiting on the line.
+        if (m_control_quit_.load())
         {
-            // Match, lets adjust volume_.
-
-            // Get rid of everything but the float.
-            const auto volume_string = std::regex_replace(read_string, std::regex(set_volume_string), "");
-
-            float new_volume;
+            quit = true;
+            continue;
+        }
 
-            try
-            {
-                new_volume = std::stof(volume_string);
-            }
-                // If anything goes wrong. Quit.
-            catch (...)
+        // There can be several commands on a line.
+        size_t position = 0;
+        const char* token;
+        size_t token_length;
+        while (!quit && (token_length = generation_parser::next_token(line.data(), line.size(), position, token)) > 0)
+        {
+            if (!generation_parser::parse(token, token_length, command))
             {
-                std::cout << "Unable to change the volume_, could not convert '" << volume_string << "' to float." <<
-                    std::endl;
+                std::cout << "Unable to match the string '" << std::string(token, token_length) <<
+                    "' to any existing functions" << std::endl;
                 continue;
             }
 
-            if (new_volume < 0.0f)
+            switch (command.m_type)
             {
-                std::cout << "Cannot have negative volume_, setting it to 0.0." << std::endl;
-                new_volume = 0.0f;
+            case generation_command::exit:
+                {
+                    // Match, lets exit.
+                    quit = true;
+                    break;
+                }
+            case generation_command::get_notes:
+                {
+                    // Print the notes as of the last callback. The callback keeps going while we read them.
+                    voice_snapshot voices;
+                    get_voices(voices);
+
+                    std::cout << "Current Notes:\n";
+                    for (uint32_t i = 0; i < std::min(voices.m_num_voices, voice_snapshot::max_voices); ++i)
+                    {
+                        const auto& voice = voices.m_voices[i];
+                        std::cout << i
+                            << " : [Frequency = " << voice.m_frequency << "]"
+                            << " [Phase = " << voice.m_phase_offset << "]"
+                            << " [Duration = " << voice.m_duration << "]"
+                            << " [Wave Type = " << sound_utilities::to_string(voice.m_wave) << "]\n";
+                    }
+
+                    if (voices.m_num_voices > voice_snapshot::max_voices)
+                    {
+                        std::cout << "And " << voices.m_num_voices - voice_snapshot::max_voices << " more.\n";
+                    }
+
+                    std::cout << std::endl;
+                    break;
+                }
+            case generation_command::set_volume:
+                {
+                    auto new_volume = command.m_volume;
+                    if (new_volume < 0.0f)
+                    {
+                        std::cout << "Cannot have negative volume_, setting it to 0.0." << std::endl;
+                        new_volume = 0.0f;
+                    }
+
+                    if (new_volume > 100.0f)
+                    {
+                        std::cout << "Cannot have volume_ above 100.0, setting it to 100.0." << std::endl;
+                        new_volume = 100.0f;
+                    }
+
+                    // The callback is the only one that changes the sound, so even immediate commands go through it.
+                    command.m_volume = new_volume;
+                    schedule(command, m_schedule_queue_, m_schedule_sequence_);
+                    if (interactive && command.m_start_unit == generation_command::immediate)
+                    {
+                        std::cout << "Set Volume to : " << new_volume << std::endl;
+                    }
+                    break;
+                }
+            case generation_command::add_note:
+                {
+                    if (interactive)
+                    {
+                        std::cout << "Adding a new note with Frequency: " << command.m_frequency
+                            << ", Phase Offset: " << command.m_phase
+                            << ", Duration: " << command.m_duration
+                            << ", Wave Type: " << sound_utilities::to_string(command.m_wave) << std::endl;
+                    }
+
+                    schedule(command, m_schedule_queue_, m_schedule_sequence_);
+                    break;
+                }
+            case generation_command::remove_note:
+                {
+                    schedule(command, m_schedule_queue_, m_schedule_sequence_);
+                    break;
+                }
+            case generation_command::none:
+                break;
             }
+        }
+    }
 
-            if (new_volume > 100.0f)
-            {
-                std::cout << "Cannot have volume_ above 100.0, setting it to 100.0." << std::endl;
-                new_volume = 100.0f;
-            }
+    m_control_server_.stop();
+    m_script_read_ = true;
 
-            // Update the volume_ and tell the user.
-            volume = new_volume / 100.0f;
-            std::cout << "Set Volume to : " << new_volume << std::endl;
+    std::cout << "Exiting Frequency Generator mode." << std::endl;
 
-            continue;
-        }
+    m_stats_.report("Frequency Generation");
+}
 
-        // Check for adding a note.
-        if (std::regex_match(read_string, add_note_regex))
+/**
+* \brief Makes a change to the sound. Called by the callback when a scheduled command is due.
+* \param command Command to carry out. Volumes have already been clamped.
+*/
+void generation_driver::apply(const generation_command& command)
+{
+    apply(command, m_sound_);
+}
+
+/**
+* \brief Sets up a sound the way the frequency generator plays it. Lets offline renders match the driver.
+* \param sound Sound to set up.
+*/
+void generation_driver::prepare(sound_data& sound)
+{
+    // Notes are so loud by themselves at max volume. Drop that down!
+    sound.set_master_volume(0.25f);
+    sound.set_control_period(generation_control_period);
+}
+
+/**
+* \brief Makes the change to a sound that a command asks for, the same way the driver does.
+* \param command Command to carry out. Volumes have already been clamped.
+* \param sound Sound to change.
+*/
+void generation_driver::apply(const generation_command& command, sound_data& sound)
+{
+    switch (command.m_type)
+    {
+    case generation_command::set_volume:
+        sound.set_master_volume(command.m_volume / 100.0f);
+        break;
+    case generation_command::add_note:
         {
-            // Match, lets add a note.
+            const auto phase = sound_utilities::two_pi_wrapper(command.m_phase * sound_utilities::two_pi / 360.0f);
+            sound.add_note(note_data(command.m_frequency, phase, command.m_duration, 1.0f, command.m_wave));
+            break;
+        }
+    case generation_command::remove_note:
+        sound.remove_notes(command.m_frequency);
+        break;
+    default:
+        break;
+    }
+}
 
-            // Get rid of the first part
-            const auto note_string = std::regex_replace(read_string, std::regex(add_note_string), "");
+/**
+* \brief Sends a command to the callback to be played on its start. Commands without a start play on the next buffer.
+* Waits when the callback has not caught up with the sender.
+* \param command Command to schedule.
+* \param queue Queue of the thread that is sending.
+* \param sequence Commands sent by the thread so far.
+*/
+void generation_driver::schedule(const generation_command& command, schedule_queue& queue, uint64_t& sequence)
+{
+    auto start = command.m_start;
+    if (command.m_start_unit == generation_command::milliseconds)
+    {
+        start = start * m_data_.sample_rate / 1000.0;
+    }
 
-            auto note_string_stream = std::stringstream(note_string);
+    const auto scheduled = scheduled_command{static_cast<uint64_t>(std::llround(start)), sequence++, command};
 
-            std::vector<std::string> string_vec;
-            std::string token;
+    // Counted first so the callback never plays it before it has been counted.
+    m_pending_commands_.fetch_add(1, std::memory_order_relaxed);
 
-            // Get all the different tokens.
-            while (std::getline(note_string_stream, token, string_seperator))
-            {
-                string_vec.push_back(token);
-            }
+    // The callback empties the queue every buffer, so a full queue only means the sender got ahead.
+    if (!queue.push(scheduled))
+    {
+        ++m_waiting_senders_;
+        while (!queue.push(scheduled))
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        --m_waiting_senders_;
+    }
+}
 
-            // There should be exactly 4 strings extracted this way.
-            assert(string_vec.size() == 4);
+/**
+* \brief Moves the commands the processor has scheduled into the heap. Called by the callback. When the heap is full
+* the rest wait in the queue until some have played.
+*/
+void generation_driver::take_scheduled()
+{
+    scheduled_command command;
+    while (!m_schedule_.full() && m_schedule_queue_.pop(command))
+    {
+        m_schedule_.push(command);
+    }
 
-            // Don't continue if something is wrong.
-            if (string_vec.size() != 4)
-            {
-                std::cout << "Unable to parse add note string" << std::endl;
-                continue;
-            }
+    while (!m_schedule_.full() && m_control_queue_.pop(command))
+    {
+        m_schedule_.push(command);
+    }
+}
 
-            const auto frequency_string = string_vec[0];
-            const auto phase_string = string_vec[1];
-            const auto duration_string = string_vec[2];
-            const auto wave_string = string_vec[3];
+/**
+* \brief Handles a line from the control socket. Called on the server thread. A line can hold any number of commands,
+* which are sent to the callback in order. The reply is "ok" and the number of commands taken, an "error" line for
+* each command that could not be read, and the answer to any query.
+* \param line Start of the line.
+* \param length Number of characters in the line.
+* \param reply Has the reply added to it.
+* \return False when the client said to exit, which closes its connection.
+*/
+bool generation_driver::control(const char* line, const size_t length, std::string& reply)
+{
+    auto command = generation_command();
+    size_t position = 0;
+    const char* token;
+    size_t token_length;
+    uint32_t taken = 0;
 
-            float frequency;
-            float phase;
-            float duration;
-            sound_utilities::wave_type wave;
+    while ((token_length = generation_parser::next_token(line, length, position, token)) > 0)
+    {
+        if (!generation_parser::parse(token, token_length, command))
+        {
+            reply += "error ";
+            reply.append(token, token_length);
+            reply += '\n';
+            continue;
+        }
 
-            try
-            {
-                frequency = std::stof(frequency_string);
-                phase = sound_utilities::two_pi_wrapper(std::stof(phase_string) * sound_utilities::two_pi / 360.0f);
-                duration = std::stof(duration_string);
-                wave = sound_utilities::from_string(wave_string);
-            }
-            catch (...)
+        ++taken;
+        switch (command.m_type)
+        {
+        case generation_command::exit:
+            m_control_quit_ = true;
+            reply += "ok " + std::to_string(taken) + "\n";
+            return false;
+        case generation_command::get_notes:
             {
-                std::cout << "Unable to parse add note string" << std::endl;
-                continue;
+                // One line for the counts, then one per voice: frequency, phase, duration left, gain, and wave.
+                voice_snapshot voices;
+                get_voices(voices);
+                reply += "notes " + std::to_string(voices.m_num_voices) + " pending " +
+                    std::to_string(m_pending_commands_.load(std::memory_order_relaxed)) + " sample " +
+                    std::to_string(voices.m_sample) + "\n";
+                for (uint32_t i = 0; i < std::min(voices.m_num_voices, voice_snapshot::max_voices); ++i)
+                {
+                    const auto& voice = voices.m_voices[i];
+                    reply += "note " + std::to_string(voice.m_frequency) + " " + std::to_string(voice.m_phase_offset)
+                        + " " + std::to_string(voice.m_duration) + " " + std::to_string(voice.m_gain) + " " +
+                        sound_utilities::to_string(voice.m_wave) + "\n";
+                }
+                break;
             }
+        case generation_command::set_volume:
+            command.m_volume = std::max(0.0f, std::min(command.m_volume, 100.0f));
+            schedule(command, m_control_queue_, m_control_sequence_);
+            break;
+        default:
+            schedule(command, m_control_queue_, m_control_sequence_);
+            break;
+        }
+    }
 
-            // Make the new note, tell the user about it, then add it.
-            const auto new_note = note_data(frequency, phase, duration, 1.0f, wave);
+    reply += "ok " + std::to_string(taken) + "\n";
+    return true;
+}
 
-            std::cout << "Adding a new note with Frequency: " << frequency
-                << ", Phase Offset: " << phase
-                << ", Duration: " << duration
-                << ", Wave Type: " << wave_string << std::endl;
+/**
+* \brief Handles a frame from a binary client on the control socket. Called on the server thread. A frame holds any
+* number of binary commands back to back, which are sent to the callback in order. The reply is the number of commands
+* taken and the number that could not be read, as 32 bit counts. When the frame asked for the notes, that is followed
+* by the 32 bit voice and pending command counts, the 64 bit sample, then for every voice its frequency, phase,
+* duration left, and gain as 32 bit floats and its wave as a 32 bit value. Everything is in host byte order.
+* \param frame Start of the frame.
+* \param length Number of bytes in the frame.
+* \param reply Has the reply added to it.
+* \return False when the client said to exit, which closes its connection.
+*/
+bool generation_driver::control_frame(const uint8_t* frame, const size_t length, std::string& reply)
+{
+    auto command = generation_command();
+    uint32_t taken = 0;
+    uint32_t rejected = 0;
+    auto keep = true;
+    auto list_notes = false;
+
+    const auto record_size = generation_parser::binary_command_size;
+    size_t offset = 0;
+    for (; keep && offset + record_size <= length; offset += record_size)
+    {
+        if (!generation_parser::parse_binary(frame + offset, command))
+        {
+            ++rejected;
+            continue;
+        }
 
-            while(static_cast<volatile bool>(generation_callback_active))
-            {
-                // Wait for the callback to not be active to add the note.
-            }
+        ++taken;
+        switch (command.m_type)
+        {
+        case generation_command::exit:
+            m_control_quit_ = true;
+            keep = false;
+            break;
+        case generation_command::get_notes:
+            list_notes = true;
+            break;
+        case generation_command::set_volume:
+            command.m_volume = std::max(0.0f, std::min(command.m_volume, 100.0f));
+            schedule(command, m_control_queue_, m_control_sequence_);
+            break;
+        default:
+            schedule(command, m_control_queue_, m_control_sequence_);
+            break;
+        }
+    }
 
-            // Add the note in.
-            generation_sound.add_note(new_note);
-            continue;
+    // Bytes left over that do not make a whole command.
+    if (keep && offset < length)
+    {
+        ++rejected;
+    }
+
+    append_binary(reply, taken);
+    append_binary(reply, rejected);
+
+    if (list_notes)
+    {
+        voice_snapshot voices;
+        get_voices(voices);
+        append_binary(reply, voices.m_num_voices);
+        append_binary(reply, m_pending_commands_.load(std::memory_order_relaxed));
+        append_binary(reply, voices.m_sample);
+        for (uint32_t i = 0; i < std::min(voices.m_num_voices, voice_snapshot::max_voices); ++i)
+        {
+            const auto& voice = voices.m_voices[i];
+            append_binary(reply, voice.m_frequency);
+            append_binary(reply, voice.m_phase_offset);
+            append_binary(reply, voice.m_duration);
+            append_binary(reply, voice.m_gain);
+            append_binary(reply, static_cast<uint32_t>(voice.m_wave));
         }
+    }
+
+    return keep;
+}
+
+/**
+* \brief Waits for the keyboard to have a line, watching for a control client saying to exit. Only waits when the
+* keyboard is a terminal and the control socket is open, otherwise reading the line does the waiting.
+* \return False if a client said to exit first.
+*/
+bool generation_driver::wait_for_keyboard()
+{
+    if (m_control_path_.empty() || !isatty(STDIN_FILENO))
+    {
+        return true;
+    }
 
-        if(regex_match(read_string, remove_note_regex))
+    pollfd keyboard{};
+    keyboard.fd = STDIN_FILENO;
+    keyboard.events = POLLIN;
+    while (!m_control_quit_.load())
+    {
+        // Errors are left for the read to find.
+        if (poll(&keyboard, 1, keyboard_poll_milliseconds) != 0)
         {
-            // Get rid of the first part
-            const auto note_string = std::regex_replace(read_string, std::regex(remove_note_string), "");
+            return true;
+        }
+    }
 
-            // All that should be left is a frequency.
-            float frequency;
-            try
-            {
-                frequency = std::stof(note_string);
-            }
-            catch (...)
-            {
-                std::cout << "Unable to parse add note string" << std::endl;
-                continue;
-            }
+    return false;
+}
 
-            while(static_cast<volatile bool>(generation_callback_active))
-            {
-                // Wait till the callback is not active before removing notes.
-            }
+/**
+* \brief Sends a command to the callback, which plays it at its start, or on the next buffer when it has none. Goes the
+* same way as commands with a start from the script, so it cannot be called while the processor is running. Used to
+* set up the driver when something other than the processor plays it, such as a benchmark.
+* \param command Command that changes the sound. Queries and exit are not played.
+*/
+void generation_driver::send(const generation_command& command)
+{
+    schedule(command, m_schedule_queue_, m_schedule_sequence_);
+}
 
-            // Remove the notes.
-            generation_sound.remove_notes(frequency);
-            continue;
+/**
+* \brief Copies out the voices as they were at the end of the last callback. Never waits on the callback, so it can be
+* called from any thread as often as a monitor likes.
+* \param snapshot Set to the voices.
+*/
+void generation_driver::get_voices(voice_snapshot& snapshot) const
+{
+    m_voices_.read(snapshot);
+}
+
+/**
+* \brief Publishes the voices that are playing. Called by the callback once per buffer.
+*/
+void generation_driver::publish_voices()
+{
+    auto& snapshot = m_voices_.begin_write();
+    snapshot.m_sample = m_sample_position_;
+    snapshot.m_master_volume = m_sound_.get_master_volume();
+
+    snapshot.m_num_voices = static_cast<uint32_t>(m_sound_.m_notes.size());
+
+    uint32_t count = 0;
+    for (const auto& note : m_sound_.m_notes)
+    {
+        if (count == voice_snapshot::max_voices)
+        {
+            break;
         }
 
-        std::cout << "Unable to match the string '" << read_string << "' to any existing functions" << std::endl;
+        auto& voice = snapshot.m_voices[count];
+        voice.m_frequency = note.m_frequency;
+        voice.m_phase_offset = note.m_phase_offset;
+        voice.m_duration = note.m_duration;
+        voice.m_gain = note.m_gain;
+        voice.m_wave = note.m_wave;
+        ++count;
     }
 
-    std::cout << "Exiting Frequency Generator mode." << std::endl;
+    m_voices_.end_write();
+}
+
+/**
+* \brief Finishes a pass of the callback. Counts a missed deadline if it finished after its buffer was due to play, and
+* sends what it did to the telemetry, if there is any.
+* \param start When the callback started.
+* \param deadline Seconds the callback had before its buffer played.
+* \param frames Frames in the buffer.
+* \param status_flags Status Port Audio handed to the callback.
+* \param events Scheduled commands the callback played.
+*/
+void generation_driver::finish_pass(const std::chrono::steady_clock::time_point start, const double deadline,
+                                    const unsigned long frames, const PaStreamCallbackFlags status_flags,
+                                    const uint32_t events)
+{
+    const auto busy_ns = telemetry_source::nanoseconds_since(start);
+    const auto missed = static_cast<double>(busy_ns) >= deadline * 1e9;
+    if (missed)
+    {
+        ++m_stats_.deadline_misses;
+    }
+
+    if (!m_telemetry_)
+    {
+        return;
+    }
 
-    generation_sound.m_notes.clear();
+    auto record = telemetry_record();
+    record.m_busy_ns = busy_ns;
+    record.m_deadline_ns = telemetry_source::deadline_nanoseconds(deadline);
+    record.m_deadline_missed = missed;
+    record.m_frames = static_cast<uint32_t>(frames);
+    record.m_voices = static_cast<uint32_t>(m_sound_.m_notes.size());
+    record.m_events = events;
+    record.m_queue_depth = m_pending_commands_.load(std::memory_order_relaxed);
+    record.m_xrun = telemetry_source::is_xrun(status_flags);
+    m_telemetry_->push(record);
 }
 
 /**
 * \brief Gets the data pointer that needs to be passed to the callback function.
-* \return Data pointer for the callback function.
+* \return Data pointer for the callback function. The driver itself.
 */
 void* generation_driver::get_data()
 {
-    return &data_;
+    return this;
+}
+
+/**
+* \brief Gets the callback that plays this driver.
+* \return Callback to hand to the audio backend along with get_data.
+*/
+PaStreamCallback* generation_driver::get_callback() const
+{
+    return callback;
+}
+
+/**
+* \brief Sends what the callback does to the telemetry. Has to be set before the driver starts.
+* \param hub Telemetry to send to. Null for none.
+*/
+void generation_driver::set_telemetry(telemetry* hub)
+{
+    m_telemetry_ = hub ? hub->add_source("generation") : nullptr;
+}
+
+/**
+* \brief Changes the buffer layout the callback is handed from the one init picked. Has to be set after init and
+* before the driver starts.
+* \param non_interleaved If the buffers are one array per channel instead of interleaved frames.
+*/
+void generation_driver::set_buffer_layout(const bool non_interleaved)
+{
+    m_data_.non_interleaved = non_interleaved;
+}
+
+/**
+* \brief Checks if the driver has what it needs to play the next buffer, which is once the script has been read and
+* sent to the callback. A sender stuck on a full queue needs the callback to run, so that counts as ready too. Commands
+* from the keyboard and the socket play whenever they come in, so they are never waited for.
+* \param frames Frames in the next buffer.
+* \return If the next buffer can be played.
+*/
+bool generation_driver::is_ready(const unsigned long frames) const
+{
+    static_cast<void>(frames);
+    return m_script_read_.load() || m_waiting_senders_.load() > 0;
 }
@@ -1,13 +1,24 @@
 #pragma once
 
-#include "src/sound/sound_utilities.h"
+#include "sound_driver.h"
+#include "sound_data.h"
+#include "src/sound/generation_parser.h"
+#include "src/sound/voice_snapshot.h"
+#include "src/utilities/control_server.h"
+#include "src/utilities/fixed_heap.h"
+#include "src/utilities/seqlock.h"
+#include "src/utilities/spsc_queue.h"
+#include "src/utilities/telemetry.h"
 
-class sound_data;
+#include <atomic>
+#include <string>
 
-class generation_driver
+class generation_driver : public sound_driver
 {
 public:
-    static bool init(sound_utilities::callback_data& data);
+    generation_driver();
+
+    bool init(sound_utilities::callback_data& data) override;
 
     static int callback(const void* input_buffer, void* output_buffer,
                         unsigned long frames_per_buffer,
@@ -15,11 +26,127 @@ public:
                         PaStreamCallbackFlags status_flags,
                         void* user_data);
 
-    static void processor();
+    void processor() override;
+
+    void* get_data() override;
+
+    PaStreamCallback* get_callback() const override;
+
+    void set_script(const std::string& path);
+
+    void set_control_socket(const std::string& path);
+
+    void set_control_period(uint32_t period);
+
+    void get_voices(voice_snapshot& snapshot) const;
+
+    void send(const generation_command& command);
+
+    void set_telemetry(telemetry* hub) override;
+
+    void set_buffer_layout(bool non_interleaved) override;
 
-    static void* get_data();
+    bool is_ready(unsigned long frames) const override;
+
+    static void prepare(sound_data& sound);
+
+    static void apply(const generation_command& command, sound_data& sound);
 
 private:
-    // Our data pointer.
-    static sound_utilities::callback_data data_;
+    /**
+     * \brief A command waiting for the sample it plays on.
+     */
+    struct scheduled_command
+    {
+        uint64_t m_sample;
+
+        // Order the command was read in, so commands on the same sample play in script order.
+        uint64_t m_sequence;
+
+        generation_command m_command;
+    };
+
+    // Puts the command that should play first on top of the heap.
+    struct later_command
+    {
+        bool operator()(const scheduled_command& left, const scheduled_command& right) const
+        {
+            return left.m_sample != right.m_sample ? left.m_sample > right.m_sample : left.m_sequence > right.m_sequence;
+        }
+    };
+
+    // Most commands that can be on their way to the callback from one thread.
+    const static uint32_t schedule_queue_capacity = 4096;
+    typedef spsc_queue<scheduled_command, schedule_queue_capacity> schedule_queue;
+
+    void apply(const generation_command& command);
+
+    void schedule(const generation_command& command, schedule_queue& queue, uint64_t& sequence);
+
+    void take_scheduled();
+
+    bool control(const char* line, size_t length, std::string& reply);
+
+    bool control_frame(const uint8_t* frame, size_t length, std::string& reply);
+
+    bool wait_for_keyboard();
+
+    void publish_voices();
+
+    void finish_pass(std::chrono::steady_clock::time_point start, double deadline, unsigned long frames,
+                     PaStreamCallbackFlags status_flags, uint32_t events);
+
+    sound_utilities::callback_data m_data_;
+
+    // Notes being played. Only changed by the callback, which plays every command the processor and the control
+    // server send it.
+    sound_data m_sound_;
+
+    bool m_initialized_;
+    sound_utilities::callback_stats m_stats_;
+
+    // Commands to read instead of the keyboard. Optional.
+    std::string m_script_path_;
+
+    // Samples between control ticks. 0 keeps the default.
+    uint32_t m_control_period_;
+
+    // Commands with a start, on their way from the processor to the callback.
+    schedule_queue m_schedule_queue_;
+
+    // Commands the callback is waiting to play, soonest on top. Only touched by the callback.
+    const static uint32_t max_scheduled_commands;
+    fixed_heap<scheduled_command, later_command> m_schedule_;
+
+    // Samples played since the driver started. Only touched by the callback.
+    uint64_t m_sample_position_;
+
+    // Scheduled commands read so far. Only touched by the processor.
+    uint64_t m_schedule_sequence_;
+
+    // Scheduled commands that have been read but not played yet.
+    std::atomic<uint32_t> m_pending_commands_;
+
+    // Socket other programs can send commands to. Optional.
+    std::string m_control_path_;
+    control_server m_control_server_;
+
+    // Every command from the socket goes to the callback through here, even ones without a start. Only pushed by the
+    // server thread.
+    schedule_queue m_control_queue_;
+    uint64_t m_control_sequence_;
+
+    // Set when a client sends exit.
+    std::atomic<bool> m_control_quit_;
+
+    // Set once the processor has read the script, or straight away when there is none. Senders waiting on a full
+    // queue are counted, since the callback has to run to make room for them.
+    std::atomic<bool> m_script_read_;
+    std::atomic<uint32_t> m_waiting_senders_;
+
+    // Where the callback sends what it did. Optional.
+    telemetry_source* m_telemetry_;
+
+    // Voices as of the last callback, so notes can be listed without waiting on the callback. Written by the callback.
+    seqlock<voice_snapshot> m_voices_;
 };
@@ -2,49 +2,97 @@
 #include "sound_data.h"
 #include "src/rtmidi/RtMidi.h"
 #include "src/Audio Driver/audio_driver.h"
-
+#include "src/utilities/startup_timer.h"
+#include "src/utilities/telemetry.h"
+#include "src/utilities/trace_profiler.h"
+#include "src/utilities/fixed_queue.h"
+#include "src/midi/midi_parser.h"
+#include "src/midi/midi_synth.h"
+#include "src/midi/midi_latency_probe.h"
+#include "src/midi/midi_load_generator.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <cassert>
 #include <iostream>
-#include <queue>
-#include <cmath>
 #include <map>
+#include <memory>
+#include <chrono>
+#include <thread>
 
+const uint8_t midi_port_config::num_channels;
 
-sound_utilities::callback_data midi_driver::data_ = sound_utilities::callback_data();
-
-static bool midi_initialized = false;
-
-static bool midi_callback_active = false;
-
-// The volume and sound that will be processed by the callback.
-static sound_data midi_sound = sound_data();
+/**
+ * \brief Construct a port config.
+ * \param pattern Ports whose name contains this are opened.
+ * \param channel Channel (0 <-> 15) that every message from the port is moved to. Leave at -1 to keep the channels.
+ */
+midi_port_config::midi_port_config(const std::string& pattern, const int channel) :
+    m_pattern(pattern)
+{
+    assert(channel >= -1 && channel < num_channels);
+    for (uint8_t i = 0; i < num_channels; ++i)
+    {
+        m_channel_map[i] = channel < 0 ? i : static_cast<uint8_t>(channel);
+    }
+}
 
-static sound_utilities::wave_type midi_current_wave = sound_utilities::sine;
-static bool dynamic_note_volume = true;
+// Number of output channels to render when the device has them.
+static const int32_t requested_output_channels = 2;
+
+const uint32_t midi_driver::max_scheduled_events = 4096;
+
+midi_driver::midi_driver() :
+    m_data_(sound_utilities::callback_data()),
+    m_initialized_(false),
+    m_load_generator_(nullptr),
+    m_latency_probe_(nullptr),
+    m_control_map_(midi_control_map()),
+    m_control_period_(0),
+    m_file_start_seconds_(0.0),
+    m_schedule_(max_scheduled_events),
+    m_sample_position_(0),
+    m_file_sent_until_(0),
+    m_pending_events_(0),
+    m_voice_count_(0),
+    m_quit_requested_(false),
+    m_callback_telemetry_(nullptr),
+    m_reader_telemetry_(nullptr)
+{
+}
 
-// Values needed to process the midi bytes.
-static const uint8_t channel_one_key_press = 144;
+/**
+ * \brief A port that is connected to the reader, and where its channels go.
+ */
+struct midi_input_port
+{
+    unsigned int m_source;
+    std::string m_name;
+    std::array<uint8_t, midi_port_config::num_channels> m_channel_map;
 
-static const uint8_t non_dynamic_volume_key = 0;
-static const uint8_t sine_wave_key = 64;
-static const uint8_t square_wave_key = 65;
-static const uint8_t sawtooth_wave_key = 66;
-static const uint8_t triangle_wave_key = 67;
+    // Every port keeps its own running status, so a message split by another port's message still reads right.
+    midi_parser m_parser;
+};
 
-static const uint8_t quit_midi_key = 81;
+// Most events that can wait for room in the queue to the callback before reading from the input queue stops.
+static const uint32_t midi_backlog_size = 512;
 
-static const uint8_t channel_two_key_press = 145;
-static const uint8_t channel_two_key_release = 129;
+// Messages the MIDI input queue can hold. Rounded up to a power of two. New messages are dropped while it is full.
+static const unsigned int midi_queue_size = 1024;
 
-static const uint8_t middle_note_value = 60;
-static const float middle_note_frequency = 440.0f;
+// Dropped messages are counted and reported on exit instead of warned about one at a time.
+static const RtMidiIn::OverflowPolicy midi_overflow_policy = RtMidiIn::OVERFLOW_SILENT;
 
-static const uint8_t max_volume_value = 127;
+// SysEx messages are read so the queue keeps moving, but nothing is done with them.
+static const size_t midi_sysex_buffer_size = 1024;
 
-static std::vector<float> frequencies_vector;
+// How long the reader sleeps between polls when nothing is coming in. Backs off while nothing is playing.
+static const std::chrono::microseconds active_poll_interval(1000);
+static const std::chrono::microseconds idle_poll_interval(4000);
 
-// Half step value.
-static const float twelth_root_two = std::exp2(1.0f / 12.0f);
+// How far ahead of the callback the file is sent. Has to cover a buffer and a slow pass of the reader.
+static const double file_lookahead_seconds = 0.1;
 
 /**
 * \brief Checks if the driver can be run at this time, and fills out the callback data.
@@ -58,11 +106,14 @@ bool midi_driver::init(sound_utilities::callback_data& data)
         return false;
     }
 
-    RtMidiIn* midi_reader;
+    // Render in stereo if the device can take it.
+    const auto output_channels = std::min(requested_output_channels, audio_driver::max_output_channels());
+
     // Get our reader setup.
+    std::unique_ptr<RtMidiIn> midi_reader;
     try
     {
-        midi_reader = new RtMidiIn();
+        midi_reader.reset(new RtMidiIn());
     }
     catch (RtMidiError& error)
     {
@@ -70,37 +121,54 @@ bool midi_driver::init(sound_utilities::callback_data& data)
         return false;
     }
 
+    // Load the file before the ports are checked, it can play without any.
+    if (!m_file_path_.empty())
+    {
+        const auto load_start = std::chrono::steady_clock::now();
+        if (m_file_.load(m_file_path_, sound_utilities::default_sample_rate))
+        {
+            const auto load_time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() -
+                load_start);
+            std::cout << "Loaded " << m_file_.get_events().size() << " events from " << m_file_path_ <<
+                " in " << load_time.count() << " ms." << std::endl;
+        }
+        else
+        {
+            std::cout << m_file_.get_error() << std::endl;
+            m_file_path_.clear();
+        }
+    }
+
     // See if there are any ports we can work with.
-    if (midi_reader->getPortCount() == 0)
+    if (midi_reader->getPortCount() == 0 && m_file_path_.empty())
     {
         std::cout << "No MIDI channels are available." << std::endl;
         return false;
     }
 
-    delete midi_reader;
+    midi_reader.reset();
 
     // Setup the values to what we allow them to be.
     data.num_input_channels = 0;
-    data.num_output_channels = 1;
+    data.num_output_channels = output_channels;
+    data.non_interleaved = true;
     data.sample_rate = sound_utilities::default_sample_rate;
 
     // Get our data pointer ready.
-    data_ = data;
-
-    // We are not in the callback, so it is false.
-    midi_callback_active = false;
+    m_data_ = data;
 
-    // Fill out the frequency vector. No need to calculate this on the fly all the time.
-    for (auto i = 0; i <= 127; ++i)
+    m_sound_.reset(new midi_synth(midi_engine::default_worker_count()));
+    m_sound_->set_control_map(m_control_map_);
+    m_sound_->set_latency_probe(m_latency_probe_);
+    if (m_control_period_ > 0)
     {
-        const auto frequency_modifier = std::pow(twelth_root_two, i - middle_note_value);
-        frequencies_vector.push_back(middle_note_frequency * frequency_modifier);
+        m_sound_->get_engine().set_control_period(m_control_period_);
     }
 
     // Say that we have been initialized.
-    midi_initialized = true;
+    m_initialized_ = true;
 
-    return midi_initialized;
+    return m_initialized_;
 }
 
 int midi_driver::callback(const void* input_buffer, void* output_buffer, unsigned long frames_per_buffer,
@@ -108,89 +176,132 @@ int midi_driver::callback(const void* input_buffer, void* output_buffer, unsigne
                           void* user_data)
 {
     // stop warnings by casting to void.
-    static_cast<void>(status_flags);
-    static_cast<void>(time_info);
     static_cast<void>(input_buffer);
 
-    // Get the data that we care about.
-    const auto data = static_cast<sound_utilities::callback_data*>(user_data);
+    const auto busy_start = std::chrono::steady_clock::now();
+
+    TRACE_THREAD("audio callback");
+    TRACE_SCOPE("midi callback");
+
+    // Get the driver, and the data that we care about.
+    auto* driver = static_cast<midi_driver*>(user_data);
+    const auto data = &driver->m_data_;
+
+    // Time we have before the buffer plays. A late wakeup can leave none, which counts as a missed deadline.
+    const auto alloted_time = sound_utilities::time_to_output(time_info, frames_per_buffer, data->sample_rate);
 
     // Check for valid values.
     assert(data->num_input_channels == 0);
     assert(data->num_output_channels >= 1);
-    assert(midi_initialized);
+    assert(data->num_output_channels <= static_cast<int>(sound_data::max_channels));
+    assert(driver->m_initialized_);
 
-    auto* out = static_cast<float*>(output_buffer);
+    if (driver->m_callback_telemetry_)
+    {
+        driver->m_callback_telemetry_->begin_pass();
+    }
 
-    uint64_t tracker = 0;
-    midi_callback_active = true;
-    for (unsigned int i = 0; i < frames_per_buffer; i++)
+    auto& sound = *driver->m_sound_;
+    auto& schedule = driver->m_schedule_;
+
+    startup_timer::mark_callback();
+    ++driver->m_stats_.callbacks;
+
+    // Pick up anything the reader has sent since the last buffer.
     {
-        auto play_val = 0.0f;
+        TRACE_SCOPE("take scheduled");
+        driver->take_scheduled();
+    }
 
-        // Go through all of the notes in the sound, get their value, and advance their phase.
-        for (auto& note : midi_sound.m_notes)
-        {
-            const auto note_volume = midi_sound.m_note_volume * note.m_volume;
-            const auto note_index = sound_utilities::phase_to_index(note.m_current_phase, sound_utilities::table_size);
+    const auto buffer_start = driver->m_sample_position_.load(std::memory_order_relaxed);
+    const auto buffer_end = buffer_start + frames_per_buffer;
+    driver->m_sample_position_.store(buffer_end, std::memory_order_release);
 
-            switch (note.m_wave)
+    // Nothing to play and nothing due, so skip rendering and hand back silence.
+    if (sound.is_silent() && (schedule.empty() || schedule.top().m_sample >= buffer_end))
+    {
+        ++driver->m_stats_.idle_callbacks;
+        sound_utilities::write_silence(output_buffer, data->num_output_channels, frames_per_buffer,
+                                       data->non_interleaved);
+        driver->finish_pass(busy_start, alloted_time, frames_per_buffer, status_flags, 0);
+        return 0;
+    }
+
+    startup_timer::mark_audible();
+
+    const auto num_channels = static_cast<uint32_t>(data->num_output_channels);
+    uint64_t tracker = 0;
+    uint32_t applied = 0;
+    unsigned long frame = 0;
+    while (frame < frames_per_buffer)
+    {
+        // Play every event that is due by now. Ones that came in late play on the first sample of the buffer.
+        if (!schedule.empty() && schedule.top().m_sample <= buffer_start + frame)
+        {
+            TRACE_SCOPE("midi apply");
+            while (!schedule.empty() && schedule.top().m_sample <= buffer_start + frame)
             {
-            case sound_utilities::sine:
-                play_val += sound_utilities::wave_lookup_tables.sine[note_index] * note_volume;
-                break;
-            case sound_utilities::square:
-                play_val += sound_utilities::wave_lookup_tables.square[note_index] * note_volume;
-                break;
-            case sound_utilities::triangle:
-                play_val += sound_utilities::wave_lookup_tables.triangle[note_index] * note_volume;
-                break;
-            case sound_utilities::sawtooth:
-                play_val += sound_utilities::wave_lookup_tables.sawtooth[note_index] * note_volume;
-                break;
-            default:
-                assert(false); // We should never hit default.
-                break;
+                if (!sound.process_event(schedule.top().m_event))
+                {
+                    driver->m_quit_requested_.store(true, std::memory_order_release);
+                }
+                schedule.pop();
+                ++applied;
             }
-
-            // Advance the phase.
-            note.m_current_phase = sound_utilities::two_pi_wrapper(
-                note.m_current_phase + sound_utilities::two_pi * note.m_frequency / static_cast<float>(data->sample_rate
-                ));
         }
 
-        // Apply the master volume.
-        play_val = sound_utilities::clipped_output(play_val * sound_utilities::non_clip_volume);
-
-        // Playback to the output.
-        for (auto j = 0; j < data->num_output_channels; ++j)
+        // Render the parts a block at a time, stopping at the next event so it starts on its sample. Envelopes,
+        // panning, phase, and mixing are all done for us.
+        auto block_size = static_cast<uint32_t>(std::min<unsigned long>(frames_per_buffer - frame,
+                                                                        sound_data::max_block_size));
+        if (!schedule.empty())
         {
-            ++tracker;
-            out[data->num_output_channels * i + j] = play_val;
+            block_size = static_cast<uint32_t>(std::min<uint64_t>(block_size,
+                                                                  schedule.top().m_sample - (buffer_start + frame)));
         }
+
+        const auto* const* block_channels = sound.render(num_channels, block_size, data->sample_rate);
+        sound_utilities::write_output(block_channels, output_buffer, num_channels, block_size, frame,
+                                      data->non_interleaved);
+
+        tracker += block_size * num_channels;
+        frame += block_size;
     }
 
     // Just a saftey to moke sure that we actually did fill up the channels.
     assert(tracker == frames_per_buffer * data->num_output_channels);
 
-    midi_callback_active = false;
+    // Everything added so far is heard from this buffer on.
+    if (driver->m_latency_probe_)
+    {
+        driver->m_latency_probe_->mark_rendered();
+    }
+
+    // The voices go out before the events are counted off, so a reader that sees nothing pending sees the notes the
+    // last events started.
+    driver->m_voice_count_.store(sound.get_engine().get_voice_count(), std::memory_order_relaxed);
+    driver->m_pending_events_.fetch_sub(applied, std::memory_order_release);
+
+    driver->finish_pass(busy_start, alloted_time, frames_per_buffer, status_flags, applied);
     return 0;
 }
 
 void midi_driver::processor()
 {
     // If we were never initialized, quit.
-    if (!midi_initialized)
+    if (!m_initialized_)
     {
         std::cout << "Midi Driver was not initialized. Quitting driver." << std::endl;
         return;
     }
 
-    RtMidiIn* midi_reader;
-    // Get our reader setup.
+    TRACE_THREAD("midi reader");
+
+    // Get our reader setup. Freed on every way out.
+    std::unique_ptr<RtMidiIn> midi_reader;
     try
     {
-        midi_reader = new RtMidiIn();
+        midi_reader.reset(new RtMidiIn(RtMidi::UNSPECIFIED, "RtMidi Input Client", midi_queue_size));
     }
     catch (RtMidiError& error)
     {
@@ -198,196 +309,560 @@ void midi_driver::processor()
         return;
     }
 
-    // Get a map of all the port indicies to the names of those ports.
-    std::map<uint32_t, std::string> midi_port_names;
+    midi_reader->setOverflowPolicy(midi_overflow_policy);
 
-    // Get the names of all the ports.
-    for (uint32_t i = 0; i < midi_reader->getPortCount(); i++)
+    // Ports that are feeding the reader. Every message is tagged with the port it came from.
+    std::vector<midi_input_port> input_ports;
+    auto quit = false;
+
+    if (!m_port_configs_.empty())
     {
-        try
+        connect_matching_ports(*midi_reader, input_ports);
+        if (input_ports.empty())
         {
-            midi_port_names.emplace(i, midi_reader->getPortName(i));
-        }
-        catch (RtMidiError& error)
-        {
-            // Don't tell them about a port that is bad.
-            error.printMessage();
+            std::cout << "No Midi ports match the requested names." << std::endl;
+            return;
         }
     }
-
-    if (midi_port_names.empty())
+    else if (m_file_path_.empty())
     {
-        std::cout << "No Midi ports exist." << std::endl;
-        return;
-    }
-
-    // Prompt the user to continue.
-    std::cout << "Please select an available midi port to use by entering its associated number:" << std::endl;
-
-    for (const auto& key_value_pair : midi_port_names)
-    {
-        const auto key = key_value_pair.first;
-        const auto value = key_value_pair.second;
-        std::cout << "[" << key << "]: " << value << std::endl;
-    }
-
-    const std::string exit_string = "exit";
+        // Get a map of all the port indicies to the names of those ports.
+        std::map<uint32_t, std::string> midi_port_names;
 
-    std::cout << "Enter '" << exit_string << "' to exit driver" << std::endl << std::endl;
-
-    auto proceed = false;
-    auto quit = false;
-
-    while (!proceed)
-    {
-        std::string read_string;
-        std::cin >> read_string;
-
-        // Catch the exit condition
-        if (read_string == exit_string)
+        // Get the names of all the ports.
+        for (uint32_t i = 0; i < midi_reader->getPortCount(); i++)
         {
-            proceed = true;
-            quit = true;
-            continue;
+            try
+            {
+                midi_port_names.emplace(i, midi_reader->getPortName(i));
+            }
+            catch (RtMidiError& error)
+            {
+                // Don't tell them about a port that is bad.
+                error.printMessage();
+            }
         }
 
-        // Get the parsed value from stoi. 
-        int parsed_value;
-        try
+        if (midi_port_names.empty())
         {
-            parsed_value = std::stoi(read_string);
+            std::cout << "No Midi ports exist." << std::endl;
+            return;
         }
-            // Catch all exceptions. If something bad slipped through the cracks, continue without changing anything.
-        catch (...)
+
+        // Prompt the user to continue.
+        std::cout << "Please select an available midi port to use by entering its associated number:" << std::endl;
+
+        for (const auto& key_value_pair : midi_port_names)
         {
-            std::cout << "Could not parse the given string to an integer: " << read_string << std::endl;
-            continue;
+            const auto key = key_value_pair.first;
+            const auto value = key_value_pair.second;
+            std::cout << "[" << key << "]: " << value << std::endl;
         }
 
-        // See if we actually have a port with the provided index.
-        if (midi_port_names.count(parsed_value) != 0)
+        const std::string exit_string = "exit";
+
+        std::cout << "Enter '" << exit_string << "' to exit driver" << std::endl << std::endl;
+
+        auto proceed = false;
+
+        while (!proceed)
         {
-            try
+            std::string read_string;
+            std::cin >> read_string;
+
+            // Catch the exit condition
+            if (read_string == exit_string)
             {
-                midi_reader->openPort(parsed_value);
                 proceed = true;
+                quit = true;
+                continue;
             }
-            catch (RtMidiError& error)
+
+            // Get the parsed value from stoi. 
+            int parsed_value;
+            try
             {
-                error.printMessage();
+                parsed_value = std::stoi(read_string);
+            }
+                // Catch all exceptions. If something bad slipped through the cracks, continue without changing anything.
+            catch (...)
+            {
+                std::cout << "Could not parse the given string to an integer: " << read_string << std::endl;
+                continue;
+            }
+
+            // See if we actually have a port with the provided index.
+            if (midi_port_names.count(parsed_value) != 0)
+            {
+                try
+                {
+                    const auto source = midi_reader->connectPort(parsed_value);
+                    input_ports.push_back(midi_input_port{
+                        source, midi_port_names[parsed_value], midi_port_config(std::string()).m_channel_map,
+                        midi_parser()
+                    });
+                    proceed = true;
+                }
+                catch (RtMidiError& error)
+                {
+                    error.printMessage();
+                }
+            }
+            else
+            {
+                std::cout << "No midi port exists with the given index: " << parsed_value << std::endl;
             }
         }
-        else
-        {
-            std::cout << "No midi port exists with the given index: " << parsed_value << std::endl;
-        }
     }
 
-    // We won't always be ready to deal with the messages, so get a buffer.
-    std::queue<std::vector<uint8_t>> waiting_messages;
+    // Events wait here until the callback has room for them. Everything is set aside up front so that reading messages
+    // never allocates.
+    fixed_queue<scheduled_event, midi_backlog_size> waiting_events;
+    std::array<midi_event, midi_backlog_size> drained_events;
+    RtMidiShortMessage message;
+    std::array<unsigned char, midi_sysex_buffer_size> sysex_buffer;
+    auto seen_port_changes = midi_reader->getPortChangeCount();
+
+    uint64_t sequence = 0;
+    const auto send = [&](const midi_event& event, const uint64_t sample)
+    {
+        // Counted first so the callback never plays it before it has been counted.
+        m_pending_events_.fetch_add(1, std::memory_order_relaxed);
+        waiting_events.push(scheduled_event{sample, sequence++, event});
+    };
+
+    // The file starts a lookahead after where the callback is now, so even its first events land on their sample.
+    const auto& file_events = m_file_.get_events();
+    const auto file_lookahead = static_cast<uint64_t>(file_lookahead_seconds * m_data_.sample_rate);
+    const auto file_start = static_cast<uint64_t>(m_file_start_seconds_ * m_file_.get_sample_rate());
+    const auto file_offset = m_sample_position_.load(std::memory_order_acquire) + file_lookahead;
+    const auto file_end = file_offset + (std::max(m_file_.get_length(), file_start) - file_start);
+    auto next_file_event = m_file_.find(file_start);
+    auto file_sent = m_file_path_.empty();
+    m_file_sent_until_.store(0, std::memory_order_release);
+    if (!file_sent)
+    {
+        std::cout << "Playing " << m_file_path_ << std::endl;
+    }
+
+    m_stats_.reset();
+    m_quit_requested_.store(false);
+
+    if (m_latency_probe_)
+    {
+        m_latency_probe_->reset();
+    }
+
+    if (m_load_generator_)
+    {
+        m_load_generator_->start();
+    }
 
     // Lets do some processing.
     while (!quit)
     {
-        // Getting the message is a non-blocking check.
-        std::vector<uint8_t> message;
-        midi_reader->getMessage(&message);
+        const auto pass_start = std::chrono::steady_clock::now();
 
-        // Get how many bytes we have.
-        const auto n_bytes = message.size();
+        // Getting the message is a non-blocking check. Drain everything that has come in. Each message is at most
+        // one event, so there is always room for it.
+        auto received = false;
+        uint32_t num_drained = 0;
+        while (num_drained + waiting_events.size() < midi_backlog_size && midi_reader->getMessage(&message))
+        {
+            received = true;
 
-        // We have a message, add it to the queue.
-        if (n_bytes > 0)
+            if (message.sysex)
+            {
+                midi_reader->getSysExMessage(sysex_buffer.data(), sysex_buffer.size());
+                continue;
+            }
+
+            // Messages still on their way from a port that has since gone away are dropped.
+            const auto port = std::find_if(input_ports.begin(), input_ports.end(), [&](const midi_input_port& input)
+            {
+                return input.m_source == message.source;
+            });
+
+            midi_event event;
+            if (port == input_ports.end() || port->m_parser.parse(message.bytes, message.size, &event, 1) != 1)
+            {
+                continue;
+            }
+
+            // Move the event to the channel its port is mapped to. Every port comes through the one input queue, so
+            // the ports are already merged in the order their messages arrived.
+            event.m_channel = port->m_channel_map[event.m_channel];
+            drained_events[num_drained] = event;
+            ++num_drained;
+        }
+
+        // Live events play as soon as the callback gets to them.
+        const auto position = m_sample_position_.load(std::memory_order_acquire);
+        for (uint32_t i = 0; i < num_drained; ++i)
         {
-            assert(n_bytes == 3);
-            waiting_messages.push(message);
-            for (uint32_t i = 0; i < n_bytes; i++)
-                std::cout << "Byte " << i << " = " << static_cast<int>(message[i]) << ", ";
-            std::cout << std::endl;
+            send(drained_events[i], position);
         }
 
-        if (!waiting_messages.empty())
+        // Send the file up to a lookahead past the callback. Whatever does not fit waits for the next pass.
+        auto file_ready = UINT64_MAX;
+        if (!file_sent)
         {
-            // So long as the callback is not active, we can add and remove notes freely.
-            while (!static_cast<volatile bool>(midi_callback_active) && !waiting_messages.empty())
+            const auto horizon = position + file_lookahead;
+            while (!waiting_events.full() && next_file_event < file_events.size())
             {
-                // Get the message at the start of the queue.
-                auto read_message = waiting_messages.front();
-                waiting_messages.pop();
-
-                const auto action = read_message[0];
-                const auto note = read_message[1];
-                const auto modifier = read_message[2];
-
-                // Channel 2 key press is an add note action.
-                if (action == channel_two_key_press)
+                const auto& file_event = file_events[next_file_event];
+                const auto sample = file_offset + (file_event.m_sample - file_start);
+                if (sample >= horizon)
                 {
-                    midi_sound.add_note(calculate_note(note, modifier));
+                    break;
                 }
-                    // Channel 2 key release is a remove note action.
-                else if (action == channel_two_key_release)
+
+                // Files are not allowed to quit.
+                const auto& event = file_event.m_event;
+                if (event.m_type != midi_control_change || event.m_number != m_control_map_.m_quit_controller)
                 {
-                    midi_sound.remove_notes(frequencies_vector[note]);
+                    send(event, sample);
                 }
-                    // Channel 1 key press is a modify state action.
-                else if (action == channel_one_key_press)
+                ++next_file_event;
+            }
+
+            // Let go of anything the file left hanging once it ends, so it rings out.
+            if (next_file_event == file_events.size() && file_end < horizon &&
+                waiting_events.size() + midi_engine::num_parts <= midi_backlog_size)
+            {
+                for (uint8_t channel = 0; channel < midi_engine::num_parts; ++channel)
                 {
-                    if (note == non_dynamic_volume_key)
-                    {
-                        dynamic_note_volume = !dynamic_note_volume;
-                    }
-                    else if (note == sine_wave_key)
-                    {
-                        midi_current_wave = sound_utilities::sine;
-                    }
-                    else if (note == square_wave_key)
-                    {
-                        midi_current_wave = sound_utilities::square;
-                    }
-                    else if (note == sawtooth_wave_key)
-                    {
-                        midi_current_wave = sound_utilities::sawtooth;
-                    }
-                    else if (note == triangle_wave_key)
-                    {
-                        midi_current_wave = sound_utilities::triangle;
-                    }
-                    else if (note == quit_midi_key)
-                    {
-                        quit = true;
-                    }
+                    send(midi_event{midi_control_change, channel, midi_all_notes_off_controller, 0, 0}, file_end);
                 }
+                file_sent = true;
+            }
+
+            // Everything before the next event left in the file has been sent.
+            file_ready = file_sent ? UINT64_MAX : horizon;
+            if (next_file_event < file_events.size())
+            {
+                file_ready = std::min(file_ready, file_offset + (file_events[next_file_event].m_sample - file_start));
             }
         }
+
+        // Hand everything waiting to the callback. Whatever does not fit waits for the next pass.
+        uint32_t sent = 0;
+        while (!waiting_events.empty() && m_event_queue_.push(waiting_events.front()))
+        {
+            waiting_events.pop();
+            ++sent;
+        }
+
+        // The callback can only count on the file once its events are on their way.
+        if (waiting_events.empty())
+        {
+            m_file_sent_until_.store(file_ready, std::memory_order_release);
+        }
+
+        // A port was plugged in or removed. Pick up any new ones that we were asked for.
+        const auto port_changes = midi_reader->getPortChangeCount();
+        if (port_changes != seen_port_changes)
+        {
+            seen_port_changes = port_changes;
+            if (!m_port_configs_.empty())
+            {
+                connect_matching_ports(*midi_reader, input_ports);
+            }
+        }
+
+        // Only passes that did something are sent, so an idle reader does not fill the ring.
+        if (m_reader_telemetry_ && (received || sent > 0))
+        {
+            auto record = telemetry_record();
+            record.m_busy_ns = telemetry_source::nanoseconds_since(pass_start);
+            record.m_events = sent;
+            record.m_queue_depth = waiting_events.size();
+            m_reader_telemetry_->push(record);
+        }
+
+        // The reader kept up, so wait a little for the next message.
+        if (!received && waiting_events.empty())
+        {
+            // Nothing to do, so don't spin a core waiting for it.
+            const auto silent = m_voice_count_.load(std::memory_order_relaxed) == 0;
+            std::this_thread::sleep_for(silent ? idle_poll_interval : active_poll_interval);
+        }
+
+        quit = m_quit_requested_.load(std::memory_order_acquire);
+
+        // With nothing but the file to listen to, stop once all of it has played and rung out.
+        if (input_ports.empty() && file_sent && m_pending_events_.load(std::memory_order_acquire) == 0 &&
+            m_voice_count_.load(std::memory_order_relaxed) == 0)
+        {
+            std::cout << "Finished playing " << m_file_path_ << std::endl;
+            quit = true;
+        }
+    }
+
+    if (m_load_generator_)
+    {
+        m_load_generator_->stop();
     }
 
     midi_reader->closePort();
 
-    delete midi_reader;
+    if (m_latency_probe_)
+    {
+        m_latency_probe_->report("Midi load");
+    }
+
+    const auto dropped_messages = midi_reader->getDroppedMessageCount();
+    if (dropped_messages > 0)
+    {
+        std::cout << "Midi: " << dropped_messages << " messages dropped, input queue holds "
+            << midi_reader->getQueueCapacity() << "." << std::endl;
+    }
+
+    midi_reader.reset();
+
+    m_stats_.report("Midi");
+
+    const auto late_parts = m_sound_->get_engine().get_late_parts();
+    if (late_parts > 0)
+    {
+        std::cout << "Midi: " << late_parts << " parts left out of their buffer because a worker ran late." <<
+            std::endl;
+    }
 }
 
+/**
+ * \brief Gets the data pointer that needs to be passed to the callback function.
+ * \return Data pointer for the callback function. The driver itself.
+ */
 void* midi_driver::get_data()
 {
-    return &data_;
+    return this;
+}
+
+/**
+ * \brief Gets the callback that plays this driver.
+ * \return Callback to hand to the audio backend along with get_data.
+ */
+PaStreamCallback* midi_driver::get_callback() const
+{
+    return callback;
+}
+
+/**
+ * \brief Sends what the callback and the reader do to the telemetry. Has to be set before the driver starts.
+ * \param hub Telemetry to send to. Null for none.
+ */
+void midi_driver::set_telemetry(telemetry* hub)
+{
+    m_callback_telemetry_ = hub ? hub->add_source("midi") : nullptr;
+    m_reader_telemetry_ = hub ? hub->add_source("midi_reader") : nullptr;
+}
+
+/**
+ * \brief Changes the buffer layout the callback is handed from the one init picked. Has to be set after init and
+ * before the driver starts.
+ * \param non_interleaved If the buffers are one array per channel instead of interleaved frames.
+ */
+void midi_driver::set_buffer_layout(const bool non_interleaved)
+{
+    m_data_.non_interleaved = non_interleaved;
+}
+
+/**
+ * \brief Checks if the driver has what it needs to play the next buffer, which is once the reader has sent the file up
+ * to the end of it. Live input plays whenever it comes in, so it is never waited for.
+ * \param frames Frames in the next buffer.
+ * \return If the next buffer can be played.
+ */
+bool midi_driver::is_ready(const unsigned long frames) const
+{
+    if (m_file_path_.empty())
+    {
+        return true;
+    }
+
+    return m_file_sent_until_.load(std::memory_order_acquire) >=
+        m_sample_position_.load(std::memory_order_acquire) + frames;
+}
+
+/**
+ * \brief Moves the events the reader has sent into the heap. Called by the callback. When the heap is full the rest
+ * wait in the queue until some have played.
+ */
+void midi_driver::take_scheduled()
+{
+    scheduled_event event;
+    while (!m_schedule_.full() && m_event_queue_.pop(event))
+    {
+        m_schedule_.push(event);
+    }
+}
+
+/**
+ * \brief Finishes a pass of the callback. Counts a missed deadline if it finished after its buffer was due to play, and
+ * sends what it did to the telemetry, if there is any. Called by the callback.
+ * \param start When the callback started.
+ * \param deadline Seconds the callback had before its buffer played.
+ * \param frames Frames in the buffer.
+ * \param status_flags Status Port Audio handed to the callback.
+ * \param events Events the callback played.
+ */
+void midi_driver::finish_pass(const std::chrono::steady_clock::time_point start, const double deadline,
+                              const unsigned long frames, const PaStreamCallbackFlags status_flags,
+                              const uint32_t events)
+{
+    const auto busy_ns = telemetry_source::nanoseconds_since(start);
+    const auto missed = static_cast<double>(busy_ns) >= deadline * 1e9;
+    if (missed)
+    {
+        ++m_stats_.deadline_misses;
+    }
+
+    if (!m_callback_telemetry_)
+    {
+        return;
+    }
+
+    auto record = telemetry_record();
+    record.m_busy_ns = busy_ns;
+    record.m_deadline_ns = telemetry_source::deadline_nanoseconds(deadline);
+    record.m_deadline_missed = missed;
+    record.m_frames = static_cast<uint32_t>(frames);
+    record.m_voices = m_sound_->get_engine().get_voice_count();
+    record.m_events = events;
+    record.m_queue_depth = m_pending_events_.load(std::memory_order_relaxed);
+    record.m_xrun = telemetry_source::is_xrun(status_flags);
+    m_callback_telemetry_->push(record);
+}
+
+/**
+ * \brief Sets which controllers and programs change the driver settings.
+ * \param map Controllers and programs to use. Picked up by the next message.
+ */
+void midi_driver::set_control_map(const midi_control_map& map)
+{
+    m_control_map_ = map;
+    if (m_sound_)
+    {
+        m_sound_->set_control_map(map);
+    }
 }
 
 /**
- * \brief Calculates the note that corresponds to the note given values.
- * \param note Note value that determines what frequency will be played.
- * \param volume Volume that the note should be played at.
- * \return Note that corresponds to the given values.
+ * \brief Sets the ports that the driver opens. Every port whose name contains one of the patterns is opened, and
+ * ports that show up later are opened when they appear.
+ * \param ports Ports to open. When empty the user is asked to pick one.
  */
-note_data midi_driver::calculate_note(const uint8_t note, const uint8_t volume)
+void midi_driver::set_ports(const std::vector<midi_port_config>& ports)
 {
-    assert(note < frequencies_vector.size());
+    m_port_configs_ = ports;
+}
 
-    auto volume_float = 1.0f;
-    if (dynamic_note_volume)
+/**
+ * \brief Sets a generator that plays into the driver while it runs, and a probe to time the notes with. The
+ * generator is started once the ports are open and stopped when the driver quits. The probe is reported on exit.
+ * \param generator Generator to run, or null for none. Its port has to be opened by name with set_ports.
+ * \param probe Probe the generator stamps, or null for none.
+ */
+void midi_driver::set_load(midi_load_generator* generator, midi_latency_probe* probe)
+{
+    m_load_generator_ = generator;
+    m_latency_probe_ = probe;
+    if (m_sound_)
+    {
+        m_sound_->set_latency_probe(probe);
+    }
+}
+
+/**
+ * \brief Sets a Standard MIDI File to play along with the input. It is loaded by init, and played from the start every
+ * time the driver runs. When no ports are asked for, the driver plays the file on its own and quits at the end.
+ * \param path Path of the file. Empty for none.
+ * \param start_seconds Where in the file to start playing.
+ */
+void midi_driver::set_file(const std::string& path, const double start_seconds)
+{
+    assert(start_seconds >= 0.0);
+    m_file_path_ = path;
+    m_file_start_seconds_ = start_seconds;
+}
+
+/**
+ * \brief Sets how many samples every part renders between updates of the envelopes and gains. Has to be set before
+ * init.
+ * \param period Samples between control ticks. 0 keeps the default.
+ */
+void midi_driver::set_control_period(const uint32_t period)
+{
+    m_control_period_ = period;
+}
+
+/**
+ * \brief Connects every port that matches a requested pattern and is not already connected. Ports that have gone away
+ * are disconnected and forgotten so that they are connected again if they come back.
+ * \param midi_reader Reader to connect the ports to.
+ * \param input_ports Ports that are already connected. Updated with the ports that were connected.
+ */
+void midi_driver::connect_matching_ports(RtMidiIn& midi_reader, std::vector<midi_input_port>& input_ports)
+{
+    std::vector<std::string> port_names;
+    for (uint32_t i = 0; i < midi_reader.getPortCount(); ++i)
     {
-        volume_float = static_cast<float>(volume) / max_volume_value;
+        try
+        {
+            port_names.push_back(midi_reader.getPortName(i));
+        }
+        catch (RtMidiError& error)
+        {
+            error.printMessage();
+            port_names.emplace_back();
+        }
     }
-    assert(volume_float >= 0.0f && volume_float <= 1.0f);
 
-    // Make a note that will last forever.
-    return note_data(frequencies_vector[note], 0.0, -1, volume_float, midi_current_wave);
+    input_ports.erase(std::remove_if(input_ports.begin(), input_ports.end(), [&](const midi_input_port& port)
+    {
+        if (std::find(port_names.begin(), port_names.end(), port.m_name) != port_names.end())
+        {
+            return false;
+        }
+
+        midi_reader.disconnectPort(port.m_source);
+        std::cout << "Disconnected Midi port: " << port.m_name << std::endl;
+        return true;
+    }), input_ports.end());
+
+    for (uint32_t i = 0; i < port_names.size(); ++i)
+    {
+        const auto& name = port_names[i];
+        const auto connected = std::any_of(input_ports.begin(), input_ports.end(), [&](const midi_input_port& port)
+        {
+            return port.m_name == name;
+        });
+
+        if (name.empty() || connected)
+        {
+            continue;
+        }
+
+        for (const auto& config : m_port_configs_)
+        {
+            if (name.find(config.m_pattern) == std::string::npos)
+            {
+                continue;
+            }
+
+            try
+            {
+                const auto source = midi_reader.connectPort(i);
+                input_ports.push_back(midi_input_port{source, name, config.m_channel_map, midi_parser()});
+                std::cout << "Connected Midi port: " << name << std::endl;
+            }
+            catch (RtMidiError& error)
+            {
+                error.printMessage();
+            }
+            break;
+        }
+    }
 }
+
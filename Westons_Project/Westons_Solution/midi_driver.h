@@ -1,12 +1,46 @@
 #pragma once
 
-#include "src/sound/sound_utilities.h"
-#include "src/sound/note_data.h"
+#include "sound_driver.h"
+#include "src/midi/midi_synth.h"
+#include "src/midi/midi_file.h"
+#include "src/utilities/fixed_heap.h"
+#include "src/utilities/spsc_queue.h"
 
-class midi_driver
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+class RtMidiIn;
+class midi_load_generator;
+class midi_latency_probe;
+class telemetry_source;
+struct midi_input_port;
+
+/**
+ * \brief A MIDI input port to open, picked by name, and the channel each of its channels plays on.
+ */
+struct midi_port_config
+{
+    explicit midi_port_config(const std::string& pattern, int channel = -1);
+
+    // Ports whose name contains this are opened.
+    std::string m_pattern;
+
+    const static uint8_t num_channels = 16;
+
+    // Channel that each incoming channel is moved to.
+    std::array<uint8_t, num_channels> m_channel_map;
+};
+
+class midi_driver : public sound_driver
 {
 public:
-    static bool init(sound_utilities::callback_data& data);
+    midi_driver();
+
+    bool init(sound_utilities::callback_data& data) override;
 
     static int callback(const void* input_buffer, void* output_buffer,
                         unsigned long frames_per_buffer,
@@ -14,12 +48,107 @@ public:
                         PaStreamCallbackFlags status_flags,
                         void* user_data);
 
-    static void processor();
+    void processor() override;
+
+    void* get_data() override;
 
-    static void* get_data();
+    PaStreamCallback* get_callback() const override;
+
+    void set_telemetry(telemetry* hub) override;
+
+    void set_buffer_layout(bool non_interleaved) override;
+
+    bool is_ready(unsigned long frames) const override;
+
+    void set_control_map(const midi_control_map& map);
+
+    void set_ports(const std::vector<midi_port_config>& ports);
+
+    void set_load(midi_load_generator* generator, midi_latency_probe* probe);
+
+    void set_file(const std::string& path, double start_seconds);
+
+    void set_control_period(uint32_t period);
 
 private:
-    static note_data calculate_note(uint8_t note, uint8_t volume);
+    /**
+     * \brief An event waiting for the sample it plays on.
+     */
+    struct scheduled_event
+    {
+        uint64_t m_sample;
+
+        // Order the event was read in, so events on the same sample play in the order they came.
+        uint64_t m_sequence;
+
+        midi_event m_event;
+    };
+
+    // Puts the event that should play first on top of the heap.
+    struct later_event
+    {
+        bool operator()(const scheduled_event& left, const scheduled_event& right) const
+        {
+            return left.m_sample != right.m_sample ? left.m_sample > right.m_sample : left.m_sequence > right.m_sequence;
+        }
+    };
+
+    // Most events that can be on their way from the reader to the callback.
+    const static uint32_t event_queue_capacity = 1024;
+
+    void connect_matching_ports(RtMidiIn& midi_reader, std::vector<midi_input_port>& input_ports);
+
+    void take_scheduled();
+
+    void finish_pass(std::chrono::steady_clock::time_point start, double deadline, unsigned long frames,
+                     PaStreamCallbackFlags status_flags, uint32_t events);
+
+    sound_utilities::callback_data m_data_;
+
+    bool m_initialized_;
+    sound_utilities::callback_stats m_stats_;
+
+    // Ports to open by name. When empty the user picks one port.
+    std::vector<midi_port_config> m_port_configs_;
+
+    // Synthetic load to play into the driver, and the probe that times it. Both optional.
+    midi_load_generator* m_load_generator_;
+    midi_latency_probe* m_latency_probe_;
+
+    // Settings for the synth, kept until init makes it. A control period of 0 keeps the synth default.
+    midi_control_map m_control_map_;
+    uint32_t m_control_period_;
+
+    // Plays every part. Made by init so its workers only start when the driver is used. Only the callback changes it.
+    std::unique_ptr<midi_synth> m_sound_;
+
+    // File to play along with the input, loaded once the sample rate is known. Optional. The reader sends its events
+    // to the callback a little ahead of time.
+    std::string m_file_path_;
+    double m_file_start_seconds_;
+    midi_file m_file_;
+
+    // Events from the ports and the file, on their way from the reader to the callback.
+    spsc_queue<scheduled_event, event_queue_capacity> m_event_queue_;
+
+    // Events the callback is waiting to play, soonest on top. Only touched by the callback.
+    const static uint32_t max_scheduled_events;
+    fixed_heap<scheduled_event, later_event> m_schedule_;
+
+    // Samples played since the driver started. Written by the callback, and read by the reader to place events.
+    std::atomic<uint64_t> m_sample_position_;
+
+    // Sample the file has been sent to the callback up to. Every sample once the whole file has been sent.
+    std::atomic<uint64_t> m_file_sent_until_;
+
+    // Events that have been read but not played yet.
+    std::atomic<uint32_t> m_pending_events_;
+
+    // Notes playing as of the last callback, and if the quit controller has been played. Written by the callback.
+    std::atomic<uint32_t> m_voice_count_;
+    std::atomic<bool> m_quit_requested_;
 
-    static sound_utilities::callback_data data_;
+    // Where the callback and the reader send what they did. Optional.
+    telemetry_source* m_callback_telemetry_;
+    telemetry_source* m_reader_telemetry_;
 };
@@ -1,14 +1,20 @@
 #include "passthrough_driver.h"
 #include "src/Audio Driver/audio_driver.h"
+#include "src/utilities/startup_timer.h"
+#include "src/utilities/telemetry.h"
+#include "src/utilities/trace_profiler.h"
 
 #include <memory>
 #include <cassert>
 #include <iostream>
 #include <chrono>
 
-sound_utilities::callback_data passthrough_driver::data_ = sound_utilities::callback_data();
-
-static bool passthrough_initialized = false;
+passthrough_driver::passthrough_driver() :
+    m_data_(sound_utilities::callback_data()),
+    m_initialized_(false),
+    m_telemetry_(nullptr)
+{
+}
 
 /**
  * \brief Checks if the driver can be run at this time, and fills out the callback data.
@@ -28,9 +34,9 @@ bool passthrough_driver::init(sound_utilities::callback_data& data)
     data.sample_rate = sound_utilities::default_sample_rate;
 
     // Looks good. Lets get our stuff setup.
-    data_ = data;
+    m_data_ = data;
 
-    passthrough_initialized = true;
+    m_initialized_ = true;
     return true;
 }
 
@@ -41,7 +47,7 @@ bool passthrough_driver::init(sound_utilities::callback_data& data)
 * \param frames_per_buffer Number of frames in each buffer.
 * \param time_info The time that the input values were captured, and the time the output values will be played.
 * \param status_flags Status bits that detail the current state of the streams.
-* \param user_data Pointer to some data that the callback expects. default_callback_data.
+* \param user_data The driver that is playing.
 * \return If the passthrough worked correctly. 0 for success, !0 for failure.
 */
 int passthrough_driver::callback(const void* input_buffer, void* output_buffer,
@@ -50,27 +56,39 @@ int passthrough_driver::callback(const void* input_buffer, void* output_buffer,
                                  PaStreamCallbackFlags status_flags,
                                  void* user_data)
 {
-    // stop warnings by casting to void.
-    static_cast<void>(status_flags);
-    static_cast<void>(time_info);
-
     // Make sure it isn't null.
     assert(user_data);
 
-    // Get the data pointer.
-    const auto data = static_cast<sound_utilities::callback_data*>(user_data);
+    TRACE_THREAD("audio callback");
+    TRACE_SCOPE("passthrough callback");
+
+    // Get the driver, and the data that we care about.
+    const auto* driver = static_cast<const passthrough_driver*>(user_data);
+    const auto data = &driver->m_data_;
 
     assert(data->num_input_channels == 1);
     assert(data->num_output_channels == 1);
-    assert(passthrough_initialized);
+    assert(driver->m_initialized_);
+
+    // Whatever comes in goes straight out, so the first callback is the first sound.
+    startup_timer::mark_callback();
+    startup_timer::mark_audible();
 
-    // Do some checks for time.
-    const auto alloted_time = time_info->outputBufferDacTime - time_info->currentTime;
-    const auto start_time = std::chrono::system_clock::now();
+    // Time we have before the buffer plays. A late wakeup can leave none, which counts as a missed deadline.
+    const auto alloted_time = sound_utilities::time_to_output(time_info, frames_per_buffer, data->sample_rate);
+    const auto busy_start = std::chrono::steady_clock::now();
+    if (driver->m_telemetry_)
+    {
+        driver->m_telemetry_->begin_pass();
+    }
 
-    // Get the parts we care about ready.
-    auto* out = static_cast<float*>(output_buffer);
-    const auto* input = static_cast<const float*>(input_buffer);
+    // Get the parts we care about ready. There is only the one channel, so either layout is one array of samples.
+    auto* out = data->non_interleaved
+                    ? static_cast<float* const*>(output_buffer)[0]
+                    : static_cast<float*>(output_buffer);
+    const auto* input = data->non_interleaved
+                            ? static_cast<const float* const*>(input_buffer)[0]
+                            : static_cast<const float*>(input_buffer);
 
     uint64_t tracker = 0;
     for (unsigned int i = 0; i < frames_per_buffer; i++)
@@ -82,10 +100,16 @@ int passthrough_driver::callback(const void* input_buffer, void* output_buffer,
     // Just a saftey to moke sure that we actually did fill up the channels.
     assert(tracker == frames_per_buffer * data->num_output_channels);
 
-    // See that we fulfiled the time requirements.
-    std::chrono::duration<double> elapsed_time = std::chrono::system_clock::now() - start_time;
-    const auto elapsed_seconds = elapsed_time.count();
-    assert(elapsed_seconds < alloted_time);
+    if (driver->m_telemetry_)
+    {
+        auto record = telemetry_record();
+        record.m_busy_ns = telemetry_source::nanoseconds_since(busy_start);
+        record.m_deadline_ns = telemetry_source::deadline_nanoseconds(alloted_time);
+        record.m_deadline_missed = static_cast<double>(record.m_busy_ns) >= alloted_time * 1e9;
+        record.m_frames = static_cast<uint32_t>(frames_per_buffer);
+        record.m_xrun = telemetry_source::is_xrun(status_flags);
+        driver->m_telemetry_->push(record);
+    }
 
     return 0;
 }
@@ -96,7 +120,7 @@ int passthrough_driver::callback(const void* input_buffer, void* output_buffer,
 void passthrough_driver::processor()
 {
     // If we were never initialized, quit.
-    if (!passthrough_initialized)
+    if (!m_initialized_)
     {
         std::cout << "Passthrough Driver was not initialized. Quitting driver." << std::endl;
         return;
@@ -115,9 +139,48 @@ void passthrough_driver::processor()
 
 /**
  * \brief Gets the data pointer that needs to be passed to the callback function.
- * \return Data pointer for the callback function.
+ * \return Data pointer for the callback function. The driver itself.
  */
 void* passthrough_driver::get_data()
 {
-    return &data_;
+    return this;
+}
+
+/**
+ * \brief Gets the callback that plays this driver.
+ * \return Callback to hand to the audio backend along with get_data.
+ */
+PaStreamCallback* passthrough_driver::get_callback() const
+{
+    return callback;
+}
+
+/**
+ * \brief Sends what the callback does to the telemetry. Has to be set before the driver starts.
+ * \param hub Telemetry to send to. Null for none.
+ */
+void passthrough_driver::set_telemetry(telemetry* hub)
+{
+    m_telemetry_ = hub ? hub->add_source("passthrough") : nullptr;
+}
+
+/**
+ * \brief Changes the buffer layout the callback is handed from the one init picked. Has to be set after init and
+ * before the driver starts.
+ * \param non_interleaved If the buffers are one array per channel instead of interleaved frames.
+ */
+void passthrough_driver::set_buffer_layout(const bool non_interleaved)
+{
+    m_data_.non_interleaved = non_interleaved;
+}
+
+/**
+ * \brief Checks if the driver has what it needs to play the next buffer. Input is all there is, so it always does.
+ * \param frames Frames in the next buffer.
+ * \return True.
+ */
+bool passthrough_driver::is_ready(const unsigned long frames) const
+{
+    static_cast<void>(frames);
+    return true;
 }
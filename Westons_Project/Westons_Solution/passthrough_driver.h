@@ -1,11 +1,15 @@
 #pragma once
 
-#include "src/sound/sound_utilities.h"
+#include "sound_driver.h"
 
-class passthrough_driver
+class telemetry_source;
+
+class passthrough_driver : public sound_driver
 {
 public:
-    static bool init(sound_utilities::callback_data& data);
+    passthrough_driver();
+
+    bool init(sound_utilities::callback_data& data) override;
 
     static int callback(const void* input_buffer, void* output_buffer,
                         unsigned long frames_per_buffer,
@@ -13,10 +17,23 @@ public:
                         PaStreamCallbackFlags status_flags,
                         void* user_data);
 
-    static void processor();
+    void processor() override;
+
+    void* get_data() override;
+
+    PaStreamCallback* get_callback() const override;
 
-    static void* get_data();
+    void set_telemetry(telemetry* hub) override;
+
+    void set_buffer_layout(bool non_interleaved) override;
+
+    bool is_ready(unsigned long frames) const override;
 
 private:
-    static sound_utilities::callback_data data_;
+    sound_utilities::callback_data m_data_;
+
+    bool m_initialized_;
+
+    // Where the callback sends what it did. Optional.
+    telemetry_source* m_telemetry_;
 };
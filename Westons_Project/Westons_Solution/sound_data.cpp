@@ -1,72 +1,393 @@
 #include "sound_data.h"
+#include "src/utilities/trace_profiler.h"
+#include <algorithm>
 #include <cassert>
+#include <cmath>
+
+const uint32_t sound_data::max_block_size = 256;
+const uint32_t sound_data::max_channels;
+const uint32_t sound_data::max_voices = 256;
+
+sound_data::sound_data() :
+    m_notes(max_voices),
+    m_note_volume(1.0f),
+    m_master_volume_(1.0f),
+    m_channel_buffer_(max_channels * max_block_size, 0.0f),
+    m_channel_pointers_(max_channels, nullptr),
+    m_offset_pointers_(max_channels, nullptr),
+    m_lane_buffer_(max_block_size * voice_filter_group::lane_count, 0.0f),
+    m_gain_buffer_(max_block_size, 0.0f)
+{
+    for (uint32_t channel = 0; channel < max_channels; ++channel)
+    {
+        m_channel_pointers_[channel] = m_channel_buffer_.data() + channel * max_block_size;
+    }
+}
 
 /**
- * \brief Adds the given note to the sound.
+ * \brief Adds the given note to the sound. It starts playing on the next control tick. When max_voices are already
+ * playing, the oldest released note is cut off to make room, or the oldest note if none have been released.
  * \param new_note Note added to the sound.
  */
 void sound_data::add_note(const note_data& new_note)
 {
-    m_notes.emplace_back(new_note);
+    if (m_notes.full())
+    {
+        const auto released = std::find_if(m_notes.begin(), m_notes.end(), [](const note_data& note)
+        {
+            return note.m_envelope.is_released();
+        });
+        m_notes.erase(released != m_notes.end() ? released : m_notes.begin());
+    }
+
+    m_notes.push_back(new_note);
     calculate_note_volume();
 }
 
 /**
- * \brief Removes all the notes with the given frequency from the sound.
- * \param frequency Frequency of the notes to remove from the sound.
+ * \brief Releases all the notes with the given frequency. They stay in the sound until their envelope has finished.
+ * \param frequency Frequency of the notes to release.
  */
 void sound_data::remove_notes(const float frequency)
 {
-    std::vector<note_data> reap_notes;
-
-    // Iterate over our list and reap what needs reaping.
-    for (const auto& note : m_notes)
+    for (auto& note : m_notes)
     {
         if (note.m_frequency == frequency)
         {
-            reap_notes.push_back(note);
+            note.m_envelope.note_off();
         }
     }
+}
 
-    for (auto reap_note : reap_notes)
+/**
+ * \brief Releases every note in the sound.
+ */
+void sound_data::release_all()
+{
+    for (auto& note : m_notes)
     {
-        m_notes.remove(reap_note);
+        note.m_envelope.note_off();
     }
+}
 
-    calculate_note_volume();
+/**
+ * \brief Renders the next block of all the notes in the sound, each panned across the channels. Control values are
+ * updated on every control tick inside the block, and notes are advanced at audio rate in between.
+ * \param channels One contiguous buffer per channel. Overwritten with the rendered samples.
+ * \param num_channels Number of channels to render. Cannot be more than max_channels.
+ * \param num_samples Number of samples to render. Cannot be more than max_block_size.
+ * \param sample_rate Sample rate of the sound.
+ */
+void sound_data::render(float* const* channels, const uint32_t num_channels, const uint32_t num_samples,
+                        const int sample_rate)
+{
+    assert(num_channels > 0 && num_channels <= max_channels);
+    assert(num_samples <= max_block_size);
+
+    auto* offset_channels = m_offset_pointers_.data();
+
+    uint32_t rendered = 0;
+    while (rendered < num_samples)
+    {
+        if (m_control_clock_.tick_due())
+        {
+            TRACE_SCOPE("control tick");
+            control_tick(num_channels, sample_rate);
+        }
+
+        // Only render up to the next tick.
+        const auto count = std::min(num_samples - rendered, m_control_clock_.samples_until_tick());
+        for (uint32_t channel = 0; channel < num_channels; ++channel)
+        {
+            offset_channels[channel] = channels[channel] + rendered;
+        }
+        {
+            TRACE_SCOPE("render period");
+            render_period(offset_channels, num_channels, count, sample_rate);
+        }
+
+        m_control_clock_.advance(count);
+        rendered += count;
+    }
 }
 
 /**
- * \brief Processes all of the contained notes in the sound. If any notes duration drops below 0, it is removed.
+ * \brief Renders the next block into buffers owned by the sound. Use when the output is not laid out per channel.
+ * \param num_channels Number of channels to render. Cannot be more than max_channels.
+ * \param num_samples Number of samples to render. Cannot be more than max_block_size.
+ * \param sample_rate Sample rate of the sound.
+ * \return One buffer per channel holding the rendered samples. Valid until the next call to render.
+ */
+const float* const* sound_data::render(const uint32_t num_channels, const uint32_t num_samples, const int sample_rate)
+{
+    render(m_channel_pointers_.data(), num_channels, num_samples, sample_rate);
+    return m_channel_pointers_.data();
+}
+
+/**
+ * \brief Checks if there is anything left to play. Released notes count until they have gone silent.
+ * \return If rendering would only produce silence.
+ */
+bool sound_data::is_silent() const
+{
+    return m_notes.empty();
+}
+
+/**
+ * \brief Sets how many samples are rendered between control ticks.
+ * \param period Number of samples between ticks.
+ */
+void sound_data::set_control_period(const uint32_t period)
+{
+    m_control_clock_.set_period(period);
+}
+
+const control_clock& sound_data::get_control_clock() const
+{
+    return m_control_clock_;
+}
+
+/**
+ * \brief Sets the volume that is applied to the whole sound. Ramps to the new volume over one control period.
+ * \param volume Volume of the sound. 0.0 <-> 1.0
+ */
+void sound_data::set_master_volume(const float volume)
+{
+    assert(volume >= 0.0f && volume <= 1.0f);
+    m_master_volume_ = volume;
+}
+
+float sound_data::get_master_volume() const
+{
+    return m_master_volume_;
+}
+
+/**
+ * \brief Does everything that only needs to happen once a control period. Durations are counted down, silent notes
+ * are reaped, and each notes envelope, gain, and filter are moved to where they should be at the next tick.
+ * \param num_channels Number of channels the notes are panned across.
  * \param sample_rate Sample rate of the sound. Used to calculate time advancement.
- * \param num_samples Number of samples processed since last process call. Used to calculate time advancement.
  */
-void sound_data::process(const int sample_rate, const int num_samples)
+void sound_data::control_tick(const uint32_t num_channels, const int sample_rate)
 {
-    std::vector<note_data> reap_notes;
+    const auto period = m_control_clock_.get_period();
+    const auto period_milliseconds = 1000.0f * static_cast<float>(period) / static_cast<float>(sample_rate);
 
-    // Go through all of the notes and advance their duration
     for (auto& note : m_notes)
     {
         // Only care about positive timed notes.
         if (note.m_duration > 0.0f)
         {
-            // Subtract away the milliseconds that passed.
-            note.m_duration -= 1000.0f * static_cast<float>(num_samples) / static_cast<float>(sample_rate);
+            // Subtract away the milliseconds that will pass this period.
+            note.m_duration -= period_milliseconds;
             if (note.m_duration < 0.0f)
             {
-                reap_notes.push_back(note);
+                note.m_envelope.note_off();
             }
         }
     }
 
-    // Remove them after the processing block.
-    for (auto reap_note : reap_notes)
+    // Reap the notes that have finished and already ramped down to silence.
+    const auto note_count = m_notes.size();
+    m_notes.remove_if([](const note_data& note)
+    {
+        return note.m_envelope.is_finished() && note.m_gain_target == 0.0f;
+    });
+
+    if (m_notes.size() != note_count)
     {
-        m_notes.remove(reap_note);
+        TRACE_SCOPE("note volume");
+        calculate_note_volume();
     }
 
-    calculate_note_volume();
+    for (auto& note : m_notes)
+    {
+        // Land exactly on last periods target so rounding never builds up.
+        note.m_gain = note.m_gain_target;
+        note.m_gain_target = note.m_envelope.advance(period, sample_rate) * note.m_volume * m_note_volume *
+            m_master_volume_;
+        note.m_gain_step = (note.m_gain_target - note.m_gain) / static_cast<float>(period);
+
+        note.m_filter_state.update(note.m_filter, sample_rate);
+
+        // Constant power pan between the two channels on either side of the notes position.
+        if (num_channels == 1)
+        {
+            note.m_pan_channel = 0;
+            note.m_pan_gains[0] = 1.0f;
+            note.m_pan_gains[1] = 0.0f;
+        }
+        else
+        {
+            const auto position = (note.m_pan + 1.0f) * 0.5f * static_cast<float>(num_channels - 1);
+            note.m_pan_channel = std::min(static_cast<uint32_t>(position), num_channels - 2);
+            const auto fraction = position - static_cast<float>(note.m_pan_channel);
+            note.m_pan_gains[0] = std::cos(fraction * sound_utilities::pi * 0.5f);
+            note.m_pan_gains[1] = std::sin(fraction * sound_utilities::pi * 0.5f);
+        }
+    }
+}
+
+/**
+ * \brief Renders part of a control period. Notes are rendered and filtered four at a time, one per lane of the filter
+ * group, then each lane is panned into its pair of channels. Groups with nothing filtered skip the lanes, and each
+ * note is rendered on its own and panned straight into the channels.
+ * \param channels One buffer per channel to render into.
+ * \param num_channels Number of channels.
+ * \param num_samples Number of samples to render. Cannot go past the next control tick.
+ * \param sample_rate Sample rate of the sound.
+ */
+void sound_data::render_period(float* const* channels, const uint32_t num_channels, const uint32_t num_samples,
+                               const int sample_rate)
+{
+    const auto lane_count = voice_filter_group::lane_count;
+    auto* lanes = m_lane_buffer_.data();
+
+    for (uint32_t channel = 0; channel < num_channels; ++channel)
+    {
+        std::fill(channels[channel], channels[channel] + num_samples, 0.0f);
+    }
+
+    auto note_iterator = m_notes.begin();
+    while (note_iterator != m_notes.end())
+    {
+        // Pull out the next group of notes.
+        note_data* group[lane_count];
+        uint32_t group_size = 0;
+        auto filtered = false;
+        while (group_size < lane_count && note_iterator != m_notes.end())
+        {
+            group[group_size] = &*note_iterator;
+            filtered = filtered || note_iterator->m_filter_state.m_mix != 0.0f;
+            ++group_size;
+            ++note_iterator;
+        }
+
+        // Nothing to filter, so there is no need to interleave the notes. Each one reuses the start of the lanes.
+        if (!filtered)
+        {
+            for (uint32_t lane = 0; lane < group_size; ++lane)
+            {
+                std::fill(lanes, lanes + num_samples, 0.0f);
+                render_note(*group[lane], lanes, 1, num_samples, sample_rate);
+                pan_note(*group[lane], lanes, 1, channels, num_channels, num_samples);
+            }
+            continue;
+        }
+
+        std::fill(lanes, lanes + num_samples * lane_count, 0.0f);
+        for (uint32_t lane = 0; lane < lane_count; ++lane)
+        {
+            if (lane < group_size)
+            {
+                render_note(*group[lane], lanes + lane, lane_count, num_samples, sample_rate);
+                m_filter_group_.load(lane, group[lane]->m_filter_state);
+            }
+            else
+            {
+                m_filter_group_.clear(lane);
+            }
+        }
+
+        m_filter_group_.process(lanes, num_samples);
+        for (uint32_t lane = 0; lane < group_size; ++lane)
+        {
+            m_filter_group_.store(lane, group[lane]->m_filter_state);
+        }
+
+        // Pan each lane into its channels.
+        for (uint32_t lane = 0; lane < group_size; ++lane)
+        {
+            pan_note(*group[lane], lanes + lane, lane_count, channels, num_channels, num_samples);
+        }
+    }
+}
+
+/**
+ * \brief Adds a rendered note into its pair of channels.
+ * \param note Note that was rendered. Its pan picks the channels and gains.
+ * \param samples First sample of the note.
+ * \param stride Distance between samples of the note.
+ * \param channels One buffer per channel to add into.
+ * \param num_channels Number of channels.
+ * \param num_samples Number of samples to add.
+ */
+void sound_data::pan_note(const note_data& note, const float* samples, const uint32_t stride, float* const* channels,
+                          const uint32_t num_channels, const uint32_t num_samples)
+{
+    const auto first_gain = note.m_pan_gains[0];
+    auto* first_channel = channels[note.m_pan_channel];
+    for (uint32_t i = 0; i < num_samples; ++i)
+    {
+        first_channel[i] += samples[i * stride] * first_gain;
+    }
+
+    // Mono, or panned hard to one side.
+    if (num_channels == 1 || note.m_pan_gains[1] == 0.0f)
+    {
+        return;
+    }
+
+    const auto second_gain = note.m_pan_gains[1];
+    auto* second_channel = channels[note.m_pan_channel + 1];
+    for (uint32_t i = 0; i < num_samples; ++i)
+    {
+        second_channel[i] += samples[i * stride] * second_gain;
+    }
+}
+
+/**
+ * \brief Renders one note and adds it into the output. Ramps the notes gain towards its target and advances its phase.
+ * \param note Note to render.
+ * \param output Buffer to add the note into.
+ * \param stride Distance between samples in the output.
+ * \param num_samples Number of samples to render.
+ * \param sample_rate Sample rate of the sound.
+ */
+void sound_data::render_note(note_data& note, float* output, const uint32_t stride, const uint32_t num_samples,
+                             const int sample_rate)
+{
+    auto* gains = m_gain_buffer_.data();
+
+    // Interpolate the control rate gain out to every sample.
+    const auto start_gain = note.m_gain;
+    const auto gain_step = note.m_gain_step;
+    for (uint32_t i = 0; i < num_samples; ++i)
+    {
+        gains[i] = start_gain + gain_step * static_cast<float>(i + 1);
+    }
+    note.m_gain = start_gain + gain_step * static_cast<float>(num_samples);
+
+    const std::vector<float>* table;
+    switch (note.m_wave)
+    {
+    case sound_utilities::sine:
+        table = &sound_utilities::wave_lookup_tables.sine;
+        break;
+    case sound_utilities::square:
+        table = &sound_utilities::wave_lookup_tables.square;
+        break;
+    case sound_utilities::triangle:
+        table = &sound_utilities::wave_lookup_tables.triangle;
+        break;
+    case sound_utilities::sawtooth:
+        table = &sound_utilities::wave_lookup_tables.sawtooth;
+        break;
+    default:
+        assert(false); // We should never hit default.
+        table = &sound_utilities::wave_lookup_tables.sine;
+        break;
+    }
+
+    const auto phase_step = sound_utilities::two_pi * note.m_frequency / static_cast<float>(sample_rate);
+    for (uint32_t i = 0; i < num_samples; ++i)
+    {
+        output[i * stride] += (*table)[sound_utilities::phase_to_index(note.m_current_phase,
+                                                                        sound_utilities::table_size)] * gains[i];
+
+        // Advance the phase.
+        note.m_current_phase = sound_utilities::two_pi_wrapper(note.m_current_phase + phase_step);
+    }
 }
 
 /**
@@ -77,7 +398,7 @@ void sound_data::calculate_note_volume()
     auto max_volume = 1.0f;
 
     auto volume_sum = 0.0f;
-    for (auto note : m_notes)
+    for (const auto& note : m_notes)
     {
         volume_sum += note.m_volume;
     }
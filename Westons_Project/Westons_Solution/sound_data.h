@@ -1,21 +1,71 @@
 #pragma once
 #include "src/sound/note_data.h"
-#include <list>
+#include "src/sound/control_clock.h"
+#include "src/utilities/fixed_vector.h"
+#include <vector>
 
 class sound_data
 {
 public:
+    sound_data();
+
     void add_note(const note_data& new_note);
 
     void remove_notes(float frequency);
 
-    void process(int sample_rate, int num_samples);
+    void release_all();
+
+    void render(float* const* channels, uint32_t num_channels, uint32_t num_samples, int sample_rate);
+
+    const float* const* render(uint32_t num_channels, uint32_t num_samples, int sample_rate);
+
+    bool is_silent() const;
+
+    void set_control_period(uint32_t period);
+
+    const control_clock& get_control_clock() const;
+
+    void set_master_volume(float volume);
+
+    float get_master_volume() const;
+
+    // Most samples that can be rendered in one call to render.
+    const static uint32_t max_block_size;
+
+    // Most channels that can be rendered at once.
+    const static uint32_t max_channels = 8;
 
-    // List of all the notes currently in the sound.
-    std::list<note_data> m_notes;
+    // Most notes that can play at once. Adding another takes over an old one.
+    const static uint32_t max_voices;
+
+    // All the notes currently in the sound, oldest first. Set aside up front so adding a note never allocates.
+    fixed_vector<note_data> m_notes;
 
     float m_note_volume;
 
 private:
+    void control_tick(uint32_t num_channels, int sample_rate);
+
     void calculate_note_volume();
+
+    void render_period(float* const* channels, uint32_t num_channels, uint32_t num_samples, int sample_rate);
+
+    void render_note(note_data& note, float* output, uint32_t stride, uint32_t num_samples, int sample_rate);
+
+    static void pan_note(const note_data& note, const float* samples, uint32_t stride, float* const* channels,
+                         uint32_t num_channels, uint32_t num_samples);
+
+    control_clock m_control_clock_;
+
+    // Volume applied on top of every note. Picked up on the next control tick.
+    float m_master_volume_;
+
+    voice_filter_group m_filter_group_;
+
+    // Scratch space for rendering. Sized once so the callback never allocates.
+    std::vector<float> m_channel_buffer_;
+    std::vector<float*> m_channel_pointers_;
+    std::vector<float*> m_offset_pointers_;
+    std::vector<float> m_lane_buffer_;
+    std::vector<float> m_gain_buffer_;
 };
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "src/sound/sound_utilities.h"
+
+class telemetry;
+
+/**
+ * \brief Something that makes sound through a Port Audio style callback. The driver is handed to its callback as the
+ * user data, and its processor runs on the main thread until the driver is told to quit.
+ */
+class sound_driver
+{
+public:
+    virtual ~sound_driver() = default;
+
+    virtual bool init(sound_utilities::callback_data& data) = 0;
+
+    virtual void processor() = 0;
+
+    virtual void* get_data() = 0;
+
+    virtual PaStreamCallback* get_callback() const = 0;
+
+    virtual void set_telemetry(telemetry* hub) = 0;
+
+    virtual void set_buffer_layout(bool non_interleaved) = 0;
+
+    virtual bool is_ready(unsigned long frames) const = 0;
+};
@@ -0,0 +1,18 @@
+#pragma once
+#include <string>
+
+/**
+ * \brief Something that drives a callback with audio buffers. Either real hardware through Port Audio, or a stand in
+ * that runs the callback on its own clock.
+ */
+class audio_backend
+{
+public:
+    virtual ~audio_backend() = default;
+
+    virtual bool start() = 0;
+
+    virtual bool stop() = 0;
+
+    virtual std::string get_error() const = 0;
+};
@@ -2,6 +2,31 @@
 #include <cassert>
 #include <iostream>
 
+#ifdef __linux__
+#include <pa_linux_alsa.h>
+#include <sys/mman.h>
+#endif
+
+bool audio_driver::null_device_ = false;
+std::string audio_driver::device_name_;
+bool audio_driver::realtime_ = false;
+
+// Channels reported for the null device.
+static const int32_t null_device_output_channels = 2;
+
+port_audio_session::port_audio_session() :
+    m_initialized_(Pa_Initialize() == paNoError)
+{
+}
+
+port_audio_session::~port_audio_session()
+{
+    if (m_initialized_)
+    {
+        Pa_Terminate();
+    }
+}
+
 /**
  * \brief Constructor for an audio driver that can have some number of input and output channels.
  */
@@ -28,6 +53,15 @@ audio_driver::audio_driver(const sound_utilities::callback_info info):
     assert(info.m_callback_data.sample_rate != 0);
     m_sample_rate_ = info.m_callback_data.sample_rate;
 
+    // Callbacks that want one buffer per channel get them non interleaved.
+    m_sample_format_ = paFloat32;
+    if (info.m_callback_data.non_interleaved)
+    {
+        m_sample_format_ |= paNonInterleaved;
+    }
+
+    m_frames_per_buffer_ = info.m_callback_data.frames_per_buffer;
+
     // Need to have an actual callback.
     assert(info.m_callback != nullptr);
     m_stream_callback_ = info.m_callback;
@@ -65,9 +99,15 @@ bool audio_driver::start()
         // Save the pointer so that we can keep track of it till the driver goes away.
         m_input_params_ = new PaStreamParameters;
 
-        // Use the default device. This is the system default set in the OS.
-        const auto default_device_index = Pa_GetDefaultInputDevice();
+        // Use the device that was asked for, or the system default set in the OS.
+        const auto default_device_index = find_device(true);
         const auto default_device_info = Pa_GetDeviceInfo(default_device_index);
+        if (!default_device_info)
+        {
+            m_error_string_ = "No input device matches " + device_name_;
+            Pa_Terminate();
+            return false;
+        }
 
         // This should never be negative.
         assert(default_device_info->maxInputChannels > 0);
@@ -79,7 +119,7 @@ bool audio_driver::start()
         // Set the params to the values that we expect.
         m_input_params_->device = default_device_index;
         m_input_params_->channelCount = m_input_channels_;
-        m_input_params_->sampleFormat = paFloat32;
+        m_input_params_->sampleFormat = m_sample_format_;
         m_input_params_->suggestedLatency = default_device_info->defaultHighInputLatency;
         m_input_params_->hostApiSpecificStreamInfo = nullptr;
     }
@@ -103,9 +143,15 @@ bool audio_driver::start()
         // Save the pointer so that we can keep track of it till the driver goes away.
         m_output_params_ = new PaStreamParameters;
 
-        // Use the default device. This is the aux jack.
-        const auto default_device_index = Pa_GetDefaultOutputDevice();
+        // Use the device that was asked for, or the default device. This is the aux jack.
+        const auto default_device_index = find_device(false);
         const auto default_device_info = Pa_GetDeviceInfo(default_device_index);
+        if (!default_device_info)
+        {
+            m_error_string_ = "No output device matches " + device_name_;
+            Pa_Terminate();
+            return false;
+        }
 
         // This should never be negative.
         assert(default_device_info->maxOutputChannels > 0);
@@ -117,7 +163,7 @@ bool audio_driver::start()
         // Set the params to the values that we expect.
         m_output_params_->device = default_device_index;
         m_output_params_->channelCount = m_output_channels_;
-        m_output_params_->sampleFormat = paFloat32;
+        m_output_params_->sampleFormat = m_sample_format_;
         m_output_params_->suggestedLatency = default_device_info->defaultHighOutputLatency;
         m_output_params_->hostApiSpecificStreamInfo = nullptr;
     }
@@ -130,7 +176,7 @@ bool audio_driver::start()
 
     // Open the stream to the default hardware devices.
     const auto err = Pa_OpenStream(&m_stream_, m_input_params_, m_output_params_,
-                                   m_sample_rate_, paFramesPerBufferUnspecified, paNoFlag,
+                                   m_sample_rate_, m_frames_per_buffer_, paNoFlag,
                                    m_stream_callback_, m_data_);
 
     if (error_detected(err))
@@ -138,6 +184,16 @@ bool audio_driver::start()
         return false;
     }
 
+#ifdef __linux__
+    // Only ALSA streams can be switched to real time scheduling.
+    const auto* stream_device = Pa_GetDeviceInfo(m_output_params_ ? m_output_params_->device :
+                                                     m_input_params_->device);
+    if (realtime_ && Pa_GetHostApiInfo(stream_device->hostApi)->type == paALSA)
+    {
+        PaAlsa_EnableRealtimeScheduling(m_stream_, 1);
+    }
+#endif
+
     // Start the stream up.
     if (error_detected(Pa_StartStream(m_stream_)))
     {
@@ -221,6 +277,11 @@ bool audio_driver::check_channels(const int32_t required_input, const int32_t re
         return true;
     }
 
+    if (null_device_)
+    {
+        return required_input <= 0 && required_output <= null_device_output_channels;
+    }
+
     if (Pa_Initialize() != paNoError)
     {
         return false;
@@ -230,26 +291,26 @@ bool audio_driver::check_channels(const int32_t required_input, const int32_t re
 
     if (required_input > 0)
     {
-        // Get the default input device and see if we can capture with the given data.
-        const auto input_device_index = Pa_GetDefaultInputDevice();
+        // Get the input device and see if we can capture with the given data.
+        const auto input_device_index = find_device(true);
         const auto input_device = Pa_GetDeviceInfo(input_device_index);
 
         if (!input_device || input_device->maxInputChannels < required_input)
         {
-            std::cout << "No input channels are available on the default capture device." << std::endl;
+            std::cout << "No input channels are available on the capture device." << std::endl;
             passed = false;
         }
     }
 
     if (required_output > 0)
     {
-        // Get the default device and see if we can play with the given data.
-        const auto output_device_index = Pa_GetDefaultOutputDevice();
+        // Get the output device and see if we can play with the given data.
+        const auto output_device_index = find_device(false);
         const auto output_device = Pa_GetDeviceInfo(output_device_index);
 
         if (!output_device || output_device->maxOutputChannels < 0)
         {
-            std::cout << "No output channels are available on the default playback device." << std::endl;
+            std::cout << "No output channels are available on the playback device." << std::endl;
             passed = false;
         }
     }
@@ -259,6 +320,96 @@ bool audio_driver::check_channels(const int32_t required_input, const int32_t re
     return passed;
 }
 
+/**
+ * \brief Gets the number of output channels that the playback device has.
+ * \return Number of output channels. 0 if there is no device.
+ */
+int32_t audio_driver::max_output_channels()
+{
+    if (null_device_)
+    {
+        return null_device_output_channels;
+    }
+
+    if (Pa_Initialize() != paNoError)
+    {
+        return 0;
+    }
+
+    const auto output_device = Pa_GetDeviceInfo(find_device(false));
+    const auto channels = output_device ? output_device->maxOutputChannels : 0;
+
+    Pa_Terminate();
+
+    return channels;
+}
+
+/**
+ * \brief Makes the device checks describe a stand in device instead of asking Port Audio. Used when callbacks are run
+ * by the null audio driver, so drivers can be set up on a machine with no sound hardware.
+ * \param null_device If the stand in device should be used.
+ */
+void audio_driver::set_null_device(const bool null_device)
+{
+    null_device_ = null_device;
+}
+
+/**
+ * \brief Picks the device that streams are opened on, for both input and output.
+ * \param name Part of the device name. The first device whose name contains it is used. Empty for the system default.
+ */
+void audio_driver::set_device(const std::string& name)
+{
+    device_name_ = name;
+}
+
+/**
+ * \brief Asks for real time scheduling on the audio thread, and keeps the program in memory so the callback never
+ * waits on a page fault. Needs permission to lock memory and raise priority, usually from limits.conf.
+ * \param realtime If real time scheduling should be used.
+ * \return False if memory could not be locked. Streams still ask for real time scheduling.
+ */
+bool audio_driver::set_realtime(const bool realtime)
+{
+    realtime_ = realtime;
+
+#ifdef __linux__
+    if (realtime)
+    {
+        return mlockall(MCL_CURRENT | MCL_FUTURE) == 0;
+    }
+    munlockall();
+#endif
+
+    return true;
+}
+
+/**
+ * \brief Finds the device to use. Port Audio has to be initialized.
+ * \param input If the device is for capture, otherwise playback.
+ * \return Index of the device. paNoDevice if none match the name.
+ */
+PaDeviceIndex audio_driver::find_device(const bool input)
+{
+    if (device_name_.empty())
+    {
+        return input ? Pa_GetDefaultInputDevice() : Pa_GetDefaultOutputDevice();
+    }
+
+    const auto device_count = Pa_GetDeviceCount();
+    for (PaDeviceIndex i = 0; i < device_count; ++i)
+    {
+        const auto* device = Pa_GetDeviceInfo(i);
+        const auto channels = input ? device->maxInputChannels : device->maxOutputChannels;
+        if (channels > 0 && std::string(device->name).find(device_name_) != std::string::npos)
+        {
+            return i;
+        }
+    }
+
+    return paNoDevice;
+}
+
 /**
  * \brief Checks if an error has been detected. If an error is detected stores the error message.
  * \param error Error code returned from a call to some Port Audio method.
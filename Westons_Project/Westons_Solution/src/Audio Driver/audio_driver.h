@@ -3,25 +3,61 @@
 #include <string>
 #include <memory>
 #include "../sound/sound_utilities.h"
+#include "audio_backend.h"
+
+/**
+ * \brief Keeps Port Audio initialized while it is alive. Port Audio counts initializations, so every driver check and
+ * stream start made inside a session skips scanning the devices again.
+ */
+class port_audio_session
+{
+public:
+    port_audio_session();
+    ~port_audio_session();
+
+    port_audio_session(const port_audio_session&) = delete;
+    port_audio_session& operator=(const port_audio_session&) = delete;
+
+private:
+    bool m_initialized_;
+};
 
 /**
  * \brief Class used to interact with the Port Audio library.
  */
-class audio_driver
+class audio_driver : public audio_backend
 {
 public:
     explicit audio_driver(sound_utilities::callback_info info);
-    ~audio_driver() = default;
+    ~audio_driver() override = default;
 
-    bool start();
+    bool start() override;
 
-    bool stop();
+    bool stop() override;
 
-    std::string get_error() const;
+    std::string get_error() const override;
 
     static bool check_channels(int32_t required_input, int32_t required_output);
 
+    static int32_t max_output_channels();
+
+    static void set_null_device(bool null_device);
+
+    static void set_device(const std::string& name);
+
+    static bool set_realtime(bool realtime);
+
 private:
+    static PaDeviceIndex find_device(bool input);
+
+    // When set, the device checks describe a stereo output with no input instead of asking Port Audio.
+    static bool null_device_;
+
+    // Part of the name of the device to use. The system default when empty.
+    static std::string device_name_;
+
+    // When set, the stream asks for real time scheduling and memory is kept out of swap.
+    static bool realtime_;
 
     bool error_detected(const PaError& error);
 
@@ -31,6 +67,10 @@ private:
     uint32_t m_output_channels_;
     uint32_t m_sample_rate_;
 
+    PaSampleFormat m_sample_format_;
+
+    unsigned long m_frames_per_buffer_;
+
     PaStreamCallback* m_stream_callback_;
 
     PaStreamParameters* m_input_params_;
@@ -0,0 +1,195 @@
+#include "null_audio_driver.h"
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+
+const unsigned long null_audio_driver::default_frames_per_buffer = 256;
+
+/**
+ * \brief Constructor for a null driver that runs the given callback.
+ */
+null_audio_driver::null_audio_driver(const sound_utilities::callback_info& info) :
+    m_stream_callback_(info.m_callback),
+    m_data_(info.m_callback_data_ptr),
+    m_name_(info.m_callback_name),
+    m_running_(false),
+    m_callbacks_(0),
+    m_overruns_(0),
+    m_busy_time_(0),
+    m_longest_callback_(0),
+    m_buffer_period_(0)
+{
+    assert(m_stream_callback_ != nullptr);
+    assert(m_data_ != nullptr);
+
+    const auto& data = info.m_callback_data;
+    assert(data.num_input_channels >= 0 && data.num_output_channels >= 0);
+    assert(data.sample_rate > 0);
+
+    m_input_channels_ = data.num_input_channels;
+    m_output_channels_ = data.num_output_channels;
+    m_sample_rate_ = data.sample_rate;
+    m_non_interleaved_ = data.non_interleaved;
+    m_frames_per_buffer_ = data.frames_per_buffer == paFramesPerBufferUnspecified
+                               ? default_frames_per_buffer
+                               : data.frames_per_buffer;
+
+    // Input is always silent.
+    m_input_buffer_.assign(m_input_channels_ * m_frames_per_buffer_, 0.0f);
+    m_output_buffer_.assign(m_output_channels_ * m_frames_per_buffer_, 0.0f);
+    for (uint32_t channel = 0; channel < m_input_channels_; ++channel)
+    {
+        m_input_pointers_.push_back(m_input_buffer_.data() + channel * m_frames_per_buffer_);
+    }
+    for (uint32_t channel = 0; channel < m_output_channels_; ++channel)
+    {
+        m_output_pointers_.push_back(m_output_buffer_.data() + channel * m_frames_per_buffer_);
+    }
+}
+
+null_audio_driver::~null_audio_driver()
+{
+    stop();
+}
+
+/**
+ * \brief Starts calling the callback. If it is already running, does nothing.
+ * \return If the driver started.
+ */
+bool null_audio_driver::start()
+{
+    if (m_running_)
+    {
+        return true;
+    }
+
+    m_callbacks_ = 0;
+    m_overruns_ = 0;
+    m_busy_time_ = std::chrono::nanoseconds(0);
+    m_longest_callback_ = std::chrono::nanoseconds(0);
+    m_buffer_period_ = std::chrono::nanoseconds(1000000000ull * m_frames_per_buffer_ / m_sample_rate_);
+
+    m_running_ = true;
+    try
+    {
+        m_thread_ = std::thread(&null_audio_driver::run, this);
+    }
+    catch (const std::system_error& error)
+    {
+        m_running_ = false;
+        m_error_string_ = error.what();
+        return false;
+    }
+
+    m_error_string_ = "";
+    return true;
+}
+
+/**
+ * \brief Stops calling the callback and reports how busy it was. If it is not running, does nothing.
+ * \return If the driver stopped.
+ */
+bool null_audio_driver::stop()
+{
+    if (!m_running_)
+    {
+        return true;
+    }
+
+    m_running_ = false;
+    m_thread_.join();
+    report();
+    return true;
+}
+
+/**
+ * \brief Gets the error that was last reported on a failed start or stop.
+ * \return Error that was last reported.
+ */
+std::string null_audio_driver::get_error() const
+{
+    return m_error_string_;
+}
+
+/**
+ * \brief Calls the callback once per buffer period until stopped. Falls behind instead of catching up when the
+ * callback runs long, the way a sound card would underrun.
+ */
+void null_audio_driver::run()
+{
+    const void* input = nullptr;
+    if (m_input_channels_ > 0)
+    {
+        input = m_non_interleaved_
+                    ? static_cast<const void*>(m_input_pointers_.data())
+                    : static_cast<const void*>(m_input_buffer_.data());
+    }
+
+    void* output = nullptr;
+    if (m_output_channels_ > 0)
+    {
+        output = m_non_interleaved_
+                     ? static_cast<void*>(m_output_pointers_.data())
+                     : static_cast<void*>(m_output_buffer_.data());
+    }
+
+    // The callbacks work out how long they have from the time stamps, so they get the ones a card would give.
+    const auto stream_start = std::chrono::steady_clock::now();
+    const auto seconds_since_start = [stream_start](const std::chrono::steady_clock::time_point time)
+    {
+        return std::chrono::duration<double>(time - stream_start).count();
+    };
+    const auto period_seconds = std::chrono::duration<double>(m_buffer_period_).count();
+
+    auto next_buffer = stream_start;
+    while (m_running_)
+    {
+        std::this_thread::sleep_until(next_buffer);
+
+        const auto start = std::chrono::steady_clock::now();
+        PaStreamCallbackTimeInfo time_info;
+        time_info.currentTime = seconds_since_start(start);
+        time_info.inputBufferAdcTime = seconds_since_start(next_buffer) - period_seconds;
+        time_info.outputBufferDacTime = seconds_since_start(next_buffer) + period_seconds;
+
+        const auto result = m_stream_callback_(input, output, m_frames_per_buffer_, &time_info, 0, m_data_);
+        const auto busy = std::chrono::steady_clock::now() - start;
+
+        ++m_callbacks_;
+        m_busy_time_ += busy;
+        m_longest_callback_ = std::max(m_longest_callback_,
+                                       std::chrono::duration_cast<std::chrono::nanoseconds>(busy));
+
+        next_buffer += m_buffer_period_;
+        if (busy > m_buffer_period_)
+        {
+            // The card would have run dry, so start over from now.
+            ++m_overruns_;
+            next_buffer = std::chrono::steady_clock::now();
+        }
+
+        if (result != paContinue)
+        {
+            break;
+        }
+    }
+}
+
+/**
+ * \brief Prints how much of the buffer period the callback used.
+ */
+void null_audio_driver::report() const
+{
+    if (m_callbacks_ == 0)
+    {
+        return;
+    }
+
+    const auto period = static_cast<double>(m_buffer_period_.count());
+    const auto average_load = static_cast<double>(m_busy_time_.count()) / m_callbacks_ / period;
+    const auto peak_load = static_cast<double>(m_longest_callback_.count()) / period;
+
+    std::cout << m_name_ << " (null audio): " << m_callbacks_ << " callbacks of " << m_frames_per_buffer_
+        << " frames, average load " << average_load * 100.0 << "%, peak load " << peak_load * 100.0
+        << "%, headroom " << (1.0 - peak_load) * 100.0 << "%, " << m_overruns_ << " overruns." << std::endl;
+}
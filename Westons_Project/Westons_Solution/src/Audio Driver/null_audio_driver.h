@@ -0,0 +1,62 @@
+#pragma once
+#include "audio_backend.h"
+#include "../sound/sound_utilities.h"
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * \brief Runs a callback on its own thread at the pace a sound card would, without any hardware. The output is thrown
+ * away. Reports how much of each buffer period the callback used, so load can be measured on machines with no sound.
+ */
+class null_audio_driver : public audio_backend
+{
+public:
+    explicit null_audio_driver(const sound_utilities::callback_info& info);
+    ~null_audio_driver() override;
+
+    bool start() override;
+
+    bool stop() override;
+
+    std::string get_error() const override;
+
+    // Buffer size used when the callback lets the host pick.
+    const static unsigned long default_frames_per_buffer;
+
+private:
+    void run();
+
+    void report() const;
+
+    PaStreamCallback* m_stream_callback_;
+    void* m_data_;
+    std::string m_name_;
+
+    uint32_t m_input_channels_;
+    uint32_t m_output_channels_;
+    uint32_t m_sample_rate_;
+    bool m_non_interleaved_;
+    unsigned long m_frames_per_buffer_;
+
+    // Buffers handed to the callback.
+    std::vector<float> m_input_buffer_;
+    std::vector<float> m_output_buffer_;
+    std::vector<const float*> m_input_pointers_;
+    std::vector<float*> m_output_pointers_;
+
+    std::thread m_thread_;
+    std::atomic<bool> m_running_;
+
+    // Time spent in the callback, against the time a buffer lasts.
+    uint64_t m_callbacks_;
+    uint64_t m_overruns_;
+    std::chrono::nanoseconds m_busy_time_;
+    std::chrono::nanoseconds m_longest_callback_;
+    std::chrono::nanoseconds m_buffer_period_;
+
+    std::string m_error_string_;
+};
@@ -0,0 +1,412 @@
+#include "simulated_audio_driver.h"
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+#include <sstream>
+
+const unsigned long simulated_audio_driver::default_frames_per_buffer = 256;
+
+// How often an unpaced card looks to see if the driver is ready for the next buffer.
+static const std::chrono::microseconds ready_poll_interval(100);
+
+simulated_audio_driver::settings::settings() :
+    m_callbacks(0),
+    m_paced(false),
+    m_latency_buffers(2),
+    m_jitter(0),
+    m_underflow_every(0),
+    m_slow_every(0),
+    m_slow_time(0),
+    m_charge_callback_time(false),
+    m_seed(1)
+{
+}
+
+/**
+ * \brief Constructor for a simulated driver that runs the given callback.
+ * \param info Callback to run and the stream it expects.
+ * \param simulation How the simulated card behaves.
+ */
+simulated_audio_driver::simulated_audio_driver(const sound_utilities::callback_info& info,
+                                               const settings& simulation) :
+    m_stream_callback_(info.m_callback),
+    m_data_(info.m_callback_data_ptr),
+    m_ready_(info.m_ready_method),
+    m_name_(info.m_callback_name),
+    m_settings_(simulation),
+    m_running_(false),
+    m_callbacks_(0),
+    m_underflows_(0),
+    m_injected_underflows_(0),
+    m_slow_callbacks_(0),
+    m_buffer_period_(0),
+    m_simulated_time_(0),
+    m_latency_total_(0),
+    m_latency_min_(0),
+    m_latest_wakeup_(0),
+    m_busy_time_(0),
+    m_longest_callback_(0),
+    m_deadline_misses_(0)
+{
+    assert(m_stream_callback_ != nullptr);
+    assert(m_data_ != nullptr);
+
+    const auto& data = info.m_callback_data;
+    assert(data.num_input_channels >= 0 && data.num_output_channels >= 0);
+    assert(data.sample_rate > 0);
+
+    m_input_channels_ = data.num_input_channels;
+    m_output_channels_ = data.num_output_channels;
+    m_sample_rate_ = data.sample_rate;
+    m_non_interleaved_ = data.non_interleaved;
+    m_frames_per_buffer_ = data.frames_per_buffer == paFramesPerBufferUnspecified
+                               ? default_frames_per_buffer
+                               : data.frames_per_buffer;
+    m_settings_.m_latency_buffers = std::max(1u, m_settings_.m_latency_buffers);
+
+    // Input is always silent.
+    m_input_buffer_.assign(m_input_channels_ * m_frames_per_buffer_, 0.0f);
+    m_output_buffer_.assign(m_output_channels_ * m_frames_per_buffer_, 0.0f);
+    for (uint32_t channel = 0; channel < m_input_channels_; ++channel)
+    {
+        m_input_pointers_.push_back(m_input_buffer_.data() + channel * m_frames_per_buffer_);
+    }
+    for (uint32_t channel = 0; channel < m_output_channels_; ++channel)
+    {
+        m_output_pointers_.push_back(m_output_buffer_.data() + channel * m_frames_per_buffer_);
+    }
+}
+
+simulated_audio_driver::~simulated_audio_driver()
+{
+    stop();
+}
+
+/**
+ * \brief Starts the simulated card from the beginning of its clock. If it is already running, does nothing.
+ * \return If the driver started.
+ */
+bool simulated_audio_driver::start()
+{
+    if (m_running_)
+    {
+        return true;
+    }
+
+    // Every start plays out the same, so a run can be repeated without making a new driver.
+    m_random_.seed(m_settings_.m_seed);
+    m_callbacks_ = 0;
+    m_underflows_ = 0;
+    m_injected_underflows_ = 0;
+    m_slow_callbacks_ = 0;
+    m_buffer_period_ = std::chrono::nanoseconds(1000000000ull * m_frames_per_buffer_ / m_sample_rate_);
+    m_simulated_time_ = std::chrono::nanoseconds(0);
+    m_latency_total_ = std::chrono::nanoseconds(0);
+    m_latency_min_ = std::chrono::nanoseconds(0);
+    m_latest_wakeup_ = std::chrono::nanoseconds(0);
+    m_busy_time_ = std::chrono::nanoseconds(0);
+    m_longest_callback_ = std::chrono::nanoseconds(0);
+    m_deadline_misses_ = 0;
+
+    m_running_ = true;
+    try
+    {
+        m_thread_ = std::thread(&simulated_audio_driver::run, this);
+    }
+    catch (const std::system_error& error)
+    {
+        m_running_ = false;
+        m_error_string_ = error.what();
+        return false;
+    }
+
+    m_error_string_ = "";
+    return true;
+}
+
+/**
+ * \brief Stops calling the callback and reports what happened on the card. If it is not running, does nothing.
+ * \return If the driver stopped.
+ */
+bool simulated_audio_driver::stop()
+{
+    if (!m_running_)
+    {
+        return true;
+    }
+
+    m_running_ = false;
+    m_thread_.join();
+    report();
+    return true;
+}
+
+/**
+ * \brief Gets the error that was last reported on a failed start or stop.
+ * \return Error that was last reported.
+ */
+std::string simulated_audio_driver::get_error() const
+{
+    return m_error_string_;
+}
+
+/**
+ * \brief Reads settings from a comma separated list, such as "callbacks=2000,jitter=1.5,slow=100:20". Times are in
+ * milliseconds.
+ *
+ * callbacks=N stops after N callbacks. paced waits for the wall clock. latency=N holds N buffers. jitter=MS makes
+ * wakeups late by up to MS. underflow=N flags every nth callback. slow=N:MS makes every nth callback take MS longer.
+ * charge adds the real callback time to the clock. seed=N seeds the jitter.
+ * \param text Settings to read.
+ * \param simulation Filled with the settings read, on top of what it already held. Left alone if any are bad.
+ * \return If every setting could be read.
+ */
+bool simulated_audio_driver::from_string(const std::string& text, settings& simulation)
+{
+    const auto to_time = [](const std::string& milliseconds)
+    {
+        const auto value = std::stod(milliseconds);
+        if (value < 0.0)
+        {
+            throw std::invalid_argument(milliseconds);
+        }
+        return std::chrono::nanoseconds(static_cast<int64_t>(value * 1000000.0));
+    };
+
+    const auto to_count = [](const std::string& count)
+    {
+        const auto value = std::stoll(count);
+        if (value < 0)
+        {
+            throw std::invalid_argument(count);
+        }
+        return static_cast<uint64_t>(value);
+    };
+
+    auto result = simulation;
+    std::istringstream items(text);
+    std::string item;
+    while (std::getline(items, item, ','))
+    {
+        const auto split = item.find('=');
+        const auto name = item.substr(0, split);
+        const auto value = split == std::string::npos ? std::string() : item.substr(split + 1);
+
+        try
+        {
+            if (name == "paced" && value.empty())
+            {
+                result.m_paced = true;
+            }
+            else if (name == "charge" && value.empty())
+            {
+                result.m_charge_callback_time = true;
+            }
+            else if (name == "callbacks")
+            {
+                result.m_callbacks = to_count(value);
+            }
+            else if (name == "latency")
+            {
+                result.m_latency_buffers = static_cast<uint32_t>(std::max<uint64_t>(1, to_count(value)));
+            }
+            else if (name == "jitter")
+            {
+                result.m_jitter = to_time(value);
+            }
+            else if (name == "underflow")
+            {
+                result.m_underflow_every = static_cast<uint32_t>(to_count(value));
+            }
+            else if (name == "slow")
+            {
+                const auto every = value.find(':');
+                if (every == std::string::npos)
+                {
+                    return false;
+                }
+                result.m_slow_every = static_cast<uint32_t>(to_count(value.substr(0, every)));
+                result.m_slow_time = to_time(value.substr(every + 1));
+            }
+            else if (name == "seed")
+            {
+                result.m_seed = static_cast<uint32_t>(to_count(value));
+            }
+            else if (!name.empty())
+            {
+                return false;
+            }
+        }
+        catch (...)
+        {
+            return false;
+        }
+    }
+
+    simulation = result;
+    return true;
+}
+
+/**
+ * \brief Plays buffers against the simulated clock until stopped, the callback asks to finish, or the set number of
+ * callbacks have run.
+ */
+void simulated_audio_driver::run()
+{
+    const void* input = nullptr;
+    if (m_input_channels_ > 0)
+    {
+        input = m_non_interleaved_
+                    ? static_cast<const void*>(m_input_pointers_.data())
+                    : static_cast<const void*>(m_input_buffer_.data());
+    }
+
+    void* output = nullptr;
+    if (m_output_channels_ > 0)
+    {
+        output = m_non_interleaved_
+                     ? static_cast<void*>(m_output_pointers_.data())
+                     : static_cast<void*>(m_output_buffer_.data());
+    }
+
+    const auto period = m_buffer_period_;
+    const auto latency = period * m_settings_.m_latency_buffers;
+    const auto jitter_range = static_cast<uint64_t>(std::max<int64_t>(0, m_settings_.m_jitter.count()));
+
+    // When buffers are due counts from the buffer after the last underrun. The first is due a period in, so the input
+    // it is handed was captured at 0.
+    auto timeline = period;
+    uint64_t timeline_buffer = 0;
+
+    // When the callback is done with the last buffer, and free for the next.
+    auto free_at = std::chrono::nanoseconds(0);
+
+    PaStreamCallbackFlags pending_flags = 0;
+    const auto real_start = std::chrono::steady_clock::now();
+
+    for (uint64_t buffer = 0; m_running_; ++buffer)
+    {
+        if (m_settings_.m_callbacks > 0 && buffer >= m_settings_.m_callbacks)
+        {
+            break;
+        }
+
+        // Without the wall clock to keep to, the buffers would race past the driver before it has sent them anything.
+        if (!m_settings_.m_paced && m_ready_)
+        {
+            while (m_running_ && !m_ready_(m_frames_per_buffer_))
+            {
+                std::this_thread::sleep_for(ready_poll_interval);
+            }
+
+            if (!m_running_)
+            {
+                break;
+            }
+        }
+
+        // Raw engine output is the same everywhere, unlike the standard distributions, so the jitter is too.
+        const auto due = timeline + period * static_cast<int64_t>(buffer - timeline_buffer);
+        const auto dac_time = due + latency;
+        const auto late = std::chrono::nanoseconds(jitter_range == 0 ? 0 : m_random_() % (jitter_range + 1));
+        const auto wakeup = std::max(due + late, free_at);
+        m_latest_wakeup_ = std::max(m_latest_wakeup_, wakeup - due);
+
+        if (m_settings_.m_paced)
+        {
+            std::this_thread::sleep_until(real_start + (wakeup - period));
+        }
+
+        PaStreamCallbackTimeInfo time_info;
+        time_info.inputBufferAdcTime = to_seconds(due - period);
+        time_info.currentTime = to_seconds(wakeup);
+        time_info.outputBufferDacTime = to_seconds(dac_time);
+
+        auto flags = pending_flags;
+        pending_flags = 0;
+        if (m_settings_.m_underflow_every > 0 && (buffer + 1) % m_settings_.m_underflow_every == 0)
+        {
+            flags |= paOutputUnderflow;
+            ++m_injected_underflows_;
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        const auto result = m_stream_callback_(input, output, m_frames_per_buffer_, &time_info, flags, m_data_);
+        const auto busy = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() -
+            start);
+
+        // How long the callback really took, against the simulated time it had before its buffer played.
+        const auto allotted = dac_time - wakeup;
+        ++m_callbacks_;
+        m_busy_time_ += busy;
+        m_longest_callback_ = std::max(m_longest_callback_, busy);
+        m_deadline_misses_ += busy > allotted ? 1 : 0;
+        m_latency_total_ += allotted;
+        m_latency_min_ = m_callbacks_ == 1 ? allotted : std::min(m_latency_min_, allotted);
+
+        auto taken = std::chrono::nanoseconds(0);
+        if (m_settings_.m_slow_every > 0 && (buffer + 1) % m_settings_.m_slow_every == 0)
+        {
+            taken += m_settings_.m_slow_time;
+            ++m_slow_callbacks_;
+        }
+        if (m_settings_.m_charge_callback_time)
+        {
+            taken += busy;
+        }
+        free_at = wakeup + taken;
+        m_simulated_time_ = free_at;
+
+        if (free_at > dac_time)
+        {
+            // The card ran dry waiting for the buffer. It played silence, and starts over from when the buffer was done.
+            ++m_underflows_;
+            pending_flags |= paOutputUnderflow;
+            timeline = free_at;
+            timeline_buffer = buffer + 1;
+        }
+
+        if (result != paContinue)
+        {
+            break;
+        }
+    }
+}
+
+/**
+ * \brief Prints what happened on the simulated card, and how much of the time it gave the callback was used.
+ */
+void simulated_audio_driver::report() const
+{
+    if (m_callbacks_ == 0)
+    {
+        return;
+    }
+
+    const auto milliseconds = [](const std::chrono::nanoseconds time)
+    {
+        return to_seconds(time) * 1000.0;
+    };
+
+    const auto period = static_cast<double>(m_buffer_period_.count());
+    const auto average_load = static_cast<double>(m_busy_time_.count()) / m_callbacks_ / period;
+    const auto peak_load = static_cast<double>(m_longest_callback_.count()) / period;
+
+    std::cout << m_name_ << " (simulated audio): " << m_callbacks_ << " callbacks of " << m_frames_per_buffer_
+        << " frames over " << to_seconds(m_simulated_time_) << " simulated seconds, latency average "
+        << milliseconds(m_latency_total_) / m_callbacks_ << " ms, lowest " << milliseconds(m_latency_min_)
+        << " ms, latest wakeup " << milliseconds(m_latest_wakeup_) << " ms, " << m_underflows_ << " underflows ("
+        << m_injected_underflows_ << " more injected), " << m_slow_callbacks_ << " slow callbacks." << std::endl;
+    std::cout << m_name_ << " (simulated audio): average load " << average_load * 100.0 << "%, peak load "
+        << peak_load * 100.0 << "%, " << m_deadline_misses_ << " callbacks took longer than they had." << std::endl;
+}
+
+/**
+ * \brief Turns simulated time into the seconds Port Audio time stamps are given in.
+ * \param time Simulated time.
+ * \return Seconds.
+ */
+double simulated_audio_driver::to_seconds(const std::chrono::nanoseconds time)
+{
+    return std::chrono::duration<double>(time).count();
+}
@@ -0,0 +1,125 @@
+#pragma once
+#include "audio_backend.h"
+#include "../sound/sound_utilities.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * \brief Runs a callback against a simulated sound card. Every callback is handed time stamps from a simulated clock,
+ * so a run plays out the same way every time it is given the same settings, on any machine and with no sound hardware.
+ * Late wakeups, underflows and a callback that runs long can all be injected to see how the drivers cope with them.
+ *
+ * Unless it is paced, the card runs a buffer as soon as the driver says it has what it needs to play it, so the
+ * commands a driver is sent land on the same buffers however fast the machine is.
+ *
+ * The card plays each buffer a set number of buffers after it was due to be written. A buffer that is not finished by
+ * the time it should play has run dry, so the next callback is flagged with paOutputUnderflow and the card starts over
+ * from when the late buffer was done, the way a real stream carries on after an underrun.
+ */
+class simulated_audio_driver : public audio_backend
+{
+public:
+    /**
+     * \brief How the simulated card behaves, and what goes wrong with it.
+     */
+    struct settings
+    {
+        settings();
+
+        // Callbacks to run before the card stops by itself. 0 runs until stopped.
+        uint64_t m_callbacks;
+
+        // When set, each callback waits for its simulated time on the wall clock. Otherwise callbacks run back to back,
+        // each one as soon as the driver is ready for it.
+        bool m_paced;
+
+        // Buffers the card holds between a buffer being due and it being played. At least 1.
+        uint32_t m_latency_buffers;
+
+        // Most a wakeup can be late by. Each wakeup is late by a random amount up to this.
+        std::chrono::nanoseconds m_jitter;
+
+        // Flag every nth callback with an underflow, whether or not one happened. 0 never does.
+        uint32_t m_underflow_every;
+
+        // Make every nth callback take this much longer, as if the callback ran long. 0 never does.
+        uint32_t m_slow_every;
+        std::chrono::nanoseconds m_slow_time;
+
+        // When set, the time the callback really takes is added to the simulated clock too. A slow build then runs
+        // dry the way it would on a card, at the cost of runs no longer being the same every time.
+        bool m_charge_callback_time;
+
+        // Seed for the jitter.
+        uint32_t m_seed;
+    };
+
+    simulated_audio_driver(const sound_utilities::callback_info& info, const settings& simulation);
+    ~simulated_audio_driver() override;
+
+    bool start() override;
+
+    bool stop() override;
+
+    std::string get_error() const override;
+
+    static bool from_string(const std::string& text, settings& simulation);
+
+    // Buffer size used when the callback lets the host pick.
+    const static unsigned long default_frames_per_buffer;
+
+private:
+    void run();
+
+    void report() const;
+
+    static double to_seconds(std::chrono::nanoseconds time);
+
+    PaStreamCallback* m_stream_callback_;
+    void* m_data_;
+    sound_utilities::callback_ready m_ready_;
+    std::string m_name_;
+    settings m_settings_;
+
+    uint32_t m_input_channels_;
+    uint32_t m_output_channels_;
+    uint32_t m_sample_rate_;
+    bool m_non_interleaved_;
+    unsigned long m_frames_per_buffer_;
+
+    // Buffers handed to the callback.
+    std::vector<float> m_input_buffer_;
+    std::vector<float> m_output_buffer_;
+    std::vector<const float*> m_input_pointers_;
+    std::vector<float*> m_output_pointers_;
+
+    std::thread m_thread_;
+    std::atomic<bool> m_running_;
+
+    // Picks how late each wakeup is. Only the thread touches it while running.
+    std::mt19937 m_random_;
+
+    // What happened on the simulated card.
+    uint64_t m_callbacks_;
+    uint64_t m_underflows_;
+    uint64_t m_injected_underflows_;
+    uint64_t m_slow_callbacks_;
+    std::chrono::nanoseconds m_buffer_period_;
+    std::chrono::nanoseconds m_simulated_time_;
+    std::chrono::nanoseconds m_latency_total_;
+    std::chrono::nanoseconds m_latency_min_;
+    std::chrono::nanoseconds m_latest_wakeup_;
+
+    // Time the callback really took, against the time it had before its buffer played.
+    std::chrono::nanoseconds m_busy_time_;
+    std::chrono::nanoseconds m_longest_callback_;
+    uint64_t m_deadline_misses_;
+
+    std::string m_error_string_;
+};
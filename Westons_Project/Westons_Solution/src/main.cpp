@@ -4,6 +4,8 @@
 // Port Audio Includes
 // All credit to: http://www.portaudio.com/
 #include "Audio Driver/audio_driver.h"
+#include "Audio Driver/null_audio_driver.h"
+#include "Audio Driver/simulated_audio_driver.h"
 
 // RtMidi
 // All credit to: http://www.music.mcgill.ca/~gary/rtmidi/
@@ -13,84 +15,727 @@
 #include "../passthrough_driver.h"
 #include "../generation_driver.h"
 #include "../midi_driver.h"
+#include "../driver_registry.h"
+#include "midi/midi_load_generator.h"
+#include "midi/midi_batch_renderer.h"
+#include "sound/golden_harness.h"
+#include "utilities/config_file.h"
+#include "utilities/startup_timer.h"
+#include "utilities/perf_counters.h"
+#include "utilities/telemetry.h"
+#include "utilities/trace_profiler.h"
 
-int main()
+#include <algorithm>
+#include <fstream>
+#include <memory>
+
+/**
+ * \brief Reads a midi port argument. Either a name, or a name and the channel (1 <-> 16) to move its messages to.
+ * \param argument Argument in the form name or name=channel.
+ * \return Config for the port.
+ */
+static midi_port_config parse_midi_port(const std::string& argument)
 {
-    std::cout << "Starting Up!" << std::endl;
+    const auto split = argument.rfind('=');
+    if (split == std::string::npos)
+    {
+        return midi_port_config(argument);
+    }
 
-    std::cout << std::endl << "Booting up Audio Driver" << std::endl;
+    int channel;
+    try
+    {
+        channel = std::stoi(argument.substr(split + 1));
+    }
+    catch (...)
+    {
+        channel = 0;
+    }
+
+    if (channel < 1 || channel > midi_port_config::num_channels)
+    {
+        std::cout << "Ignoring the channel for midi port " << argument << ", it should be 1 to 16." << std::endl;
+        return midi_port_config(argument.substr(0, split));
+    }
+
+    return midi_port_config(argument.substr(0, split), channel - 1);
+}
+
+/**
+ * \brief Prints every argument the program takes.
+ */
+static void print_usage()
+{
+    std::cout <<
+        "Arguments:\n"
+        "  --config FILE                  Read arguments from FILE first. The command line overrides them.\n"
+        "  --driver NAME                  Run a driver without asking: passthrough, generation, or midi.\n"
+        "  --device NAME                  Play on the audio device whose name contains NAME.\n"
+        "  --buffer FRAMES                Frames in each buffer.\n"
+        "  --buffer-layout LAYOUT         interleaved or non-interleaved.\n"
+        "  --latency-preset PRESET        power for bigger buffers and fewer wakeups, or default.\n"
+        "  --control-period SAMPLES       Samples between control ticks in the generation and midi drivers.\n"
+        "  --realtime                     Lock memory for real time audio.\n"
+        "  --null-audio                   Run the callbacks without sound hardware.\n"
+        "  --simulated-audio LIST         Run them against a simulated card, such as callbacks=2000,jitter=1.5,paced.\n"
+        "  --generation-script FILE       Commands for the frequency generator to read first. - reads a pipe.\n"
+        "  --control-socket PATH          Socket other programs can send generation commands to.\n"
+        "  --midi-port NAME[=CHANNEL]     Open a midi port by name, moving its messages to CHANNEL (1 to 16).\n"
+        "  --midi-controls LIST           Controllers that switch the midi settings, such as wave=70,quit=none.\n"
+        "  --midi-load KIND               Play synthetic midi: chords, glissando, or storm[:events].\n"
+        "  --play-midi FILE               Play a Standard MIDI File through the midi driver.\n"
+        "  --midi-start SECONDS           Where to start in the file.\n"
+        "  --render-midi FILE             Render a midi file to WAV instead of playing. Can be given more than once.\n"
+        "  --render-list FILE             Render every midi file listed in FILE, one per line.\n"
+        "  --render-dir DIR               Where rendered WAV files go.\n"
+        "  --render-threads N             Threads to render on. 0 is one per core.\n"
+        "  --golden-record DIR            Record golden references into DIR.\n"
+        "  --golden-check DIR             Check renders against the golden references in DIR.\n"
+        "  --golden-snr DB                Lowest signal to noise ratio a golden check passes at.\n"
+        "  --golden-spectral-snr DB       Lowest spectral signal to noise ratio a golden check passes at.\n"
+        "  --metrics FILE                 Write telemetry to FILE every second.\n"
+        "  --perf-counters                Count cycles and cache misses in the callbacks.\n"
+        "  --trace FILE                   Write a trace to FILE on exit.\n"
+        "  --trace-events N               Events each thread can record in the trace.\n"
+        "  --help                         Print this and exit." << std::endl;
+}
+
+/**
+ * \brief Settings that decide how a driver is run.
+ */
+struct run_settings
+{
+    // Run the callbacks without sound hardware.
+    bool m_null_audio = false;
+
+    // Run them against a simulated card instead, on its own clock and with any faults it is set to inject.
+    bool m_simulated_audio = false;
+    simulated_audio_driver::settings m_simulation;
+
+    // The power latency preset asks for bigger buffers so the audio thread wakes up less often. It is fixed for the
+    // run, idle or not.
+    bool m_power_preset = false;
+
+    // Frames in each buffer. 0 lets the driver pick.
+    unsigned long m_frames_per_buffer = 0;
+
+    // Buffer layout to ask for, one array per channel or interleaved frames. Only used when set, otherwise the driver
+    // picks.
+    bool m_layout_set = false;
+    bool m_non_interleaved = true;
+
+    // Where the drivers send what their real time threads do. Optional.
+    telemetry* m_telemetry = nullptr;
+};
 
-    // Get vector of all the callbacks that have been constructed.
-    std::vector<sound_utilities::callback_info> available_callbacks;
+/**
+ * \brief Makes the driver, sets it up and plays through it until its processor returns. Only the driver that is run
+ * gets to look at the devices.
+ * \param entry Driver to run.
+ * \param settings How to run it.
+ * \return True if the driver started and stopped cleanly.
+ */
+static bool run_driver(const driver_registry::entry& entry, const run_settings& settings)
+{
+    const auto driver = entry.m_create();
+    driver->set_telemetry(settings.m_telemetry);
 
-    // Passthrough
-    auto pass_call_data = sound_utilities::callback_data();
-    if (passthrough_driver::init(pass_call_data))
+    auto call_data = sound_utilities::callback_data();
+    if (!driver->init(call_data))
     {
-        const auto passthrough_info = sound_utilities::callback_info(passthrough_driver::callback, pass_call_data,
-                                                                     passthrough_driver::get_data(), "Passthrough",
-                                                                     passthrough_driver::processor);
-        available_callbacks.push_back(passthrough_info);
+        std::cout << entry.m_title << " Driver could not be initialized." << std::endl;
+        return false;
     }
-    else
+
+    if (settings.m_frames_per_buffer > 0)
+    {
+        call_data.frames_per_buffer = settings.m_frames_per_buffer;
+    }
+    // Passthrough keeps its small buffers so the monitoring delay stays short.
+    else if (settings.m_power_preset && entry.m_name != "passthrough")
+    {
+        call_data.frames_per_buffer = sound_utilities::power_preset_frames_per_buffer;
+    }
+
+    // The driver keeps its own copy of the layout from init, so it has to be told as well.
+    if (settings.m_layout_set)
     {
-        std::cout << "Passthrough Driver could not be initialized and will be disabled." << std::endl;
+        call_data.non_interleaved = settings.m_non_interleaved;
+        driver->set_buffer_layout(settings.m_non_interleaved);
     }
 
-    // Frequency Generator
-    auto gen_call_data = sound_utilities::callback_data();
-    if (generation_driver::init(gen_call_data))
+    auto* const driver_ptr = driver.get();
+    const auto info = sound_utilities::callback_info(driver->get_callback(), call_data, driver->get_data(),
+                                                     entry.m_title, [driver_ptr] { driver_ptr->processor(); },
+                                                     [driver_ptr](const unsigned long frames)
+                                                     {
+                                                         return driver_ptr->is_ready(frames);
+                                                     });
+
+    // Construct the backend
+    std::unique_ptr<audio_backend> backend;
+    if (settings.m_simulated_audio)
+    {
+        backend.reset(new simulated_audio_driver(info, settings.m_simulation));
+    }
+    else if (settings.m_null_audio)
     {
-        const auto frequency_gen_info = sound_utilities::callback_info(generation_driver::callback, gen_call_data,
-                                                                       generation_driver::get_data(),
-                                                                       "Frequency Generation",
-                                                                       generation_driver::processor);
-        available_callbacks.push_back(frequency_gen_info);
+        backend.reset(new null_audio_driver(info));
     }
     else
     {
-        std::cout << "Frequency Generation Driver could not be initialized and will be disabled." << std::endl;
+        backend.reset(new audio_driver(info));
     }
 
-    // Midi Reader
-    auto midi_call_data = sound_utilities::callback_data();
-    if (midi_driver::init(midi_call_data))
+    // Start it up!
+    if (!backend->start())
     {
-        const auto midi_gen_info = sound_utilities::callback_info(midi_driver::callback, midi_call_data,
-                                                                  midi_driver::get_data(), "Midi player",
-                                                                  midi_driver::processor);
-        available_callbacks.push_back(midi_gen_info);
+        std::cerr << "Failed to start [" << info.m_callback_name << "]" << std::endl << "Error: " +
+            backend->get_error() << std::endl;
+        return false;
     }
-    else
+
+    // Go into the method that processes the callback.
+    info.m_process_method();
+
+    // Stop the backend.
+    if (!backend->stop())
     {
-        std::cout << "Midi Driver could not be initialized and will be disabled." << std::endl;
+        std::cerr << "Failed to stop [" << info.m_callback_name << "]" << std::endl << "Error: " +
+            backend->get_error() << std::endl;
+        return false;
     }
 
-    auto quit = false;
+    return true;
+}
 
-    // If we have no drivers, quit out.
-    if (available_callbacks.empty())
+/**
+ * \brief Traces the run and writes the trace out when main returns, however it returns.
+ */
+class trace_session
+{
+public:
+    trace_session(const std::string& path, const uint32_t events_per_thread) :
+        m_path_(path)
     {
-        std::cout << "No drivers are currently enabled, exiting program" << std::endl;
-        quit = true;
+        if (m_path_.empty())
+        {
+            return;
+        }
 
-        // Assert here so that it will break instead of just exiting.
-        assert(false);
+#ifdef WESTONS_TRACE
+        trace_profiler::start(events_per_thread);
+        TRACE_THREAD("main");
+#else
+        static_cast<void>(events_per_thread);
+        std::cout << "Tracing was not built in, define WESTONS_TRACE to use --trace." << std::endl;
+        m_path_.clear();
+#endif
     }
-    else
+
+    ~trace_session()
+    {
+        if (m_path_.empty())
+        {
+            return;
+        }
+
+        trace_profiler::stop();
+        if (trace_profiler::write(m_path_))
+        {
+            std::cout << "Wrote trace to " << m_path_ << std::endl;
+        }
+        else
+        {
+            std::cout << "Could not write trace to " << m_path_ << std::endl;
+        }
+    }
+
+    trace_session(const trace_session&) = delete;
+    trace_session& operator=(const trace_session&) = delete;
+
+private:
+    std::string m_path_;
+};
+
+int main(const int argc, char* argv[])
+{
+    startup_timer::start();
+
+    std::cout << "Starting Up!" << std::endl;
+
+    // Settings from a config file come first so that the command line can override them.
+    std::vector<std::string> arguments;
+    for (auto i = 1; i + 1 < argc; ++i)
     {
-        // Initialize the program, and let the user know how to operate it.
-        std::cout << "Starting Audio Driver program." << std::endl;
+        if (std::string(argv[i]) == "--config" && !config_file::read(argv[i + 1], arguments))
+        {
+            std::cout << "Could not read config file " << argv[i + 1] << std::endl;
+        }
     }
+    arguments.insert(arguments.end(), argv + 1, argv + argc);
+    const auto num_arguments = arguments.size();
+
+    auto settings = run_settings();
+
+    // Driver to run without asking, and the device to play it on.
+    std::string driver_name;
+    std::string device_name;
+    auto realtime = false;
+
+    // Midi ports to open by name instead of asking.
+    std::vector<midi_port_config> midi_ports;
+
+    // Synthetic midi to play into the midi driver.
+    auto midi_load = false;
+    auto load_settings = midi_load_generator::settings();
+
+    // Samples between control ticks in the generation and midi drivers. 0 keeps each drivers default.
+    uint32_t control_period = 0;
+
+    // Commands for the frequency generator to read instead of the keyboard. "-" reads a pipe.
+    std::string generation_script;
+
+    // Socket other programs can send generation commands to.
+    std::string control_socket;
+
+    // File the telemetry is written to every second, and if it counts cycles and cache misses in the callbacks.
+    std::string metrics_path;
+    auto count_hardware = false;
+
+    // File the trace is written to on exit, and how many events each thread can record.
+    std::string trace_path;
+    auto trace_events = trace_profiler::default_events_per_thread;
+
+    // Standard MIDI File for the midi driver to play, and where to start in it.
+    std::string midi_file_path;
+    auto midi_file_start = 0.0;
+
+    // Controllers and program changes that switch the midi driver settings.
+    auto midi_controls = midi_control_map();
+
+    // Midi files to render to WAV instead of starting the audio driver.
+    std::vector<std::string> render_paths;
+    std::string render_directory;
+    auto render_threads = 0;
+
+    // Directory to record golden references into, or check renders against, instead of starting the audio driver.
+    std::string golden_record_directory;
+    std::string golden_check_directory;
+    auto golden_tolerance_settings = golden_tolerance();
+
+    for (size_t i = 0; i < num_arguments; ++i)
+    {
+        const auto& argument = arguments[i];
+        if (argument == "--config" && i + 1 < num_arguments)
+        {
+            // Already read.
+            ++i;
+        }
+        else if (argument == "--driver" && i + 1 < num_arguments)
+        {
+            ++i;
+            driver_name = arguments[i];
+        }
+        else if (argument == "--device" && i + 1 < num_arguments)
+        {
+            ++i;
+            device_name = arguments[i];
+        }
+        else if (argument == "--buffer" && i + 1 < num_arguments)
+        {
+            ++i;
+            try
+            {
+                settings.m_frames_per_buffer = std::stoul(arguments[i]);
+            }
+            catch (...)
+            {
+                std::cout << "Could not read buffer size " << arguments[i] << ", letting the driver pick." << std::endl;
+            }
+        }
+        else if (argument == "--buffer-layout" && i + 1 < num_arguments)
+        {
+            ++i;
+            if (arguments[i] == "interleaved" || arguments[i] == "non-interleaved")
+            {
+                settings.m_layout_set = true;
+                settings.m_non_interleaved = arguments[i] == "non-interleaved";
+            }
+            else
+            {
+                std::cout << "Unknown buffer layout " << arguments[i] << ", use interleaved or non-interleaved." <<
+                    std::endl;
+            }
+        }
+        else if (argument == "--control-period" && i + 1 < num_arguments)
+        {
+            ++i;
+            try
+            {
+                control_period = static_cast<uint32_t>(std::max(0, std::stoi(arguments[i])));
+            }
+            catch (...)
+            {
+                std::cout << "Could not read control period " << arguments[i] << ", keeping the default." << std::endl;
+            }
+        }
+        else if (argument == "--realtime")
+        {
+            realtime = true;
+        }
+        else if (argument == "--latency-preset" && i + 1 < num_arguments)
+        {
+            ++i;
+            const auto preset = arguments[i];
+            if (preset == "power" || preset == "default")
+            {
+                settings.m_power_preset = preset == "power";
+            }
+            else
+            {
+                std::cout << "Unknown latency preset " << preset << ", keeping the default." << std::endl;
+            }
+        }
+        else if (argument == "--midi-port" && i + 1 < num_arguments)
+        {
+            ++i;
+            midi_ports.push_back(parse_midi_port(arguments[i]));
+        }
+        else if (argument == "--midi-controls" && i + 1 < num_arguments)
+        {
+            ++i;
+            if (!midi_control_map::from_string(arguments[i], midi_controls))
+            {
+                std::cout << "Could not read midi controls " << arguments[i] << ", use a list such as "
+                    "wave=70,volume=80,quit=none,program=off." << std::endl;
+            }
+        }
+        else if (argument == "--null-audio")
+        {
+            settings.m_null_audio = true;
+        }
+        else if (argument == "--simulated-audio" && i + 1 < num_arguments)
+        {
+            ++i;
+            if (simulated_audio_driver::from_string(arguments[i], settings.m_simulation))
+            {
+                // The simulated card has no hardware behind it either.
+                settings.m_null_audio = true;
+                settings.m_simulated_audio = true;
+            }
+            else
+            {
+                std::cout << "Could not read simulated audio " << arguments[i] << ", use a list such as "
+                    "callbacks=2000,jitter=1.5,underflow=100,slow=50:20,latency=2,seed=7,paced,charge." << std::endl;
+            }
+        }
+        else if (argument == "--generation-script" && i + 1 < num_arguments)
+        {
+            ++i;
+            generation_script = arguments[i];
+        }
+        else if (argument == "--control-socket" && i + 1 < num_arguments)
+        {
+            ++i;
+            control_socket = arguments[i];
+        }
+        else if (argument == "--metrics" && i + 1 < num_arguments)
+        {
+            ++i;
+            metrics_path = arguments[i];
+        }
+        else if (argument == "--perf-counters")
+        {
+            count_hardware = true;
+        }
+        else if (argument == "--trace" && i + 1 < num_arguments)
+        {
+            ++i;
+            trace_path = arguments[i];
+        }
+        else if (argument == "--trace-events" && i + 1 < num_arguments)
+        {
+            ++i;
+            try
+            {
+                trace_events = static_cast<uint32_t>(std::max(1, std::stoi(arguments[i])));
+            }
+            catch (...)
+            {
+                std::cout << "Could not read trace events " << arguments[i] << ", keeping " << trace_events << "."
+                    << std::endl;
+            }
+        }
+        else if (argument == "--play-midi" && i + 1 < num_arguments)
+        {
+            ++i;
+            midi_file_path = arguments[i];
+        }
+        else if (argument == "--midi-start" && i + 1 < num_arguments)
+        {
+            ++i;
+            try
+            {
+                midi_file_start = std::max(0.0, std::stod(arguments[i]));
+            }
+            catch (...)
+            {
+                std::cout << "Could not read midi start " << arguments[i] << ", playing from the beginning." << std::endl;
+            }
+        }
+        else if (argument == "--render-midi" && i + 1 < num_arguments)
+        {
+            ++i;
+            render_paths.push_back(arguments[i]);
+        }
+        else if (argument == "--render-list" && i + 1 < num_arguments)
+        {
+            // One path per line.
+            ++i;
+            std::ifstream list(arguments[i]);
+            if (!list)
+            {
+                std::cout << "Could not open render list " << arguments[i] << std::endl;
+            }
+
+            std::string line;
+            while (std::getline(list, line))
+            {
+                if (!line.empty())
+                {
+                    render_paths.push_back(line);
+                }
+            }
+        }
+        else if (argument == "--render-dir" && i + 1 < num_arguments)
+        {
+            ++i;
+            render_directory = arguments[i];
+        }
+        else if (argument == "--render-threads" && i + 1 < num_arguments)
+        {
+            ++i;
+            try
+            {
+                render_threads = std::max(0, std::stoi(arguments[i]));
+            }
+            catch (...)
+            {
+                std::cout << "Could not read render threads " << arguments[i] << ", using one per core." << std::endl;
+            }
+        }
+        else if (argument == "--golden-record" && i + 1 < num_arguments)
+        {
+            ++i;
+            golden_record_directory = arguments[i];
+        }
+        else if (argument == "--golden-check" && i + 1 < num_arguments)
+        {
+            ++i;
+            golden_check_directory = arguments[i];
+        }
+        else if ((argument == "--golden-snr" || argument == "--golden-spectral-snr") && i + 1 < num_arguments)
+        {
+            ++i;
+            try
+            {
+                // Any tolerance means close is good enough, so the match no longer has to be exact.
+                const auto limit = std::stod(arguments[i]);
+                auto& setting = argument == "--golden-snr" ? golden_tolerance_settings.m_min_snr_db :
+                    golden_tolerance_settings.m_min_spectral_snr_db;
+                setting = limit;
+                golden_tolerance_settings.m_exact = false;
+            }
+            catch (...)
+            {
+                std::cout << "Could not read " << argument << " " << arguments[i] << ", keeping the old limit." <<
+                    std::endl;
+            }
+        }
+        else if (argument == "--midi-load" && i + 1 < num_arguments)
+        {
+            ++i;
+            midi_load = midi_load_generator::from_string(arguments[i], load_settings);
+            if (!midi_load)
+            {
+                std::cout << "Could not read midi load " << arguments[i] << ", use chords, glissando, or storm[:events]."
+                    << std::endl;
+            }
+        }
+        else if (argument == "--help" || argument == "-h")
+        {
+            print_usage();
+            return 0;
+        }
+        else
+        {
+            // A typo would otherwise run as if the option had been left out.
+            std::cout << "Unknown argument " << argument << ", or it is missing its value." << std::endl;
+            print_usage();
+            return 1;
+        }
+    }
+
+    const trace_session trace(trace_path, trace_events);
+
+    // Batch rendering runs on its own and never touches the audio device.
+    if (!render_paths.empty())
+    {
+        std::vector<midi_batch_renderer::job> jobs;
+        for (const auto& path : render_paths)
+        {
+            jobs.push_back(midi_batch_renderer::job{path, midi_batch_renderer::output_path(path, render_directory)});
+        }
+
+        midi_batch_renderer renderer(static_cast<uint32_t>(render_threads));
+        return renderer.render(jobs) == jobs.size() ? 0 : 1;
+    }
+
+    // The golden harness renders offline too.
+    if (!golden_record_directory.empty())
+    {
+        golden_harness harness(golden_record_directory);
+        return harness.record() == 0 ? 0 : 1;
+    }
+
+    if (!golden_check_directory.empty())
+    {
+        golden_harness harness(golden_check_directory, golden_tolerance_settings);
+        return harness.check() == 0 ? 0 : 1;
+    }
+
+    audio_driver::set_null_device(settings.m_null_audio);
+    audio_driver::set_device(device_name);
+    if (realtime && !audio_driver::set_realtime(true))
+    {
+        std::cout << "Could not lock memory for real time audio, the callback may be paged out." << std::endl;
+    }
+
+    // Telemetry is written from its own thread while any driver runs.
+    telemetry metrics;
+    if (!metrics_path.empty())
+    {
+        if (metrics.start(metrics_path))
+        {
+            settings.m_telemetry = &metrics;
+        }
+        else
+        {
+            std::cout << "Could not write metrics to " << metrics_path << ", telemetry will be disabled." << std::endl;
+        }
+    }
+
+    // Counters are only turned on if the kernel will give them out, otherwise the callbacks go on without them.
+    if (count_hardware && !settings.m_telemetry)
+    {
+        std::cout << "Hardware counters are exported with the metrics, use --metrics to see them." << std::endl;
+    }
+    else if (count_hardware)
+    {
+        std::string error;
+        const auto available = perf_counters::probe(error);
+        if (available != 0)
+        {
+            std::cout << "Counting " << perf_counters::describe(available) << " in the callbacks." << std::endl;
+            perf_counters::set_enabled(true);
+        }
+        else
+        {
+            std::cout << "Hardware counters are not available, carrying on without them. " << error << std::endl;
+        }
+    }
+
+    // The load generator makes its port when the midi driver is first made so the driver can find it by name.
+    midi_latency_probe latency_probe;
+    std::unique_ptr<midi_load_generator> load_generator;
+
+    // Drivers are only made when they are picked.
+    driver_registry drivers;
+    drivers.add("passthrough", "Passthrough", []
+    {
+        return std::unique_ptr<sound_driver>(new passthrough_driver());
+    });
+    drivers.add("generation", "Frequency Generation", [&]
+    {
+        std::unique_ptr<generation_driver> generation(new generation_driver());
+        generation->set_script(generation_script);
+        generation->set_control_socket(control_socket);
+        generation->set_control_period(control_period);
+        return std::unique_ptr<sound_driver>(generation.release());
+    });
+    drivers.add("midi", "Midi player", [&]
+    {
+        std::unique_ptr<midi_driver> midi(new midi_driver());
+        if (midi_load && !load_generator)
+        {
+            load_generator.reset(new midi_load_generator(load_settings, &latency_probe));
+            if (load_generator->open())
+            {
+                midi_ports.push_back(midi_port_config(midi_load_generator::port_name));
+            }
+            else
+            {
+                std::cout << "Midi load generator could not open its port and will be disabled." << std::endl;
+                midi_load = false;
+                load_generator.reset();
+            }
+        }
+
+        if (load_generator)
+        {
+            midi->set_load(load_generator.get(), &latency_probe);
+        }
+
+        midi->set_ports(midi_ports);
+        midi->set_control_map(midi_controls);
+        midi->set_file(midi_file_path, midi_file_start);
+        midi->set_control_period(control_period);
+        return std::unique_ptr<sound_driver>(midi.release());
+    });
+
+    std::cout << std::endl << "Booting up Audio Driver" << std::endl;
+
+    // Keep Port Audio up so the device list is only scanned once.
+    std::unique_ptr<port_audio_session> session;
+    if (!settings.m_null_audio)
+    {
+        session.reset(new port_audio_session());
+    }
+
+    // Headless start. Run the driver that was asked for and exit when it is done.
+    if (!driver_name.empty())
+    {
+        const auto* entry = drivers.find(driver_name);
+        if (!entry)
+        {
+            std::cout << "No driver is called " << driver_name << ". Available drivers are:" << std::endl;
+            for (const auto& available : drivers.get_entries())
+            {
+                std::cout << "  " << available.m_name << std::endl;
+            }
+            return 1;
+        }
+
+        const auto ran = run_driver(*entry, settings);
+        startup_timer::report();
+        return ran ? 0 : 1;
+    }
+
+    // Initialize the program, and let the user know how to operate it.
+    std::cout << "Starting Audio Driver program." << std::endl;
+
+    const auto& entries = drivers.get_entries();
+    auto quit = false;
 
     // Until promted to exit, try to run.
     while (!quit)
     {
         std::cout << "Please select an available mode to use by entering its associated number:" << std::endl;
 
-        for (auto i = 0; i < static_cast<int>(available_callbacks.size()); ++i)
+        for (auto i = 0; i < static_cast<int>(entries.size()); ++i)
         {
-            std::cout << "[" << i << "]: " << available_callbacks[i].m_callback_name << std::endl;
+            std::cout << "[" << i << "]: " << entries[i].m_title << std::endl;
         }
 
         const std::string exit_string = "exit";
@@ -101,7 +746,7 @@ int main()
         std::cin >> read_string;
 
         // Catch the exit condition
-        if (read_string == exit_string)
+        if (read_string == exit_string || !std::cin)
         {
             quit = true;
             continue;
@@ -119,32 +764,10 @@ int main()
             continue;
         }
 
-        // If we have a parsed value in a valid range, start up that callback!
-        if (parsed_value >= 0 && parsed_value < static_cast<int>(available_callbacks.size()))
+        // If we have a parsed value in a valid range, start up that driver!
+        if (parsed_value >= 0 && parsed_value < static_cast<int>(entries.size()))
         {
-            const auto selected_callback = available_callbacks[parsed_value];
-
-            // Construct the driver
-            auto driver = audio_driver(selected_callback);
-
-            // Start it up!
-            if (!driver.start())
-            {
-                std::cerr << "Failed to start [" << selected_callback.m_callback_name << "]" << std::endl << "Error: " +
-                    driver.get_error() << std::endl;
-                continue;
-            }
-
-            // Go into the method that processes the callback.
-            selected_callback.m_process_method();
-
-            // Stop the driver.
-            if (!driver.stop())
-            {
-                std::cerr << "Failed to stop [" << selected_callback.m_callback_name << "]" << std::endl << "Error: " +
-                    driver.get_error() << std::endl;
-                continue;
-            }
+            run_driver(entries[parsed_value], settings);
         }
 
         std::cout << "Stopping Audio Driver" << std::endl;
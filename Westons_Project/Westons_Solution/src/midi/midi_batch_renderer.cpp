@@ -0,0 +1,211 @@
+#include "midi_batch_renderer.h"
+#include "midi_file_player.h"
+#include "midi_synth.h"
+#include "../sound/wav_writer.h"
+#include "../utilities/work_stealing_pool.h"
+#include "../../sound_data.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <numeric>
+
+#include <sys/stat.h>
+#include <time.h>
+
+const float midi_batch_renderer::max_tail_seconds = 10.0f;
+const uint32_t midi_batch_renderer::num_channels;
+
+/**
+ * \brief Gets the size of a file, used to guess how long it takes to render.
+ * \param path Path of the file.
+ * \return Size in bytes, or 0 if it cannot be read.
+ */
+static uint64_t file_size(const std::string& path)
+{
+    struct stat file_stat;
+    if (stat(path.c_str(), &file_stat) != 0)
+    {
+        return 0;
+    }
+    return static_cast<uint64_t>(file_stat.st_size);
+}
+
+/**
+ * \brief Gets how much CPU time the calling thread has used. Unlike wall time it does not grow while the thread waits
+ * for a core, so it shows the real cost of a file.
+ * \return CPU time in seconds.
+ */
+static double thread_cpu_seconds()
+{
+    timespec time;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+    return static_cast<double>(time.tv_sec) + static_cast<double>(time.tv_nsec) * 1e-9;
+}
+
+/**
+ * \brief Construct a renderer.
+ * \param num_threads Number of files rendered at once. 0 renders one per core.
+ * \param sample_rate Sample rate of the files written. 0 uses the default sample rate.
+ */
+midi_batch_renderer::midi_batch_renderer(const uint32_t num_threads, const int sample_rate) :
+    m_num_threads_(num_threads),
+    m_sample_rate_(sample_rate > 0 ? sample_rate : static_cast<int>(sound_utilities::default_sample_rate))
+{
+}
+
+/**
+ * \brief Renders every job and reports how it went.
+ * \param jobs Files to render.
+ * \return Number of files that were rendered.
+ */
+uint32_t midi_batch_renderer::render(const std::vector<job>& jobs)
+{
+    // Biggest files first, so a long one is not left running on its own at the end.
+    std::vector<uint32_t> order(jobs.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::vector<uint64_t> sizes(jobs.size());
+    for (size_t i = 0; i < jobs.size(); ++i)
+    {
+        sizes[i] = file_size(jobs[i].m_input_path);
+    }
+    std::stable_sort(order.begin(), order.end(), [&](const uint32_t a, const uint32_t b)
+    {
+        return sizes[a] > sizes[b];
+    });
+
+    std::vector<result> results(jobs.size());
+    work_stealing_pool pool(m_num_threads_);
+
+    const auto start = std::chrono::steady_clock::now();
+    pool.run(static_cast<uint32_t>(order.size()), [&](const uint32_t task, const uint32_t thread)
+    {
+        static_cast<void>(thread);
+        const auto index = order[task];
+        render_job(jobs[index], results[index]);
+    });
+    const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    uint32_t num_rendered = 0;
+    uint64_t total_frames = 0;
+    auto render_seconds = 0.0;
+    for (size_t i = 0; i < jobs.size(); ++i)
+    {
+        const auto& job_result = results[i];
+        if (!job_result.m_rendered)
+        {
+            std::cout << "Could not render " << jobs[i].m_input_path << ": " << job_result.m_error << std::endl;
+            continue;
+        }
+
+        ++num_rendered;
+        total_frames += job_result.m_frames;
+        render_seconds += job_result.m_seconds;
+    }
+
+    const auto audio_seconds = static_cast<double>(total_frames) / m_sample_rate_;
+    std::cout << "Rendered " << num_rendered << " of " << jobs.size() << " files, " << audio_seconds <<
+        " s of audio in " << elapsed << " s on " << pool.get_thread_count() << " threads." << std::endl;
+    if (elapsed > 0.0 && render_seconds > 0.0)
+    {
+        // Scaling compares the wall time against the CPU time all of the files took. Close to the thread count when
+        // every core is kept busy.
+        std::cout << "Batch: " << audio_seconds / elapsed << "x real time, " << render_seconds / elapsed <<
+            "x speedup over one thread, " << pool.get_steal_count() << " files stolen." << std::endl;
+    }
+
+    return num_rendered;
+}
+
+/**
+ * \brief Works out where to write a file.
+ * \param input_path Path of the MIDI file.
+ * \param output_directory Directory to write into. Empty to write next to the MIDI file.
+ * \return Path of the WAV file.
+ */
+std::string midi_batch_renderer::output_path(const std::string& input_path, const std::string& output_directory)
+{
+    const auto name_start = input_path.find_last_of('/');
+    const auto directory = name_start == std::string::npos ? std::string() : input_path.substr(0, name_start + 1);
+    auto name = name_start == std::string::npos ? input_path : input_path.substr(name_start + 1);
+
+    const auto extension = name.rfind('.');
+    if (extension != std::string::npos && extension > 0)
+    {
+        name.erase(extension);
+    }
+
+    if (output_directory.empty())
+    {
+        return directory + name + ".wav";
+    }
+
+    const auto separator = output_directory.back() == '/' ? "" : "/";
+    return output_directory + separator + name + ".wav";
+}
+
+/**
+ * \brief Renders one file start to end, then lets the notes ring out.
+ * \param render_job File to render.
+ * \param job_result Filled with how it went.
+ * \return If the file was rendered.
+ */
+bool midi_batch_renderer::render_job(const job& render_job, result& job_result) const
+{
+    const auto start = thread_cpu_seconds();
+    job_result = result{false, 0, 0.0, std::string()};
+
+    midi_file file;
+    if (!file.load(render_job.m_input_path, m_sample_rate_))
+    {
+        job_result.m_error = file.get_error();
+        return false;
+    }
+
+    wav_writer writer;
+    if (!writer.open(render_job.m_output_path, num_channels, m_sample_rate_))
+    {
+        job_result.m_error = "Could not create " + render_job.m_output_path + ".";
+        return false;
+    }
+
+    // Every file has its own synth. The pool is already using every core, so the parts stay on this thread.
+    midi_synth synth(0);
+    midi_file_player player(file);
+
+    std::vector<float> buffer(num_channels * sound_data::max_block_size, 0.0f);
+    float* channels[num_channels];
+    for (uint32_t channel = 0; channel < num_channels; ++channel)
+    {
+        channels[channel] = buffer.data() + channel * sound_data::max_block_size;
+    }
+
+    const auto block_size = sound_data::max_block_size;
+    while (!player.is_finished())
+    {
+        synth.render(player, channels, num_channels, block_size, m_sample_rate_);
+        writer.write(channels, block_size);
+    }
+
+    // Let go of anything still held and stop once it has rung out.
+    synth.release_all();
+    const auto max_tail_frames = static_cast<uint64_t>(max_tail_seconds * m_sample_rate_);
+    uint64_t tail_frames = 0;
+    while (!synth.is_silent() && tail_frames < max_tail_frames)
+    {
+        synth.render(channels, num_channels, block_size, m_sample_rate_);
+        writer.write(channels, block_size);
+        tail_frames += block_size;
+    }
+
+    job_result.m_frames = writer.get_frames_written();
+    if (!writer.close())
+    {
+        job_result.m_error = "Could not write " + render_job.m_output_path + ".";
+        return false;
+    }
+
+    job_result.m_seconds = thread_cpu_seconds() - start;
+    job_result.m_rendered = true;
+    return true;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * \brief Renders MIDI files to WAV files offline, as fast as the machine can go. Files are spread over a work
+ * stealing pool, and every file gets a synth of its own so nothing is shared between them.
+ */
+class midi_batch_renderer
+{
+public:
+    /**
+     * \brief One file to render, and where to write it.
+     */
+    struct job
+    {
+        std::string m_input_path;
+        std::string m_output_path;
+    };
+
+    explicit midi_batch_renderer(uint32_t num_threads = 0, int sample_rate = 0);
+
+    uint32_t render(const std::vector<job>& jobs);
+
+    static std::string output_path(const std::string& input_path, const std::string& output_directory);
+
+    // Longest the notes are left to ring out after the end of a file.
+    const static float max_tail_seconds;
+
+    // Files are rendered in stereo.
+    const static uint32_t num_channels = 2;
+
+private:
+    /**
+     * \brief How one job went.
+     */
+    struct result
+    {
+        bool m_rendered;
+        uint64_t m_frames;
+
+        // CPU time the file took.
+        double m_seconds;
+        std::string m_error;
+    };
+
+    bool render_job(const job& render_job, result& job_result) const;
+
+    uint32_t m_num_threads_;
+    int m_sample_rate_;
+};
@@ -0,0 +1,506 @@
+#include "midi_engine.h"
+#include "../utilities/trace_profiler.h"
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <climits>
+#include <ctime>
+
+const uint32_t midi_engine::num_parts;
+const uint32_t midi_engine::parallel_note_threshold = 16;
+
+// Leave a core for the callback thread, and don't go wider than a Raspberry Pi.
+static const uint32_t max_default_workers = 3;
+
+// How long render waits for the workers to finish their parts, as a share of the time the block plays for. Short
+// blocks still get the minimum, since waking a worker alone can take that long.
+static const double worker_wait_share = 0.5;
+static const std::chrono::microseconds min_worker_wait(200);
+
+/**
+ * \brief Sleeps until the word no longer holds the given value. Can return early, so callers check again.
+ * \param word Word to watch.
+ * \param value Value to sleep through.
+ * \param timeout Longest to sleep for. Null sleeps for as long as it takes.
+ */
+static void wait_for_change(std::atomic<uint32_t>& word, const uint32_t value,
+                            const std::chrono::nanoseconds* timeout = nullptr)
+{
+#ifdef __linux__
+    static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex needs a plain 32 bit word");
+    timespec wait_time = {};
+    if (timeout)
+    {
+        wait_time.tv_sec = static_cast<time_t>(timeout->count() / 1000000000);
+        wait_time.tv_nsec = static_cast<long>(timeout->count() % 1000000000);
+    }
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT_PRIVATE, value, timeout ? &wait_time : nullptr,
+            nullptr, 0);
+#else
+    if (word.load(std::memory_order_acquire) == value)
+    {
+        auto sleep_time = std::chrono::nanoseconds(std::chrono::microseconds(100));
+        if (timeout)
+        {
+            sleep_time = std::min(sleep_time, *timeout);
+        }
+        std::this_thread::sleep_for(sleep_time);
+    }
+#endif
+}
+
+/**
+ * \brief Wakes every thread waiting on the word. Does not block.
+ * \param word Word that changed.
+ */
+static void wake_all(std::atomic<uint32_t>& word)
+{
+#ifdef __linux__
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+#else
+    static_cast<void>(word);
+#endif
+}
+
+midi_part::midi_part() :
+    m_wave(sound_utilities::sine),
+    m_envelope(envelope_data()),
+    m_output(nullptr)
+{
+}
+
+/**
+ * \brief Construct the engine and start its workers.
+ * \param num_workers Number of worker threads. 0 renders everything on the calling thread.
+ */
+midi_engine::midi_engine(const uint32_t num_workers) :
+    m_busy_{},
+    m_pending_release_{},
+    m_job_parts_{},
+    m_job_channels_(0),
+    m_job_samples_(0),
+    m_job_sample_rate_(0),
+    m_next_claim_(0),
+    m_parts_done_(0),
+    m_render_waiting_(false),
+    m_late_parts_(0),
+    m_generation_(0),
+    m_sleeping_workers_(0),
+    m_stopping_(false),
+    m_mix_buffer_(sound_data::max_channels * sound_data::max_block_size, 0.0f),
+    m_mix_pointers_(sound_data::max_channels, nullptr)
+{
+    for (uint32_t channel = 0; channel < sound_data::max_channels; ++channel)
+    {
+        m_mix_pointers_[channel] = m_mix_buffer_.data() + channel * sound_data::max_block_size;
+    }
+
+    start_workers(num_workers);
+}
+
+midi_engine::~midi_engine()
+{
+    m_stopping_.store(true, std::memory_order_release);
+    m_generation_.fetch_add(1, std::memory_order_seq_cst);
+    wake_all(m_generation_);
+
+    for (auto& worker : m_workers_)
+    {
+        worker.join();
+    }
+}
+
+/**
+ * \brief Gets the part that plays the given MIDI channel.
+ * \param channel MIDI channel. 0 <-> 15
+ * \return Part for the channel.
+ */
+midi_part& midi_engine::get_part(const uint8_t channel)
+{
+    assert(channel < num_parts);
+    return m_parts_[channel];
+}
+
+/**
+ * \brief Checks if a worker that ran late is still rendering the part for a channel. Busy parts cannot be touched.
+ * \param channel MIDI channel. 0 <-> 15
+ * \return If the part is busy.
+ */
+bool midi_engine::is_busy(const uint8_t channel) const
+{
+    assert(channel < num_parts);
+    return m_busy_[channel].load(std::memory_order_acquire);
+}
+
+/**
+ * \brief Sets how many samples are rendered between control ticks in every part.
+ * \param period Number of samples between ticks.
+ */
+void midi_engine::set_control_period(const uint32_t period)
+{
+    for (auto& part : m_parts_)
+    {
+        part.m_sound.set_control_period(period);
+    }
+}
+
+/**
+ * \brief Releases every note in every part.
+ */
+void midi_engine::release_all()
+{
+    for (uint32_t i = 0; i < num_parts; ++i)
+    {
+        if (m_busy_[i].load(std::memory_order_acquire))
+        {
+            m_pending_release_[i] = true;
+            continue;
+        }
+
+        m_parts_[i].m_sound.release_all();
+    }
+}
+
+/**
+ * \brief Renders the next block of every part that is playing and mixes them together.
+ * \param channels One contiguous buffer per channel. Overwritten with the mix.
+ * \param num_channels Number of channels to render. Cannot be more than sound_data::max_channels.
+ * \param num_samples Number of samples to render. Cannot be more than sound_data::max_block_size.
+ * \param sample_rate Sample rate of the sound.
+ */
+void midi_engine::render(float* const* channels, const uint32_t num_channels, const uint32_t num_samples,
+                         const int sample_rate)
+{
+    assert(num_channels > 0 && num_channels <= sound_data::max_channels);
+    assert(num_samples <= sound_data::max_block_size);
+
+    // Only the parts with something to play are rendered. Parts a late worker still has are left until it is done.
+    std::array<uint32_t, num_parts> job_parts;
+    uint32_t job_size = 0;
+    size_t note_count = 0;
+    for (uint32_t i = 0; i < num_parts; ++i)
+    {
+        if (m_busy_[i].load(std::memory_order_acquire))
+        {
+            continue;
+        }
+
+        if (m_pending_release_[i])
+        {
+            m_parts_[i].m_sound.release_all();
+            m_pending_release_[i] = false;
+        }
+
+        if (!m_parts_[i].m_sound.is_silent())
+        {
+            job_parts[job_size] = i;
+            ++job_size;
+            note_count += m_parts_[i].m_sound.m_notes.size();
+        }
+    }
+
+    if (!m_workers_.empty() && job_size > 1 && note_count >= parallel_note_threshold)
+    {
+        for (uint32_t i = 0; i < job_size; ++i)
+        {
+            m_busy_[job_parts[i]].store(true, std::memory_order_relaxed);
+            m_job_parts_[i].store(job_parts[i], std::memory_order_relaxed);
+        }
+
+        m_job_channels_.store(num_channels, std::memory_order_relaxed);
+        m_job_samples_.store(num_samples, std::memory_order_relaxed);
+        m_job_sample_rate_.store(sample_rate, std::memory_order_relaxed);
+
+        // Only this thread moves the generation on, so there is nothing to lock. Publishing the claim word makes the
+        // job above visible to whoever claims from it.
+        const auto generation = m_generation_.load(std::memory_order_relaxed) + 1;
+        m_next_claim_.store(static_cast<uint64_t>(generation) << 32 | static_cast<uint64_t>(job_size) << 16,
+                            std::memory_order_release);
+        m_generation_.store(generation, std::memory_order_seq_cst);
+
+        // Workers that are still awake from the last job see the new generation without a system call.
+        if (m_sleeping_workers_.load(std::memory_order_seq_cst) > 0)
+        {
+            wake_all(m_generation_);
+        }
+
+        // Pitch in rather than wait. If the workers are slow to wake this thread renders everything itself.
+        render_claimed_parts(generation);
+
+        // Everything is claimed now, so only parts the workers are partway through are left.
+        wait_for_parts(job_size, num_samples, sample_rate);
+    }
+    else
+    {
+        for (uint32_t i = 0; i < job_size; ++i)
+        {
+            auto& part = m_parts_[job_parts[i]];
+            part.m_output = part.m_sound.render(num_channels, num_samples, sample_rate);
+        }
+    }
+
+    // Mix in part order so the result is the same however the parts were rendered.
+    for (uint32_t channel = 0; channel < num_channels; ++channel)
+    {
+        std::fill(channels[channel], channels[channel] + num_samples, 0.0f);
+    }
+
+    for (uint32_t i = 0; i < job_size; ++i)
+    {
+        // Late parts are left out. Their worker is still writing the output.
+        if (m_busy_[job_parts[i]].load(std::memory_order_acquire))
+        {
+            continue;
+        }
+
+        const auto* const* part_output = m_parts_[job_parts[i]].m_output;
+        for (uint32_t channel = 0; channel < num_channels; ++channel)
+        {
+            auto* out = channels[channel];
+            const auto* in = part_output[channel];
+            for (uint32_t j = 0; j < num_samples; ++j)
+            {
+                out[j] += in[j];
+            }
+        }
+    }
+}
+
+/**
+ * \brief Renders the next block into buffers owned by the engine. Use when the output is not laid out per channel.
+ * \param num_channels Number of channels to render. Cannot be more than sound_data::max_channels.
+ * \param num_samples Number of samples to render. Cannot be more than sound_data::max_block_size.
+ * \param sample_rate Sample rate of the sound.
+ * \return One buffer per channel holding the mix. Valid until the next call to render.
+ */
+const float* const* midi_engine::render(const uint32_t num_channels, const uint32_t num_samples,
+                                        const int sample_rate)
+{
+    render(m_mix_pointers_.data(), num_channels, num_samples, sample_rate);
+    return m_mix_pointers_.data();
+}
+
+/**
+ * \brief Checks if any part has something left to play.
+ * \return If rendering would only produce silence.
+ */
+bool midi_engine::is_silent() const
+{
+    // A busy part was playing when it was handed out, so it still counts as playing.
+    for (uint32_t i = 0; i < num_parts; ++i)
+    {
+        if (m_busy_[i].load(std::memory_order_acquire) || !m_parts_[i].m_sound.is_silent())
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * \brief Counts the notes playing over every part that is not busy. Cannot be called while rendering on another
+ * thread.
+ * \return Number of notes.
+ */
+uint32_t midi_engine::get_voice_count() const
+{
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < num_parts; ++i)
+    {
+        if (!m_busy_[i].load(std::memory_order_acquire))
+        {
+            count += static_cast<uint32_t>(m_parts_[i].m_sound.m_notes.size());
+        }
+    }
+    return count;
+}
+
+/**
+ * \brief Starts more worker threads. Cannot be called while rendering.
+ * \param num_workers Number of workers to add.
+ */
+void midi_engine::start_workers(const uint32_t num_workers)
+{
+    for (uint32_t i = 0; i < num_workers; ++i)
+    {
+        m_workers_.emplace_back(&midi_engine::worker_loop, this);
+    }
+}
+
+uint32_t midi_engine::get_worker_count() const
+{
+    return static_cast<uint32_t>(m_workers_.size());
+}
+
+/**
+ * \brief Counts the parts that were left out of a render because their worker did not finish them in time.
+ * \return Number of late parts.
+ */
+uint64_t midi_engine::get_late_parts() const
+{
+    return m_late_parts_.load(std::memory_order_relaxed);
+}
+
+/**
+ * \brief Picks a worker count for this machine. One core is left for the thread that calls render.
+ * \return Number of workers to start.
+ */
+uint32_t midi_engine::default_worker_count()
+{
+    const auto cores = std::thread::hardware_concurrency();
+    if (cores <= 1)
+    {
+        return 0;
+    }
+
+    return std::min(cores - 1, max_default_workers);
+}
+
+/**
+ * \brief Waits for jobs and helps render them until the engine is destroyed.
+ */
+void midi_engine::worker_loop()
+{
+    TRACE_THREAD("midi worker");
+
+    auto seen_generation = m_generation_.load(std::memory_order_acquire);
+    while (true)
+    {
+        const auto generation = m_generation_.load(std::memory_order_acquire);
+        if (generation == seen_generation)
+        {
+            // Count this worker as asleep before looking again, so render either sees the count or this sees the new
+            // generation.
+            m_sleeping_workers_.fetch_add(1, std::memory_order_seq_cst);
+            if (m_generation_.load(std::memory_order_seq_cst) == seen_generation)
+            {
+                wait_for_change(m_generation_, seen_generation);
+            }
+            m_sleeping_workers_.fetch_sub(1, std::memory_order_relaxed);
+            continue;
+        }
+
+        if (m_stopping_.load(std::memory_order_acquire))
+        {
+            return;
+        }
+
+        seen_generation = generation;
+
+        TRACE_SCOPE("render parts");
+        render_claimed_parts(seen_generation);
+    }
+}
+
+/**
+ * \brief Claims and renders parts of the given job until there are none left. Does nothing if the job is already over.
+ * \param generation Job to help with.
+ */
+void midi_engine::render_claimed_parts(const uint32_t generation)
+{
+    auto claim = m_next_claim_.load(std::memory_order_acquire);
+    while (true)
+    {
+        // A later job has started, or this one is all claimed.
+        const auto index = static_cast<uint32_t>(claim & 0xFFFF);
+        if (static_cast<uint32_t>(claim >> 32) != generation || index >= static_cast<uint32_t>(claim >> 16 & 0xFFFF))
+        {
+            return;
+        }
+
+        // Read before claiming. Render cannot start the next job until every part is claimed, so the claim only
+        // succeeds if these are for this one.
+        const auto part_index = m_job_parts_[index].load(std::memory_order_relaxed);
+        const auto num_channels = m_job_channels_.load(std::memory_order_relaxed);
+        const auto num_samples = m_job_samples_.load(std::memory_order_relaxed);
+        const auto sample_rate = m_job_sample_rate_.load(std::memory_order_relaxed);
+
+        if (!m_next_claim_.compare_exchange_weak(claim, claim + 1, std::memory_order_acq_rel,
+                                                 std::memory_order_acquire))
+        {
+            continue;
+        }
+
+        auto& part = m_parts_[part_index];
+        part.m_output = part.m_sound.render(num_channels, num_samples, sample_rate);
+
+        // Hand the part back before counting it, so a render that wakes up on the count sees it done.
+        m_busy_[part_index].store(false, std::memory_order_seq_cst);
+        m_parts_done_.fetch_add(1, std::memory_order_seq_cst);
+        if (m_render_waiting_.load(std::memory_order_seq_cst))
+        {
+            wake_all(m_parts_done_);
+        }
+
+        claim = m_next_claim_.load(std::memory_order_acquire);
+    }
+}
+
+/**
+ * \brief Waits for the workers to finish the parts of the job they claimed, but only for a share of the time the
+ * block plays for. Parts still busy after that are counted as late and left out of the mix.
+ * \param job_size Number of parts in the job.
+ * \param num_samples Number of samples in the block.
+ * \param sample_rate Sample rate of the block.
+ */
+void midi_engine::wait_for_parts(const uint32_t job_size, const uint32_t num_samples, const int sample_rate)
+{
+    const auto all_done = [this, job_size]
+    {
+        for (uint32_t i = 0; i < job_size; ++i)
+        {
+            if (m_busy_[m_job_parts_[i].load(std::memory_order_relaxed)].load(std::memory_order_seq_cst))
+            {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    if (all_done())
+    {
+        return;
+    }
+
+    TRACE_SCOPE("wait for workers");
+    const auto block_time = std::chrono::duration<double>(worker_wait_share * num_samples / sample_rate);
+    const auto wait_time = std::max<std::chrono::nanoseconds>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(block_time), min_worker_wait);
+    const auto deadline = std::chrono::steady_clock::now() + wait_time;
+
+    // Flagged first, so a worker either sees the flag and wakes us, or finished early enough for the check to see it.
+    m_render_waiting_.store(true, std::memory_order_seq_cst);
+    while (true)
+    {
+        const auto done = m_parts_done_.load(std::memory_order_seq_cst);
+        if (all_done())
+        {
+            break;
+        }
+
+        const auto left = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline -
+            std::chrono::steady_clock::now());
+        if (left.count() <= 0)
+        {
+            for (uint32_t i = 0; i < job_size; ++i)
+            {
+                if (m_busy_[m_job_parts_[i].load(std::memory_order_relaxed)].load(std::memory_order_acquire))
+                {
+                    m_late_parts_.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+            break;
+        }
+
+        wait_for_change(m_parts_done_, done, &left);
+    }
+    m_render_waiting_.store(false, std::memory_order_relaxed);
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "../../sound_data.h"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+/**
+ * \brief One MIDI channel worth of sound. Every part has its own voices, wave, envelope, and gain.
+ */
+struct midi_part
+{
+    midi_part();
+
+    sound_data m_sound;
+
+    sound_utilities::wave_type m_wave;
+
+    envelope_data m_envelope;
+
+    // Channels the part rendered into during the current block. Owned by the sound.
+    const float* const* m_output;
+};
+
+/**
+ * \brief Sixteen independent parts, one per MIDI channel, mixed into one output. When enough notes are playing the
+ * parts are spread over a pool of worker threads, otherwise they are rendered on the calling thread.
+ *
+ * Render only waits so long for the workers. A part a worker has not finished by then is left out of the mix and
+ * counted as late, and stays busy until the worker is done with it. Busy parts are skipped by everything else the
+ * engine does, and must not be touched through get_part.
+ */
+class midi_engine
+{
+public:
+    explicit midi_engine(uint32_t num_workers = 0);
+
+    ~midi_engine();
+
+    midi_engine(const midi_engine&) = delete;
+    midi_engine& operator=(const midi_engine&) = delete;
+
+    midi_part& get_part(uint8_t channel);
+
+    bool is_busy(uint8_t channel) const;
+
+    void set_control_period(uint32_t period);
+
+    void release_all();
+
+    void render(float* const* channels, uint32_t num_channels, uint32_t num_samples, int sample_rate);
+
+    const float* const* render(uint32_t num_channels, uint32_t num_samples, int sample_rate);
+
+    bool is_silent() const;
+
+    uint32_t get_voice_count() const;
+
+    void start_workers(uint32_t num_workers);
+
+    uint32_t get_worker_count() const;
+
+    uint64_t get_late_parts() const;
+
+    static uint32_t default_worker_count();
+
+    // One part per MIDI channel.
+    const static uint32_t num_parts = 16;
+
+    // Fewest notes playing before the parts are rendered in parallel. Below this waking the workers costs more than
+    // it saves.
+    const static uint32_t parallel_note_threshold;
+
+private:
+    void worker_loop();
+
+    void render_claimed_parts(uint32_t generation);
+
+    void wait_for_parts(uint32_t job_size, uint32_t num_samples, int sample_rate);
+
+    std::array<midi_part, num_parts> m_parts_;
+
+    // Set for every part in a job before it is published, and cleared by whoever renders the part once it is done.
+    std::array<std::atomic<bool>, num_parts> m_busy_;
+
+    // Releases asked for while a part was busy. Carried out once it is not.
+    std::array<bool, num_parts> m_pending_release_;
+
+    // The block being rendered. Written before the job is published, and read before a part is claimed. A claim only
+    // succeeds if the job is still the current one, so whatever was read is for that job.
+    std::array<std::atomic<uint32_t>, num_parts> m_job_parts_;
+    std::atomic<uint32_t> m_job_channels_;
+    std::atomic<uint32_t> m_job_samples_;
+    std::atomic<int> m_job_sample_rate_;
+
+    // Generation in the top 32 bits, then the job size, then the next part to claim. Claims only succeed on the
+    // current job, so a worker that wakes late can never take a part from the next one.
+    std::atomic<uint64_t> m_next_claim_;
+
+    // Bumped by the workers as they finish parts, and waited on by render when it is waiting for them.
+    std::atomic<uint32_t> m_parts_done_;
+    std::atomic<bool> m_render_waiting_;
+
+    // Parts left out of the mix because their worker was late. Only written by the thread that calls render.
+    std::atomic<uint64_t> m_late_parts_;
+
+    // Bumped by render for every job the workers can help with, and waited on by idle workers. Render never blocks,
+    // it only wakes the workers when some are asleep.
+    std::vector<std::thread> m_workers_;
+    std::atomic<uint32_t> m_generation_;
+    std::atomic<uint32_t> m_sleeping_workers_;
+    std::atomic<bool> m_stopping_;
+
+    // Mixed output for callers that do not bring their own channels.
+    std::vector<float> m_mix_buffer_;
+    std::vector<float*> m_mix_pointers_;
+};
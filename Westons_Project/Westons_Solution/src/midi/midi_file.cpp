@@ -0,0 +1,454 @@
+#include "midi_file.h"
+#include "midi_parser.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Chunk headers are a four letter type and a big endian length.
+static const size_t chunk_header_size = 8;
+static const size_t file_header_size = 6;
+
+static const uint8_t meta_status = 0xFF;
+static const uint8_t sysex_status = 0xF0;
+static const uint8_t sysex_continue_status = 0xF7;
+
+static const uint8_t meta_end_of_track = 0x2F;
+static const uint8_t meta_tempo = 0x51;
+
+// Microseconds per quarter note until the file says otherwise. 120 beats per minute.
+static const uint32_t default_tempo = 500000;
+
+// Variable length numbers are at most four bytes of seven bits each.
+static const uint32_t max_variable_length_bytes = 4;
+
+// SMPTE timing stores -29 for 29.97 drop frame.
+static const uint32_t drop_frame_rate = 29;
+static const double drop_frame_frames_per_second = 30000.0 / 1001.0;
+
+// Typical files spend about this many bytes per event. Only used to size the event list before reading.
+static const size_t estimated_bytes_per_event = 3;
+
+/**
+ * \brief A file mapped into memory for reading. Unmapped when it goes out of scope.
+ */
+struct mapped_file
+{
+    explicit mapped_file(const std::string& path) :
+        m_bytes(nullptr),
+        m_size(0)
+    {
+        const auto descriptor = open(path.c_str(), O_RDONLY);
+        if (descriptor < 0)
+        {
+            return;
+        }
+
+        struct stat file_stat;
+        if (fstat(descriptor, &file_stat) == 0 && file_stat.st_size > 0)
+        {
+            auto* const mapping = mmap(nullptr, static_cast<size_t>(file_stat.st_size), PROT_READ, MAP_PRIVATE,
+                                       descriptor, 0);
+            if (mapping != MAP_FAILED)
+            {
+                m_bytes = static_cast<const uint8_t*>(mapping);
+                m_size = static_cast<size_t>(file_stat.st_size);
+
+                // The whole file is read front to back once.
+                madvise(mapping, m_size, MADV_SEQUENTIAL);
+            }
+        }
+
+        // The mapping stays valid after the descriptor is closed.
+        close(descriptor);
+    }
+
+    ~mapped_file()
+    {
+        if (m_bytes)
+        {
+            munmap(const_cast<uint8_t*>(m_bytes), m_size);
+        }
+    }
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    const uint8_t* m_bytes;
+    size_t m_size;
+};
+
+static uint32_t read_big_endian(const uint8_t* bytes, const uint32_t num_bytes)
+{
+    uint32_t value = 0;
+    for (uint32_t i = 0; i < num_bytes; ++i)
+    {
+        value = value << 8 | bytes[i];
+    }
+    return value;
+}
+
+/**
+ * \brief Reads a variable length number.
+ * \param bytes Bytes to read from.
+ * \param num_bytes Number of bytes that can be read.
+ * \param position Where the number starts. Moved past the number.
+ * \param value Filled with the number.
+ * \return False if the number runs off the end or is too long.
+ */
+static bool read_variable_length(const uint8_t* bytes, const size_t num_bytes, size_t& position, uint32_t& value)
+{
+    value = 0;
+    for (uint32_t i = 0; i < max_variable_length_bytes; ++i)
+    {
+        if (position >= num_bytes)
+        {
+            return false;
+        }
+
+        const auto byte = bytes[position];
+        ++position;
+        value = value << 7 | (byte & 0x7F);
+        if (!(byte & 0x80))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+midi_file::midi_file() :
+    m_sample_rate_(0),
+    m_length_(0),
+    m_division_(0)
+{
+}
+
+/**
+ * \brief Reads the file and places every event on the sample it plays at. Anything loaded before is replaced.
+ * \param path Path of the file.
+ * \param sample_rate Sample rate the file will be played at.
+ * \return If the file could be read. The reason is in get_error when it could not.
+ */
+bool midi_file::load(const std::string& path, const int sample_rate)
+{
+    assert(sample_rate > 0);
+
+    m_events_.clear();
+    m_track_events_.clear();
+    m_sample_rate_ = sample_rate;
+    m_length_ = 0;
+    m_error_.clear();
+
+    const mapped_file file(path);
+    if (!file.m_bytes)
+    {
+        return fail("Could not open " + path + ".");
+    }
+
+    m_track_events_.reserve(file.m_size / estimated_bytes_per_event);
+    if (!read(file.m_bytes, file.m_size))
+    {
+        m_track_events_.clear();
+        return false;
+    }
+
+    place_events();
+
+    // Let go of the tracks now that they are merged.
+    std::vector<track_event>().swap(m_track_events_);
+    std::vector<size_t>().swap(m_track_starts_);
+    return true;
+}
+
+const std::vector<midi_file_event>& midi_file::get_events() const
+{
+    return m_events_;
+}
+
+/**
+ * \brief Finds the first event that plays at or after the given sample.
+ * \param sample Sample to look from.
+ * \return Index of the event. The number of events if there are none left.
+ */
+uint32_t midi_file::find(const uint64_t sample) const
+{
+    const auto found = std::lower_bound(m_events_.begin(), m_events_.end(), sample,
+                                        [](const midi_file_event& event, const uint64_t value)
+                                        {
+                                            return event.m_sample < value;
+                                        });
+    return static_cast<uint32_t>(found - m_events_.begin());
+}
+
+/**
+ * \brief Gets the length of the file. Runs to the end of the longest track, which can be after the last event.
+ * \return Length in samples.
+ */
+uint64_t midi_file::get_length() const
+{
+    return m_length_;
+}
+
+int midi_file::get_sample_rate() const
+{
+    return m_sample_rate_;
+}
+
+const std::string& midi_file::get_error() const
+{
+    return m_error_;
+}
+
+/**
+ * \brief Reads the header and every track in the file. Chunks that are not tracks are skipped.
+ * \param bytes Contents of the file.
+ * \param num_bytes Size of the file.
+ * \return If the file could be read.
+ */
+bool midi_file::read(const uint8_t* bytes, const size_t num_bytes)
+{
+    if (num_bytes < chunk_header_size + file_header_size || !std::equal(bytes, bytes + 4, "MThd"))
+    {
+        return fail("Not a MIDI file.");
+    }
+
+    const auto header_size = read_big_endian(bytes + 4, 4);
+    if (header_size < file_header_size || header_size > num_bytes - chunk_header_size)
+    {
+        return fail("The MIDI file header is damaged.");
+    }
+
+    const auto* const header = bytes + chunk_header_size;
+    const auto format = read_big_endian(header, 2);
+    const auto num_tracks = read_big_endian(header + 2, 2);
+    m_division_ = static_cast<uint16_t>(read_big_endian(header + 4, 2));
+
+    if (format > 1)
+    {
+        return fail("Only format 0 and 1 MIDI files can be played.");
+    }
+
+    if (m_division_ == 0 || ((m_division_ & 0x8000) && (m_division_ & 0xFF) == 0))
+    {
+        return fail("The MIDI file has no timing.");
+    }
+
+    m_track_starts_.assign(1, 0);
+    uint32_t tracks_read = 0;
+    auto position = chunk_header_size + header_size;
+    while (tracks_read < num_tracks && num_bytes - position >= chunk_header_size)
+    {
+        const auto* const chunk = bytes + position;
+        const size_t chunk_size = read_big_endian(chunk + 4, 4);
+        position += chunk_header_size;
+
+        // A track that says it is longer than the file is read up to the end.
+        const auto available = std::min(chunk_size, num_bytes - position);
+        if (std::equal(chunk, chunk + 4, "MTrk"))
+        {
+            if (!read_track(bytes + position, available))
+            {
+                return false;
+            }
+            m_track_starts_.push_back(m_track_events_.size());
+            ++tracks_read;
+        }
+
+        position += available;
+    }
+
+    if (tracks_read == 0)
+    {
+        return fail("The MIDI file has no tracks.");
+    }
+
+    return true;
+}
+
+/**
+ * \brief Reads the events of one track. Channel events are decoded, tempo changes and the end are kept for timing,
+ * and everything else is skipped. A track that is cut short keeps the events read up to that point.
+ * \param bytes Contents of the track.
+ * \param num_bytes Size of the track.
+ * \return If the track could be read.
+ */
+bool midi_file::read_track(const uint8_t* bytes, const size_t num_bytes)
+{
+    midi_parser parser;
+    uint64_t tick = 0;
+    uint8_t running_status = 0;
+    size_t position = 0;
+
+    while (position < num_bytes)
+    {
+        uint32_t delta;
+        if (!read_variable_length(bytes, num_bytes, position, delta) || position >= num_bytes)
+        {
+            break;
+        }
+        tick += delta;
+
+        auto status = bytes[position];
+        if (status == meta_status || status == sysex_status || status == sysex_continue_status)
+        {
+            ++position;
+
+            // Meta and SysEx events cancel running status.
+            running_status = 0;
+            parser.reset();
+
+            auto meta_type = uint8_t(0);
+            if (status == meta_status)
+            {
+                if (position >= num_bytes)
+                {
+                    break;
+                }
+                meta_type = bytes[position];
+                ++position;
+            }
+
+            uint32_t length;
+            if (!read_variable_length(bytes, num_bytes, position, length) || length > num_bytes - position)
+            {
+                break;
+            }
+
+            const auto tempo = length == 3 ? read_big_endian(bytes + position, 3) : 0;
+            if (status == meta_status && meta_type == meta_tempo && tempo > 0)
+            {
+                m_track_events_.push_back(track_event{tick, tempo, midi_event()});
+            }
+            else if (status == meta_status && meta_type == meta_end_of_track)
+            {
+                m_track_events_.push_back(track_event{tick, 0, midi_event()});
+                return true;
+            }
+
+            position += length;
+            continue;
+        }
+
+        // Data with no status in front of it uses the last one.
+        if (status & 0x80)
+        {
+            running_status = status;
+            ++position;
+        }
+        else if (running_status == 0)
+        {
+            return fail("A MIDI file track has data with no status.");
+        }
+        else
+        {
+            status = running_status;
+        }
+
+        // Program change and channel aftertouch have one data byte, the rest of the channel messages have two.
+        const auto nibble = status >> 4;
+        const size_t data_length = nibble == midi_program_change || nibble == midi_channel_aftertouch ? 1 : 2;
+        if (data_length > num_bytes - position)
+        {
+            break;
+        }
+
+        // System common messages do not belong in a file. Skip them like the parser would.
+        if (status >= 0xF0)
+        {
+            running_status = 0;
+            position += data_length;
+            continue;
+        }
+
+        const uint8_t message[3] = {status, bytes[position], data_length == 2 ? bytes[position + 1] : uint8_t(0)};
+        position += data_length;
+
+        midi_event event;
+        if (parser.parse(message, static_cast<uint32_t>(1 + data_length), &event, 1) == 1)
+        {
+            m_track_events_.push_back(track_event{tick, 0, event});
+        }
+    }
+
+    // No end of track. Count the track as ending at the last event.
+    m_track_events_.push_back(track_event{tick, 0, midi_event()});
+    return true;
+}
+
+/**
+ * \brief Merges the tracks and turns ticks into samples. Events on the same tick keep the order of their tracks, so
+ * a tempo change in the first track lands before notes on the same tick in the others.
+ */
+void midi_file::place_events()
+{
+    // Each track is already in order, so fold them into the merged ones one at a time.
+    const auto earlier = [](const track_event& a, const track_event& b)
+    {
+        return a.m_tick < b.m_tick;
+    };
+    for (size_t i = 1; i + 1 < m_track_starts_.size(); ++i)
+    {
+        std::inplace_merge(m_track_events_.begin(), m_track_events_.begin() + m_track_starts_[i],
+                           m_track_events_.begin() + m_track_starts_[i + 1], earlier);
+    }
+
+    // Samples per tick, worked out again at every tempo change. SMPTE timing has no tempo.
+    double samples_per_tick;
+    const auto smpte = (m_division_ & 0x8000) != 0;
+    if (smpte)
+    {
+        const auto frame_rate = static_cast<uint32_t>(-static_cast<int8_t>(m_division_ >> 8));
+        const auto frames_per_second = frame_rate == drop_frame_rate ? drop_frame_frames_per_second : frame_rate;
+        samples_per_tick = m_sample_rate_ / (frames_per_second * (m_division_ & 0xFF));
+    }
+    else
+    {
+        samples_per_tick = m_sample_rate_ * (default_tempo / 1000000.0) / m_division_;
+    }
+
+    // Where the current tempo started.
+    uint64_t tempo_tick = 0;
+    auto tempo_sample = 0.0;
+
+    m_events_.reserve(m_track_events_.size());
+    for (const auto& track_event : m_track_events_)
+    {
+        const auto sample = tempo_sample + static_cast<double>(track_event.m_tick - tempo_tick) * samples_per_tick;
+        const auto rounded_sample = static_cast<uint64_t>(std::llround(sample));
+
+        if (track_event.m_tempo != 0)
+        {
+            if (!smpte)
+            {
+                tempo_tick = track_event.m_tick;
+                tempo_sample = sample;
+                samples_per_tick = m_sample_rate_ * (track_event.m_tempo / 1000000.0) / m_division_;
+            }
+        }
+        else if (track_event.m_event.m_type != midi_none)
+        {
+            m_events_.push_back(midi_file_event{rounded_sample, track_event.m_event});
+        }
+
+        m_length_ = std::max(m_length_, rounded_sample);
+    }
+}
+
+/**
+ * \brief Throws away anything read so far and keeps the error.
+ * \param error What went wrong.
+ * \return Always false.
+ */
+bool midi_file::fail(const std::string& error)
+{
+    m_events_.clear();
+    m_error_ = error;
+    return false;
+}
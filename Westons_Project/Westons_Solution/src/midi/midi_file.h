@@ -0,0 +1,80 @@
+#pragma once
+
+#include "../../MidiMessages.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * \brief An event from a MIDI file and the sample it plays on.
+ */
+struct midi_file_event
+{
+    uint64_t m_sample;
+
+    midi_event m_event;
+};
+
+/**
+ * \brief A Standard MIDI File, format 0 or 1, read ahead of time into one list of events. The tracks are merged and
+ * every event is placed on the sample it plays at, so playing the file is just walking the list.
+ */
+class midi_file
+{
+public:
+    midi_file();
+
+    bool load(const std::string& path, int sample_rate);
+
+    const std::vector<midi_file_event>& get_events() const;
+
+    uint32_t find(uint64_t sample) const;
+
+    uint64_t get_length() const;
+
+    int get_sample_rate() const;
+
+    const std::string& get_error() const;
+
+private:
+    /**
+     * \brief An event as it was read from its track. Tempo changes and track ends are kept in with the channel events
+     * so they can be sorted together.
+     */
+    struct track_event
+    {
+        uint64_t m_tick;
+
+        // Microseconds per quarter note when this is a tempo change, otherwise 0.
+        uint32_t m_tempo;
+
+        // midi_none when this is a tempo change or the end of a track.
+        midi_event m_event;
+    };
+
+    bool read(const uint8_t* bytes, size_t num_bytes);
+
+    bool read_track(const uint8_t* bytes, size_t num_bytes);
+
+    void place_events();
+
+    bool fail(const std::string& error);
+
+    std::vector<midi_file_event> m_events_;
+
+    // Events of every track while the file is being read. Emptied once they have been placed.
+    std::vector<track_event> m_track_events_;
+
+    // Where each tracks events start, and one past the last track.
+    std::vector<size_t> m_track_starts_;
+
+    int m_sample_rate_;
+    uint64_t m_length_;
+
+    // Division from the header. Ticks per quarter note, or frames per second and ticks per frame when the top bit is
+    // set.
+    uint16_t m_division_;
+
+    std::string m_error_;
+};
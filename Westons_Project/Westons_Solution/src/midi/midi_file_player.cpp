@@ -0,0 +1,90 @@
+#include "midi_file_player.h"
+
+#include <algorithm>
+#include <cassert>
+
+/**
+ * \brief Construct a player at the start of the file.
+ * \param file File to play. Has to outlive the player, and cannot be loaded again while it is played.
+ */
+midi_file_player::midi_file_player(const midi_file& file) :
+    m_file_(file),
+    m_next_event_(0),
+    m_position_(0)
+{
+}
+
+/**
+ * \brief Moves the player to the given sample. Events before it are skipped. Notes that are already playing are left
+ * alone, so release them first if the jump should be clean.
+ * \param sample Sample to move to.
+ */
+void midi_file_player::seek(const uint64_t sample)
+{
+    m_next_event_ = m_file_.find(sample);
+    m_position_ = sample;
+}
+
+/**
+ * \brief Gets how many samples can be rendered before the next event is due.
+ * \param max_samples Most samples that are wanted.
+ * \return Samples until the next event, up to max_samples. 0 when events are due now.
+ */
+uint32_t midi_file_player::samples_until_event(const uint32_t max_samples) const
+{
+    const auto& events = m_file_.get_events();
+    if (m_next_event_ >= events.size())
+    {
+        return max_samples;
+    }
+
+    const auto next_sample = events[m_next_event_].m_sample;
+    if (next_sample <= m_position_)
+    {
+        return 0;
+    }
+
+    return static_cast<uint32_t>(std::min<uint64_t>(next_sample - m_position_, max_samples));
+}
+
+/**
+ * \brief Takes every event that is due at the current sample.
+ * \param num_events Filled with the number of events taken.
+ * \return The events taken. Stays valid as long as the file does.
+ */
+const midi_file_event* midi_file_player::take_due_events(uint32_t& num_events)
+{
+    const auto& events = m_file_.get_events();
+    const auto first = m_next_event_;
+    while (m_next_event_ < events.size() && events[m_next_event_].m_sample <= m_position_)
+    {
+        ++m_next_event_;
+    }
+
+    num_events = m_next_event_ - first;
+    return events.data() + first;
+}
+
+/**
+ * \brief Moves the player forward once the samples have been rendered.
+ * \param num_samples Samples rendered. Cannot go past the next event.
+ */
+void midi_file_player::advance(const uint32_t num_samples)
+{
+    assert(num_samples <= samples_until_event(num_samples));
+    m_position_ += num_samples;
+}
+
+uint64_t midi_file_player::get_position() const
+{
+    return m_position_;
+}
+
+/**
+ * \brief Checks if the player has passed the end of the file.
+ * \return If there is nothing left to play.
+ */
+bool midi_file_player::is_finished() const
+{
+    return m_next_event_ >= m_file_.get_events().size() && m_position_ >= m_file_.get_length();
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "midi_file.h"
+
+#include <cstdint>
+
+/**
+ * \brief Walks through a loaded MIDI file in step with the audio. The caller renders up to the next event, takes the
+ * events that are due, and moves on, so every event lands on the sample it was placed at.
+ */
+class midi_file_player
+{
+public:
+    explicit midi_file_player(const midi_file& file);
+
+    void seek(uint64_t sample);
+
+    uint32_t samples_until_event(uint32_t max_samples) const;
+
+    const midi_file_event* take_due_events(uint32_t& num_events);
+
+    void advance(uint32_t num_samples);
+
+    uint64_t get_position() const;
+
+    bool is_finished() const;
+
+private:
+    const midi_file& m_file_;
+
+    // Next event to hand out.
+    uint32_t m_next_event_;
+
+    // Sample the player is at.
+    uint64_t m_position_;
+};
@@ -0,0 +1,126 @@
+#include "midi_latency_probe.h"
+
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+#include <limits>
+
+const uint8_t midi_latency_probe::num_keys;
+
+midi_latency_probe::midi_latency_probe()
+{
+    reset();
+}
+
+/**
+ * \brief Forgets everything that has been measured. Cannot be called while notes are moving through.
+ */
+void midi_latency_probe::reset()
+{
+    m_origin_ = std::chrono::steady_clock::now();
+    for (auto& sent_time : m_sent_times_)
+    {
+        sent_time.store(0, std::memory_order_relaxed);
+    }
+
+    m_sent_count_.store(0, std::memory_order_relaxed);
+    m_pending_count_ = 0;
+    m_pending_time_sum_ = 0;
+    m_pending_earliest_ = std::numeric_limits<int64_t>::max();
+    m_added_count_ = 0;
+    m_rendered_count_ = 0;
+    m_latency_sum_ = 0;
+    m_latency_max_ = 0;
+}
+
+/**
+ * \brief Stamps a key as it is sent. Called by the sender just before the note on goes out.
+ * \param key Key of the note.
+ */
+void midi_latency_probe::mark_sent(const uint8_t key)
+{
+    assert(key < num_keys);
+    m_sent_times_[key].store(now(), std::memory_order_release);
+    m_sent_count_.fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+ * \brief Marks a note as added to the sound. Called by the callback as it plays the note on.
+ * \param key Key of the note.
+ */
+void midi_latency_probe::mark_added(const uint8_t key)
+{
+    assert(key < num_keys);
+    ++m_added_count_;
+
+    // Notes that were not sent by the prober have nothing to measure.
+    const auto sent_time = m_sent_times_[key].load(std::memory_order_acquire);
+    if (sent_time == 0)
+    {
+        return;
+    }
+
+    ++m_pending_count_;
+    m_pending_time_sum_ += sent_time;
+    m_pending_earliest_ = std::min(m_pending_earliest_, sent_time);
+}
+
+/**
+ * \brief Marks every added note as rendered. Called by the callback once it has rendered the buffer.
+ */
+void midi_latency_probe::mark_rendered()
+{
+    if (m_pending_count_ == 0)
+    {
+        return;
+    }
+
+    // Every waiting note is heard now, so the total wait is the count times now less the send times.
+    const auto rendered_time = now();
+    m_latency_sum_ += static_cast<int64_t>(m_pending_count_) * rendered_time - m_pending_time_sum_;
+    m_latency_max_ = std::max(m_latency_max_, rendered_time - m_pending_earliest_);
+    m_rendered_count_ += m_pending_count_;
+
+    m_pending_count_ = 0;
+    m_pending_time_sum_ = 0;
+    m_pending_earliest_ = std::numeric_limits<int64_t>::max();
+}
+
+uint64_t midi_latency_probe::get_sent_count() const
+{
+    return m_sent_count_.load(std::memory_order_relaxed);
+}
+
+uint64_t midi_latency_probe::get_added_count() const
+{
+    return m_added_count_;
+}
+
+/**
+ * \brief Prints how many notes made it through, and how long they took.
+ * \param name Name to print the numbers under.
+ */
+void midi_latency_probe::report(const std::string& name) const
+{
+    const auto sent = get_sent_count();
+    const auto lost = sent > m_added_count_ ? sent - m_added_count_ : 0;
+
+    std::cout << name << ": " << sent << " notes sent, " << m_added_count_ << " played, " << lost << " lost";
+    if (m_rendered_count_ > 0)
+    {
+        const auto average = static_cast<double>(m_latency_sum_) / m_rendered_count_ / 1000000.0;
+        std::cout << ", send to render latency average " << average << " ms, max "
+            << static_cast<double>(m_latency_max_) / 1000000.0 << " ms";
+    }
+    std::cout << "." << std::endl;
+}
+
+/**
+ * \brief Gets the current time. Never 0, so 0 can mean never sent.
+ * \return Nanoseconds since the last reset, plus one.
+ */
+int64_t midi_latency_probe::now() const
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_origin_).count()
+        + 1;
+}
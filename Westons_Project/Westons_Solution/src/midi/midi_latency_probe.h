@@ -0,0 +1,56 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+/**
+ * \brief Measures how long notes take from being sent to being heard. The sender stamps each key as it goes out, and
+ * the callback marks the note once it is in the sound and then every waiting note as rendered.
+ *
+ * Stamps are kept per key, so a key that is sent again before it is played is measured from the later send.
+ */
+class midi_latency_probe
+{
+public:
+    midi_latency_probe();
+
+    void reset();
+
+    void mark_sent(uint8_t key);
+
+    void mark_added(uint8_t key);
+
+    void mark_rendered();
+
+    uint64_t get_sent_count() const;
+
+    uint64_t get_added_count() const;
+
+    void report(const std::string& name) const;
+
+    const static uint8_t num_keys = 128;
+
+private:
+    int64_t now() const;
+
+    // Times are kept from here so sums of them stay small.
+    std::chrono::steady_clock::time_point m_origin_;
+
+    // Written by the sender.
+    std::array<std::atomic<int64_t>, num_keys> m_sent_times_;
+    std::atomic<uint64_t> m_sent_count_;
+
+    // Notes added since the last render. Written by the callback.
+    uint64_t m_pending_count_;
+    int64_t m_pending_time_sum_;
+    int64_t m_pending_earliest_;
+    uint64_t m_added_count_;
+
+    // Written by the callback.
+    uint64_t m_rendered_count_;
+    int64_t m_latency_sum_;
+    int64_t m_latency_max_;
+};
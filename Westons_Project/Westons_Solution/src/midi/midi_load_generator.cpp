@@ -0,0 +1,293 @@
+#include "midi_load_generator.h"
+#include "../rtmidi/RtMidi.h"
+
+#include <array>
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <random>
+
+const std::string midi_load_generator::port_name = "Westons Load Generator";
+
+static const uint8_t note_on_status = 0x90;
+static const uint8_t note_off_status = 0x80;
+static const uint8_t control_change_status = 0xB0;
+
+static const uint8_t load_velocity = 100;
+static const uint8_t controller_on_value = 127;
+
+// Keys the patterns stay inside of.
+static const uint8_t lowest_key = 36;
+static const uint8_t highest_key = 96;
+
+// Most notes a storm holds before it starts letting the oldest go.
+static const uint32_t storm_held_notes = 16;
+
+// Major triad on top of the root.
+static const std::array<uint8_t, 3> chord_intervals = {0, 4, 7};
+
+midi_load_generator::settings::settings() :
+    m_pattern(storm),
+    m_events_per_second(1000),
+    m_duration_seconds(10.0f),
+    m_channel(0),
+    m_quit_controller(81)
+{
+}
+
+/**
+ * \brief Construct a generator. Nothing is opened or sent until open and start.
+ * \param load_settings What to play.
+ * \param probe Stamped with every note on as it is sent. Can be null.
+ */
+midi_load_generator::midi_load_generator(const settings& load_settings, midi_latency_probe* probe) :
+    m_settings_(load_settings),
+    m_probe_(probe),
+    m_output_(nullptr),
+    m_running_(false)
+{
+    assert(m_settings_.m_events_per_second > 0);
+    assert(m_settings_.m_channel < 16);
+}
+
+midi_load_generator::~midi_load_generator()
+{
+    stop();
+    delete m_output_;
+}
+
+/**
+ * \brief Creates the virtual port. Has to happen before the driver looks for ports to open.
+ * \return If the port was created.
+ */
+bool midi_load_generator::open()
+{
+    if (m_output_)
+    {
+        return true;
+    }
+
+    try
+    {
+        m_output_ = new RtMidiOut();
+        m_output_->openVirtualPort(port_name);
+    }
+    catch (RtMidiError& error)
+    {
+        error.printMessage();
+        delete m_output_;
+        m_output_ = nullptr;
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * \brief Starts playing on a thread of its own.
+ */
+void midi_load_generator::start()
+{
+    assert(m_output_);
+    if (m_running_)
+    {
+        return;
+    }
+
+    m_running_ = true;
+    m_thread_ = std::thread(&midi_load_generator::run, this);
+}
+
+/**
+ * \brief Stops playing early. Does nothing if it already finished.
+ */
+void midi_load_generator::stop()
+{
+    m_running_ = false;
+    if (m_thread_.joinable())
+    {
+        m_thread_.join();
+    }
+}
+
+/**
+ * \brief Reads settings from text in the form pattern or pattern:events_per_second.
+ * \param text Text to read. Pattern is one of chords, glissando, or storm.
+ * \param load_settings Filled in from the text. Left alone if the text can't be read.
+ * \return If the text could be read.
+ */
+bool midi_load_generator::from_string(const std::string& text, settings& load_settings)
+{
+    const auto split = text.find(':');
+    const auto name = text.substr(0, split);
+
+    auto result = load_settings;
+    if (name == "chords")
+    {
+        result.m_pattern = chords;
+    }
+    else if (name == "glissando")
+    {
+        result.m_pattern = glissando;
+    }
+    else if (name == "storm")
+    {
+        result.m_pattern = storm;
+    }
+    else
+    {
+        return false;
+    }
+
+    if (split != std::string::npos)
+    {
+        try
+        {
+            const auto rate = std::stoi(text.substr(split + 1));
+            if (rate <= 0)
+            {
+                return false;
+            }
+            result.m_events_per_second = static_cast<uint32_t>(rate);
+        }
+        catch (...)
+        {
+            return false;
+        }
+    }
+
+    load_settings = result;
+    return true;
+}
+
+/**
+ * \brief Sends the pattern at the set rate until the duration is up, then lets every note go and asks the driver to
+ * quit. Events are scheduled against the start time, so a late wakeup sends a burst to catch up.
+ */
+void midi_load_generator::run()
+{
+    const auto event_period = std::chrono::nanoseconds(1000000000ull / m_settings_.m_events_per_second);
+    const auto start_time = std::chrono::steady_clock::now();
+    const auto end_time = start_time + std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::duration<float>(m_settings_.m_duration_seconds));
+
+    std::minstd_rand random(1);
+    std::uniform_int_distribution<int> key_distribution(lowest_key, highest_key);
+
+    // Notes that are still held, oldest first.
+    std::array<uint8_t, storm_held_notes> held{};
+    uint32_t held_start = 0;
+    uint32_t held_count = 0;
+
+    auto glissando_key = lowest_key;
+    auto glissando_step = 1;
+    auto chord_root = lowest_key;
+
+    uint64_t events_sent = 0;
+    while (m_running_ && std::chrono::steady_clock::now() < end_time)
+    {
+        std::this_thread::sleep_until(start_time + event_period * events_sent);
+
+        switch (m_settings_.m_pattern)
+        {
+        case chords:
+            // Let the last chord go and play the next one up. Each note on and off is an event.
+            for (uint32_t i = 0; i < held_count; ++i)
+            {
+                note_off(held[i]);
+            }
+            events_sent += held_count;
+            held_count = 0;
+
+            for (const auto interval : chord_intervals)
+            {
+                held[held_count] = static_cast<uint8_t>(chord_root + interval);
+                note_on(held[held_count]);
+                ++held_count;
+            }
+            events_sent += chord_intervals.size();
+
+            chord_root = chord_root + 1 + chord_intervals.back() > highest_key ? lowest_key : chord_root + 1;
+            break;
+        case glissando:
+            // One key at a time, up and back down.
+            if (held_count > 0)
+            {
+                note_off(held[0]);
+                ++events_sent;
+            }
+            held[0] = glissando_key;
+            held_count = 1;
+            note_on(glissando_key);
+            ++events_sent;
+
+            if (glissando_key + glissando_step > highest_key || glissando_key + glissando_step < lowest_key)
+            {
+                glissando_step = -glissando_step;
+            }
+            glissando_key = static_cast<uint8_t>(glissando_key + glissando_step);
+            break;
+        case storm:
+        default:
+            // Random keys, letting the oldest go once too many are held.
+            if (held_count == storm_held_notes)
+            {
+                note_off(held[held_start]);
+                held_start = (held_start + 1) % storm_held_notes;
+                --held_count;
+                ++events_sent;
+            }
+            {
+                const auto key = static_cast<uint8_t>(key_distribution(random));
+                held[(held_start + held_count) % storm_held_notes] = key;
+                ++held_count;
+                note_on(key);
+                ++events_sent;
+            }
+            break;
+        }
+    }
+
+    // Let go of anything still playing.
+    for (uint32_t i = 0; i < held_count; ++i)
+    {
+        const auto index = m_settings_.m_pattern == storm ? (held_start + i) % storm_held_notes : i;
+        note_off(held[index]);
+    }
+
+    if (m_running_ && m_settings_.m_quit_controller <= 127)
+    {
+        send(control_change_status, m_settings_.m_quit_controller, controller_on_value);
+    }
+
+    std::cout << "Load generator sent " << events_sent << " events in "
+        << std::chrono::duration<float>(std::chrono::steady_clock::now() - start_time).count() << " s." << std::endl;
+    m_running_ = false;
+}
+
+void midi_load_generator::send(const uint8_t status, const uint8_t number, const uint8_t value)
+{
+    const unsigned char message[3] = {static_cast<unsigned char>(status | m_settings_.m_channel), number, value};
+    try
+    {
+        m_output_->sendMessage(message, sizeof(message));
+    }
+    catch (RtMidiError& error)
+    {
+        error.printMessage();
+    }
+}
+
+void midi_load_generator::note_on(const uint8_t key)
+{
+    if (m_probe_)
+    {
+        m_probe_->mark_sent(key);
+    }
+    send(note_on_status, key, load_velocity);
+}
+
+void midi_load_generator::note_off(const uint8_t key)
+{
+    send(note_off_status, key, 0);
+}
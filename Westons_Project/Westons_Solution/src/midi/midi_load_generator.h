@@ -0,0 +1,80 @@
+#pragma once
+
+#include "midi_latency_probe.h"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+class RtMidiOut;
+
+/**
+ * \brief Plays synthetic MIDI into a virtual sequencer port so the MIDI driver can be loaded without any hardware.
+ */
+class midi_load_generator
+{
+public:
+    enum pattern
+    {
+        chords,
+        glissando,
+        storm
+    };
+
+    /**
+     * \brief What to play, how fast, and for how long.
+     */
+    struct settings
+    {
+        settings();
+
+        pattern m_pattern;
+
+        // Note ons and note offs sent each second, counted together.
+        uint32_t m_events_per_second;
+
+        float m_duration_seconds;
+
+        // Channel everything is sent on. 0 <-> 15
+        uint8_t m_channel;
+
+        // Controller that is sent at the end to tell the driver to quit. Left unsent when above 127.
+        uint8_t m_quit_controller;
+    };
+
+    explicit midi_load_generator(const settings& load_settings, midi_latency_probe* probe = nullptr);
+
+    ~midi_load_generator();
+
+    midi_load_generator(const midi_load_generator&) = delete;
+    midi_load_generator& operator=(const midi_load_generator&) = delete;
+
+    bool open();
+
+    void start();
+
+    void stop();
+
+    static bool from_string(const std::string& text, settings& load_settings);
+
+    // Name of the virtual port, so the driver can be pointed at it.
+    const static std::string port_name;
+
+private:
+    void run();
+
+    void send(uint8_t status, uint8_t number, uint8_t value);
+
+    void note_on(uint8_t key);
+
+    void note_off(uint8_t key);
+
+    settings m_settings_;
+    midi_latency_probe* m_probe_;
+
+    RtMidiOut* m_output_;
+
+    std::thread m_thread_;
+    std::atomic<bool> m_running_;
+};
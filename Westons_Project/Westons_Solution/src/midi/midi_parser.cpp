@@ -0,0 +1,176 @@
+#include "midi_parser.h"
+
+#include <cassert>
+
+// Status bytes have the top bit set. Real time bytes can show up anywhere, even in the middle of a message.
+static const uint8_t status_bit = 0x80;
+static const uint8_t system_status = 0xF0;
+static const uint8_t real_time_status = 0xF8;
+
+static const int16_t pitch_bend_center = 8192;
+
+const midi_parser::decoder midi_parser::decoders_[16] = {
+    // 0x0 - 0x7 are data bytes, they never reach a decoder.
+    decode_none, decode_none, decode_none, decode_none, decode_none, decode_none, decode_none, decode_none,
+    decode_note_off,     // 0x8
+    decode_note_on,      // 0x9
+    decode_number_value, // 0xA poly aftertouch
+    decode_number_value, // 0xB control change
+    decode_value,        // 0xC program change
+    decode_value,        // 0xD channel aftertouch
+    decode_pitch_bend,   // 0xE
+    decode_none          // 0xF system messages are skipped.
+};
+
+const uint8_t midi_parser::data_lengths_[16] = {
+    0, 0, 0, 0, 0, 0, 0, 0,
+    2, 2, 2, 2, 1, 1, 2,
+    0
+};
+
+midi_parser::midi_parser() :
+    m_running_status_(0),
+    m_data_{0, 0},
+    m_data_count_(0)
+{
+}
+
+/**
+ * \brief Feeds one byte into the parser.
+ * \param byte Next byte of the stream.
+ * \param event Filled out when the byte completes a channel voice message.
+ * \return If the event was filled out.
+ */
+bool midi_parser::parse(const uint8_t byte, midi_event& event)
+{
+    if (byte & status_bit)
+    {
+        // Real time messages are one byte and leave the message in progress alone.
+        if (byte >= real_time_status)
+        {
+            return false;
+        }
+
+        // System common and SysEx cancel running status. Their data bytes are skipped until the next status.
+        m_running_status_ = byte < system_status ? byte : 0;
+        m_data_count_ = 0;
+        return false;
+    }
+
+    // Data with no status to go with it.
+    if (m_running_status_ == 0)
+    {
+        return false;
+    }
+
+    const auto nibble = m_running_status_ >> 4;
+    m_data_[m_data_count_] = byte;
+    ++m_data_count_;
+    if (m_data_count_ < data_lengths_[nibble])
+    {
+        return false;
+    }
+
+    // Keep the status so the next data bytes can reuse it.
+    m_data_count_ = 0;
+    return decoders_[nibble](m_running_status_, m_data_, event);
+}
+
+/**
+ * \brief Feeds a run of bytes into the parser.
+ * \param bytes Bytes to parse. Can hold any number of messages, and can start or end part way through one.
+ * \param num_bytes Number of bytes.
+ * \param events Filled with the decoded events, in order.
+ * \param max_events Room in the events buffer. Parsing stops once it is full.
+ * \return Number of events that were filled out.
+ */
+uint32_t midi_parser::parse(const uint8_t* bytes, const uint32_t num_bytes, midi_event* events,
+                            const uint32_t max_events)
+{
+    uint32_t num_events = 0;
+    for (uint32_t i = 0; i < num_bytes && num_events < max_events; ++i)
+    {
+        if (parse(bytes[i], events[num_events]))
+        {
+            ++num_events;
+        }
+    }
+
+    return num_events;
+}
+
+/**
+ * \brief Forgets the running status and any partly read message.
+ */
+void midi_parser::reset()
+{
+    m_running_status_ = 0;
+    m_data_count_ = 0;
+}
+
+bool midi_parser::decode_none(const uint8_t status, const uint8_t* data, midi_event& event)
+{
+    static_cast<void>(status);
+    static_cast<void>(data);
+    static_cast<void>(event);
+    return false;
+}
+
+bool midi_parser::decode_note_off(const uint8_t status, const uint8_t* data, midi_event& event)
+{
+    event.m_type = midi_note_off;
+    event.m_channel = status & 0x0F;
+    event.m_number = data[0];
+    event.m_value = data[1];
+    event.m_bend = 0;
+    return true;
+}
+
+/**
+ * \brief Note on with no velocity is a note off. Plenty of keyboards send it that way to make use of running status.
+ */
+bool midi_parser::decode_note_on(const uint8_t status, const uint8_t* data, midi_event& event)
+{
+    decode_note_off(status, data, event);
+    if (data[1] != 0)
+    {
+        event.m_type = midi_note_on;
+    }
+
+    return true;
+}
+
+bool midi_parser::decode_number_value(const uint8_t status, const uint8_t* data, midi_event& event)
+{
+    event.m_type = static_cast<midi_event_type>(status >> 4);
+    event.m_channel = status & 0x0F;
+    event.m_number = data[0];
+    event.m_value = data[1];
+    event.m_bend = 0;
+    return true;
+}
+
+bool midi_parser::decode_value(const uint8_t status, const uint8_t* data, midi_event& event)
+{
+    event.m_type = static_cast<midi_event_type>(status >> 4);
+    event.m_channel = status & 0x0F;
+
+    // Program changes carry a number, aftertouch carries a value.
+    event.m_number = event.m_type == midi_program_change ? data[0] : 0;
+    event.m_value = event.m_type == midi_program_change ? 0 : data[0];
+    event.m_bend = 0;
+    return true;
+}
+
+bool midi_parser::decode_pitch_bend(const uint8_t status, const uint8_t* data, midi_event& event)
+{
+    event.m_type = midi_pitch_bend;
+    event.m_channel = status & 0x0F;
+    event.m_number = 0;
+    event.m_value = 0;
+
+    // Least significant seven bits come first.
+    event.m_bend = static_cast<int16_t>((data[1] << 7 | data[0]) - pitch_bend_center);
+    assert(event.m_bend >= -pitch_bend_center && event.m_bend < pitch_bend_center);
+    return true;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "../../MidiMessages.h"
+
+#include <cstdint>
+
+/**
+ * \brief Turns a stream of MIDI bytes into channel voice events. Handles running status, lets real time bytes through
+ * without breaking a message, and skips system and SysEx data. Never allocates.
+ */
+class midi_parser
+{
+public:
+    midi_parser();
+
+    bool parse(uint8_t byte, midi_event& event);
+
+    uint32_t parse(const uint8_t* bytes, uint32_t num_bytes, midi_event* events, uint32_t max_events);
+
+    void reset();
+
+private:
+    // Fills the event from a complete message. Returns false if the message does not make an event.
+    typedef bool (*decoder)(uint8_t status, const uint8_t* data, midi_event& event);
+
+    static bool decode_none(uint8_t status, const uint8_t* data, midi_event& event);
+
+    static bool decode_note_off(uint8_t status, const uint8_t* data, midi_event& event);
+
+    static bool decode_note_on(uint8_t status, const uint8_t* data, midi_event& event);
+
+    static bool decode_number_value(uint8_t status, const uint8_t* data, midi_event& event);
+
+    static bool decode_value(uint8_t status, const uint8_t* data, midi_event& event);
+
+    static bool decode_pitch_bend(uint8_t status, const uint8_t* data, midi_event& event);
+
+    // Decoder and number of data bytes for each status nibble.
+    static const decoder decoders_[16];
+    static const uint8_t data_lengths_[16];
+
+    // Status of the message being read. Kept after a message finishes so running status works. 0 when there is none.
+    uint8_t m_running_status_;
+
+    uint8_t m_data_[2];
+    uint8_t m_data_count_;
+};
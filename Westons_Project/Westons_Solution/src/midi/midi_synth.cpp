@@ -0,0 +1,425 @@
+#include "midi_synth.h"
+#include "midi_file_player.h"
+#include "midi_latency_probe.h"
+
+#include <cassert>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+
+const uint8_t midi_control_map::no_controller = 255;
+const uint8_t midi_synth::num_keys;
+const uint32_t midi_synth::max_deferred_events;
+
+// Samples between updates of the envelopes and gains.
+static const uint32_t midi_control_period = 32;
+
+// How far the lowest and highest keys are panned away from center.
+static const float key_pan_spread = 0.6f;
+
+// Envelope every part starts with.
+static const envelope_data midi_envelope = envelope_data(10.0f, 150.0f, 0.7f, 250.0f);
+
+// Filter cutoff at the middle note. Moves with the key and opens up with velocity.
+static const float filter_base_cutoff = 2000.0f;
+static const float filter_key_tracking = 0.5f;
+static const float filter_velocity_amount = 0.75f;
+static const float filter_resonance = 1.0f;
+
+// Waves in the order that mapped controllers and programs pick them.
+static const sound_utilities::wave_type mapped_waves[] = {
+    sound_utilities::sine, sound_utilities::square, sound_utilities::sawtooth, sound_utilities::triangle
+};
+static const uint8_t num_mapped_waves = 4;
+
+// Switch style controllers are on at or above the half way value.
+static const uint8_t controller_switch_on_value = 64;
+
+static const uint8_t middle_note_value = 60;
+static const float middle_note_frequency = 440.0f;
+
+static const uint8_t max_volume_value = 127;
+
+// Half step value.
+static const float twelth_root_two = std::exp2(1.0f / 12.0f);
+
+/**
+ * \brief Construct the default map. Sound variation picks the wave, general purpose buttons 5 and 6 switch dynamic
+ * volume and quit, and program changes pick the wave.
+ */
+midi_control_map::midi_control_map() :
+    m_wave_controller(70),
+    m_dynamic_volume_controller(80),
+    m_quit_controller(81),
+    m_program_selects_wave(true)
+{
+}
+
+/**
+ * \brief Reads a map from a comma separated list, such as "wave=70,volume=none,quit=81,program=off". Anything not
+ * listed keeps its current mapping.
+ *
+ * wave, volume and quit take a controller number from 0 to 127, or none to leave it unmapped. program takes on or off.
+ * \param text Map to read.
+ * \param map Filled with the map read, on top of what it already held. Left alone if any entry is bad.
+ * \return If every entry could be read.
+ */
+bool midi_control_map::from_string(const std::string& text, midi_control_map& map)
+{
+    const auto to_controller = [](const std::string& controller)
+    {
+        if (controller == "none")
+        {
+            return no_controller;
+        }
+
+        const auto value = std::stoi(controller);
+        if (value < 0 || value > 127)
+        {
+            throw std::invalid_argument(controller);
+        }
+        return static_cast<uint8_t>(value);
+    };
+
+    auto result = map;
+    std::istringstream items(text);
+    std::string item;
+    while (std::getline(items, item, ','))
+    {
+        const auto split = item.find('=');
+        const auto name = item.substr(0, split);
+        const auto value = split == std::string::npos ? std::string() : item.substr(split + 1);
+
+        try
+        {
+            if (name == "wave")
+            {
+                result.m_wave_controller = to_controller(value);
+            }
+            else if (name == "volume")
+            {
+                result.m_dynamic_volume_controller = to_controller(value);
+            }
+            else if (name == "quit")
+            {
+                result.m_quit_controller = to_controller(value);
+            }
+            else if (name == "program" && (value == "on" || value == "off"))
+            {
+                result.m_program_selects_wave = value == "on";
+            }
+            else if (!name.empty())
+            {
+                return false;
+            }
+        }
+        catch (...)
+        {
+            return false;
+        }
+    }
+
+    map = result;
+    return true;
+}
+
+/**
+ * \brief Construct a synth with every part on the default envelope.
+ * \param num_workers Number of threads the parts are spread over. 0 renders everything on the calling thread.
+ */
+midi_synth::midi_synth(const uint32_t num_workers) :
+    m_engine_(num_workers),
+    m_deferred_{},
+    m_num_deferred_(0),
+    m_deferred_channels_(0),
+    m_frequencies_{},
+    m_control_map_(midi_control_map()),
+    m_dynamic_note_volume_(true),
+    m_latency_probe_(nullptr)
+{
+    m_engine_.set_control_period(midi_control_period);
+    for (uint8_t channel = 0; channel < midi_engine::num_parts; ++channel)
+    {
+        m_engine_.get_part(channel).m_envelope = midi_envelope;
+    }
+
+    for (uint32_t i = 0; i < num_keys; ++i)
+    {
+        const auto frequency_modifier = std::pow(twelth_root_two, static_cast<float>(i) - middle_note_value);
+        m_frequencies_[i] = middle_note_frequency * frequency_modifier;
+    }
+}
+
+/**
+ * \brief Acts on one event. Notes on any channel are played, mapped controllers and programs change the settings.
+ * Events for a part that a late worker still has wait until it is handed back.
+ * \param event Event to act on.
+ * \return False if the event asked to quit.
+ */
+bool midi_synth::process_event(const midi_event& event)
+{
+    if (event.m_type == midi_control_change)
+    {
+        if (event.m_number == m_control_map_.m_dynamic_volume_controller)
+        {
+            m_dynamic_note_volume_ = event.m_value >= controller_switch_on_value;
+            return true;
+        }
+
+        if (event.m_number == m_control_map_.m_quit_controller && event.m_value >= controller_switch_on_value)
+        {
+            return false;
+        }
+    }
+
+    if (!touches_part(event))
+    {
+        return true;
+    }
+
+    const auto channel_bit = 1u << event.m_channel;
+    if ((m_deferred_channels_ & channel_bit) != 0 || m_engine_.is_busy(event.m_channel))
+    {
+        if (m_num_deferred_ < max_deferred_events)
+        {
+            m_deferred_[m_num_deferred_] = event;
+            ++m_num_deferred_;
+            m_deferred_channels_ |= channel_bit;
+        }
+        return true;
+    }
+
+    apply_event(event);
+    return true;
+}
+
+/**
+ * \brief Checks if an event changes its part.
+ * \param event Event to check.
+ * \return If acting on the event touches the part of its channel.
+ */
+bool midi_synth::touches_part(const midi_event& event) const
+{
+    switch (event.m_type)
+    {
+    case midi_note_on:
+    case midi_note_off:
+        return true;
+    case midi_control_change:
+        return event.m_number == midi_all_notes_off_controller || event.m_number == midi_all_sound_off_controller ||
+            event.m_number == midi_channel_volume_controller || event.m_number == m_control_map_.m_wave_controller;
+    case midi_program_change:
+        return m_control_map_.m_program_selects_wave;
+    default:
+        // Aftertouch and pitch bend are decoded but nothing is driven by them yet.
+        return false;
+    }
+}
+
+/**
+ * \brief Makes the change to its part that an event asks for. The part cannot be busy.
+ * \param event Event to act on.
+ */
+void midi_synth::apply_event(const midi_event& event)
+{
+    auto& part = m_engine_.get_part(event.m_channel);
+
+    switch (event.m_type)
+    {
+    case midi_note_on:
+        part.m_sound.add_note(calculate_note(part, event.m_number, event.m_value));
+        if (m_latency_probe_)
+        {
+            m_latency_probe_->mark_added(event.m_number);
+        }
+        break;
+    case midi_note_off:
+        part.m_sound.remove_notes(m_frequencies_[event.m_number]);
+        break;
+    case midi_control_change:
+        if (event.m_number == midi_all_notes_off_controller || event.m_number == midi_all_sound_off_controller)
+        {
+            part.m_sound.release_all();
+        }
+        else if (event.m_number == midi_channel_volume_controller)
+        {
+            part.m_sound.set_master_volume(static_cast<float>(event.m_value) / max_volume_value);
+        }
+        else if (event.m_number == m_control_map_.m_wave_controller)
+        {
+            // Split the controller range evenly between the waves.
+            part.m_wave = mapped_waves[event.m_value * num_mapped_waves / (max_volume_value + 1)];
+        }
+        break;
+    case midi_program_change:
+        part.m_wave = mapped_waves[event.m_number % num_mapped_waves];
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+ * \brief Plays the events that were waiting on parts that have since been handed back. Events for parts that are still
+ * busy keep waiting, and so does everything after them on the same channel.
+ */
+void midi_synth::apply_deferred()
+{
+    if (m_num_deferred_ == 0)
+    {
+        return;
+    }
+
+    uint32_t kept = 0;
+    uint32_t kept_channels = 0;
+    for (uint32_t i = 0; i < m_num_deferred_; ++i)
+    {
+        const auto& event = m_deferred_[i];
+        const auto channel_bit = 1u << event.m_channel;
+        if ((kept_channels & channel_bit) != 0 || m_engine_.is_busy(event.m_channel))
+        {
+            m_deferred_[kept] = event;
+            ++kept;
+            kept_channels |= channel_bit;
+            continue;
+        }
+
+        apply_event(event);
+    }
+
+    m_num_deferred_ = kept;
+    m_deferred_channels_ = kept_channels;
+}
+
+/**
+ * \brief Renders the next block of every part mixed together.
+ * \param channels One buffer per channel. Overwritten with the mix.
+ * \param num_channels Number of channels to render. Cannot be more than max_channels.
+ * \param num_samples Number of samples to render. Cannot be more than max_block_size.
+ * \param sample_rate Sample rate of the output.
+ */
+void midi_synth::render(float* const* channels, const uint32_t num_channels, const uint32_t num_samples,
+                        const int sample_rate)
+{
+    apply_deferred();
+    m_engine_.render(channels, num_channels, num_samples, sample_rate);
+}
+
+/**
+ * \brief Renders the next block into buffers owned by the synth.
+ * \param num_channels Number of channels to render. Cannot be more than max_channels.
+ * \param num_samples Number of samples to render. Cannot be more than max_block_size.
+ * \param sample_rate Sample rate of the output.
+ * \return One buffer per channel holding the mix. Valid until the next call to render.
+ */
+const float* const* midi_synth::render(const uint32_t num_channels, const uint32_t num_samples, const int sample_rate)
+{
+    apply_deferred();
+    return m_engine_.render(num_channels, num_samples, sample_rate);
+}
+
+/**
+ * \brief Renders the next block while playing a file. The block is split at every event so each one is acted on at
+ * the sample it was placed at.
+ * \param player Player to take the events from. Moved forward by the block.
+ * \param channels One buffer per channel to render into.
+ * \param num_channels Number of channels.
+ * \param num_samples Number of samples to render. Cannot be more than max_block_size.
+ * \param sample_rate Sample rate of the output.
+ */
+void midi_synth::render(midi_file_player& player, float* const* channels, const uint32_t num_channels,
+                        const uint32_t num_samples, const int sample_rate)
+{
+    float* offset_channels[sound_data::max_channels];
+
+    uint32_t rendered = 0;
+    while (rendered < num_samples)
+    {
+        uint32_t num_events;
+        const auto* events = player.take_due_events(num_events);
+        for (uint32_t i = 0; i < num_events; ++i)
+        {
+            // Files are not allowed to quit, so the result is ignored.
+            process_event(events[i].m_event);
+        }
+
+        const auto count = player.samples_until_event(num_samples - rendered);
+        for (uint32_t channel = 0; channel < num_channels; ++channel)
+        {
+            offset_channels[channel] = channels[channel] + rendered;
+        }
+
+        apply_deferred();
+        m_engine_.render(offset_channels, num_channels, count, sample_rate);
+        player.advance(count);
+        rendered += count;
+    }
+}
+
+bool midi_synth::is_silent() const
+{
+    return m_num_deferred_ == 0 && m_engine_.is_silent();
+}
+
+/**
+ * \brief Releases every note in every part.
+ */
+void midi_synth::release_all()
+{
+    m_engine_.release_all();
+}
+
+/**
+ * \brief Sets which controllers and programs change the synth settings.
+ * \param map Controllers and programs to use. Picked up by the next event.
+ */
+void midi_synth::set_control_map(const midi_control_map& map)
+{
+    m_control_map_ = map;
+}
+
+/**
+ * \brief Sets a probe that is stamped whenever a note is added.
+ * \param probe Probe to stamp, or null for none.
+ */
+void midi_synth::set_latency_probe(midi_latency_probe* probe)
+{
+    m_latency_probe_ = probe;
+}
+
+midi_engine& midi_synth::get_engine()
+{
+    return m_engine_;
+}
+
+/**
+ * \brief Calculates the note that corresponds to the note given values.
+ * \param part Part the note is played on. Its wave and envelope are used.
+ * \param note Note value that determines what frequency will be played.
+ * \param volume Volume that the note should be played at.
+ * \return Note that corresponds to the given values.
+ */
+note_data midi_synth::calculate_note(const midi_part& part, const uint8_t note, const uint8_t volume) const
+{
+    assert(note < m_frequencies_.size());
+
+    auto volume_float = 1.0f;
+    if (m_dynamic_note_volume_)
+    {
+        volume_float = static_cast<float>(volume) / max_volume_value;
+    }
+    assert(volume_float >= 0.0f && volume_float <= 1.0f);
+
+    // Higher notes and harder hits get a brighter filter.
+    const auto frequency = m_frequencies_[note];
+    const auto velocity_float = static_cast<float>(volume) / max_volume_value;
+    const auto key_scale = std::pow(frequency / middle_note_frequency, filter_key_tracking);
+    const auto velocity_scale = 1.0f - filter_velocity_amount + filter_velocity_amount * velocity_float;
+    const auto filter = filter_data(filter_base_cutoff * key_scale * velocity_scale, filter_resonance);
+
+    // Spread the keyboard out from left to right like a piano.
+    const auto pan = key_pan_spread * (static_cast<float>(note) - 63.5f) / 63.5f;
+
+    // Make a note that will last until it is released.
+    return note_data(frequency, 0.0, -1, volume_float, part.m_wave, part.m_envelope, filter, pan);
+}
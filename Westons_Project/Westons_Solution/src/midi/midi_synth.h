@@ -0,0 +1,98 @@
+#pragma once
+
+#include "midi_engine.h"
+#include "../../MidiMessages.h"
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+class midi_file_player;
+class midi_latency_probe;
+
+/**
+ * \brief Which control changes and program changes switch the synth settings. Set a controller to no_controller to
+ * leave it unmapped.
+ */
+struct midi_control_map
+{
+    midi_control_map();
+
+    static bool from_string(const std::string& text, midi_control_map& map);
+
+    // Picks the wave. The controller range is split evenly between sine, square, sawtooth, and triangle.
+    uint8_t m_wave_controller;
+
+    // Switches dynamic note volume on at or above 64, off below.
+    uint8_t m_dynamic_volume_controller;
+
+    // Quits the driver at or above 64.
+    uint8_t m_quit_controller;
+
+    // Program changes pick the wave in the same order as the wave controller.
+    bool m_program_selects_wave;
+
+    // Controller numbers only go up to 127, so this never matches.
+    const static uint8_t no_controller;
+};
+
+/**
+ * \brief Everything needed to turn MIDI events into sound. Owns its parts and settings, so any number of synths can
+ * run side by side.
+ */
+class midi_synth
+{
+public:
+    explicit midi_synth(uint32_t num_workers = 0);
+
+    bool process_event(const midi_event& event);
+
+    void render(float* const* channels, uint32_t num_channels, uint32_t num_samples, int sample_rate);
+
+    const float* const* render(uint32_t num_channels, uint32_t num_samples, int sample_rate);
+
+    void render(midi_file_player& player, float* const* channels, uint32_t num_channels, uint32_t num_samples,
+                int sample_rate);
+
+    bool is_silent() const;
+
+    void release_all();
+
+    void set_control_map(const midi_control_map& map);
+
+    void set_latency_probe(midi_latency_probe* probe);
+
+    midi_engine& get_engine();
+
+    const static uint8_t num_keys = 128;
+
+    // Most events that can wait on busy parts at once. Any more are dropped.
+    const static uint32_t max_deferred_events = 512;
+
+private:
+    bool touches_part(const midi_event& event) const;
+
+    void apply_event(const midi_event& event);
+
+    void apply_deferred();
+
+    note_data calculate_note(const midi_part& part, uint8_t note, uint8_t volume) const;
+
+    midi_engine m_engine_;
+
+    // Events for parts a late worker still has, in the order they came in. Played once the part is handed back.
+    std::array<midi_event, max_deferred_events> m_deferred_;
+    uint32_t m_num_deferred_;
+
+    // One bit per channel that has events waiting, so later events for it wait behind them.
+    uint32_t m_deferred_channels_;
+
+    // Frequency of every key. No need to calculate this on the fly all the time.
+    std::array<float, num_keys> m_frequencies_;
+
+    midi_control_map m_control_map_;
+    bool m_dynamic_note_volume_;
+
+    // Stamped as notes are added. Can be null.
+    midi_latency_probe* m_latency_probe_;
+};
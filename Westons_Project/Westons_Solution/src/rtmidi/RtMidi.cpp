@@ -37,6 +37,7 @@
 /**********************************************************************/
 
 #include "RtMidi.h"
+#include <algorithm>
 #include <sstream>
 
 #if defined(__MACOSX_CORE__)
@@ -290,16 +291,38 @@ void MidiApi::error(RtMidiError::Type type, std::string errorString)
 MidiInApi::MidiInApi(unsigned int queueSizeLimit)
     : MidiApi()
 {
-    // Allocate the MIDI queue.
-    inputData_.queue.ringSize = queueSizeLimit;
+    // Allocate the MIDI queue, and the SysEx overflow queue next to it.
+    // The ring is rounded up to a power of two so indices can be masked.
+    unsigned int ringSize = 0;
+    if (queueSizeLimit > 0)
+    {
+        ringSize = 1;
+        while (ringSize < queueSizeLimit) ringSize <<= 1;
+    }
+    inputData_.queue.ringSize = ringSize;
+    inputData_.queue.ringMask = ringSize - 1;
     if (inputData_.queue.ringSize > 0)
-        inputData_.queue.ring = new MidiMessage[ inputData_.queue.ringSize ];
+    {
+        inputData_.queue.ring = new RtMidiShortMessage[ inputData_.queue.ringSize ];
+        inputData_.queue.sysexRing = new SysExSlot[ sysexSlotCount ];
+        inputData_.queue.sysexBytes = new unsigned char[ sysexSlotCount * sysexSlotCapacity ];
+        for (unsigned int i = 0; i < sysexSlotCount; ++i)
+        {
+            inputData_.queue.sysexRing[i].bytes = inputData_.queue.sysexBytes + i * sysexSlotCapacity;
+            inputData_.queue.sysexRing[i].size = 0;
+        }
+    }
 }
 
 MidiInApi::~MidiInApi(void)
 {
     // Delete the MIDI queue.
-    if (inputData_.queue.ringSize > 0) delete [] inputData_.queue.ring;
+    if (inputData_.queue.ringSize > 0)
+    {
+        delete [] inputData_.queue.ring;
+        delete [] inputData_.queue.sysexRing;
+        delete [] inputData_.queue.sysexBytes;
+    }
 }
 
 void MidiInApi::setCallback(RtMidiIn::RtMidiCallback callback, void* userData)
@@ -345,6 +368,32 @@ void MidiInApi::ignoreTypes(bool midiSysex, bool midiTime, bool midiSense)
     if (midiSense) inputData_.ignoreFlags |= 0x04;
 }
 
+// APIs that cannot merge sources into one input only take the first.
+unsigned int MidiInApi::connectPort(unsigned int portNumber, const std::string& portName)
+{
+    if (connected_)
+    {
+        errorString_ = "MidiInApi::connectPort: this API can only read one port per input!";
+        error(RtMidiError::WARNING, errorString_);
+        return 0;
+    }
+
+    openPort(portNumber, portName);
+    return 0;
+}
+
+// The only source is the open port.
+void MidiInApi::disconnectPort(unsigned int source)
+{
+    (void)source;
+    closePort();
+}
+
+unsigned int MidiInApi::getPortChangeCount(void) const
+{
+    return inputData_.portChanges.load(std::memory_order_relaxed);
+}
+
 double MidiInApi::getMessage(std::vector<unsigned char>* message)
 {
     message->clear();
@@ -356,70 +405,167 @@ double MidiInApi::getMessage(std::vector<unsigned char>* message)
         return 0.0;
     }
 
-    double timeStamp;
-    if (!inputData_.queue.pop(message, &timeStamp))
+    RtMidiShortMessage shortMessage;
+    if (!inputData_.queue.pop(&shortMessage))
         return 0.0;
 
-    return timeStamp;
+    if (shortMessage.sysex)
+    {
+        message->resize(sysexSlotCapacity);
+        message->resize(inputData_.queue.popSysEx(message->data(), message->size()));
+    }
+    else
+    {
+        message->assign(shortMessage.bytes, shortMessage.bytes + shortMessage.size);
+    }
+
+    return shortMessage.timeStamp;
+}
+
+bool MidiInApi::getMessage(RtMidiShortMessage* message)
+{
+    message->size = 0;
+    message->sysex = false;
+
+    if (inputData_.usingCallback)
+    {
+        errorString_ = "RtMidiIn::getNextMessage: a user callback is currently set for this port.";
+        error(RtMidiError::WARNING, errorString_);
+        return false;
+    }
+
+    return inputData_.queue.pop(message);
+}
+
+size_t MidiInApi::getSysExMessage(unsigned char* buffer, size_t capacity)
+{
+    return inputData_.queue.popSysEx(buffer, capacity);
+}
+
+unsigned int MidiInApi::getQueueCapacity(void) const
+{
+    return inputData_.queue.ringSize;
+}
+
+void MidiInApi::setOverflowPolicy(RtMidiIn::OverflowPolicy policy)
+{
+    inputData_.queue.warnOnOverflow = (policy == RtMidiIn::OVERFLOW_WARN);
 }
 
+unsigned long long MidiInApi::getDroppedMessageCount(void) const
+{
+    return inputData_.queue.dropped.load(std::memory_order_relaxed);
+}
+
+// Safe to call from either side.  Each index is loaded once, the
+// other side's with acquire so the count never includes a slot that
+// isn't visible yet.
 unsigned int MidiInApi::MidiQueue::size(unsigned int* __back,
                                         unsigned int* __front)
 {
-    // Access back/front members exactly once and make stack copies for
-    // size calculation
-    unsigned int _back = back, _front = front, _size;
-    if (_back >= _front)
-        _size = _back - _front;
-    else
-        _size = ringSize - _front + _back;
+    unsigned int _back = back.load(std::memory_order_acquire);
+    unsigned int _front = front.load(std::memory_order_acquire);
 
-    // Return copies of back/front so no new and unsynchronized accesses
-    // to member variables are needed.
+    // Indices only count up, so unsigned wrap around gives the size.
     if (__back) *__back = _back;
     if (__front) *__front = _front;
-    return _size;
+    return _back - _front;
 }
 
-// As long as we haven't reached our queue size limit, push the message.
+// Producer side.  As long as there is room, push the message.
+// Messages of three bytes or less are copied inline.  Longer messages
+// go to the SysEx overflow ring and leave a marker in the main ring.
 bool MidiInApi::MidiQueue::push(const MidiMessage& msg)
 {
-    // Local stack copies of front/back
-    unsigned int _back, _front, _size;
+    // Only this thread writes back, so a relaxed load sees our own value.
+    const unsigned int _back = back.load(std::memory_order_relaxed);
+    const unsigned int _front = front.load(std::memory_order_acquire);
+
+    if (ringSize == 0 || _back - _front >= ringSize)
+    {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
 
-    // Get back/front indexes exactly once and calculate current size
-    _size = size(&_back, &_front);
+    RtMidiShortMessage& slot = ring[_back & ringMask];
+    slot.source = msg.source;
+    slot.timeStamp = msg.timeStamp;
 
-    if (_size < ringSize - 1)
+    const size_t nBytes = msg.bytes.size();
+    if (nBytes <= 3)
     {
-        ring[_back] = msg;
-        back = (back + 1) % ringSize;
-        return true;
+        for (size_t i = 0; i < nBytes; ++i)
+            slot.bytes[i] = msg.bytes[i];
+        slot.size = (unsigned char)nBytes;
+        slot.sysex = false;
     }
+    else
+    {
+        // Drop SysEx that would not fit in a slot, or when every slot is waiting.
+        const unsigned int _sysexBack = sysexBack.load(std::memory_order_relaxed);
+        const unsigned int _sysexFront = sysexFront.load(std::memory_order_acquire);
+        if (nBytes > sysexSlotCapacity || _sysexBack - _sysexFront >= sysexSlotCount)
+        {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
 
-    return false;
+        SysExSlot& sysexSlot = sysexRing[_sysexBack & (sysexSlotCount - 1)];
+        std::copy(msg.bytes.begin(), msg.bytes.end(), sysexSlot.bytes);
+        sysexSlot.size = nBytes;
+        sysexBack.store(_sysexBack + 1, std::memory_order_release);
+
+        slot.size = 0;
+        slot.sysex = true;
+    }
+
+    // Publish the slot.  Everything written above is visible to a reader that sees the new back.
+    back.store(_back + 1, std::memory_order_release);
+    return true;
 }
 
-bool MidiInApi::MidiQueue::pop(std::vector<unsigned char>* msg, double* timeStamp)
+// Consumer side.
+bool MidiInApi::MidiQueue::pop(RtMidiShortMessage* msg)
 {
-    // Local stack copies of front/back
-    unsigned int _back, _front, _size;
+    // A SysEx message that was announced but never read is thrown away.
+    if (sysexPending)
+    {
+        sysexFront.store(sysexFront.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        sysexPending = false;
+    }
 
-    // Get back/front indexes exactly once and calculate current size
-    _size = size(&_back, &_front);
+    const unsigned int _front = front.load(std::memory_order_relaxed);
+    const unsigned int _back = back.load(std::memory_order_acquire);
 
-    if (_size == 0)
+    if (_back == _front)
         return false;
 
-    // Copy queued message to the vector pointer argument and then "pop" it.
-    msg->assign(ring[_front].bytes.begin(), ring[_front].bytes.end());
-    *timeStamp = ring[_front].timeStamp;
+    // Copy queued message to the message pointer argument and then "pop" it.
+    *msg = ring[_front & ringMask];
+    sysexPending = msg->sysex;
 
-    // Update front
-    front = (front + 1) % ringSize;
+    // Hand the slot back to the producer only after the copy is done.
+    front.store(_front + 1, std::memory_order_release);
     return true;
 }
 
+// Consumer side.  The SysEx slot was published before its marker, so
+// it is already visible once the marker has been popped.
+size_t MidiInApi::MidiQueue::popSysEx(unsigned char* buffer, size_t capacity)
+{
+    if (!sysexPending)
+        return 0;
+
+    const unsigned int _sysexFront = sysexFront.load(std::memory_order_relaxed);
+    const SysExSlot& sysexSlot = sysexRing[_sysexFront & (sysexSlotCount - 1)];
+    const size_t nBytes = std::min(sysexSlot.size, capacity);
+    std::copy(sysexSlot.bytes, sysexSlot.bytes + nBytes, buffer);
+
+    sysexFront.store(_sysexFront + 1, std::memory_order_release);
+    sysexPending = false;
+    return nBytes;
+}
+
 //*********************************************************************//
 //  Common MidiOutApi Definitions
 //*********************************************************************//
@@ -531,7 +677,7 @@ static void midiInputCallback( const MIDIPacketList *list, void *procRef, void *
         }
         else {
           // As long as we haven't reached our queue size limit, push the message.
-          if (!data->queue.push(message))
+          if (!data->queue.push(message) && data->queue.warnOnOverflow)
             std::cerr << "\nMidiInCore: message queue limit reached!!\n\n";
         }
         message.bytes.clear();
@@ -590,7 +736,7 @@ static void midiInputCallback( const MIDIPacketList *list, void *procRef, void *
             }
             else {
               // As long as we haven't reached our queue size limit, push the message.
-              if (!data->queue.push(message))
+              if (!data->queue.push(message) && data->queue.warnOnOverflow)
                 std::cerr << "\nMidiInCore: message queue limit reached!!\n\n";
             }
             message.bytes.clear();
@@ -1189,8 +1335,16 @@ struct AlsaMidiData
     snd_seq_real_time_t lastTime;
     int queue_id; // an input queue is needed to get timestamped events
     int trigger_fds[2];
+    std::vector<snd_seq_addr_t> extraSources; // sources added by connectPort after the first
+    bool watchingPorts; // subscribed to the system announce port
 };
 
+// Sources are told apart by their sequencer address.
+static unsigned int alsaSourceId(const snd_seq_addr_t& address)
+{
+    return ((unsigned int)address.client << 8) | address.port;
+}
+
 #define PORT_TYPE( pinfo, bits ) ((snd_seq_port_info_get_capability(pinfo) & (bits)) == (bits))
 
 //*********************************************************************//
@@ -1283,6 +1437,13 @@ static void* alsaMidiHandler(void* ptr)
 #endif
             break;
 
+        case SND_SEQ_EVENT_PORT_START:
+        case SND_SEQ_EVENT_PORT_EXIT:
+        case SND_SEQ_EVENT_PORT_CHANGE:
+            // Reported by the system announce port once connectPort() is watching it.
+            data->portChanges.fetch_add(1, std::memory_order_relaxed);
+            break;
+
         case SND_SEQ_EVENT_PORT_UNSUBSCRIBED:
 #if defined(__RTMIDI_DEBUG__)
             std::cerr << "MidiInAlsa::alsaMidiHandler: port connection has closed!\n";
@@ -1343,6 +1504,7 @@ static void* alsaMidiHandler(void* ptr)
                     message.bytes.assign(buffer, &buffer[nBytes]);
                 else
                     message.bytes.insert(message.bytes.end(), buffer, &buffer[nBytes]);
+                message.source = alsaSourceId(ev->source);
 
                 continueSysex = ((ev->type == SND_SEQ_EVENT_SYSEX) && (message.bytes.back() != 0xF7));
                 if (!continueSysex)
@@ -1406,7 +1568,7 @@ static void* alsaMidiHandler(void* ptr)
         else
         {
             // As long as we haven't reached our queue size limit, push the message.
-            if (!data->queue.push(message))
+            if (!data->queue.push(message) && data->queue.warnOnOverflow)
                 std::cerr << "\nMidiInAlsa: message queue limit reached!!\n\n";
         }
     }
@@ -1471,6 +1633,7 @@ void MidiInAlsa::initialize(const std::string& clientName)
     data->portNum = -1;
     data->vport = -1;
     data->subscription = nullptr;
+    data->watchingPorts = false;
     data->dummy_thread_id = pthread_self();
     data->thread = data->dummy_thread_id;
     data->trigger_fds[0] = -1;
@@ -1758,6 +1921,87 @@ void MidiInAlsa::openVirtualPort(const std::string& portName)
     }
 }
 
+unsigned int MidiInAlsa::connectPort(unsigned int portNumber, const std::string& portName)
+{
+    AlsaMidiData* data = static_cast<AlsaMidiData *>(apiData_);
+
+    snd_seq_port_info_t* src_pinfo;
+    snd_seq_port_info_alloca(&src_pinfo);
+    if (portInfo(data->seq, src_pinfo, SND_SEQ_PORT_CAP_READ | SND_SEQ_PORT_CAP_SUBS_READ, (int)portNumber) == 0)
+    {
+        std::ostringstream ost;
+        ost << "MidiInAlsa::connectPort: the 'portNumber' argument (" << portNumber << ") is invalid.";
+        errorString_ = ost.str();
+        error(RtMidiError::INVALID_PARAMETER, errorString_);
+        return 0;
+    }
+
+    snd_seq_addr_t sender;
+    sender.client = snd_seq_port_info_get_client(src_pinfo);
+    sender.port = snd_seq_port_info_get_port(src_pinfo);
+
+    // The first source opens the input port and starts the thread, the rest are connected to the same port.
+    if (!connected_)
+    {
+        openPort(portNumber, portName);
+        if (!connected_)
+            return 0;
+    }
+    else
+    {
+        if (snd_seq_connect_from(data->seq, data->vport, sender.client, sender.port) < 0)
+        {
+            errorString_ = "MidiInAlsa::connectPort: ALSA error making port connection.";
+            error(RtMidiError::DRIVER_ERROR, errorString_);
+            return 0;
+        }
+        data->extraSources.push_back(sender);
+    }
+
+    // Hear about ports that are plugged in or removed from now on.
+    if (!data->watchingPorts)
+    {
+        if (snd_seq_connect_from(data->seq, data->vport, SND_SEQ_CLIENT_SYSTEM, SND_SEQ_PORT_SYSTEM_ANNOUNCE) < 0)
+        {
+            errorString_ = "MidiInAlsa::connectPort: ALSA error watching the announce port.";
+            error(RtMidiError::WARNING, errorString_);
+        }
+        else
+        {
+            data->watchingPorts = true;
+        }
+    }
+
+    return alsaSourceId(sender);
+}
+
+void MidiInAlsa::disconnectPort(unsigned int source)
+{
+    AlsaMidiData* data = static_cast<AlsaMidiData *>(apiData_);
+    if (!connected_)
+        return;
+
+    // The first source is held by the subscription that openPort() made. The port stays open for the others.
+    if (data->subscription && alsaSourceId(*snd_seq_port_subscribe_get_sender(data->subscription)) == source)
+    {
+        snd_seq_unsubscribe_port(data->seq, data->subscription);
+        snd_seq_port_subscribe_free(data->subscription);
+        data->subscription = nullptr;
+        return;
+    }
+
+    for (std::vector<snd_seq_addr_t>::iterator it = data->extraSources.begin(); it != data->extraSources.end(); ++it)
+    {
+        if (alsaSourceId(*it) == source)
+        {
+            // Fails harmlessly when the port is already gone, ALSA drops its connections itself.
+            snd_seq_disconnect_from(data->seq, data->vport, it->client, it->port);
+            data->extraSources.erase(it);
+            return;
+        }
+    }
+}
+
 void MidiInAlsa::closePort(void)
 {
     AlsaMidiData* data = static_cast<AlsaMidiData *>(apiData_);
@@ -1770,6 +2014,14 @@ void MidiInAlsa::closePort(void)
             snd_seq_port_subscribe_free(data->subscription);
             data->subscription = nullptr;
         }
+        for (const snd_seq_addr_t& source : data->extraSources)
+            snd_seq_disconnect_from(data->seq, data->vport, source.client, source.port);
+        data->extraSources.clear();
+        if (data->watchingPorts)
+        {
+            snd_seq_disconnect_from(data->seq, data->vport, SND_SEQ_CLIENT_SYSTEM, SND_SEQ_PORT_SYSTEM_ANNOUNCE);
+            data->watchingPorts = false;
+        }
         // Stop the input queue
 #ifndef AVOID_TIMESTAMPING
         snd_seq_stop_queue(data->seq, data->queue_id, NULL);
@@ -2203,7 +2455,7 @@ static void CALLBACK midiInputCallback( HMIDIIN /*hmin*/,
   }
   else {
     // As long as we haven't reached our queue size limit, push the message.
-    if (!data->queue.push(apiData->message))
+    if (!data->queue.push(apiData->message) && data->queue.warnOnOverflow)
       std::cerr << "\nMidiInWinMM: message queue limit reached!!\n\n";
   }
 
@@ -2676,7 +2928,7 @@ static int jackProcessIn( jack_nframes_t nframes, void *arg )
       }
       else {
         // As long as we haven't reached our queue size limit, push the message.
-        if (!rtData->queue.push(message))
+        if (!rtData->queue.push(message) && rtData->queue.warnOnOverflow)
           std::cerr << "\nMidiInJack: message queue limit reached!!\n\n";
       }
     }
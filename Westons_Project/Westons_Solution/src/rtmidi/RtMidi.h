@@ -55,6 +55,7 @@
 
 #define RTMIDI_VERSION "3.0.0"
 
+#include <atomic>
 #include <exception>
 #include <iostream>
 #include <string>
@@ -206,6 +207,33 @@ protected:
     MidiApi* rtapi_;
 };
 
+//! A MIDI message small enough to be stored inline.
+/*!
+    Channel voice messages and system common/realtime messages are at
+    most three bytes, so they are copied in and out of the input queue
+    without touching the heap.  SysEx messages go through a separate,
+    preallocated overflow queue; when one is next in line the message
+    is returned with \e size 0 and \e sysex set, and its bytes can be
+    fetched with RtMidiIn::getSysExMessage().
+*/
+struct RtMidiShortMessage
+{
+    unsigned char bytes[3];
+    unsigned char size;
+    bool sysex;
+
+    //! Port the message came from, as returned by RtMidiIn::connectPort().
+    unsigned int source;
+
+    //! Time in seconds elapsed since the previous message
+    double timeStamp;
+
+    RtMidiShortMessage()
+        : bytes{0, 0, 0}, size(0), sysex(false), source(0), timeStamp(0.0)
+    {
+    }
+};
+
 /**********************************************************************/
 /*! \class RtMidiIn
     \brief A realtime MIDI input class.
@@ -245,6 +273,13 @@ public:
     //! User callback function type definition.
     typedef void (*RtMidiCallback)(double timeStamp, std::vector<unsigned char>* message, void* userData);
 
+    //! What to do when a message arrives and the input queue is full.
+    enum OverflowPolicy
+    {
+        OVERFLOW_WARN, /*!< Drop the message and write a warning to std::cerr. */
+        OVERFLOW_SILENT /*!< Drop the message quietly.  It is still counted. */
+    };
+
     //! Default constructor that allows an optional api, client name and queue size.
     /*!
       An exception will be thrown if a MIDI system initialization
@@ -293,6 +328,39 @@ public:
     */
     void openVirtualPort(const std::string& portName = std::string("RtMidi Input")) override;
 
+    //! Connect another MIDI source to this input, so several ports are read through one queue and one thread.
+    /*!
+      The first call opens the port as openPort() would.  Later calls
+      add the source to the same input (Linux ALSA only, the function
+      warns for the other APIs).  Messages from every connected source
+      arrive in one stream, in the order they were received, tagged
+      with the id returned here.  Connecting also starts watching for
+      ports that come and go, see getPortChangeCount().
+
+      \param portNumber Port to connect, as numbered by getPortName().
+      \param portName An optional name for the application port.
+      \return Id that messages from this port carry in RtMidiShortMessage::source.
+    */
+    unsigned int connectPort(unsigned int portNumber, const std::string& portName = std::string("RtMidi Input"));
+
+    //! Disconnect a source added by connectPort(), leaving the others connected.
+    /*!
+      Call it when a port goes away, so the input forgets the source
+      and can connect it again if it comes back.  APIs that read one
+      port close it.
+
+      \param source Id returned by connectPort().
+    */
+    void disconnectPort(unsigned int source);
+
+    //! Return a count that goes up whenever a MIDI port appears or goes away (Linux ALSA only).
+    /*!
+      Only counts once connectPort() has been called.  Poll it and
+      rescan the ports with getPortCount() and getPortName() when it
+      changes.
+    */
+    unsigned int getPortChangeCount(void) const;
+
     //! Set a callback function to be invoked for incoming MIDI messages.
     /*!
       The callback function will be called whenever an incoming MIDI
@@ -357,6 +425,40 @@ public:
     */
     double getMessage(std::vector<unsigned char>* message);
 
+    //! Fill the user-provided message with the next available MIDI message in the input queue without allocating.
+    /*!
+      This function returns immediately whether a new message is
+      available or not, returning true when one was.  If the next
+      message is a SysEx message, \e message->sysex is set and its
+      bytes must be read with getSysExMessage() before the next call.
+    */
+    bool getMessage(RtMidiShortMessage* message);
+
+    //! Copy the SysEx message announced by the last getMessage() call into the user-provided buffer.
+    /*!
+      \return The number of bytes copied.  Messages longer than the
+              capacity are truncated.  Returns 0 if no SysEx message
+              is pending.
+    */
+    size_t getSysExMessage(unsigned char* buffer, size_t capacity);
+
+    //! Return how many messages the input queue can hold.
+    /*!
+      The queue size limit given to the constructor is rounded up to
+      the next power of two.
+    */
+    unsigned int getQueueCapacity(void) const;
+
+    //! Choose what happens when a message arrives and the input queue is full.
+    /*!
+      The message is always dropped and counted.  With OVERFLOW_WARN
+      (the default) a warning is also written to std::cerr.
+    */
+    void setOverflowPolicy(OverflowPolicy policy);
+
+    //! Return how many incoming messages have been dropped because the input queue was full.
+    unsigned long long getDroppedMessageCount(void) const;
+
     //! Set an error callback function to be invoked when an error has occured.
     /*!
       The callback function will be called whenever an error has occured. It is best
@@ -528,39 +630,89 @@ public:
     void setCallback(RtMidiIn::RtMidiCallback callback, void* userData);
     void cancelCallback(void);
     virtual void ignoreTypes(bool midiSysex, bool midiTime, bool midiSense);
+    virtual unsigned int connectPort(unsigned int portNumber, const std::string& portName);
+    virtual void disconnectPort(unsigned int source);
+    unsigned int getPortChangeCount(void) const;
     double getMessage(std::vector<unsigned char>* message);
+    bool getMessage(RtMidiShortMessage* message);
+    size_t getSysExMessage(unsigned char* buffer, size_t capacity);
+    unsigned int getQueueCapacity(void) const;
+    void setOverflowPolicy(RtMidiIn::OverflowPolicy policy);
+    unsigned long long getDroppedMessageCount(void) const;
+
+    //! Number of SysEx messages that can wait in the overflow queue (a power of two), and the most bytes each one can hold.
+    static const unsigned int sysexSlotCount = 8;
+    static const size_t sysexSlotCapacity = 1024;
 
     // A MIDI structure used internally by the class to store incoming
     // messages.  Each message represents one and only one MIDI message.
+    // The backends build messages here; the bytes are reserved up front
+    // so building a message does not allocate.
     struct MidiMessage
     {
         std::vector<unsigned char> bytes;
 
+        //! Port the message came from.
+        unsigned int source;
+
         //! Time in seconds elapsed since the previous message
         double timeStamp;
 
         // Default constructor.
         MidiMessage()
-            : bytes(0), timeStamp(0.0)
+            : bytes(0), source(0), timeStamp(0.0)
         {
+            bytes.reserve(sysexSlotCapacity);
         }
     };
 
+    // Preallocated home for one SysEx message in the overflow queue.
+    struct SysExSlot
+    {
+        unsigned char* bytes;
+        size_t size;
+    };
+
+    // Short messages are stored inline in the ring.  SysEx messages
+    // leave a marker in the ring and their bytes in the overflow ring,
+    // so the two stay in arrival order.
+    //
+    // The queue is single producer, single consumer: only the input
+    // thread pushes and only the reader pops.  Indices count up forever
+    // and are masked into the power of two sized rings.  Each side
+    // publishes its index with a release store and reads the other
+    // side's with an acquire load, so a slot is never read before the
+    // write that filled it is visible.  The two indices are kept on
+    // separate cache lines so the threads don't fight over one line.
     struct MidiQueue
     {
-        unsigned int front;
-        unsigned int back;
-        unsigned int ringSize;
-        MidiMessage* ring;
+        alignas(64) std::atomic<unsigned int> front;
+        std::atomic<unsigned int> sysexFront;
+        bool sysexPending;
+
+        alignas(64) std::atomic<unsigned int> back;
+        std::atomic<unsigned int> sysexBack;
+        std::atomic<unsigned long long> dropped;
+
+        alignas(64) unsigned int ringSize;
+        unsigned int ringMask;
+        RtMidiShortMessage* ring;
+        SysExSlot* sysexRing;
+        unsigned char* sysexBytes;
+        bool warnOnOverflow;
 
         // Default constructor.
         MidiQueue()
-            : front(0), back(0), ringSize(0), ring(nullptr)
+            : front(0), sysexFront(0), sysexPending(false),
+              back(0), sysexBack(0), dropped(0),
+              ringSize(0), ringMask(0), ring(nullptr), sysexRing(nullptr), sysexBytes(nullptr),
+              warnOnOverflow(true)
         {
         }
 
         bool push(const MidiMessage&);
-        bool pop(std::vector<unsigned char>*, double*);
+        bool pop(RtMidiShortMessage*);
+        size_t popSysEx(unsigned char*, size_t);
         unsigned int size(unsigned int* back = nullptr,
                           unsigned int* front = nullptr);
     };
@@ -579,12 +731,13 @@ public:
         RtMidiIn::RtMidiCallback userCallback;
         void* userData;
         bool continueSysex;
+        std::atomic<unsigned int> portChanges;
 
         // Default constructor.
         RtMidiInData()
             : ignoreFlags(7), doInput(false), firstMessage(true),
               apiData(nullptr), usingCallback(false), userCallback(nullptr), userData(nullptr),
-              continueSysex(false)
+              continueSysex(false), portChanges(0)
         {
         }
     };
@@ -616,6 +769,22 @@ inline void RtMidiIn::openPort(unsigned int portNumber, const std::string& portN
 }
 
 inline void RtMidiIn::openVirtualPort(const std::string& portName) { rtapi_->openVirtualPort(portName); }
+
+inline unsigned int RtMidiIn::connectPort(unsigned int portNumber, const std::string& portName)
+{
+    return ((MidiInApi *)rtapi_)->connectPort(portNumber, portName);
+}
+
+inline void RtMidiIn::disconnectPort(unsigned int source)
+{
+    ((MidiInApi *)rtapi_)->disconnectPort(source);
+}
+
+inline unsigned int RtMidiIn::getPortChangeCount(void) const
+{
+    return ((MidiInApi *)rtapi_)->getPortChangeCount();
+}
+
 inline void RtMidiIn::closePort(void) { rtapi_->closePort(); }
 inline bool RtMidiIn::isPortOpen() const { return rtapi_->isPortOpen(); }
 
@@ -638,6 +807,31 @@ inline double RtMidiIn::getMessage(std::vector<unsigned char>* message)
     return ((MidiInApi *)rtapi_)->getMessage(message);
 }
 
+inline bool RtMidiIn::getMessage(RtMidiShortMessage* message)
+{
+    return ((MidiInApi *)rtapi_)->getMessage(message);
+}
+
+inline size_t RtMidiIn::getSysExMessage(unsigned char* buffer, size_t capacity)
+{
+    return ((MidiInApi *)rtapi_)->getSysExMessage(buffer, capacity);
+}
+
+inline unsigned int RtMidiIn::getQueueCapacity(void) const
+{
+    return ((MidiInApi *)rtapi_)->getQueueCapacity();
+}
+
+inline void RtMidiIn::setOverflowPolicy(OverflowPolicy policy)
+{
+    ((MidiInApi *)rtapi_)->setOverflowPolicy(policy);
+}
+
+inline unsigned long long RtMidiIn::getDroppedMessageCount(void) const
+{
+    return ((MidiInApi *)rtapi_)->getDroppedMessageCount();
+}
+
 inline void RtMidiIn::setErrorCallback(RtMidiErrorCallback errorCallback, void* userData)
 {
     rtapi_->setErrorCallback(errorCallback, userData);
@@ -772,6 +966,8 @@ public:
     void openPort(unsigned int portNumber, const std::string& portName) override;
     void openVirtualPort(const std::string& portName) override;
     void closePort(void) override;
+    unsigned int connectPort(unsigned int portNumber, const std::string& portName) override;
+    void disconnectPort(unsigned int source) override;
     unsigned int getPortCount(void) override;
     std::string getPortName(unsigned int portNumber) override;
 
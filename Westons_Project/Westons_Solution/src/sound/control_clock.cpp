@@ -0,0 +1,74 @@
+#include "control_clock.h"
+
+#include <cassert>
+
+/**
+ * \brief Construct a clock that ticks every period samples. The first tick is due right away.
+ * \param period Number of samples between ticks.
+ */
+control_clock::control_clock(const uint32_t period) :
+    m_period_(period),
+    m_position_(0),
+    m_tick_count_(0)
+{
+    assert(m_period_ > 0);
+}
+
+/**
+ * \brief Changes the control period. Restarts the current period so a tick is due right away.
+ * \param period Number of samples between ticks.
+ */
+void control_clock::set_period(const uint32_t period)
+{
+    assert(period > 0);
+    m_period_ = period;
+    m_position_ = 0;
+}
+
+uint32_t control_clock::get_period() const
+{
+    return m_period_;
+}
+
+/**
+ * \brief Checks if we are at the start of a period, and the control values need to be updated.
+ * \return If a tick is due.
+ */
+bool control_clock::tick_due() const
+{
+    return m_position_ == 0;
+}
+
+/**
+ * \brief Gets how many samples can be rendered before the next tick.
+ * \return Samples left in the current period.
+ */
+uint32_t control_clock::samples_until_tick() const
+{
+    return m_period_ - m_position_;
+}
+
+/**
+ * \brief Moves the clock forward. Cannot move past the end of the current period.
+ * \param num_samples Number of samples that were rendered.
+ */
+void control_clock::advance(const uint32_t num_samples)
+{
+    assert(num_samples <= samples_until_tick());
+
+    m_position_ += num_samples;
+    if (m_position_ == m_period_)
+    {
+        m_position_ = 0;
+        ++m_tick_count_;
+    }
+}
+
+/**
+ * \brief Gets the number of periods that have been completed.
+ * \return Completed periods.
+ */
+uint64_t control_clock::get_tick_count() const
+{
+    return m_tick_count_;
+}
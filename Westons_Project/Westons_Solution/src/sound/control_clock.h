@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * \brief Splits audio time into control periods. Slow moving values like envelopes, gain targets, and voice
+ * bookkeeping are updated once a period, then interpolated at audio rate where they need to be smooth.
+ */
+class control_clock
+{
+public:
+    explicit control_clock(uint32_t period = default_period);
+
+    void set_period(uint32_t period);
+
+    uint32_t get_period() const;
+
+    bool tick_due() const;
+
+    uint32_t samples_until_tick() const;
+
+    void advance(uint32_t num_samples);
+
+    uint64_t get_tick_count() const;
+
+    // Samples between control ticks when nothing else is asked for.
+    const static uint32_t default_period = 32;
+
+private:
+    uint32_t m_period_;
+
+    // Samples into the current period.
+    uint32_t m_position_;
+
+    uint64_t m_tick_count_;
+};
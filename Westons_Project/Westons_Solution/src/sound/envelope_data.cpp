@@ -0,0 +1,202 @@
+#include "envelope_data.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+// How far past the end level an exponential segment aims. Lets the segment land exactly on its end level in finite time.
+static const float exponential_overshoot = 0.001f;
+
+/**
+ * \brief Construct a default envelope. Short attack and release, full sustain. Just enough to stop clicks.
+ */
+envelope_data::envelope_data() : envelope_data(5.0f, 0.0f, 1.0f, 30.0f)
+{
+}
+
+/**
+ * \brief Construct an envelope with the given values.
+ * \param attack Time in milliseconds to go from silent to full volume.
+ * \param decay Time in milliseconds to go from full volume to the sustain level.
+ * \param sustain Level that is held until the note is released. 0.0 <-> 1.0
+ * \param release Time in milliseconds to go from the current level to silent once released.
+ */
+envelope_data::envelope_data(const float attack, const float decay, const float sustain, const float release)
+{
+    assert(attack >= 0.0f);
+    m_attack = attack;
+
+    assert(decay >= 0.0f);
+    m_decay = decay;
+
+    assert(sustain >= 0.0f && sustain <= 1.0f);
+    m_sustain = sustain;
+
+    assert(release >= 0.0f);
+    m_release = release;
+}
+
+envelope_generator::envelope_generator() : envelope_generator(envelope_data())
+{
+}
+
+/**
+ * \brief Construct a generator that will follow the given settings. Does not start until it is first advanced.
+ * \param settings Envelope settings to follow.
+ */
+envelope_generator::envelope_generator(const envelope_data& settings) :
+    m_settings_(settings),
+    m_stage_(idle),
+    m_sample_rate_(0),
+    m_level_(0.0f),
+    m_samples_left_(0),
+    m_increment_(0.0f),
+    m_target_(0.0f),
+    m_coefficient_(0.0f),
+    m_end_level_(0.0f)
+{
+}
+
+/**
+ * \brief Moves the envelope forward. Called once a control period, the sound ramps between the levels it returns.
+ * \param num_samples Number of samples to move forward.
+ * \param sample_rate Sample rate that the envelope is running at.
+ * \return Level of the envelope after moving forward.
+ */
+float envelope_generator::advance(const uint32_t num_samples, const int sample_rate)
+{
+    assert(sample_rate > 0);
+
+    // First advance kicks off the attack.
+    if (m_stage_ == idle)
+    {
+        m_sample_rate_ = sample_rate;
+        enter_stage(attack);
+    }
+
+    auto remaining = num_samples;
+    while (remaining > 0 && (m_stage_ == attack || m_stage_ == decay || m_stage_ == release))
+    {
+        const auto count = std::min(remaining, m_samples_left_);
+
+        if (m_stage_ == attack)
+        {
+            m_level_ += m_increment_ * static_cast<float>(count);
+        }
+        else
+        {
+            m_level_ = m_target_ + (m_level_ - m_target_) * std::pow(m_coefficient_, static_cast<float>(count));
+        }
+
+        m_samples_left_ -= count;
+        remaining -= count;
+
+        if (m_samples_left_ == 0)
+        {
+            m_level_ = m_end_level_;
+            enter_stage(static_cast<stage>(m_stage_ + 1));
+        }
+    }
+
+    return m_level_;
+}
+
+/**
+ * \brief Moves the envelope into its release stage. Does nothing if it is already releasing.
+ */
+void envelope_generator::note_off()
+{
+    if (is_released())
+    {
+        return;
+    }
+
+    // Never advanced, so there is nothing to fade out.
+    if (m_stage_ == idle)
+    {
+        enter_stage(finished);
+        return;
+    }
+
+    enter_stage(release);
+}
+
+/**
+ * \brief Checks if the envelope has finished its release and is now silent.
+ * \return If the envelope is done.
+ */
+bool envelope_generator::is_finished() const
+{
+    return m_stage_ == finished;
+}
+
+/**
+ * \brief Checks if the envelope has been released, or has already finished.
+ * \return If the envelope is released.
+ */
+bool envelope_generator::is_released() const
+{
+    return m_stage_ == release || m_stage_ == finished;
+}
+
+envelope_generator::stage envelope_generator::get_stage() const
+{
+    return m_stage_;
+}
+
+float envelope_generator::get_level() const
+{
+    return m_level_;
+}
+
+/**
+ * \brief Sets up the segment for the given stage. Stages with no length are skipped over right away.
+ * \param new_stage Stage to start.
+ */
+void envelope_generator::enter_stage(const stage new_stage)
+{
+    m_stage_ = new_stage;
+
+    auto segment_time = 0.0f;
+    switch (m_stage_)
+    {
+    case attack:
+        segment_time = m_settings_.m_attack;
+        m_end_level_ = 1.0f;
+        break;
+    case decay:
+        segment_time = m_settings_.m_decay;
+        m_end_level_ = m_settings_.m_sustain;
+        break;
+    case release:
+        segment_time = m_settings_.m_release;
+        m_end_level_ = 0.0f;
+        break;
+    case sustain:
+        m_level_ = m_settings_.m_sustain;
+        return;
+    case finished:
+        m_level_ = 0.0f;
+        return;
+    default:
+        return;
+    }
+
+    m_samples_left_ = static_cast<uint32_t>(segment_time * static_cast<float>(m_sample_rate_) / 1000.0f);
+
+    // Nothing to move through, jump to the end of the segment.
+    if (m_samples_left_ == 0 || m_level_ == m_end_level_)
+    {
+        m_level_ = m_end_level_;
+        enter_stage(static_cast<stage>(m_stage_ + 1));
+        return;
+    }
+
+    // Attack is a straight line up.
+    m_increment_ = (m_end_level_ - m_level_) / static_cast<float>(m_samples_left_);
+
+    // Decay and release aim a little past their end level so that they reach it in exactly the segment length.
+    m_coefficient_ = std::pow(exponential_overshoot / (1.0f + exponential_overshoot),
+                              1.0f / static_cast<float>(m_samples_left_));
+    m_target_ = m_end_level_ - exponential_overshoot * (m_level_ - m_end_level_);
+}
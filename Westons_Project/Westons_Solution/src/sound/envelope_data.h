@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * \brief Simple struct used to store the attack, decay, sustain, and release settings of a note.
+ */
+struct envelope_data
+{
+    envelope_data();
+    envelope_data(float attack, float decay, float sustain, float release);
+
+    // Times are in milliseconds.
+    float m_attack;
+    float m_decay;
+    float m_release;
+
+    // Level that the note holds at after the decay. 0.0 <-> 1.0
+    float m_sustain;
+};
+
+/**
+ * \brief Segment based ADSR generator. Every stage is one segment that is stepped over a control period at a time, and
+ * the sound ramps its gain between the levels it lands on.
+ */
+class envelope_generator
+{
+public:
+    enum stage
+    {
+        idle,
+        attack,
+        decay,
+        sustain,
+        release,
+        finished
+    };
+
+    envelope_generator();
+    explicit envelope_generator(const envelope_data& settings);
+
+    float advance(uint32_t num_samples, int sample_rate);
+
+    void note_off();
+
+    bool is_finished() const;
+
+    bool is_released() const;
+
+    stage get_stage() const;
+
+    float get_level() const;
+
+private:
+    void enter_stage(stage new_stage);
+
+    envelope_data m_settings_;
+
+    stage m_stage_;
+    int m_sample_rate_;
+
+    // Current output of the envelope.
+    float m_level_;
+
+    // Samples left in the current segment.
+    uint32_t m_samples_left_;
+
+    // Linear segments step by the increment, exponential segments decay towards the target by the coefficient.
+    float m_increment_;
+    float m_target_;
+    float m_coefficient_;
+    float m_end_level_;
+};
@@ -0,0 +1,323 @@
+#include "generation_parser.h"
+
+#include <charconv>
+#include <cmath>
+#include <cstring>
+
+const size_t generation_parser::binary_command_size = 24;
+
+/**
+ * \brief Reads one command. The whole of the text has to be the command.
+ * \param text Start of the command.
+ * \param length Number of characters in the command.
+ * \param command Filled with the command. Only the values its type uses are set.
+ * \return False if the text is not a command.
+ */
+bool generation_parser::parse(const char* text, const size_t length, generation_command& command)
+{
+    const auto* at = text;
+    const auto* const end = text + length;
+
+    command.m_type = generation_command::none;
+    command.m_start_unit = generation_command::immediate;
+    command.m_start = 0.0;
+
+    if (match(at, end, "exit"))
+    {
+        command.m_type = generation_command::exit;
+    }
+    else if (match(at, end, "getNotes"))
+    {
+        command.m_type = generation_command::get_notes;
+    }
+    else if (match(at, end, "setVolume:"))
+    {
+        if (!read_number(at, end, command.m_volume))
+        {
+            return false;
+        }
+
+        command.m_type = generation_command::set_volume;
+    }
+    else if (match(at, end, "addNote:"))
+    {
+        // {frequency}:{phase}:{duration}:{wave}
+        if (!read_number(at, end, command.m_frequency) || !match(at, end, ":")
+            || !read_number(at, end, command.m_phase) || !match(at, end, ":")
+            || !read_number(at, end, command.m_duration) || !match(at, end, ":")
+            || !read_wave(at, end, command.m_wave))
+        {
+            return false;
+        }
+
+        command.m_type = generation_command::add_note;
+    }
+    else if (match(at, end, "removeNote:"))
+    {
+        if (!read_number(at, end, command.m_frequency))
+        {
+            return false;
+        }
+
+        command.m_type = generation_command::remove_note;
+    }
+
+    // Everything that changes the sound can be scheduled.
+    const auto schedulable = command.m_type == generation_command::set_volume ||
+        command.m_type == generation_command::add_note || command.m_type == generation_command::remove_note;
+    if (schedulable && match(at, end, "@") && !read_start(at, end, command))
+    {
+        command.m_type = generation_command::none;
+    }
+
+    // Anything left over means the text was not a command.
+    if (at != end)
+    {
+        command.m_type = generation_command::none;
+        command.m_start_unit = generation_command::immediate;
+        command.m_start = 0.0;
+    }
+
+    return command.m_type != generation_command::none;
+}
+
+/**
+ * \brief Reads one binary command. Values are taken as they are, the same as from text.
+ * \param record Start of the command. Has to hold binary_command_size bytes.
+ * \param command Filled with the command. Only the values its type uses are set.
+ * \return False if the record is not a command.
+ */
+bool generation_parser::parse_binary(const uint8_t* record, generation_command& command)
+{
+    command.m_type = generation_command::none;
+    command.m_start_unit = generation_command::immediate;
+    command.m_start = 0.0;
+
+    const auto type = record[0];
+    const auto wave = record[1];
+    const auto unit = record[2];
+
+    float values[3];
+    double start;
+    std::memcpy(values, record + 4, sizeof(values));
+    std::memcpy(&start, record + 16, sizeof(start));
+
+    if (type < generation_command::exit || type > generation_command::remove_note || wave > sound_utilities::sawtooth ||
+        unit > generation_command::samples || !std::isfinite(values[0]) || !std::isfinite(values[1]) ||
+        !std::isfinite(values[2]) || !std::isfinite(start))
+    {
+        return false;
+    }
+
+    switch (type)
+    {
+    case generation_command::set_volume:
+        command.m_volume = values[0];
+        break;
+    case generation_command::add_note:
+        command.m_frequency = values[0];
+        command.m_phase = values[1];
+        command.m_duration = values[2];
+        command.m_wave = static_cast<sound_utilities::wave_type>(wave);
+        break;
+    case generation_command::remove_note:
+        command.m_frequency = values[0];
+        break;
+    default:
+        // Queries and exit cannot be scheduled.
+        command.m_type = static_cast<generation_command::command_type>(type);
+        return unit == generation_command::immediate;
+    }
+
+    if (unit != generation_command::immediate)
+    {
+        if (start < 0.0)
+        {
+            return false;
+        }
+
+        command.m_start_unit = static_cast<generation_command::start_unit>(unit);
+        command.m_start = start;
+    }
+
+    command.m_type = static_cast<generation_command::command_type>(type);
+    return true;
+}
+
+/**
+ * \brief Finds the next whitespace separated token, so several commands can be given on a line.
+ * \param text Text to look through.
+ * \param length Number of characters in the text.
+ * \param position Where to start looking. Moved past the token.
+ * \param token Set to the start of the token.
+ * \return Length of the token. 0 when there are no more.
+ */
+size_t generation_parser::next_token(const char* text, const size_t length, size_t& position, const char*& token)
+{
+    while (position < length && (text[position] == ' ' || text[position] == '\t' || text[position] == '\r'))
+    {
+        ++position;
+    }
+
+    const auto start = position;
+    while (position < length && text[position] != ' ' && text[position] != '\t' && text[position] != '\r')
+    {
+        ++position;
+    }
+
+    token = text + start;
+    return position - start;
+}
+
+/**
+ * \brief Steps over a word if the text starts with it.
+ * \param at Where to look. Moved past the word when it matches.
+ * \param end End of the text.
+ * \param word Null terminated word to look for.
+ * \return If the word was there.
+ */
+bool generation_parser::match(const char*& at, const char* end, const char* word)
+{
+    auto* check = at;
+    while (*word)
+    {
+        if (check == end || *check != *word)
+        {
+            return false;
+        }
+
+        ++check;
+        ++word;
+    }
+
+    at = check;
+    return true;
+}
+
+/**
+ * \brief Reads a number written as an optional minus, at least one digit, then an optional point and more digits.
+ * Exponents, inf, and nan are not taken.
+ * \param at Where the number starts. Moved past it.
+ * \param end End of the text.
+ * \param value Set to the number.
+ * \return If there was a number.
+ */
+bool generation_parser::read_number(const char*& at, const char* end, double& value)
+{
+    auto* scan = at;
+    if (scan != end && *scan == '-')
+    {
+        ++scan;
+    }
+
+    const auto* const digits = scan;
+    while (scan != end && *scan >= '0' && *scan <= '9')
+    {
+        ++scan;
+    }
+
+    if (scan == digits)
+    {
+        return false;
+    }
+
+    if (scan != end && *scan == '.')
+    {
+        ++scan;
+        while (scan != end && *scan >= '0' && *scan <= '9')
+        {
+            ++scan;
+        }
+    }
+
+    const auto result = std::from_chars(at, scan, value);
+    if (result.ec != std::errc() || result.ptr != scan)
+    {
+        return false;
+    }
+
+    at = scan;
+    return true;
+}
+
+/**
+ * \brief Reads a number into a float. See the double version.
+ * \param at Where the number starts. Moved past it.
+ * \param end End of the text.
+ * \param value Set to the number.
+ * \return If there was a number.
+ */
+bool generation_parser::read_number(const char*& at, const char* end, float& value)
+{
+    double number;
+    if (!read_number(at, end, number))
+    {
+        return false;
+    }
+
+    value = static_cast<float>(number);
+    return true;
+}
+
+/**
+ * \brief Reads when a command starts, a number followed by ms or smp. Starts cannot be negative.
+ * \param at Where the number starts. Moved past the unit.
+ * \param end End of the text.
+ * \param command Has its start set.
+ * \return If there was a start.
+ */
+bool generation_parser::read_start(const char*& at, const char* end, generation_command& command)
+{
+    if (!read_number(at, end, command.m_start) || command.m_start < 0.0)
+    {
+        return false;
+    }
+
+    if (match(at, end, "ms"))
+    {
+        command.m_start_unit = generation_command::milliseconds;
+    }
+    else if (match(at, end, "smp"))
+    {
+        command.m_start_unit = generation_command::samples;
+    }
+    else
+    {
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * \brief Reads the name of a wave.
+ * \param at Where the name starts. Moved past it.
+ * \param end End of the text.
+ * \param wave Set to the wave.
+ * \return If there was a wave name.
+ */
+bool generation_parser::read_wave(const char*& at, const char* end, sound_utilities::wave_type& wave)
+{
+    if (match(at, end, "sine"))
+    {
+        wave = sound_utilities::sine;
+    }
+    else if (match(at, end, "square"))
+    {
+        wave = sound_utilities::square;
+    }
+    else if (match(at, end, "sawtooth"))
+    {
+        wave = sound_utilities::sawtooth;
+    }
+    else if (match(at, end, "triangle"))
+    {
+        wave = sound_utilities::triangle;
+    }
+    else
+    {
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "sound_utilities.h"
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * \brief A command for the frequency generator.
+ */
+struct generation_command
+{
+    enum command_type
+    {
+        none,
+        exit,
+        get_notes,
+        set_volume,
+        add_note,
+        remove_note
+    };
+
+    // When the command should happen. Commands without a start happen as soon as they are read.
+    enum start_unit
+    {
+        immediate,
+        milliseconds,
+        samples
+    };
+
+    command_type m_type;
+
+    start_unit m_start_unit;
+
+    // Time since the driver started playing, in m_start_unit.
+    double m_start;
+
+    // Volume from 0.0 to 100.0 for set_volume. Not clamped.
+    float m_volume;
+
+    // Frequency in Hz for add_note and remove_note.
+    float m_frequency;
+
+    // Phase offset in degrees and duration in milliseconds for add_note.
+    float m_phase;
+    float m_duration;
+
+    sound_utilities::wave_type m_wave;
+};
+
+/**
+ * \brief Reads frequency generator commands such as addNote:440.0:90:1000:sine. Works on the characters where they
+ * are, and never allocates, so a long script of notes can be read as fast as it can be played.
+ *
+ * setVolume, addNote, and removeNote can be given a start, addNote:440.0:90:1000:sine@1500ms or
+ * removeNote:440.0@72000smp, to schedule them from when the driver started playing.
+ *
+ * The same commands can be read from binary records of binary_command_size bytes, for programs that send a lot of
+ * them. In host byte order, which is little endian on every target: the command type, the wave, and the start unit
+ * as a byte each, using their enum values, a spare byte, then the frequency or volume, the phase, and the duration as
+ * 32 bit floats, and the start as a 64 bit float.
+ */
+class generation_parser
+{
+public:
+    static bool parse(const char* text, size_t length, generation_command& command);
+
+    static bool parse_binary(const uint8_t* record, generation_command& command);
+
+    // Size of one binary command.
+    const static size_t binary_command_size;
+
+    static size_t next_token(const char* text, size_t length, size_t& position, const char*& token);
+
+private:
+    static bool match(const char*& at, const char* end, const char* word);
+
+    static bool read_number(const char*& at, const char* end, double& value);
+
+    static bool read_number(const char*& at, const char* end, float& value);
+
+    static bool read_start(const char*& at, const char* end, generation_command& command);
+
+    static bool read_wave(const char*& at, const char* end, sound_utilities::wave_type& wave);
+};
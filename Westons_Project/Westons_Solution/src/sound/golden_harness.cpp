@@ -0,0 +1,559 @@
+#include "golden_harness.h"
+#include "generation_parser.h"
+#include "../../generation_driver.h"
+#include "../../sound_data.h"
+#include "../midi/midi_synth.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+
+const int golden_harness::sample_rate = 44100;
+const uint32_t golden_harness::num_channels;
+const uint32_t golden_harness::spectrum_size;
+
+// "WGLD" read as a little endian number.
+const uint32_t golden_harness::reference_magic = 0x444C4757;
+const uint32_t golden_harness::reference_version = 1;
+
+/**
+ * \brief Construct a tolerance that only passes a bit for bit match.
+ */
+golden_tolerance::golden_tolerance() :
+    m_exact(true),
+    m_min_snr_db(0.0),
+    m_min_spectral_snr_db(0.0)
+{
+}
+
+/**
+ * \brief Construct a harness that keeps its references in the given directory.
+ * \param directory Directory the references are written to and read from. Has to exist.
+ * \param tolerance How close a render has to be to pass a check.
+ */
+golden_harness::golden_harness(const std::string& directory, const golden_tolerance& tolerance) :
+    m_directory_(directory),
+    m_tolerance_(tolerance),
+    m_scenarios_(make_scenarios())
+{
+}
+
+/**
+ * \brief Renders every scenario and writes it out as the new reference.
+ * \return Number of scenarios that could not be recorded.
+ */
+uint32_t golden_harness::record()
+{
+    uint32_t failed = 0;
+    std::vector<float> output;
+    for (const auto& rendered : m_scenarios_)
+    {
+        if (!render(rendered, output))
+        {
+            std::cout << rendered.m_name << ": could not render." << std::endl;
+            ++failed;
+            continue;
+        }
+
+        const auto path = reference_path(rendered);
+        if (!write_reference(path, output))
+        {
+            std::cout << rendered.m_name << ": could not write " << path << std::endl;
+            ++failed;
+            continue;
+        }
+
+        std::cout << rendered.m_name << ": recorded " << rendered.m_frames << " frames." << std::endl;
+    }
+
+    return failed;
+}
+
+/**
+ * \brief Renders every scenario and compares it against its reference, printing how far off each one is.
+ * \return Number of scenarios that failed, including ones with no reference.
+ */
+uint32_t golden_harness::check()
+{
+    uint32_t failed = 0;
+    std::vector<float> reference;
+    std::vector<float> output;
+    for (const auto& rendered : m_scenarios_)
+    {
+        const auto path = reference_path(rendered);
+        if (!read_reference(path, reference))
+        {
+            std::cout << rendered.m_name << ": FAILED, no usable reference at " << path << std::endl;
+            ++failed;
+            continue;
+        }
+
+        if (!render(rendered, output))
+        {
+            std::cout << rendered.m_name << ": FAILED, could not render." << std::endl;
+            ++failed;
+            continue;
+        }
+
+        if (reference.size() != output.size())
+        {
+            std::cout << rendered.m_name << ": FAILED, rendered " << output.size() / num_channels <<
+                " frames but the reference has " << reference.size() / num_channels << "." << std::endl;
+            ++failed;
+            continue;
+        }
+
+        const auto result = compare(reference, output);
+        const auto pass = passed(result);
+        if (!pass)
+        {
+            ++failed;
+        }
+
+        std::cout << rendered.m_name << ": " << (pass ? "passed" : "FAILED") << ", ";
+        if (result.m_exact)
+        {
+            std::cout << "bit exact." << std::endl;
+            continue;
+        }
+
+        std::cout << result.m_mismatched << " samples differ, max error " << std::scientific << std::setprecision(3) <<
+            result.m_max_error << std::fixed << std::setprecision(1) << ", SNR " << result.m_snr_db <<
+            " dB, spectral SNR " << result.m_spectral_snr_db << " dB." << std::defaultfloat << std::endl;
+    }
+
+    std::cout << m_scenarios_.size() - failed << " of " << m_scenarios_.size() << " scenarios passed." << std::endl;
+    return failed;
+}
+
+/**
+ * \brief Makes the scenarios. Single notes of every wave, a dense chord, and timed notes through each engine.
+ * Changing any of these means recording the references again.
+ * \return Every scenario.
+ */
+std::vector<golden_harness::scenario> golden_harness::make_scenarios()
+{
+    std::vector<scenario> scenarios;
+
+    // One endless note of each wave.
+    for (const auto wave : {sound_utilities::sine, sound_utilities::square, sound_utilities::triangle,
+                            sound_utilities::sawtooth})
+    {
+        const auto name = sound_utilities::to_string(wave);
+        scenarios.push_back({"generation_" + name, 22050, {"addNote:440:0:-1:" + name + "@0smp"}, {}});
+    }
+
+    // Two dozen notes of every wave at once, then a drop in volume part way through.
+    {
+        auto chord = scenario{"generation_chord", 22050, {}, {}};
+        const char* waves[] = {"sine", "square", "triangle", "sawtooth"};
+        for (auto i = 0; i < 24; ++i)
+        {
+            const auto frequency = 110.0 * std::pow(2.0, i / 6.0);
+            chord.m_commands.push_back("addNote:" + std::to_string(frequency) + ":" + std::to_string(i * 15) + ":-1:" +
+                waves[i % 4] + "@0smp");
+        }
+        chord.m_commands.push_back("setVolume:60@11025smp");
+        scenarios.push_back(chord);
+    }
+
+    // Notes that start part way through a buffer and run out on their own, and one that is removed.
+    scenarios.push_back({
+        "generation_timed", 26460, {
+            "addNote:261.63:0:50:sine@0smp",
+            "addNote:329.63:90:120:square@2205smp",
+            "addNote:392:180:250:triangle@4410smp",
+            "addNote:523.25:0:-1:sawtooth@8820smp",
+            "setVolume:50@13230smp",
+            "removeNote:523.25@17640smp"
+        },
+        {}
+    });
+
+    // A note on each of the first four channels, each switched to its own wave by a program change.
+    {
+        auto waves = scenario{"midi_waves", 22050, {}, {}};
+        for (uint8_t channel = 0; channel < 4; ++channel)
+        {
+            waves.m_events.push_back({0, {midi_program_change, channel, channel, 0, 0}});
+            waves.m_events.push_back({0, {midi_note_on, channel, static_cast<uint8_t>(57 + channel * 5), 100, 0}});
+            waves.m_events.push_back({16000, {midi_note_off, channel, static_cast<uint8_t>(57 + channel * 5), 0, 0}});
+        }
+        scenarios.push_back(waves);
+    }
+
+    // Four notes on every channel. Half are let go early.
+    {
+        auto chord = scenario{"midi_chord", 22050, {}, {}};
+        for (uint8_t i = 0; i < 64; ++i)
+        {
+            const auto channel = static_cast<uint8_t>(i % midi_engine::num_parts);
+            const auto key = static_cast<uint8_t>(36 + i / midi_engine::num_parts * 12 + channel);
+            chord.m_events.push_back({0, {midi_note_on, channel, key, static_cast<uint8_t>(40 + i), 0}});
+            if (i % 2 == 0)
+            {
+                chord.m_events.push_back({15000, {midi_note_off, channel, key, 0, 0}});
+            }
+        }
+        scenarios.push_back(chord);
+    }
+
+    // A run of short notes on one channel that never lines up with a block, with the channel volume dropped halfway.
+    {
+        auto timed = scenario{"midi_timed", 26460, {}, {}};
+        for (uint8_t i = 0; i < 8; ++i)
+        {
+            const auto start = static_cast<uint64_t>(i) * 2757;
+            const auto key = static_cast<uint8_t>(60 + i * 2);
+            timed.m_events.push_back({start, {midi_note_on, 0, key, 90, 0}});
+            timed.m_events.push_back({start + 2000, {midi_note_off, 0, key, 0, 0}});
+        }
+        timed.m_events.push_back({11025, {midi_control_change, 0, midi_channel_volume_controller, 64, 0}});
+        scenarios.push_back(timed);
+    }
+
+    return scenarios;
+}
+
+/**
+ * \brief Renders a scenario through the engine it was written for.
+ * \param rendered Scenario to render.
+ * \param output Filled with the interleaved output.
+ * \return If the scenario could be rendered.
+ */
+bool golden_harness::render(const scenario& rendered, std::vector<float>& output)
+{
+    output.assign(rendered.m_frames * num_channels, 0.0f);
+    if (!rendered.m_commands.empty())
+    {
+        return render_generation(rendered, output);
+    }
+
+    render_midi(rendered, output);
+    return true;
+}
+
+/**
+ * \brief Renders a generation scenario the way the generation callback does. Commands are applied on their sample,
+ * blocks stop at the next command, and every block is written out through the callback's own mixing and clipping.
+ * \param rendered Scenario to render.
+ * \param output Interleaved output, already sized.
+ * \return If every command could be read.
+ */
+bool golden_harness::render_generation(const scenario& rendered, std::vector<float>& output)
+{
+    std::vector<generation_command> commands;
+    for (const auto& line : rendered.m_commands)
+    {
+        generation_command command;
+        if (!generation_parser::parse(line.data(), line.size(), command) ||
+            command.m_start_unit != generation_command::samples)
+        {
+            std::cout << rendered.m_name << ": could not read " << line << std::endl;
+            return false;
+        }
+        commands.push_back(command);
+    }
+
+    // Commands on the same sample play in script order.
+    std::stable_sort(commands.begin(), commands.end(), [](const generation_command& left,
+                                                          const generation_command& right)
+    {
+        return left.m_start < right.m_start;
+    });
+
+    sound_data sound;
+    generation_driver::prepare(sound);
+
+    size_t next = 0;
+    uint64_t frame = 0;
+    while (frame < rendered.m_frames)
+    {
+        while (next < commands.size() && static_cast<uint64_t>(commands[next].m_start) <= frame)
+        {
+            generation_driver::apply(commands[next], sound);
+            ++next;
+        }
+
+        auto block_size = std::min<uint64_t>(rendered.m_frames - frame, sound_data::max_block_size);
+        if (next < commands.size())
+        {
+            block_size = std::min<uint64_t>(block_size, static_cast<uint64_t>(commands[next].m_start) - frame);
+        }
+
+        const auto samples = static_cast<uint32_t>(block_size);
+        const auto* const* channels = sound.render(num_channels, samples, sample_rate);
+        sound_utilities::write_output(channels, output.data(), num_channels, samples, frame, false);
+        frame += block_size;
+    }
+
+    return true;
+}
+
+/**
+ * \brief Renders a midi scenario through a synth with no workers the way the midi callback does, stopping each block at
+ * the next event so it lands on its sample, and writing every block out through the callback's own mixing and
+ * clipping.
+ * \param rendered Scenario to render.
+ * \param output Interleaved output, already sized.
+ */
+void golden_harness::render_midi(const scenario& rendered, std::vector<float>& output)
+{
+    midi_synth synth(0);
+
+    // Events on the same sample happen in the order they were listed.
+    auto events = rendered.m_events;
+    std::stable_sort(events.begin(), events.end(), [](const timed_event& left, const timed_event& right)
+    {
+        return left.m_sample < right.m_sample;
+    });
+
+    size_t next = 0;
+    uint64_t frame = 0;
+    while (frame < rendered.m_frames)
+    {
+        while (next < events.size() && events[next].m_sample <= frame)
+        {
+            synth.process_event(events[next].m_event);
+            ++next;
+        }
+
+        auto block_size = std::min<uint64_t>(rendered.m_frames - frame, sound_data::max_block_size);
+        if (next < events.size())
+        {
+            block_size = std::min(block_size, events[next].m_sample - frame);
+        }
+
+        const auto samples = static_cast<uint32_t>(block_size);
+        const auto* const* channels = synth.render(num_channels, samples, sample_rate);
+        sound_utilities::write_output(channels, output.data(), num_channels, samples, frame, false);
+        frame += block_size;
+    }
+}
+
+/**
+ * \brief Works out how far a render is from its reference.
+ * \param reference Reference samples.
+ * \param output Rendered samples. The same length as the reference.
+ * \return How they compared.
+ */
+golden_harness::comparison golden_harness::compare(const std::vector<float>& reference,
+                                                   const std::vector<float>& output)
+{
+    assert(reference.size() == output.size());
+
+    auto result = comparison{true, 0, 0.0, std::numeric_limits<double>::infinity(),
+                             std::numeric_limits<double>::infinity()};
+
+    auto signal = 0.0;
+    auto noise = 0.0;
+    for (size_t i = 0; i < reference.size(); ++i)
+    {
+        // Compared as values, so -0.0 and 0.0 count as the same.
+        if (reference[i] != output[i])
+        {
+            ++result.m_mismatched;
+        }
+
+        const auto error = static_cast<double>(output[i]) - reference[i];
+        result.m_max_error = std::max(result.m_max_error, std::abs(error));
+        signal += static_cast<double>(reference[i]) * reference[i];
+        noise += error * error;
+    }
+
+    result.m_exact = result.m_mismatched == 0;
+    if (!result.m_exact)
+    {
+        result.m_snr_db = signal > 0.0 ? 10.0 * std::log10(signal / noise) : -std::numeric_limits<double>::infinity();
+        result.m_spectral_snr_db = spectral_snr(reference, output);
+    }
+
+    return result;
+}
+
+/**
+ * \brief Compares the magnitude spectra of each channel, a window at a time. Small shifts in phase barely move the
+ * spectrum, so this shows if a render still sounds the same when the waveform has drifted.
+ * \param reference Interleaved reference samples.
+ * \param output Interleaved rendered samples. The same length as the reference.
+ * \return Signal to noise ratio between the spectra in dB.
+ */
+double golden_harness::spectral_snr(const std::vector<float>& reference, const std::vector<float>& output)
+{
+    std::vector<float> real(spectrum_size);
+    std::vector<float> imaginary(spectrum_size);
+    std::vector<double> reference_magnitudes(spectrum_size / 2);
+    std::vector<double> output_magnitudes(spectrum_size / 2);
+
+    auto signal = 0.0;
+    auto noise = 0.0;
+    const auto frames = reference.size() / num_channels;
+    for (size_t start = 0; start + spectrum_size <= frames; start += spectrum_size)
+    {
+        for (uint32_t channel = 0; channel < num_channels; ++channel)
+        {
+            const auto offset = start * num_channels + channel;
+            magnitude_spectrum(reference.data() + offset, num_channels, real, imaginary, reference_magnitudes);
+            magnitude_spectrum(output.data() + offset, num_channels, real, imaginary, output_magnitudes);
+
+            for (uint32_t bin = 0; bin < spectrum_size / 2; ++bin)
+            {
+                const auto error = output_magnitudes[bin] - reference_magnitudes[bin];
+                signal += reference_magnitudes[bin] * reference_magnitudes[bin];
+                noise += error * error;
+            }
+        }
+    }
+
+    if (noise == 0.0)
+    {
+        return std::numeric_limits<double>::infinity();
+    }
+
+    return signal > 0.0 ? 10.0 * std::log10(signal / noise) : -std::numeric_limits<double>::infinity();
+}
+
+/**
+ * \brief Takes the magnitude spectrum of one Hann windowed window of a channel with a radix 2 FFT.
+ * \param samples First sample of the window.
+ * \param stride Distance between samples of the channel.
+ * \param real Scratch space, spectrum_size long.
+ * \param imaginary Scratch space, spectrum_size long.
+ * \param magnitudes Filled with the magnitude of each bin up to half the sample rate.
+ */
+void golden_harness::magnitude_spectrum(const float* samples, const uint32_t stride, std::vector<float>& real,
+                                        std::vector<float>& imaginary, std::vector<double>& magnitudes)
+{
+    const auto size = spectrum_size;
+
+    // Window the samples, putting each one in bit reversed order as it goes.
+    uint32_t bits = 0;
+    while ((1u << bits) < size)
+    {
+        ++bits;
+    }
+
+    for (uint32_t i = 0; i < size; ++i)
+    {
+        uint32_t reversed = 0;
+        for (uint32_t bit = 0; bit < bits; ++bit)
+        {
+            reversed |= (i >> bit & 1u) << (bits - 1 - bit);
+        }
+
+        const auto window = 0.5f - 0.5f * std::cos(sound_utilities::two_pi * static_cast<float>(i) /
+            static_cast<float>(size - 1));
+        real[reversed] = samples[i * stride] * window;
+        imaginary[reversed] = 0.0f;
+    }
+
+    for (uint32_t length = 2; length <= size; length *= 2)
+    {
+        const auto angle = -static_cast<double>(sound_utilities::two_pi) / length;
+        for (uint32_t start = 0; start < size; start += length)
+        {
+            for (uint32_t k = 0; k < length / 2; ++k)
+            {
+                const auto twiddle_real = static_cast<float>(std::cos(angle * k));
+                const auto twiddle_imaginary = static_cast<float>(std::sin(angle * k));
+                const auto even = start + k;
+                const auto odd = even + length / 2;
+
+                const auto odd_real = real[odd] * twiddle_real - imaginary[odd] * twiddle_imaginary;
+                const auto odd_imaginary = real[odd] * twiddle_imaginary + imaginary[odd] * twiddle_real;
+                real[odd] = real[even] - odd_real;
+                imaginary[odd] = imaginary[even] - odd_imaginary;
+                real[even] += odd_real;
+                imaginary[even] += odd_imaginary;
+            }
+        }
+    }
+
+    for (uint32_t bin = 0; bin < size / 2; ++bin)
+    {
+        magnitudes[bin] = std::sqrt(static_cast<double>(real[bin]) * real[bin] +
+            static_cast<double>(imaginary[bin]) * imaginary[bin]);
+    }
+}
+
+/**
+ * \brief Checks a comparison against the tolerance.
+ * \param result Comparison to check.
+ * \return If it is close enough.
+ */
+bool golden_harness::passed(const comparison& result) const
+{
+    if (result.m_exact)
+    {
+        return true;
+    }
+
+    if (m_tolerance_.m_exact)
+    {
+        return false;
+    }
+
+    return result.m_snr_db >= m_tolerance_.m_min_snr_db && result.m_spectral_snr_db >= m_tolerance_.m_min_spectral_snr_db;
+}
+
+std::string golden_harness::reference_path(const scenario& rendered) const
+{
+    return m_directory_ + "/" + rendered.m_name + ".golden";
+}
+
+/**
+ * \brief Writes a reference. A small header with the layout, then the interleaved samples as they are in memory.
+ * \param path File to write.
+ * \param samples Interleaved samples.
+ * \return If the whole file was written.
+ */
+bool golden_harness::write_reference(const std::string& path, const std::vector<float>& samples)
+{
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file)
+    {
+        return false;
+    }
+
+    const uint32_t header[] = {reference_magic, reference_version, num_channels, static_cast<uint32_t>(sample_rate)};
+    const uint64_t frames = samples.size() / num_channels;
+    file.write(reinterpret_cast<const char*>(header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(&frames), sizeof(frames));
+    file.write(reinterpret_cast<const char*>(samples.data()), static_cast<std::streamsize>(samples.size() *
+        sizeof(float)));
+
+    return static_cast<bool>(file.flush());
+}
+
+/**
+ * \brief Reads a reference written by write_reference. Fails if it was written with a different layout.
+ * \param path File to read.
+ * \param samples Filled with the interleaved samples.
+ * \return If the reference could be read.
+ */
+bool golden_harness::read_reference(const std::string& path, std::vector<float>& samples)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        return false;
+    }
+
+    uint32_t header[4];
+    uint64_t frames = 0;
+    file.read(reinterpret_cast<char*>(header), sizeof(header));
+    file.read(reinterpret_cast<char*>(&frames), sizeof(frames));
+    if (!file || header[0] != reference_magic || header[1] != reference_version || header[2] != num_channels ||
+        header[3] != static_cast<uint32_t>(sample_rate))
+    {
+        return false;
+    }
+
+    samples.resize(frames * num_channels);
+    file.read(reinterpret_cast<char*>(samples.data()), static_cast<std::streamsize>(samples.size() * sizeof(float)));
+    return static_cast<bool>(file);
+}
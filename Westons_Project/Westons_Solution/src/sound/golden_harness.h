@@ -0,0 +1,116 @@
+#pragma once
+
+#include "../../MidiMessages.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * \brief How close a render has to be to its reference to pass.
+ */
+struct golden_tolerance
+{
+    golden_tolerance();
+
+    // When set every sample has to match bit for bit, and the limits below are ignored.
+    bool m_exact;
+
+    // Lowest signal to noise ratio allowed, taking the difference from the reference as the noise.
+    double m_min_snr_db;
+
+    // Lowest signal to noise ratio allowed between the magnitude spectra. Forgives small phase drift, which the
+    // waveform comparison does not.
+    double m_min_spectral_snr_db;
+};
+
+/**
+ * \brief Renders fixed scenarios offline through the generation and midi engines and compares them against references
+ * recorded earlier, so changes to the rendering code can be checked for changes to the sound.
+ *
+ * References are stored one file per scenario as raw 32 bit floats, so an exact check sees every bit. Record them on a
+ * build that is known to be good, then check every change against them. The references for these scenarios are kept in
+ * the golden directory of the project, and building with /p:GoldenCheck=true checks against them once the build is
+ * done.
+ */
+class golden_harness
+{
+public:
+    explicit golden_harness(const std::string& directory, const golden_tolerance& tolerance = golden_tolerance());
+
+    uint32_t record();
+
+    uint32_t check();
+
+    // Sample rate and channels every scenario is rendered at.
+    const static int sample_rate;
+    const static uint32_t num_channels = 2;
+
+private:
+    /**
+     * \brief A midi event and the sample it happens on.
+     */
+    struct timed_event
+    {
+        uint64_t m_sample;
+        midi_event m_event;
+    };
+
+    /**
+     * \brief Something to render. Generation scenarios are a script of commands, each given a start in samples, and
+     * midi scenarios are a list of events.
+     */
+    struct scenario
+    {
+        std::string m_name;
+        uint64_t m_frames;
+        std::vector<std::string> m_commands;
+        std::vector<timed_event> m_events;
+    };
+
+    /**
+     * \brief How a render compared against its reference.
+     */
+    struct comparison
+    {
+        bool m_exact;
+        uint64_t m_mismatched;
+        double m_max_error;
+        double m_snr_db;
+        double m_spectral_snr_db;
+    };
+
+    static std::vector<scenario> make_scenarios();
+
+    static bool render(const scenario& rendered, std::vector<float>& output);
+
+    static bool render_generation(const scenario& rendered, std::vector<float>& output);
+
+    static void render_midi(const scenario& rendered, std::vector<float>& output);
+
+    static comparison compare(const std::vector<float>& reference, const std::vector<float>& output);
+
+    static double spectral_snr(const std::vector<float>& reference, const std::vector<float>& output);
+
+    static void magnitude_spectrum(const float* samples, uint32_t stride, std::vector<float>& real,
+                                   std::vector<float>& imaginary, std::vector<double>& magnitudes);
+
+    bool passed(const comparison& result) const;
+
+    std::string reference_path(const scenario& rendered) const;
+
+    static bool write_reference(const std::string& path, const std::vector<float>& samples);
+
+    static bool read_reference(const std::string& path, std::vector<float>& samples);
+
+    std::string m_directory_;
+    golden_tolerance m_tolerance_;
+    std::vector<scenario> m_scenarios_;
+
+    // Frames in each window of the spectral comparison. A power of two.
+    const static uint32_t spectrum_size = 2048;
+
+    // Marks a reference file, and the layout it was written with.
+    const static uint32_t reference_magic;
+    const static uint32_t reference_version;
+};
@@ -9,9 +9,20 @@
  * \param duration Duration of the sound in milliseconds. Negative valued duration means infinite play time.
  * \param volume Volume that the note should be played at.
  * \param wave Type of wave to be used by this sound
+ * \param envelope Attack, decay, sustain, and release that the note will follow.
+ * \param filter Low pass filter that the note is played through.
+ * \param pan Position of the note between the output channels. -1.0 <-> 1.0
  */
 note_data::note_data(const float frequency, const float phase_offset, const float duration, const float volume,
-                     const sound_utilities::wave_type wave)
+                     const sound_utilities::wave_type wave, const envelope_data& envelope,
+                     const filter_data& filter, const float pan) :
+    m_envelope(envelope),
+    m_filter(filter),
+    m_gain(0.0f),
+    m_gain_target(0.0f),
+    m_gain_step(0.0f),
+    m_pan_channel(0),
+    m_pan_gains{1.0f, 0.0f}
 {
     assert(frequency > 0.0f);
     m_frequency = frequency;
@@ -29,6 +40,9 @@ note_data::note_data(const float frequency, const float phase_offset, const floa
     m_wave = wave;
 
     m_current_phase = m_phase_offset;
+
+    assert(pan >= -1.0f && pan <= 1.0f);
+    m_pan = pan;
 }
 
 bool note_data::operator==(const note_data& other) const
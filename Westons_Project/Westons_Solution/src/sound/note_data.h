@@ -1,6 +1,8 @@
 #pragma once
 
 #include "sound_utilities.h"
+#include "envelope_data.h"
+#include "voice_filter.h"
 
 /**
  * \brief Simple struct used to store information about playing a sound.
@@ -8,7 +10,8 @@
 struct note_data
 {
     explicit note_data(float frequency, float phase_offset, float duration, float volume,
-                       sound_utilities::wave_type wave);
+                       sound_utilities::wave_type wave, const envelope_data& envelope = envelope_data(),
+                       const filter_data& filter = filter_data(), float pan = 0.0f);
     note_data(const note_data& other) = default;
 
     bool operator==(const note_data& other) const;
@@ -19,4 +22,19 @@ struct note_data
     float m_volume;
     float m_current_phase;
     sound_utilities::wave_type m_wave;
+    envelope_generator m_envelope;
+    filter_data m_filter;
+    filter_state m_filter_state;
+
+    // Gain the note is playing at, where it is heading by the next control tick, and how far it moves each sample.
+    float m_gain;
+    float m_gain_target;
+    float m_gain_step;
+
+    // Position between the output channels. -1.0 is the first channel, 1.0 is the last.
+    float m_pan;
+
+    // The pair of channels the note is panned between, and the constant power gain for each.
+    uint32_t m_pan_channel;
+    float m_pan_gains[2];
 };
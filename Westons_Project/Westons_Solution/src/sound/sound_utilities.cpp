@@ -1,7 +1,10 @@
 #include "sound_utilities.h"
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <cstring>
+#include <iostream>
 #include <stdexcept>
 
 const float sound_utilities::pi = static_cast<float>(std::acos(-1));
@@ -13,6 +16,8 @@ const uint32_t sound_utilities::table_size = 1 << 12;
 // If you have signals at max volume playing over half, it clips. So scale everything by half.
 const float sound_utilities::non_clip_volume = 0.5f;
 
+const unsigned long sound_utilities::power_preset_frames_per_buffer = 1024;
+
 const sound_utilities::wave_tables sound_utilities::wave_lookup_tables = wave_tables();
 
 sound_utilities::wave_type sound_utilities::from_string(const std::string& wave)
@@ -68,6 +73,136 @@ float sound_utilities::clipped_output(const float& input)
     return std::max(std::min(1.0f, input), -1.0f);
 }
 
+/**
+* \brief Applies the non clip volume and clipping to a set of channel buffers, and interleaves them into one buffer.
+* \param channels One contiguous buffer per channel.
+* \param num_channels Number of channels.
+* \param num_samples Number of samples in each channel.
+* \param output Buffer of interleaved frames, num_channels * num_samples long.
+*/
+void sound_utilities::interleave_channels(const float* const* channels, const uint32_t num_channels,
+                                          const uint32_t num_samples, float* output)
+{
+    for (uint32_t channel = 0; channel < num_channels; ++channel)
+    {
+        const auto* samples = channels[channel];
+        for (uint32_t i = 0; i < num_samples; ++i)
+        {
+            output[num_channels * i + channel] = clipped_output(samples[i] * non_clip_volume);
+        }
+    }
+}
+
+/**
+* \brief Applies the non clip volume and clipping to a rendered block, and writes it into the buffer handed to the
+* callback in whichever layout the buffer is in. Every callback and offline render goes through here, so they all make
+* the same samples.
+* \param channels One contiguous buffer per channel holding the block.
+* \param output_buffer Buffer handed to the callback.
+* \param num_channels Number of channels.
+* \param num_samples Number of samples in each channel of the block.
+* \param offset Frame of the output buffer the block starts on.
+* \param non_interleaved If the buffer is one array per channel instead of interleaved frames.
+*/
+void sound_utilities::write_output(const float* const* channels, void* output_buffer, const uint32_t num_channels,
+                                   const uint32_t num_samples, const unsigned long offset, const bool non_interleaved)
+{
+    if (!non_interleaved)
+    {
+        interleave_channels(channels, num_channels, num_samples, static_cast<float*>(output_buffer) +
+                            num_channels * offset);
+        return;
+    }
+
+    auto* const* outputs = static_cast<float* const*>(output_buffer);
+    for (uint32_t channel = 0; channel < num_channels; ++channel)
+    {
+        const auto* samples = channels[channel];
+        auto* output = outputs[channel] + offset;
+        for (uint32_t i = 0; i < num_samples; ++i)
+        {
+            output[i] = clipped_output(samples[i] * non_clip_volume);
+        }
+    }
+}
+
+/**
+* \brief Fills the output buffer with silence. The fast path for when there is nothing to play.
+* \param output_buffer Buffer handed to the callback.
+* \param num_channels Number of channels in the buffer.
+* \param num_samples Number of samples in each channel.
+* \param non_interleaved If the buffer is one array per channel instead of interleaved frames.
+*/
+void sound_utilities::write_silence(void* output_buffer, const uint32_t num_channels, const unsigned long num_samples,
+                                    const bool non_interleaved)
+{
+    if (non_interleaved)
+    {
+        auto* const* channels = static_cast<float* const*>(output_buffer);
+        for (uint32_t channel = 0; channel < num_channels; ++channel)
+        {
+            std::memset(channels[channel], 0, num_samples * sizeof(float));
+        }
+        return;
+    }
+
+    std::memset(output_buffer, 0, num_channels * num_samples * sizeof(float));
+}
+
+/**
+* \brief Works out how long a callback has before its buffer plays, from the time stamps the host handed it. Hosts that
+* give no time stamps get the length of the buffer. A wakeup that came late can already be past the time the buffer
+* plays, so this can be 0 or less.
+* \param time_info Time stamps handed to the callback. Can be null.
+* \param num_samples Samples in each channel of the buffer.
+* \param sample_rate Sample rate the buffer is played at.
+* \return Seconds until the buffer plays.
+*/
+double sound_utilities::time_to_output(const PaStreamCallbackTimeInfo* time_info, const unsigned long num_samples,
+                                       const int sample_rate)
+{
+    if (!time_info || time_info->outputBufferDacTime <= 0.0)
+    {
+        return sample_rate > 0 ? static_cast<double>(num_samples) / sample_rate : 0.0;
+    }
+
+    return time_info->outputBufferDacTime - time_info->currentTime;
+}
+
+/**
+* \brief Clears the counts and starts timing from now.
+*/
+void sound_utilities::callback_stats::reset()
+{
+    callbacks = 0;
+    idle_callbacks = 0;
+    deadline_misses = 0;
+    start_time = std::chrono::steady_clock::now();
+}
+
+/**
+* \brief Prints how many times a second the callback woke up, and how many of those had nothing to play.
+* \param name Name of the callback to print with the counts.
+*/
+void sound_utilities::callback_stats::report(const std::string& name) const
+{
+    const std::chrono::duration<double> elapsed_time = std::chrono::steady_clock::now() - start_time;
+    const auto elapsed_seconds = elapsed_time.count();
+    const auto total = callbacks.load();
+    const auto idle = idle_callbacks.load();
+    const auto misses = deadline_misses.load();
+
+    if (total == 0 || elapsed_seconds <= 0.0)
+    {
+        return;
+    }
+
+    std::cout << name << " callback: " << total << " wakeups over " << elapsed_seconds << " seconds ("
+        << static_cast<double>(total) / elapsed_seconds << " per second), "
+        << 100.0 * static_cast<double>(idle) / static_cast<double>(total) << "% idle, " << misses <<
+        " missed deadlines." << std::endl;
+}
+
 /**
 * \brief Takes a float and ensures it is between 0 to two pi, by wrapping it to the correct value.
 * \param input input float to wrap to a value between 0 to two pi.
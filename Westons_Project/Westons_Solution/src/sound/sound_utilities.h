@@ -2,6 +2,9 @@
 
 #include "portaudio.h"
 
+#include <atomic>
+#include <chrono>
+#include <functional>
 #include <string>
 #include <vector>
 
@@ -18,6 +21,9 @@ public:
 
     const static float non_clip_volume;
 
+    // Buffer size of the power latency preset. Fewer, larger buffers means fewer wakeups, at the cost of latency.
+    const static unsigned long power_preset_frames_per_buffer;
+
     enum wave_type
     {
         sine,
@@ -31,6 +37,18 @@ public:
 
     static float clipped_output(const float& input);
 
+    static void interleave_channels(const float* const* channels, uint32_t num_channels, uint32_t num_samples,
+                                    float* output);
+
+    static void write_output(const float* const* channels, void* output_buffer, uint32_t num_channels,
+                             uint32_t num_samples, unsigned long offset, bool non_interleaved);
+
+    static void write_silence(void* output_buffer, uint32_t num_channels, unsigned long num_samples,
+                              bool non_interleaved);
+
+    static double time_to_output(const PaStreamCallbackTimeInfo* time_info, unsigned long num_samples,
+                                 int sample_rate);
+
     static float two_pi_wrapper(const float& input);
 
     static int phase_to_index(const float& phase, const uint32_t& max_index);
@@ -73,6 +91,8 @@ public:
             num_input_channels = 0;
             num_output_channels = 0;
             sample_rate = 0;
+            non_interleaved = false;
+            frames_per_buffer = paFramesPerBufferUnspecified;
         }
 
         callback_data(const int input_channels, const int output_channels, const int rate)
@@ -80,14 +100,47 @@ public:
             num_input_channels = input_channels;
             num_output_channels = output_channels;
             sample_rate = rate;
+            non_interleaved = false;
+            frames_per_buffer = paFramesPerBufferUnspecified;
         }
 
         int num_input_channels;
         int num_output_channels;
         int sample_rate;
+
+        // When set, the buffers handed to the callback are one array per channel instead of interleaved frames.
+        bool non_interleaved;
+
+        // Frames in each buffer handed to the callback. paFramesPerBufferUnspecified lets the host pick.
+        unsigned long frames_per_buffer;
     };
 
-    typedef void callback_processor();
+    /**
+    * \brief Struct used to count how often a callback wakes up, how many of those wakeups had nothing to play, and how
+    * many finished after their buffer was due to play.
+    */
+    struct callback_stats
+    {
+        callback_stats()
+        {
+            reset();
+        }
+
+        void reset();
+
+        void report(const std::string& name) const;
+
+        std::atomic<uint64_t> callbacks;
+        std::atomic<uint64_t> idle_callbacks;
+        std::atomic<uint64_t> deadline_misses;
+        std::chrono::steady_clock::time_point start_time;
+    };
+
+    // Runs the driver until it is told to quit. Bound to the driver instance that the callback plays.
+    typedef std::function<void()> callback_processor;
+
+    // Says if the driver has what it needs to play a buffer of the given number of frames.
+    typedef std::function<bool(unsigned long)> callback_ready;
 
     /**
     * \brief Struct used to contain information about a port audio callback.
@@ -95,19 +148,24 @@ public:
     struct callback_info
     {
         callback_info(PaStreamCallback* callback, const callback_data& call_data, void* callback_data_ptr,
-                      const std::string& callback_name, callback_processor* process_method)
+                      const std::string& callback_name, const callback_processor& process_method,
+                      const callback_ready& ready_method = callback_ready())
         {
             m_callback = callback;
             m_callback_data = call_data;
             m_callback_data_ptr = callback_data_ptr;
             m_callback_name = callback_name;
             m_process_method = process_method;
+            m_ready_method = ready_method;
         }
 
         PaStreamCallback* m_callback;
         callback_data m_callback_data;
         void* m_callback_data_ptr;
         std::string m_callback_name;
-        callback_processor* m_process_method;
+        callback_processor m_process_method;
+
+        // Optional. Backends that run on their own clock wait on it instead of the wall clock.
+        callback_ready m_ready_method;
     };
 };
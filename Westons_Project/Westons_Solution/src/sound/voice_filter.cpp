@@ -0,0 +1,198 @@
+#include "voice_filter.h"
+#include "sound_utilities.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+// Keep the cutoff away from nyquist, the filter goes unstable past it.
+static const float max_cutoff_ratio = 0.45f;
+
+/**
+ * \brief Construct filter settings that leave the note unfiltered.
+ */
+filter_data::filter_data() : filter_data(0.0f, 0.707f)
+{
+}
+
+/**
+ * \brief Construct filter settings with the given values.
+ * \param cutoff Cutoff frequency in Hz. 0 turns the filter off.
+ * \param resonance Resonance as a Q value. Must be at least 0.5.
+ */
+filter_data::filter_data(const float cutoff, const float resonance)
+{
+    assert(cutoff >= 0.0f);
+    m_cutoff = cutoff;
+
+    assert(resonance >= 0.5f);
+    m_resonance = resonance;
+}
+
+/**
+ * \brief Checks if the note should be filtered at all.
+ * \return If the filter is on.
+ */
+bool filter_data::is_enabled() const
+{
+    return m_cutoff > 0.0f;
+}
+
+filter_state::filter_state() :
+    m_a1(1.0f),
+    m_a2(0.0f),
+    m_a3(0.0f),
+    m_mix(0.0f),
+    m_ic1(0.0f),
+    m_ic2(0.0f)
+{
+}
+
+/**
+ * \brief Recalculates the coefficients for the given settings. Calls tan, so only do this at control rate.
+ * \param filter Filter settings of the voice.
+ * \param sample_rate Sample rate that the filter is running at.
+ */
+void filter_state::update(const filter_data& filter, const int sample_rate)
+{
+    if (!filter.is_enabled())
+    {
+        m_a1 = 1.0f;
+        m_a2 = 0.0f;
+        m_a3 = 0.0f;
+        m_mix = 0.0f;
+        return;
+    }
+
+    const auto cutoff = std::min(filter.m_cutoff, max_cutoff_ratio * static_cast<float>(sample_rate));
+
+    // Trapezoidal state variable filter coefficients.
+    const auto g = std::tan(sound_utilities::pi * cutoff / static_cast<float>(sample_rate));
+    const auto k = 1.0f / filter.m_resonance;
+
+    m_a1 = 1.0f / (1.0f + g * (g + k));
+    m_a2 = g * m_a1;
+    m_a3 = g * m_a2;
+    m_mix = 1.0f;
+}
+
+voice_filter_group::voice_filter_group()
+{
+    for (uint32_t lane = 0; lane < lane_count; ++lane)
+    {
+        clear(lane);
+    }
+}
+
+/**
+ * \brief Loads a voice into a lane of the group.
+ * \param lane Lane that the voice is in.
+ * \param state Coefficients and running state of the voices filter.
+ */
+void voice_filter_group::load(const uint32_t lane, const filter_state& state)
+{
+    assert(lane < lane_count);
+
+    m_a1_[lane] = state.m_a1;
+    m_a2_[lane] = state.m_a2;
+    m_a3_[lane] = state.m_a3;
+    m_mix_[lane] = state.m_mix;
+    m_ic1_[lane] = state.m_ic1;
+    m_ic2_[lane] = state.m_ic2;
+}
+
+/**
+ * \brief Sets a lane to pass its samples straight through.
+ * \param lane Lane to clear.
+ */
+void voice_filter_group::clear(const uint32_t lane)
+{
+    assert(lane < lane_count);
+
+    m_a1_[lane] = 1.0f;
+    m_a2_[lane] = 0.0f;
+    m_a3_[lane] = 0.0f;
+    m_mix_[lane] = 0.0f;
+    m_ic1_[lane] = 0.0f;
+    m_ic2_[lane] = 0.0f;
+}
+
+/**
+ * \brief Copies the running state of a lane back out so the voice can carry it to the next block.
+ * \param lane Lane to store.
+ * \param state State to fill.
+ */
+void voice_filter_group::store(const uint32_t lane, filter_state& state) const
+{
+    assert(lane < lane_count);
+
+    state.m_ic1 = m_ic1_[lane];
+    state.m_ic2 = m_ic2_[lane];
+}
+
+/**
+ * \brief Checks if any lane in the group is filtered.
+ * \return If processing the group would change anything.
+ */
+bool voice_filter_group::is_active() const
+{
+    for (uint32_t lane = 0; lane < lane_count; ++lane)
+    {
+        if (m_mix_[lane] != 0.0f)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * \brief Filters a block of lane interleaved samples in place.
+ * \param lanes Samples laid out as [sample][lane].
+ * \param num_samples Number of samples in each lane.
+ */
+void voice_filter_group::process(float* lanes, const uint32_t num_samples)
+{
+    // Work on local copies so the compiler knows nothing aliases the sample buffer, and keeps them in registers.
+    alignas(16) float a1[lane_count];
+    alignas(16) float a2[lane_count];
+    alignas(16) float a3[lane_count];
+    alignas(16) float mix[lane_count];
+    alignas(16) float ic1[lane_count];
+    alignas(16) float ic2[lane_count];
+
+    for (uint32_t lane = 0; lane < lane_count; ++lane)
+    {
+        a1[lane] = m_a1_[lane];
+        a2[lane] = m_a2_[lane];
+        a3[lane] = m_a3_[lane];
+        mix[lane] = m_mix_[lane];
+        ic1[lane] = m_ic1_[lane];
+        ic2[lane] = m_ic2_[lane];
+    }
+
+    for (uint32_t i = 0; i < num_samples; ++i)
+    {
+        auto* frame = lanes + i * lane_count;
+
+        // Every lane does the same math, so this inner loop becomes a single vector operation per step.
+        for (uint32_t lane = 0; lane < lane_count; ++lane)
+        {
+            const auto v0 = frame[lane];
+            const auto v3 = v0 - ic2[lane];
+            const auto v1 = a1[lane] * ic1[lane] + a2[lane] * v3;
+            const auto v2 = ic2[lane] + a2[lane] * ic1[lane] + a3[lane] * v3;
+            ic1[lane] = 2.0f * v1 - ic1[lane];
+            ic2[lane] = 2.0f * v2 - ic2[lane];
+
+            // Pass through lanes get their input back.
+            frame[lane] = v0 + mix[lane] * (v2 - v0);
+        }
+    }
+
+    for (uint32_t lane = 0; lane < lane_count; ++lane)
+    {
+        m_ic1_[lane] = ic1[lane];
+        m_ic2_[lane] = ic2[lane];
+    }
+}
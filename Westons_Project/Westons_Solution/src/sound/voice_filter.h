@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * \brief Simple struct used to store the low pass filter settings of a note.
+ */
+struct filter_data
+{
+    filter_data();
+    filter_data(float cutoff, float resonance);
+
+    bool is_enabled() const;
+
+    // Cutoff frequency in Hz. 0 means the note is not filtered.
+    float m_cutoff;
+
+    // Resonance as a Q value. 0.5 is no resonance.
+    float m_resonance;
+};
+
+/**
+ * \brief Running state and coefficients of one voices filter. Lives with the note so voices can move between lane
+ * groups.
+ */
+struct filter_state
+{
+    filter_state();
+
+    void update(const filter_data& filter, int sample_rate);
+
+    // Coefficients, recalculated at control rate.
+    float m_a1;
+    float m_a2;
+    float m_a3;
+
+    // 1.0 when the voice is filtered, 0.0 when it passes straight through.
+    float m_mix;
+
+    float m_ic1;
+    float m_ic2;
+};
+
+/**
+ * \brief State variable low pass filter that runs a group of voices side by side, one voice per SIMD lane.
+ * Voice samples are interleaved so that each sample of the group is one vector.
+ */
+class voice_filter_group
+{
+public:
+    // Number of voices that are filtered together. Four floats fills a NEON or SSE register.
+    static const uint32_t lane_count = 4;
+
+    voice_filter_group();
+
+    void load(uint32_t lane, const filter_state& state);
+
+    void clear(uint32_t lane);
+
+    void store(uint32_t lane, filter_state& state) const;
+
+    bool is_active() const;
+
+    void process(float* lanes, uint32_t num_samples);
+
+private:
+    // Coefficients, copied in from the voices.
+    alignas(16) float m_a1_[lane_count];
+    alignas(16) float m_a2_[lane_count];
+    alignas(16) float m_a3_[lane_count];
+
+    // 1.0 for lanes that are filtered, 0.0 for lanes that pass straight through.
+    alignas(16) float m_mix_[lane_count];
+
+    alignas(16) float m_ic1_[lane_count];
+    alignas(16) float m_ic2_[lane_count];
+};
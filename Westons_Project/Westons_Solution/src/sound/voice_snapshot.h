@@ -0,0 +1,42 @@
+#pragma once
+
+#include "sound_utilities.h"
+
+#include <cstdint>
+
+/**
+ * \brief Read only copy of the voices that were playing at the end of a callback. Small and fixed in size, so the
+ * callback can publish one every buffer and monitors can copy it out whenever they like.
+ */
+struct voice_snapshot
+{
+    /**
+     * \brief What a voice was doing when the snapshot was taken.
+     */
+    struct voice
+    {
+        float m_frequency;
+        float m_phase_offset;
+
+        // Milliseconds left to play.
+        float m_duration;
+
+        // Gain the voice was at, envelope included.
+        float m_gain;
+
+        sound_utilities::wave_type m_wave;
+    };
+
+    // Most voices kept. Voices past this are counted but left out.
+    const static uint32_t max_voices = 64;
+
+    // Samples played since the driver started.
+    uint64_t m_sample;
+
+    // Voices that were playing. Can be more than max_voices.
+    uint32_t m_num_voices;
+
+    float m_master_volume;
+
+    voice m_voices[max_voices];
+};
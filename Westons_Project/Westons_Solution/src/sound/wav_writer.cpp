@@ -0,0 +1,149 @@
+#include "wav_writer.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+static const uint32_t bits_per_sample = 16;
+static const uint32_t bytes_per_sample = bits_per_sample / 8;
+static const float max_sample_value = 32767.0f;
+
+// Everything in front of the sample data.
+static const uint32_t header_size = 44;
+
+// Sizes in the header are 32 bit, so this is as much sample data as a file can hold.
+static const uint64_t max_data_size = 0xFFFFFFFFull - header_size;
+
+// Little endian, as the format asks for.
+static void put_bytes(std::ofstream& file, const uint32_t value, const uint32_t num_bytes)
+{
+    for (uint32_t i = 0; i < num_bytes; ++i)
+    {
+        file.put(static_cast<char>(value >> (8 * i) & 0xFF));
+    }
+}
+
+wav_writer::wav_writer() :
+    m_num_channels_(0),
+    m_sample_rate_(0),
+    m_frames_written_(0)
+{
+}
+
+wav_writer::~wav_writer()
+{
+    close();
+}
+
+/**
+ * \brief Creates the file and writes a header for it. Anything that was open is closed first.
+ * \param path Path of the file. Replaced if it exists.
+ * \param num_channels Number of channels in the file.
+ * \param sample_rate Sample rate of the file.
+ * \return If the file could be created.
+ */
+bool wav_writer::open(const std::string& path, const uint32_t num_channels, const int sample_rate)
+{
+    assert(num_channels > 0);
+    assert(sample_rate > 0);
+
+    close();
+
+    m_file_.open(path, std::ios::binary | std::ios::trunc);
+    if (!m_file_)
+    {
+        return false;
+    }
+
+    m_num_channels_ = num_channels;
+    m_sample_rate_ = sample_rate;
+    m_frames_written_ = 0;
+
+    // Written again with the real sizes on close.
+    write_header();
+    return static_cast<bool>(m_file_);
+}
+
+/**
+ * \brief Adds a block of samples to the file. Samples are clipped to -1.0 <-> 1.0.
+ * \param channels One buffer per channel, as many as the file was opened with.
+ * \param num_samples Number of samples in each buffer.
+ * \return If the samples were written.
+ */
+bool wav_writer::write(const float* const* channels, const uint32_t num_samples)
+{
+    if (!m_file_.is_open())
+    {
+        return false;
+    }
+
+    const auto block_size = static_cast<size_t>(num_samples) * m_num_channels_;
+    if ((m_frames_written_ + num_samples) * m_num_channels_ * bytes_per_sample > max_data_size)
+    {
+        return false;
+    }
+
+    m_block_.resize(block_size);
+    for (uint32_t channel = 0; channel < m_num_channels_; ++channel)
+    {
+        const auto* samples = channels[channel];
+        for (uint32_t i = 0; i < num_samples; ++i)
+        {
+            const auto clipped = std::max(-1.0f, std::min(1.0f, samples[i]));
+            m_block_[i * m_num_channels_ + channel] = static_cast<int16_t>(std::lround(clipped * max_sample_value));
+        }
+    }
+
+    // The format is little endian, and so is everything this runs on.
+    m_file_.write(reinterpret_cast<const char*>(m_block_.data()),
+                  static_cast<std::streamsize>(block_size * bytes_per_sample));
+    m_frames_written_ += num_samples;
+    return static_cast<bool>(m_file_);
+}
+
+/**
+ * \brief Fills in the sizes and closes the file. Does nothing if no file is open.
+ * \return If the file was finished without errors.
+ */
+bool wav_writer::close()
+{
+    if (!m_file_.is_open())
+    {
+        return true;
+    }
+
+    m_file_.seekp(0);
+    write_header();
+
+    const auto good = static_cast<bool>(m_file_);
+    m_file_.close();
+    return good;
+}
+
+uint64_t wav_writer::get_frames_written() const
+{
+    return m_frames_written_;
+}
+
+void wav_writer::write_header()
+{
+    const auto block_align = m_num_channels_ * bytes_per_sample;
+    const auto data_size = static_cast<uint32_t>(m_frames_written_ * block_align);
+
+    m_file_.write("RIFF", 4);
+    put_bytes(m_file_, header_size - 8 + data_size, 4);
+    m_file_.write("WAVE", 4);
+
+    m_file_.write("fmt ", 4);
+    put_bytes(m_file_, 16, 4);
+    // PCM.
+    put_bytes(m_file_, 1, 2);
+    put_bytes(m_file_, m_num_channels_, 2);
+    put_bytes(m_file_, static_cast<uint32_t>(m_sample_rate_), 4);
+    put_bytes(m_file_, static_cast<uint32_t>(m_sample_rate_) * block_align, 4);
+    put_bytes(m_file_, block_align, 2);
+    put_bytes(m_file_, bits_per_sample, 2);
+
+    m_file_.write("data", 4);
+    put_bytes(m_file_, data_size, 4);
+}
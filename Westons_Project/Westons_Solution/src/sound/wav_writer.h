@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+/**
+ * \brief Writes 16 bit PCM WAV files a block at a time. The header is filled in with the final size on close.
+ */
+class wav_writer
+{
+public:
+    wav_writer();
+
+    ~wav_writer();
+
+    wav_writer(const wav_writer&) = delete;
+    wav_writer& operator=(const wav_writer&) = delete;
+
+    bool open(const std::string& path, uint32_t num_channels, int sample_rate);
+
+    bool write(const float* const* channels, uint32_t num_samples);
+
+    bool close();
+
+    uint64_t get_frames_written() const;
+
+private:
+    void write_header();
+
+    std::ofstream m_file_;
+    uint32_t m_num_channels_;
+    int m_sample_rate_;
+    uint64_t m_frames_written_;
+
+    // Interleaved samples of the block being written.
+    std::vector<int16_t> m_block_;
+};
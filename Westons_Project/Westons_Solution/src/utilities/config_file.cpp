@@ -0,0 +1,80 @@
+#include "config_file.h"
+
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+
+// Characters trimmed from around keys and values.
+static const char* const whitespace = " \t\r";
+
+static std::string trim(const std::string& text)
+{
+    const auto first = text.find_first_not_of(whitespace);
+    if (first == std::string::npos)
+    {
+        return std::string();
+    }
+
+    const auto last = text.find_last_not_of(whitespace);
+    return text.substr(first, last - first + 1);
+}
+
+/**
+ * \brief Reads a config file into command line arguments. A key with no value, or a value of true, is a switch. A
+ * value of false leaves the switch off.
+ * \param path Path of the file.
+ * \param arguments Arguments are added to the end of this, in the order they are in the file.
+ * \return If the file could be read.
+ */
+bool config_file::read(const std::string& path, std::vector<std::string>& arguments)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        std::cout << "Could not open config file " << path << std::endl;
+        return false;
+    }
+
+    std::string line;
+    uint32_t line_number = 0;
+    while (std::getline(file, line))
+    {
+        ++line_number;
+
+        const auto comment = line.find('#');
+        if (comment != std::string::npos)
+        {
+            line.erase(comment);
+        }
+
+        line = trim(line);
+        if (line.empty())
+        {
+            continue;
+        }
+
+        const auto split = line.find('=');
+        const auto key = trim(line.substr(0, split));
+        const auto value = split == std::string::npos ? std::string() : trim(line.substr(split + 1));
+
+        if (key.empty())
+        {
+            std::cout << "Skipping line " << line_number << " of " << path << ", it has no setting name." <<
+                std::endl;
+            continue;
+        }
+
+        if (value == "false")
+        {
+            continue;
+        }
+
+        arguments.push_back("--" + key);
+        if (!value.empty() && value != "true")
+        {
+            arguments.push_back(value);
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+/**
+ * \brief Reads settings from a file so a unit can boot without anyone at the keyboard. Each line is a command line
+ * option without the dashes, so the file and the command line take exactly the same settings.
+ *
+ *     # Comments start with a hash.
+ *     driver = midi
+ *     buffer = 128
+ *     realtime = true
+ *     midi-port = Keystation
+ */
+class config_file
+{
+public:
+    static bool read(const std::string& path, std::vector<std::string>& arguments);
+};
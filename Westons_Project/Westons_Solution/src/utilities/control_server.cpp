@@ -0,0 +1,426 @@
+#include "control_server.h"
+#include "trace_profiler.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+const size_t control_server::max_line_length = 64 * 1024;
+const uint8_t control_server::binary_protocol_marker = 0xB1;
+const size_t control_server::max_frame_length = 0xFFFF;
+
+// Most events to take from epoll at once.
+static const int max_events = 64;
+
+control_server::control_server() :
+    m_listen_socket_(-1),
+    m_epoll_(-1),
+    m_wake_(-1),
+    m_line_count_(0)
+{
+}
+
+control_server::~control_server()
+{
+    stop();
+}
+
+/**
+ * \brief Listens on the socket and starts handing lines to the handler. A file left at the path by an earlier run is
+ * replaced.
+ * \param path Path of the socket.
+ * \param handler Called on the server thread for every line.
+ * \param binary_handler Called on the server thread for every frame. Leave empty to only take lines.
+ * \return False if the socket could not be made. The error says why.
+ */
+bool control_server::start(const std::string& path, const line_handler& handler, const frame_handler& binary_handler)
+{
+    stop();
+
+    sockaddr_un address{};
+    if (path.empty() || path.size() >= sizeof(address.sun_path))
+    {
+        return fail("Control socket path has to be 1 to " + std::to_string(sizeof(address.sun_path) - 1) +
+            " characters.");
+    }
+
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+    m_listen_socket_ = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (m_listen_socket_ < 0)
+    {
+        return fail("Could not make the control socket: " + std::string(std::strerror(errno)));
+    }
+
+    unlink(path.c_str());
+    if (bind(m_listen_socket_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 ||
+        listen(m_listen_socket_, SOMAXCONN) < 0)
+    {
+        return fail("Could not listen on " + path + ": " + std::strerror(errno));
+    }
+
+    m_path_ = path;
+
+    m_epoll_ = epoll_create1(EPOLL_CLOEXEC);
+    m_wake_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_epoll_ < 0 || m_wake_ < 0)
+    {
+        return fail("Could not set up epoll: " + std::string(std::strerror(errno)));
+    }
+
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = m_listen_socket_;
+    epoll_ctl(m_epoll_, EPOLL_CTL_ADD, m_listen_socket_, &event);
+    event.data.fd = m_wake_;
+    epoll_ctl(m_epoll_, EPOLL_CTL_ADD, m_wake_, &event);
+
+    m_handler_ = handler;
+    m_frame_handler_ = binary_handler;
+    m_line_count_ = 0;
+    m_error_.clear();
+    m_thread_ = std::thread(&control_server::run, this);
+
+    return true;
+}
+
+/**
+ * \brief Stops the thread, hangs up on every client, and removes the socket.
+ */
+void control_server::stop()
+{
+    if (m_thread_.joinable())
+    {
+        const uint64_t wake = 1;
+        static_cast<void>(write(m_wake_, &wake, sizeof(wake)));
+        m_thread_.join();
+    }
+
+    for (const auto& connection : m_clients_)
+    {
+        close(connection.first);
+    }
+    m_clients_.clear();
+
+    for (auto* descriptor : {&m_listen_socket_, &m_epoll_, &m_wake_})
+    {
+        if (*descriptor >= 0)
+        {
+            close(*descriptor);
+            *descriptor = -1;
+        }
+    }
+
+    if (!m_path_.empty())
+    {
+        unlink(m_path_.c_str());
+        m_path_.clear();
+    }
+}
+
+/**
+ * \brief Gets the number of lines that have been handled since the server started.
+ * \return Number of lines.
+ */
+uint64_t control_server::get_line_count() const
+{
+    return m_line_count_.load(std::memory_order_relaxed);
+}
+
+/**
+ * \brief Gets why the server could not start.
+ * \return Error, empty if there was none.
+ */
+const std::string& control_server::get_error() const
+{
+    return m_error_;
+}
+
+/**
+ * \brief Waits on the sockets until told to stop.
+ */
+void control_server::run()
+{
+    TRACE_THREAD("control server");
+
+    epoll_event events[max_events];
+
+    while (true)
+    {
+        const auto num_events = epoll_wait(m_epoll_, events, max_events, -1);
+        if (num_events < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return;
+        }
+
+        for (auto i = 0; i < num_events; ++i)
+        {
+            const auto socket = events[i].data.fd;
+            if (socket == m_wake_)
+            {
+                return;
+            }
+
+            if (socket == m_listen_socket_)
+            {
+                accept_clients();
+                continue;
+            }
+
+            const auto found = m_clients_.find(socket);
+            if (found == m_clients_.end())
+            {
+                continue;
+            }
+
+            auto& connection = found->second;
+            auto keep = (events[i].events & (EPOLLERR | EPOLLHUP)) == 0 || (events[i].events & EPOLLIN) != 0;
+            if (keep && (events[i].events & EPOLLIN) && !connection.m_closing)
+            {
+                keep = read_client(socket, connection);
+            }
+            if (keep && (events[i].events & EPOLLOUT))
+            {
+                keep = write_client(socket, connection) && !(connection.m_closing && connection.m_output.empty());
+            }
+
+            if (!keep)
+            {
+                close_client(socket);
+            }
+        }
+    }
+}
+
+/**
+ * \brief Takes every client that is waiting to connect.
+ */
+void control_server::accept_clients()
+{
+    while (true)
+    {
+        const auto socket = accept4(m_listen_socket_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (socket < 0)
+        {
+            return;
+        }
+
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLRDHUP;
+        event.data.fd = socket;
+        if (epoll_ctl(m_epoll_, EPOLL_CTL_ADD, socket, &event) < 0)
+        {
+            close(socket);
+            continue;
+        }
+
+        m_clients_[socket] = client();
+    }
+}
+
+/**
+ * \brief Reads everything the client has sent, handles each full line or frame, and sends the replies.
+ * \param socket Socket of the client.
+ * \param connection The client.
+ * \return False if the client should be hung up on.
+ */
+bool control_server::read_client(const int socket, client& connection)
+{
+    char buffer[16 * 1024];
+    auto open = true;
+
+    while (true)
+    {
+        const auto num_read = read(socket, buffer, sizeof(buffer));
+        if (num_read > 0)
+        {
+            connection.m_input.append(buffer, static_cast<size_t>(num_read));
+            continue;
+        }
+
+        // Nothing more to read for now, or the client has finished sending.
+        open = num_read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR);
+        break;
+    }
+
+    // The first byte says how the client talks.
+    if (connection.m_protocol == client::undecided && !connection.m_input.empty())
+    {
+        if (static_cast<uint8_t>(connection.m_input[0]) == binary_protocol_marker && m_frame_handler_)
+        {
+            connection.m_protocol = client::binary;
+            connection.m_input.erase(0, 1);
+        }
+        else
+        {
+            connection.m_protocol = client::text;
+        }
+    }
+
+    const auto keep = connection.m_protocol == client::binary ? handle_frames(connection) : handle_lines(connection);
+
+    // A client that is done still gets every reply. It is hung up on once they have all gone out.
+    if (!keep || !open)
+    {
+        connection.m_closing = true;
+    }
+
+    if (!write_client(socket, connection))
+    {
+        return false;
+    }
+
+    return !connection.m_closing || !connection.m_output.empty();
+}
+
+/**
+ * \brief Hands every full line the client has sent to the handler. Lines are handled where they sit in the buffer.
+ * \param connection The client.
+ * \return False if the client should be hung up on once the replies are sent.
+ */
+bool control_server::handle_lines(client& connection)
+{
+    auto keep = true;
+    size_t line_start = 0;
+    while (keep)
+    {
+        const auto line_end = connection.m_input.find('\n', line_start);
+        if (line_end == std::string::npos)
+        {
+            break;
+        }
+
+        auto length = line_end - line_start;
+        if (length > 0 && connection.m_input[line_end - 1] == '\r')
+        {
+            --length;
+        }
+
+        {
+            TRACE_SCOPE("control line");
+            keep = m_handler_(connection.m_input.data() + line_start, length, connection.m_output);
+        }
+        m_line_count_.fetch_add(1, std::memory_order_relaxed);
+        line_start = line_end + 1;
+    }
+    connection.m_input.erase(0, line_start);
+
+    if (connection.m_input.size() > max_line_length)
+    {
+        connection.m_output += "error line too long\n";
+        keep = false;
+    }
+
+    return keep;
+}
+
+/**
+ * \brief Hands every full frame the client has sent to the frame handler, and frames the replies. Frames count as
+ * lines.
+ * \param connection The client.
+ * \return False if the client should be hung up on once the replies are sent.
+ */
+bool control_server::handle_frames(client& connection)
+{
+    auto keep = true;
+    size_t frame_start = 0;
+    while (keep && connection.m_input.size() - frame_start >= 2)
+    {
+        const auto* header = reinterpret_cast<const uint8_t*>(connection.m_input.data() + frame_start);
+        const auto length = static_cast<size_t>(header[0]) | static_cast<size_t>(header[1]) << 8;
+        if (connection.m_input.size() - frame_start - 2 < length)
+        {
+            break;
+        }
+
+        m_frame_reply_.clear();
+        {
+            TRACE_SCOPE("control frame");
+            keep = m_frame_handler_(header + 2, length, m_frame_reply_);
+        }
+        m_line_count_.fetch_add(1, std::memory_order_relaxed);
+        frame_start += 2 + length;
+
+        // Replies that do not fit in a frame are cut short rather than breaking the framing.
+        const auto reply_length = std::min(m_frame_reply_.size(), max_frame_length);
+        connection.m_output += static_cast<char>(reply_length & 0xFF);
+        connection.m_output += static_cast<char>(reply_length >> 8);
+        connection.m_output.append(m_frame_reply_, 0, reply_length);
+    }
+    connection.m_input.erase(0, frame_start);
+
+    return keep;
+}
+
+/**
+ * \brief Sends as much of the replies as the socket will take. Waits for the socket to be writable when some are left.
+ * \param socket Socket of the client.
+ * \param connection The client.
+ * \return False if the client has gone away.
+ */
+bool control_server::write_client(const int socket, client& connection)
+{
+    size_t sent = 0;
+    while (sent < connection.m_output.size())
+    {
+        const auto num_sent = send(socket, connection.m_output.data() + sent, connection.m_output.size() - sent,
+                                   MSG_NOSIGNAL);
+        if (num_sent < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                break;
+            }
+            return false;
+        }
+
+        sent += static_cast<size_t>(num_sent);
+    }
+    connection.m_output.erase(0, sent);
+
+    // A client that is done is only waited on to take the rest of its replies.
+    epoll_event event{};
+    event.events = connection.m_closing ? 0 : EPOLLIN | EPOLLRDHUP;
+    if (!connection.m_output.empty())
+    {
+        event.events |= EPOLLOUT;
+    }
+    event.data.fd = socket;
+    epoll_ctl(m_epoll_, EPOLL_CTL_MOD, socket, &event);
+
+    return true;
+}
+
+/**
+ * \brief Hangs up on a client.
+ * \param socket Socket of the client.
+ */
+void control_server::close_client(const int socket)
+{
+    epoll_ctl(m_epoll_, EPOLL_CTL_DEL, socket, nullptr);
+    close(socket);
+    m_clients_.erase(socket);
+}
+
+/**
+ * \brief Records why the server could not start and cleans up what was made.
+ * \param error What went wrong.
+ * \return Always false.
+ */
+bool control_server::fail(const std::string& error)
+{
+    stop();
+    m_error_ = error;
+    return false;
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+/**
+ * \brief Takes commands from other programs over a Unix domain socket. Each line a client sends is handed to the
+ * handler, and whatever the handler replies is sent back. A client can send as many lines as it likes in one write, so
+ * a burst of note changes costs one wake up instead of one terminal read each.
+ *
+ * A client that starts with binary_protocol_marker sends frames instead of lines, each a 16 bit little endian length
+ * and then that many bytes. Every frame is handed to the frame handler, and its reply goes back framed the same way.
+ *
+ * All the socket work happens on a thread of its own, waiting on epoll, so the handler should never be called from
+ * the audio callback and should hand its work off through a lock free queue.
+ */
+class control_server
+{
+public:
+    // Called for every line, without its new line. Return false to close the connection after the reply is sent.
+    typedef std::function<bool(const char* line, size_t length, std::string& reply)> line_handler;
+
+    // Called for every frame from a binary client, without its length. Return false to close the connection after the
+    // reply is sent.
+    typedef std::function<bool(const uint8_t* frame, size_t length, std::string& reply)> frame_handler;
+
+    control_server();
+
+    ~control_server();
+
+    control_server(const control_server&) = delete;
+    control_server& operator=(const control_server&) = delete;
+
+    bool start(const std::string& path, const line_handler& handler,
+               const frame_handler& binary_handler = frame_handler());
+
+    void stop();
+
+    uint64_t get_line_count() const;
+
+    const std::string& get_error() const;
+
+    // Longest line a client can send. Clients that go over are dropped.
+    const static size_t max_line_length;
+
+    // First byte a binary client sends. Text lines never start with it.
+    const static uint8_t binary_protocol_marker;
+
+    // Longest frame either way, as its length has to fit in 16 bits.
+    const static size_t max_frame_length;
+
+private:
+    /**
+     * \brief A connected client and what is waiting to be read and written.
+     */
+    struct client
+    {
+        // Picked by the first byte the client sends.
+        enum protocol
+        {
+            undecided,
+            text,
+            binary
+        };
+
+        protocol m_protocol = undecided;
+
+        // Bytes read that have not made a full line or frame yet.
+        std::string m_input;
+
+        // Replies the socket has not taken yet.
+        std::string m_output;
+
+        // Set once the client is done. It is hung up on as soon as its replies have all been sent.
+        bool m_closing = false;
+    };
+
+    void run();
+
+    void accept_clients();
+
+    bool read_client(int socket, client& connection);
+
+    bool handle_lines(client& connection);
+
+    bool handle_frames(client& connection);
+
+    bool write_client(int socket, client& connection);
+
+    void close_client(int socket);
+
+    bool fail(const std::string& error);
+
+    std::string m_path_;
+    line_handler m_handler_;
+    frame_handler m_frame_handler_;
+
+    // Reply to the frame being handled, before it is framed. Only touched by the server thread.
+    std::string m_frame_reply_;
+
+    int m_listen_socket_;
+    int m_epoll_;
+
+    // Written to wake the thread up when it should stop.
+    int m_wake_;
+
+    std::thread m_thread_;
+
+    // Only touched by the server thread.
+    std::unordered_map<int, client> m_clients_;
+
+    std::atomic<uint64_t> m_line_count_;
+
+    std::string m_error_;
+};
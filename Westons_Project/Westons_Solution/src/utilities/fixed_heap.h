@@ -0,0 +1,81 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+/**
+ * \brief Binary heap with a capacity set when it is made. The storage is allocated once up front, so pushing and
+ * popping never touch the heap allocator and each costs O(log n). Only meant to be used from one thread.
+ * \tparam T Type of the stored values.
+ * \tparam Compare Ordering of the values. The value that comes last in this order is on top, like std::priority_queue.
+ */
+template <typename T, typename Compare>
+class fixed_heap
+{
+public:
+    explicit fixed_heap(const uint32_t capacity) :
+        m_capacity_(capacity)
+    {
+        m_values_.reserve(capacity);
+    }
+
+    /**
+     * \brief Adds a value to the heap.
+     * \param value Value to add.
+     * \return If there was room for the value. Full heaps leave the value out.
+     */
+    bool push(const T& value)
+    {
+        if (m_values_.size() == m_capacity_)
+        {
+            return false;
+        }
+
+        m_values_.push_back(value);
+        std::push_heap(m_values_.begin(), m_values_.end(), Compare());
+        return true;
+    }
+
+    /**
+     * \brief Removes the value on top of the heap. The heap cannot be empty.
+     */
+    void pop()
+    {
+        assert(!m_values_.empty());
+        std::pop_heap(m_values_.begin(), m_values_.end(), Compare());
+        m_values_.pop_back();
+    }
+
+    const T& top() const
+    {
+        assert(!m_values_.empty());
+        return m_values_.front();
+    }
+
+    void clear()
+    {
+        m_values_.clear();
+    }
+
+    bool empty() const
+    {
+        return m_values_.empty();
+    }
+
+    bool full() const
+    {
+        return m_values_.size() == m_capacity_;
+    }
+
+    uint32_t size() const
+    {
+        return static_cast<uint32_t>(m_values_.size());
+    }
+
+private:
+    uint32_t m_capacity_;
+
+    std::vector<T> m_values_;
+};
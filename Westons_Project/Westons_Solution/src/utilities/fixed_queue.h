@@ -0,0 +1,72 @@
+#pragma once
+
+#include <array>
+#include <cassert>
+#include <cstdint>
+
+/**
+ * \brief First in first out queue with a fixed capacity. All the storage lives inside the queue, so pushing and
+ * popping never touch the heap. Only meant to be used from one thread.
+ * \tparam T Type of the stored values. Copied in and out.
+ * \tparam Capacity Most values that can be waiting at once.
+ */
+template <typename T, uint32_t Capacity>
+class fixed_queue
+{
+public:
+    /**
+     * \brief Adds a value to the back of the queue.
+     * \param value Value to add.
+     * \return If there was room for the value. Full queues leave the value out.
+     */
+    bool push(const T& value)
+    {
+        if (m_size_ == Capacity)
+        {
+            return false;
+        }
+
+        m_values_[(m_front_ + m_size_) % Capacity] = value;
+        ++m_size_;
+        return true;
+    }
+
+    /**
+     * \brief Removes the value at the front of the queue. The queue cannot be empty.
+     */
+    void pop()
+    {
+        assert(m_size_ > 0);
+        m_front_ = (m_front_ + 1) % Capacity;
+        --m_size_;
+    }
+
+    const T& front() const
+    {
+        assert(m_size_ > 0);
+        return m_values_[m_front_];
+    }
+
+    bool empty() const
+    {
+        return m_size_ == 0;
+    }
+
+    bool full() const
+    {
+        return m_size_ == Capacity;
+    }
+
+    uint32_t size() const
+    {
+        return m_size_;
+    }
+
+    const static uint32_t capacity = Capacity;
+
+private:
+    std::array<T, Capacity> m_values_{};
+
+    uint32_t m_front_ = 0;
+    uint32_t m_size_ = 0;
+};
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+/**
+ * \brief List with a capacity set when it is made. The storage is allocated once up front, so adding and removing
+ * values never touch the heap allocator. Values stay in the order they were added. Only meant to be used from one
+ * thread.
+ * \tparam T Type of the stored values.
+ */
+template <typename T>
+class fixed_vector
+{
+public:
+    typedef typename std::vector<T>::iterator iterator;
+    typedef typename std::vector<T>::const_iterator const_iterator;
+
+    explicit fixed_vector(const uint32_t capacity) :
+        m_capacity_(capacity)
+    {
+        m_values_.reserve(capacity);
+    }
+
+    fixed_vector(const fixed_vector& other) :
+        m_capacity_(other.m_capacity_)
+    {
+        m_values_.reserve(m_capacity_);
+        m_values_.assign(other.m_values_.begin(), other.m_values_.end());
+    }
+
+    fixed_vector& operator=(const fixed_vector& other)
+    {
+        // Keep the larger storage, so a copy never has to grow later.
+        m_capacity_ = std::max(m_capacity_, other.m_capacity_);
+        m_values_.reserve(m_capacity_);
+        m_values_.assign(other.m_values_.begin(), other.m_values_.end());
+        return *this;
+    }
+
+    /**
+     * \brief Adds a value to the back.
+     * \param value Value to add.
+     * \return If there was room for the value. Full lists leave the value out.
+     */
+    bool push_back(const T& value)
+    {
+        if (m_values_.size() == m_capacity_)
+        {
+            return false;
+        }
+
+        m_values_.push_back(value);
+        return true;
+    }
+
+    /**
+     * \brief Removes the value at the back. The list cannot be empty.
+     */
+    void pop_back()
+    {
+        assert(!m_values_.empty());
+        m_values_.pop_back();
+    }
+
+    /**
+     * \brief Removes one value. The values after it move up to fill the gap.
+     * \param position Value to remove.
+     * \return The value that followed the removed one.
+     */
+    iterator erase(const iterator position)
+    {
+        return m_values_.erase(position);
+    }
+
+    /**
+     * \brief Removes every value that matches, keeping the rest in order.
+     * \tparam Predicate Takes a value and returns true to remove it.
+     * \param predicate Picks the values to remove.
+     */
+    template <typename Predicate>
+    void remove_if(Predicate predicate)
+    {
+        m_values_.erase(std::remove_if(m_values_.begin(), m_values_.end(), predicate), m_values_.end());
+    }
+
+    void clear()
+    {
+        m_values_.clear();
+    }
+
+    T& back()
+    {
+        assert(!m_values_.empty());
+        return m_values_.back();
+    }
+
+    const T& back() const
+    {
+        assert(!m_values_.empty());
+        return m_values_.back();
+    }
+
+    iterator begin()
+    {
+        return m_values_.begin();
+    }
+
+    iterator end()
+    {
+        return m_values_.end();
+    }
+
+    const_iterator begin() const
+    {
+        return m_values_.begin();
+    }
+
+    const_iterator end() const
+    {
+        return m_values_.end();
+    }
+
+    bool empty() const
+    {
+        return m_values_.empty();
+    }
+
+    bool full() const
+    {
+        return m_values_.size() == m_capacity_;
+    }
+
+    uint32_t size() const
+    {
+        return static_cast<uint32_t>(m_values_.size());
+    }
+
+    uint32_t capacity() const
+    {
+        return m_capacity_;
+    }
+
+private:
+    uint32_t m_capacity_;
+
+    std::vector<T> m_values_;
+};
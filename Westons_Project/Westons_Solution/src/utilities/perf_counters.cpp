@@ -0,0 +1,280 @@
+#include "perf_counters.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <cerrno>
+#include <cstring>
+
+bool perf_counters::enabled_ = false;
+
+#ifdef __linux__
+/**
+ * \brief What to ask perf_event_open for to get each counter.
+ */
+struct counter_request
+{
+    perf_counters::counter m_counter;
+    uint32_t m_type;
+    uint64_t m_config;
+};
+
+// Cycles lead the group, so if they cannot be counted nothing is.
+static const counter_request counter_requests[perf_counters::num_counters] = {
+    {perf_counters::cycles, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {perf_counters::instructions, PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {
+        perf_counters::l1d_misses, PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | PERF_COUNT_HW_CACHE_OP_READ << 8 |
+        PERF_COUNT_HW_CACHE_RESULT_MISS << 16
+    },
+    {perf_counters::branch_misses, PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES}
+};
+#endif
+
+perf_counters::perf_counters() :
+    m_files_{-1, -1, -1, -1},
+    m_slots_{cycles, cycles, cycles, cycles},
+    m_num_slots_(0),
+    m_available_(0),
+    m_start_{},
+    m_begun_(false),
+    m_failed_(false)
+{
+}
+
+perf_counters::~perf_counters()
+{
+    close();
+}
+
+/**
+ * \brief Reads the counters at the start of a pass. Opens them first if this thread has not used them yet, which is
+ * a handful of system calls the first time and a single read after that.
+ */
+void perf_counters::begin()
+{
+    m_begun_ = false;
+    if (!enabled_)
+    {
+        return;
+    }
+
+    // A new thread has taken over, such as a stream that was started again. Counters only follow their own thread.
+    const auto thread = std::this_thread::get_id();
+    if (thread != m_thread_)
+    {
+        close();
+        m_thread_ = thread;
+        m_failed_ = false;
+    }
+
+    if (m_num_slots_ == 0 && !m_failed_)
+    {
+        std::string error;
+        m_failed_ = !open(error);
+    }
+
+    m_begun_ = m_num_slots_ > 0 && read(m_start_);
+}
+
+/**
+ * \brief Reads the counters at the end of a pass and works out how much each went up by.
+ * \param counts Filled with the counts for the pass. Left empty if they could not be read.
+ * \return If the pass was counted.
+ */
+bool perf_counters::end(perf_counter_values& counts)
+{
+    counts = perf_counter_values();
+
+    uint64_t values[num_counters];
+    if (!m_begun_ || !read(values))
+    {
+        return false;
+    }
+    m_begun_ = false;
+
+    for (uint32_t slot = 0; slot < m_num_slots_; ++slot)
+    {
+        const auto difference = values[slot] - m_start_[slot];
+        switch (m_slots_[slot])
+        {
+        case cycles:
+            counts.m_cycles = difference;
+            break;
+        case instructions:
+            counts.m_instructions = difference;
+            break;
+        case l1d_misses:
+            counts.m_l1d_misses = difference;
+            break;
+        case branch_misses:
+            counts.m_branch_misses = difference;
+            break;
+        }
+    }
+    counts.m_available = m_available_;
+
+    return true;
+}
+
+/**
+ * \brief Checks which counters the calling thread can open. Use before turning the counters on to find out if it is
+ * worth it.
+ * \param error Filled with why nothing could be opened.
+ * \return Which counters can be opened, as counter bits. 0 when none can.
+ */
+uint32_t perf_counters::probe(std::string& error)
+{
+    perf_counters counters;
+    return counters.open(error) ? counters.m_available_ : 0;
+}
+
+/**
+ * \brief Turns counting on or off for every pass that starts after this.
+ * \param enabled If passes are counted.
+ */
+void perf_counters::set_enabled(const bool enabled)
+{
+    enabled_ = enabled;
+}
+
+bool perf_counters::is_enabled()
+{
+    return enabled_;
+}
+
+/**
+ * \brief Names the counters in a set of counter bits.
+ * \param available Counter bits.
+ * \return The names, separated by commas.
+ */
+std::string perf_counters::describe(const uint32_t available)
+{
+    std::string names;
+    const std::pair<counter, const char*> counter_names[] = {
+        {cycles, "cycles"}, {instructions, "instructions"}, {l1d_misses, "L1D misses"},
+        {branch_misses, "branch misses"}
+    };
+
+    for (const auto& name : counter_names)
+    {
+        if ((available & name.first) != 0)
+        {
+            names += (names.empty() ? "" : ", ") + std::string(name.second);
+        }
+    }
+
+    return names.empty() ? "none" : names;
+}
+
+/**
+ * \brief Opens the counters as one group on the calling thread, so they are all read at once. Counters the CPU or
+ * kernel will not give out are skipped, as long as cycles can be had.
+ * \param error Filled with why the group could not be opened.
+ * \return If at least cycles are being counted.
+ */
+bool perf_counters::open(std::string& error)
+{
+    close();
+
+#ifdef __linux__
+    for (const auto& request : counter_requests)
+    {
+        perf_event_attr attributes;
+        std::memset(&attributes, 0, sizeof(attributes));
+        attributes.size = sizeof(attributes);
+        attributes.type = request.m_type;
+        attributes.config = request.m_config;
+        attributes.read_format = PERF_FORMAT_GROUP;
+
+        // Only count this program. Kernel counts need more permission and are not ours to tune anyway.
+        attributes.exclude_kernel = 1;
+        attributes.exclude_hv = 1;
+
+        // The leader starts off and brings the whole group on with it.
+        const auto leader = m_num_slots_ == 0;
+        attributes.disabled = leader ? 1 : 0;
+
+        const auto file = static_cast<int>(syscall(__NR_perf_event_open, &attributes, 0, -1,
+                                                   leader ? -1 : m_files_[0], 0));
+        if (file < 0)
+        {
+            if (leader)
+            {
+                error = std::string("perf_event_open: ") + std::strerror(errno);
+                if (errno == EACCES || errno == EPERM)
+                {
+                    error += ". Lower /proc/sys/kernel/perf_event_paranoid to 2 or less to allow it.";
+                }
+                return false;
+            }
+            continue;
+        }
+
+        m_files_[m_num_slots_] = file;
+        m_slots_[m_num_slots_] = request.m_counter;
+        ++m_num_slots_;
+        m_available_ |= request.m_counter;
+    }
+
+    ioctl(m_files_[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    if (ioctl(m_files_[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP) != 0)
+    {
+        error = std::string("Could not start the counters: ") + std::strerror(errno);
+        close();
+        return false;
+    }
+
+    return true;
+#else
+    error = "Hardware counters are only read on Linux.";
+    return false;
+#endif
+}
+
+void perf_counters::close()
+{
+#ifdef __linux__
+    for (uint32_t slot = 0; slot < m_num_slots_; ++slot)
+    {
+        ::close(m_files_[slot]);
+        m_files_[slot] = -1;
+    }
+#endif
+
+    m_num_slots_ = 0;
+    m_available_ = 0;
+    m_begun_ = false;
+}
+
+/**
+ * \brief Reads every counter in the group with one system call.
+ * \param values Filled with the count of each slot.
+ * \return If the read worked.
+ */
+bool perf_counters::read(uint64_t* values) const
+{
+#ifdef __linux__
+    // The number of counters, then each count in the order they were opened.
+    uint64_t group[num_counters + 1];
+    const auto size = static_cast<ssize_t>((m_num_slots_ + 1) * sizeof(uint64_t));
+    if (::read(m_files_[0], group, static_cast<size_t>(size)) != size || group[0] != m_num_slots_)
+    {
+        return false;
+    }
+
+    for (uint32_t slot = 0; slot < m_num_slots_; ++slot)
+    {
+        values[slot] = group[slot + 1];
+    }
+
+    return true;
+#else
+    static_cast<void>(values);
+    return false;
+#endif
+}
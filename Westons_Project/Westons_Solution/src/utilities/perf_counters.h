@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <thread>
+
+/**
+ * \brief Hardware counts taken over one pass of a real time thread.
+ */
+struct perf_counter_values
+{
+    uint64_t m_cycles = 0;
+    uint64_t m_instructions = 0;
+    uint64_t m_l1d_misses = 0;
+    uint64_t m_branch_misses = 0;
+
+    // Which of the counts above were measured, as perf_counters::counter bits. 0 when nothing was.
+    uint32_t m_available = 0;
+};
+
+/**
+ * \brief Reads the CPU's performance counters for the calling thread through perf_event_open. The counters follow the
+ * thread that opens them, so they are opened on the first pass and opened again if a new thread takes over. Where the
+ * kernel will not give out a counter it is left out, and where it gives out none at all passes are simply not counted.
+ *
+ * Off unless set_enabled is called. Only on Linux.
+ */
+class perf_counters
+{
+public:
+    enum counter
+    {
+        cycles = 1 << 0,
+        instructions = 1 << 1,
+        l1d_misses = 1 << 2,
+        branch_misses = 1 << 3
+    };
+
+    perf_counters();
+
+    ~perf_counters();
+
+    perf_counters(const perf_counters&) = delete;
+    perf_counters& operator=(const perf_counters&) = delete;
+
+    void begin();
+
+    bool end(perf_counter_values& counts);
+
+    static uint32_t probe(std::string& error);
+
+    static void set_enabled(bool enabled);
+
+    static bool is_enabled();
+
+    static std::string describe(uint32_t available);
+
+    const static uint32_t num_counters = 4;
+
+private:
+    bool open(std::string& error);
+
+    void close();
+
+    bool read(uint64_t* values) const;
+
+    // Group leader, then the rest of the counters that opened. -1 when closed.
+    int m_files_[num_counters];
+
+    // Which counter each slot in a group read belongs to, in the order they were opened.
+    counter m_slots_[num_counters];
+    uint32_t m_num_slots_;
+    uint32_t m_available_;
+
+    // Thread the counters were opened on.
+    std::thread::id m_thread_;
+
+    // Counts read at the start of the pass, by slot. Only good when m_begun_ is set.
+    uint64_t m_start_[num_counters];
+    bool m_begun_;
+
+    // Set once opening has failed on the current thread, so it is not tried every pass.
+    bool m_failed_;
+
+    static bool enabled_;
+};
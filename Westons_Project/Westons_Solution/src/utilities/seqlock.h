@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <type_traits>
+
+/**
+ * \brief Holds a value that one thread writes and any number of threads read, without the writer ever waiting. The
+ * writer bumps a sequence number before and after each write. Readers copy the value and try again if the sequence
+ * changed or was odd while they copied, so they only ever see a whole value.
+ *
+ * Meant for the audio callback to publish state. The writer cost is two stores and the copy in, however many readers
+ * there are.
+ * \tparam T Type of the value. Has to be trivially copyable since readers may copy it while it is being written.
+ */
+template <typename T>
+class seqlock
+{
+    static_assert(std::is_trivially_copyable<T>::value, "Values have to be trivially copyable.");
+
+public:
+    /**
+     * \brief Starts a write and gives the value to change in place. Only called by the writing thread.
+     * \return The value. end_write has to be called once it is done.
+     */
+    T& begin_write()
+    {
+        const auto sequence = m_sequence_.load(std::memory_order_relaxed);
+        m_sequence_.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        return m_value_;
+    }
+
+    /**
+     * \brief Finishes a write, letting readers see the new value.
+     */
+    void end_write()
+    {
+        const auto sequence = m_sequence_.load(std::memory_order_relaxed);
+        m_sequence_.store(sequence + 1, std::memory_order_release);
+    }
+
+    /**
+     * \brief Copies out the last whole value that was written. Never blocks the writer.
+     * \param value Set to the value.
+     */
+    void read(T& value) const
+    {
+        while (true)
+        {
+            const auto before = m_sequence_.load(std::memory_order_acquire);
+            if ((before & 1) == 0)
+            {
+                value = m_value_;
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (m_sequence_.load(std::memory_order_relaxed) == before)
+                {
+                    return;
+                }
+            }
+
+            // The writer is only ever in the middle of a short copy, so give it the core and try again.
+            std::this_thread::yield();
+        }
+    }
+
+    /**
+     * \brief Gets how many writes have finished. Readers can use it to tell if anything has changed.
+     * \return Number of writes.
+     */
+    uint64_t get_version() const
+    {
+        return m_sequence_.load(std::memory_order_acquire) / 2;
+    }
+
+private:
+    alignas(64) std::atomic<uint64_t> m_sequence_{0};
+
+    T m_value_{};
+};
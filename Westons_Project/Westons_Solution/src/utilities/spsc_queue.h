@@ -0,0 +1,84 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+/**
+ * \brief First in first out queue for handing values from one thread to another without locks. One thread pushes and
+ * one thread pops. All the storage lives inside the queue, so neither side touches the heap and the audio callback can
+ * be either end.
+ * \tparam T Type of the stored values. Copied in and out.
+ * \tparam Capacity Most values that can be waiting at once. Has to be a power of two.
+ */
+template <typename T, uint32_t Capacity>
+class spsc_queue
+{
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Capacity has to be a power of two.");
+
+public:
+    /**
+     * \brief Adds a value to the back of the queue. Only called by the pushing thread.
+     * \param value Value to add.
+     * \return If there was room for the value. Full queues leave the value out.
+     */
+    bool push(const T& value)
+    {
+        const auto tail = m_tail_.load(std::memory_order_relaxed);
+        if (tail - m_head_.load(std::memory_order_acquire) == Capacity)
+        {
+            return false;
+        }
+
+        m_values_[tail & (Capacity - 1)] = value;
+        m_tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * \brief Takes the value at the front of the queue. Only called by the popping thread.
+     * \param value Set to the value.
+     * \return If there was a value.
+     */
+    bool pop(T& value)
+    {
+        const auto head = m_head_.load(std::memory_order_relaxed);
+        if (head == m_tail_.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+
+        value = m_values_[head & (Capacity - 1)];
+        m_head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * \brief Looks at the value at the front of the queue without taking it. Only called by the popping thread.
+     * \return The value, or nullptr when the queue is empty.
+     */
+    const T* front() const
+    {
+        const auto head = m_head_.load(std::memory_order_relaxed);
+        if (head == m_tail_.load(std::memory_order_acquire))
+        {
+            return nullptr;
+        }
+
+        return &m_values_[head & (Capacity - 1)];
+    }
+
+    bool empty() const
+    {
+        return m_head_.load(std::memory_order_acquire) == m_tail_.load(std::memory_order_acquire);
+    }
+
+    const static uint32_t capacity = Capacity;
+
+private:
+    std::array<T, Capacity> m_values_{};
+
+    // Counts of values taken and added. Kept on their own cache lines so the two threads do not fight over them.
+    alignas(64) std::atomic<uint32_t> m_head_{0};
+    alignas(64) std::atomic<uint32_t> m_tail_{0};
+};
@@ -0,0 +1,80 @@
+#include "startup_timer.h"
+
+#include <algorithm>
+#include <iostream>
+
+const double startup_timer::target_milliseconds = 200.0;
+
+std::chrono::steady_clock::time_point startup_timer::start_time_ = std::chrono::steady_clock::now();
+std::atomic<int64_t> startup_timer::first_callback_(0);
+std::atomic<int64_t> startup_timer::first_audible_(0);
+
+/**
+ * \brief Starts timing. Call first thing in main. Until then times are taken from static initialization.
+ */
+void startup_timer::start()
+{
+    start_time_ = std::chrono::steady_clock::now();
+    first_callback_.store(0);
+    first_audible_.store(0);
+}
+
+/**
+ * \brief Records the first callback. Cheap enough to call from every callback.
+ */
+void startup_timer::mark_callback()
+{
+    mark(first_callback_);
+}
+
+/**
+ * \brief Records the first callback that put out something other than silence. Cheap enough to call from every
+ * callback.
+ */
+void startup_timer::mark_audible()
+{
+    mark(first_audible_);
+}
+
+/**
+ * \brief Prints the startup times and if they met the target.
+ */
+void startup_timer::report()
+{
+    const auto first_callback = first_callback_.load() / 1e6;
+    const auto first_audible = first_audible_.load() / 1e6;
+
+    std::cout << "Cold start: ";
+    if (first_callback > 0.0)
+    {
+        std::cout << "first callback at " << first_callback << " ms";
+    }
+    else
+    {
+        std::cout << "no callbacks";
+    }
+
+    if (first_audible > 0.0)
+    {
+        std::cout << ", first audible sample at " << first_audible << " ms, target " << target_milliseconds << " ms" <<
+            (first_audible > target_milliseconds ? " missed." : " met.") << std::endl;
+    }
+    else
+    {
+        std::cout << ", nothing audible." << std::endl;
+    }
+}
+
+void startup_timer::mark(std::atomic<int64_t>& time)
+{
+    // Only the first one counts, and after that this is a single load.
+    if (time.load(std::memory_order_relaxed) != 0)
+    {
+        return;
+    }
+
+    const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() -
+        start_time_).count();
+    int64_t unset = 0;
+    time.compare_exchange_strong(unset, std::max<int64_t>(elapsed, 1));
+}
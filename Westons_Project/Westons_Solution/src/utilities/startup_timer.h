@@ -0,0 +1,33 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+/**
+ * \brief Times how long the program takes from starting to making sound. The first callback shows when the audio path
+ * is up, and the first audible buffer is what a listener notices. Each is only recorded once.
+ */
+class startup_timer
+{
+public:
+    static void start();
+
+    static void mark_callback();
+
+    static void mark_audible();
+
+    static void report();
+
+    // Longest a cold start should take to the first audible sample.
+    const static double target_milliseconds;
+
+private:
+    static void mark(std::atomic<int64_t>& time);
+
+    static std::chrono::steady_clock::time_point start_time_;
+
+    // Nanoseconds from the start. 0 until it happens.
+    static std::atomic<int64_t> first_callback_;
+    static std::atomic<int64_t> first_audible_;
+};
@@ -0,0 +1,427 @@
+#include "telemetry.h"
+#include "trace_profiler.h"
+
+#include <portaudio.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+// Upper bounds, in nanoseconds, of the buckets that pass times are counted in.
+static const uint32_t busy_bucket_bounds[telemetry_source::num_busy_buckets] = {
+    50000, 100000, 250000, 500000, 1000000, 2000000, 3000000, 5000000, 10000000, 20000000
+};
+
+telemetry_source::telemetry_source(const std::string& name) :
+    m_name_(name),
+    m_dropped_(0)
+{
+}
+
+/**
+ * \brief Gets the name the source is exported under.
+ * \return Name of the source.
+ */
+const std::string& telemetry_source::get_name() const
+{
+    return m_name_;
+}
+
+/**
+ * \brief Gets how long it has been since a pass started.
+ * \param start When the pass started.
+ * \return Nanoseconds since the start. Capped at about 4 seconds.
+ */
+uint32_t telemetry_source::nanoseconds_since(const std::chrono::steady_clock::time_point start)
+{
+    const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+    return static_cast<uint32_t>(std::min<int64_t>(elapsed.count(), UINT32_MAX));
+}
+
+/**
+ * \brief Turns the time a callback has before its buffer plays into a deadline for a record.
+ * \param seconds Seconds until the buffer plays, from sound_utilities::time_to_output.
+ * \return Nanoseconds until the buffer plays. 0 when it is already late.
+ */
+uint32_t telemetry_source::deadline_nanoseconds(const double seconds)
+{
+    if (!(seconds > 0.0))
+    {
+        return 0;
+    }
+
+    return static_cast<uint32_t>(std::min(seconds * 1e9, static_cast<double>(UINT32_MAX)));
+}
+
+/**
+ * \brief Checks the callback status for an under or overflow.
+ * \param status_flags Status Port Audio handed to the callback.
+ * \return If the stream glitched.
+ */
+bool telemetry_source::is_xrun(const unsigned long status_flags)
+{
+    return (status_flags & (paInputUnderflow | paInputOverflow | paOutputUnderflow | paOutputOverflow)) != 0;
+}
+
+/**
+ * \brief Sorts a voice count into the power of two at or below it, so passes with similar loads are counted together.
+ * \param voices Voices playing.
+ * \return Smallest voice count in the bucket. 0, 1, 2, 4, and so on up to 256, which takes everything above.
+ */
+uint32_t telemetry_source::voice_bucket(const uint32_t voices)
+{
+    const uint32_t max_bucket = 256;
+    if (voices == 0 || voices >= max_bucket)
+    {
+        return std::min(voices, max_bucket);
+    }
+
+    uint32_t bucket = 1;
+    while (bucket * 2 <= voices)
+    {
+        bucket *= 2;
+    }
+
+    return bucket;
+}
+
+telemetry::telemetry() :
+    m_period_(1000),
+    m_running_(false)
+{
+}
+
+telemetry::~telemetry()
+{
+    stop();
+}
+
+/**
+ * \brief Gets the source for a thread to send its records to. Asking again for the same name gives back the same
+ * source, so a driver that is run again carries on its totals.
+ * \param name Name the records are exported under.
+ * \return The source. Stays good until the telemetry goes away.
+ */
+telemetry_source* telemetry::add_source(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(m_sources_mutex_);
+    for (const auto& source : m_sources_)
+    {
+        if (source->get_name() == name)
+        {
+            return source.get();
+        }
+    }
+
+    m_sources_.emplace_back(new telemetry_source(name));
+    return m_sources_.back().get();
+}
+
+/**
+ * \brief Starts writing the totals to a file.
+ * \param path File to write. Ends in .json for JSON, anything else for the Prometheus text format.
+ * \param period How often to write it.
+ * \return False if the file could not be written.
+ */
+bool telemetry::start(const std::string& path, const std::chrono::milliseconds period)
+{
+    stop();
+
+    m_path_ = path;
+    m_period_ = period;
+    if (!write())
+    {
+        return false;
+    }
+
+    m_running_ = true;
+    m_thread_ = std::thread(&telemetry::run, this);
+    return true;
+}
+
+/**
+ * \brief Stops the exporter after it writes out everything that has come in.
+ */
+void telemetry::stop()
+{
+    if (!m_thread_.joinable())
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_wake_mutex_);
+        m_running_ = false;
+    }
+    m_wake_.notify_all();
+    m_thread_.join();
+
+    collect();
+    write();
+}
+
+/**
+ * \brief Collects and writes every period until stopped.
+ */
+void telemetry::run()
+{
+    TRACE_THREAD("telemetry");
+
+    std::unique_lock<std::mutex> lock(m_wake_mutex_);
+    while (m_running_)
+    {
+        m_wake_.wait_for(lock, m_period_, [this] { return !m_running_; });
+        if (!m_running_)
+        {
+            break;
+        }
+
+        lock.unlock();
+        {
+            TRACE_SCOPE("telemetry export");
+            collect();
+            write();
+        }
+        lock.lock();
+    }
+}
+
+/**
+ * \brief Takes every record waiting in the rings and adds it to the totals.
+ */
+void telemetry::collect()
+{
+    std::lock_guard<std::mutex> lock(m_sources_mutex_);
+    for (const auto& source : m_sources_)
+    {
+        auto& totals = source->m_totals_;
+        telemetry_record record;
+        while (source->m_ring_.pop(record))
+        {
+            ++totals.m_passes;
+            totals.m_frames += record.m_frames;
+            totals.m_events += record.m_events;
+            totals.m_xruns += record.m_xrun ? 1 : 0;
+            totals.m_deadline_misses += record.m_deadline_missed ? 1 : 0;
+            totals.m_busy_ns += record.m_busy_ns;
+            totals.m_busy_max_ns = std::max(totals.m_busy_max_ns, record.m_busy_ns);
+            totals.m_voices = record.m_voices;
+            totals.m_voices_max = std::max(totals.m_voices_max, record.m_voices);
+            totals.m_queue_depth = record.m_queue_depth;
+            totals.m_queue_depth_max = std::max(totals.m_queue_depth_max, record.m_queue_depth);
+
+            uint32_t bucket = 0;
+            while (bucket < telemetry_source::num_busy_buckets && record.m_busy_ns > busy_bucket_bounds[bucket])
+            {
+                ++bucket;
+            }
+            ++totals.m_busy_counts[bucket];
+
+            const auto& counts = record.m_counters;
+            if (counts.m_available != 0)
+            {
+                const auto key = std::make_pair(record.m_frames, telemetry_source::voice_bucket(record.m_voices));
+                auto& group = totals.m_counter_groups[key];
+                ++group.m_passes;
+                group.m_cycles += counts.m_cycles;
+                group.m_instructions += counts.m_instructions;
+                group.m_l1d_misses += counts.m_l1d_misses;
+                group.m_branch_misses += counts.m_branch_misses;
+                totals.m_counters_available = counts.m_available;
+            }
+        }
+    }
+}
+
+/**
+ * \brief Replaces the file with the current totals. Written to the side first and moved over the old one.
+ * \return If the file was written.
+ */
+bool telemetry::write() const
+{
+    const auto json = m_path_.size() >= 5 && m_path_.compare(m_path_.size() - 5, 5, ".json") == 0;
+    const auto text = json ? to_json() : to_prometheus();
+
+    const auto temporary_path = m_path_ + ".tmp";
+    {
+        std::ofstream file(temporary_path, std::ios::trunc);
+        if (!file || !(file << text))
+        {
+            return false;
+        }
+    }
+
+    return std::rename(temporary_path.c_str(), m_path_.c_str()) == 0;
+}
+
+/**
+ * \brief Writes the totals in the Prometheus text format.
+ * \return The text.
+ */
+std::string telemetry::to_prometheus() const
+{
+    std::lock_guard<std::mutex> lock(m_sources_mutex_);
+    std::ostringstream out;
+
+    const auto write_metric = [&](const char* name, const char* type, const char* help, uint64_t (*value)(
+        const telemetry_source&))
+    {
+        out << "# HELP " << name << " " << help << "\n# TYPE " << name << " " << type << "\n";
+        for (const auto& source : m_sources_)
+        {
+            out << name << "{source=\"" << source->get_name() << "\"} " << value(*source) << "\n";
+        }
+    };
+
+    write_metric("westons_passes_total", "counter", "Callbacks or reader passes run.",
+                 [](const telemetry_source& s) { return s.m_totals_.m_passes; });
+    write_metric("westons_frames_total", "counter", "Frames rendered.",
+                 [](const telemetry_source& s) { return s.m_totals_.m_frames; });
+    write_metric("westons_events_total", "counter", "Events and commands carried out.",
+                 [](const telemetry_source& s) { return s.m_totals_.m_events; });
+    write_metric("westons_xruns_total", "counter", "Passes that Port Audio reported an under or overflow on.",
+                 [](const telemetry_source& s) { return s.m_totals_.m_xruns; });
+    write_metric("westons_deadline_misses_total", "counter", "Passes that finished after their buffer was due to play.",
+                 [](const telemetry_source& s) { return s.m_totals_.m_deadline_misses; });
+    write_metric("westons_telemetry_dropped_total", "counter", "Records dropped because the ring was full.",
+                 [](const telemetry_source& s) { return static_cast<uint64_t>(s.m_dropped_.load()); });
+    write_metric("westons_voices", "gauge", "Voices playing after the last pass.",
+                 [](const telemetry_source& s) { return static_cast<uint64_t>(s.m_totals_.m_voices); });
+    write_metric("westons_voices_max", "gauge", "Most voices playing after any pass.",
+                 [](const telemetry_source& s) { return static_cast<uint64_t>(s.m_totals_.m_voices_max); });
+    write_metric("westons_queue_depth", "gauge", "Work waiting after the last pass.",
+                 [](const telemetry_source& s) { return static_cast<uint64_t>(s.m_totals_.m_queue_depth); });
+    write_metric("westons_queue_depth_max", "gauge", "Most work waiting after any pass.",
+                 [](const telemetry_source& s) { return static_cast<uint64_t>(s.m_totals_.m_queue_depth_max); });
+
+    out << "# HELP westons_pass_seconds Time each pass took.\n# TYPE westons_pass_seconds histogram\n";
+    for (const auto& source : m_sources_)
+    {
+        const auto& totals = source->m_totals_;
+        const auto label = "source=\"" + source->get_name() + "\"";
+        uint64_t count = 0;
+        for (uint32_t i = 0; i < telemetry_source::num_busy_buckets; ++i)
+        {
+            count += totals.m_busy_counts[i];
+            out << "westons_pass_seconds_bucket{" << label << ",le=\"" << busy_bucket_bounds[i] / 1e9 << "\"} "
+                << count << "\n";
+        }
+        out << "westons_pass_seconds_bucket{" << label << ",le=\"+Inf\"} " << totals.m_passes << "\n";
+        out << "westons_pass_seconds_sum{" << label << "} " << totals.m_busy_ns / 1e9 << "\n";
+        out << "westons_pass_seconds_count{" << label << "} " << totals.m_passes << "\n";
+    }
+
+    // Hardware counts next to the pass times, split by buffer size and voices so cache effects can be picked out.
+    const auto write_counter = [&](const char* name, const char* help, const uint32_t counter,
+                                   uint64_t telemetry_source::counter_totals::* value)
+    {
+        out << "# HELP " << name << " " << help << "\n# TYPE " << name << " counter\n";
+        for (const auto& source : m_sources_)
+        {
+            if ((source->m_totals_.m_counters_available & counter) != counter)
+            {
+                continue;
+            }
+
+            for (const auto& group : source->m_totals_.m_counter_groups)
+            {
+                out << name << "{source=\"" << source->get_name() << "\",frames=\"" << group.first.first <<
+                    "\",voices=\"" << group.first.second << "\"} " << group.second.*value << "\n";
+            }
+        }
+    };
+
+    write_counter("westons_counted_passes_total", "Passes the hardware counters were read over.",
+                  perf_counters::cycles, &telemetry_source::counter_totals::m_passes);
+    write_counter("westons_pass_cycles_total", "CPU cycles spent in counted passes.", perf_counters::cycles,
+                  &telemetry_source::counter_totals::m_cycles);
+    write_counter("westons_pass_instructions_total", "Instructions retired in counted passes.",
+                  perf_counters::instructions, &telemetry_source::counter_totals::m_instructions);
+    write_counter("westons_pass_l1d_misses_total", "L1 data cache read misses in counted passes.",
+                  perf_counters::l1d_misses, &telemetry_source::counter_totals::m_l1d_misses);
+    write_counter("westons_pass_branch_misses_total", "Mispredicted branches in counted passes.",
+                  perf_counters::branch_misses, &telemetry_source::counter_totals::m_branch_misses);
+
+    return out.str();
+}
+
+/**
+ * \brief Writes the totals as JSON, one object per source.
+ * \return The text.
+ */
+std::string telemetry::to_json() const
+{
+    std::lock_guard<std::mutex> lock(m_sources_mutex_);
+    std::ostringstream out;
+
+    out << "{\"sources\":{";
+    for (size_t i = 0; i < m_sources_.size(); ++i)
+    {
+        const auto& source = *m_sources_[i];
+        const auto& totals = source.m_totals_;
+        out << (i > 0 ? "," : "") << "\"" << source.get_name() << "\":{"
+            << "\"passes\":" << totals.m_passes
+            << ",\"frames\":" << totals.m_frames
+            << ",\"events\":" << totals.m_events
+            << ",\"xruns\":" << totals.m_xruns
+            << ",\"deadline_misses\":" << totals.m_deadline_misses
+            << ",\"dropped\":" << source.m_dropped_.load()
+            << ",\"voices\":" << totals.m_voices
+            << ",\"voices_max\":" << totals.m_voices_max
+            << ",\"queue_depth\":" << totals.m_queue_depth
+            << ",\"queue_depth_max\":" << totals.m_queue_depth_max
+            << ",\"busy_seconds_total\":" << totals.m_busy_ns / 1e9
+            << ",\"busy_seconds_max\":" << totals.m_busy_max_ns / 1e9
+            << ",\"busy_histogram\":[";
+
+        for (uint32_t j = 0; j <= telemetry_source::num_busy_buckets; ++j)
+        {
+            out << (j > 0 ? "," : "") << "{\"le\":";
+            if (j < telemetry_source::num_busy_buckets)
+            {
+                out << busy_bucket_bounds[j] / 1e9;
+            }
+            else
+            {
+                out << "null";
+            }
+            out << ",\"count\":" << totals.m_busy_counts[j] << "}";
+        }
+        out << "]";
+
+        // Counters that were not read are null rather than 0, so they are not mistaken for a perfect score.
+        const auto available = totals.m_counters_available;
+        const auto write_count = [&](const char* name, const uint32_t counter, const uint64_t value)
+        {
+            out << ",\"" << name << "\":";
+            if ((available & counter) != 0)
+            {
+                out << value;
+            }
+            else
+            {
+                out << "null";
+            }
+        };
+
+        out << ",\"counters\":[";
+        auto first = true;
+        for (const auto& group : totals.m_counter_groups)
+        {
+            const auto& counts = group.second;
+            out << (first ? "" : ",") << "{\"frames\":" << group.first.first << ",\"voices\":" << group.first.second
+                << ",\"passes\":" << counts.m_passes;
+            write_count("cycles", perf_counters::cycles, counts.m_cycles);
+            write_count("instructions", perf_counters::instructions, counts.m_instructions);
+            write_count("l1d_misses", perf_counters::l1d_misses, counts.m_l1d_misses);
+            write_count("branch_misses", perf_counters::branch_misses, counts.m_branch_misses);
+            out << "}";
+            first = false;
+        }
+        out << "]}";
+    }
+    out << "}}\n";
+
+    return out.str();
+}
@@ -0,0 +1,188 @@
+#pragma once
+
+#include "perf_counters.h"
+#include "spsc_queue.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * \brief What one pass of a real time thread did. Fixed in size so it can go through a ring without allocating.
+ */
+struct telemetry_record
+{
+    // How long the pass took, and how long it had before its buffer played. The deadline is 0 when the buffer was
+    // already late.
+    uint32_t m_busy_ns;
+    uint32_t m_deadline_ns;
+
+    // Set when the pass finished after its buffer was due to play.
+    bool m_deadline_missed;
+
+    uint32_t m_frames;
+
+    // Voices playing at the end of the pass.
+    uint32_t m_voices;
+
+    // Events or commands the pass carried out.
+    uint32_t m_events;
+
+    // Work still waiting after the pass.
+    uint32_t m_queue_depth;
+
+    // Under and overflows Port Audio reported for the pass.
+    bool m_xrun;
+
+    // Hardware counts for the pass. Filled in by the source when the pass was begun with begin_pass.
+    perf_counter_values m_counters;
+};
+
+/**
+ * \brief Where one real time thread sends its records. Only the thread that owns the source pushes to it, so the ring
+ * needs no locks. Records that do not fit are counted and dropped.
+ */
+class telemetry_source
+{
+public:
+    explicit telemetry_source(const std::string& name);
+
+    /**
+     * \brief Marks the start of a pass, reading the hardware counters if they are on. Call first thing in the pass.
+     */
+    void begin_pass()
+    {
+        m_counters_.begin();
+    }
+
+    /**
+     * \brief Sends a record to be exported, along with the hardware counts since begin_pass. Never blocks.
+     * \param record Record to send.
+     */
+    void push(const telemetry_record& record)
+    {
+        auto counted = record;
+        m_counters_.end(counted.m_counters);
+        if (!m_ring_.push(counted))
+        {
+            m_dropped_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    const std::string& get_name() const;
+
+    static uint32_t nanoseconds_since(std::chrono::steady_clock::time_point start);
+
+    static uint32_t deadline_nanoseconds(double seconds);
+
+    static bool is_xrun(unsigned long status_flags);
+
+    static uint32_t voice_bucket(uint32_t voices);
+
+    // Number of bounds that pass times are sorted into.
+    const static uint32_t num_busy_buckets = 10;
+
+private:
+    friend class telemetry;
+
+    /**
+     * \brief Hardware counts added up over every counted pass with the same buffer size and voice bucket.
+     */
+    struct counter_totals
+    {
+        uint64_t m_passes = 0;
+        uint64_t m_cycles = 0;
+        uint64_t m_instructions = 0;
+        uint64_t m_l1d_misses = 0;
+        uint64_t m_branch_misses = 0;
+    };
+
+    /**
+     * \brief Everything the source has sent so far. Only touched by the exporter.
+     */
+    struct totals
+    {
+        uint64_t m_passes = 0;
+        uint64_t m_frames = 0;
+        uint64_t m_events = 0;
+        uint64_t m_xruns = 0;
+        uint64_t m_deadline_misses = 0;
+        uint64_t m_busy_ns = 0;
+        uint32_t m_busy_max_ns = 0;
+        uint32_t m_voices = 0;
+        uint32_t m_voices_max = 0;
+        uint32_t m_queue_depth = 0;
+        uint32_t m_queue_depth_max = 0;
+
+        // Passes that took up to each bucket bound, and one more for the rest.
+        std::array<uint64_t, num_busy_buckets + 1> m_busy_counts{};
+
+        // Hardware counts by frames in the pass and its voice bucket, and which counters were read.
+        std::map<std::pair<uint32_t, uint32_t>, counter_totals> m_counter_groups;
+        uint32_t m_counters_available = 0;
+    };
+
+    const static uint32_t ring_capacity = 4096;
+
+    std::string m_name_;
+    spsc_queue<telemetry_record, ring_capacity> m_ring_;
+    std::atomic<uint64_t> m_dropped_;
+
+    // Only used by the thread that owns the source.
+    perf_counters m_counters_;
+
+    totals m_totals_;
+};
+
+/**
+ * \brief Collects records from every real time thread and writes the totals to a file every period, in the Prometheus
+ * text format, or as JSON when the file name ends in .json. The file is replaced whole each time, so anything reading
+ * it never sees half of one.
+ */
+class telemetry
+{
+public:
+    telemetry();
+
+    ~telemetry();
+
+    telemetry(const telemetry&) = delete;
+    telemetry& operator=(const telemetry&) = delete;
+
+    telemetry_source* add_source(const std::string& name);
+
+    bool start(const std::string& path, std::chrono::milliseconds period = std::chrono::milliseconds(1000));
+
+    void stop();
+
+private:
+    void run();
+
+    void collect();
+
+    bool write() const;
+
+    std::string to_prometheus() const;
+
+    std::string to_json() const;
+
+    std::string m_path_;
+    std::chrono::milliseconds m_period_;
+
+    // Sources are only ever added, so their pointers stay good until the telemetry goes away.
+    mutable std::mutex m_sources_mutex_;
+    std::vector<std::unique_ptr<telemetry_source>> m_sources_;
+
+    std::thread m_thread_;
+    std::mutex m_wake_mutex_;
+    std::condition_variable m_wake_;
+    bool m_running_;
+};
@@ -0,0 +1,161 @@
+#include "trace_profiler.h"
+
+#include <algorithm>
+#include <fstream>
+
+std::unique_ptr<trace_profiler::thread_buffer[]> trace_profiler::buffers_;
+std::atomic<uint32_t> trace_profiler::num_buffers_(0);
+std::atomic<bool> trace_profiler::recording_(false);
+std::chrono::steady_clock::time_point trace_profiler::origin_;
+
+/**
+ * \brief Allocates every buffer and starts recording. Can only be started once.
+ * \param events_per_thread Most events each thread can record.
+ * \return False if tracing was already started.
+ */
+bool trace_profiler::start(const uint32_t events_per_thread)
+{
+    if (buffers_)
+    {
+        return false;
+    }
+
+    buffers_.reset(new thread_buffer[max_threads]);
+    for (uint32_t i = 0; i < max_threads; ++i)
+    {
+        buffers_[i].m_events.resize(events_per_thread);
+    }
+
+    origin_ = std::chrono::steady_clock::now();
+    recording_.store(true, std::memory_order_release);
+    return true;
+}
+
+/**
+ * \brief Stops recording. What was recorded is kept until it is written.
+ */
+void trace_profiler::stop()
+{
+    recording_.store(false, std::memory_order_release);
+}
+
+/**
+ * \brief Writes every event recorded so far in the Chrome trace event format.
+ * \param path File to write.
+ * \return If the file was written.
+ */
+bool trace_profiler::write(const std::string& path)
+{
+    if (!buffers_)
+    {
+        return false;
+    }
+
+    std::ofstream file(path, std::ios::trunc);
+    if (!file)
+    {
+        return false;
+    }
+
+    file << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    auto first = true;
+
+    const auto num_buffers = std::min(num_buffers_.load(std::memory_order_acquire), max_threads);
+    for (uint32_t i = 0; i < num_buffers; ++i)
+    {
+        const auto& buffer = buffers_[i];
+        const auto thread_id = i + 1;
+
+        const auto* name = buffer.m_name.load(std::memory_order_acquire);
+        file << (first ? "" : ",") << "\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << thread_id
+            << ",\"args\":{\"name\":\"" << (name ? name : "thread") << "\"}}";
+        first = false;
+
+        const auto count = std::min<size_t>(buffer.m_count.load(std::memory_order_acquire), buffer.m_events.size());
+        for (size_t j = 0; j < count; ++j)
+        {
+            const auto& recorded = buffer.m_events[j];
+            file << ",\n{\"ph\":\"X\",\"name\":\"" << recorded.m_name << "\",\"pid\":1,\"tid\":" << thread_id
+                << ",\"ts\":" << static_cast<double>(recorded.m_start_ns) / 1000.0
+                << ",\"dur\":" << static_cast<double>(recorded.m_duration_ns) / 1000.0 << "}";
+        }
+    }
+
+    file << "\n]}\n";
+    return static_cast<bool>(file);
+}
+
+/**
+ * \brief Names the calling thread in the trace.
+ * \param name Name of the thread. Has to be a string literal.
+ */
+void trace_profiler::name_thread(const char* name)
+{
+    auto* buffer = get_buffer();
+    if (buffer)
+    {
+        buffer->m_name.store(name, std::memory_order_release);
+    }
+}
+
+/**
+ * \brief Records a stage on the calling thread.
+ * \param name Name of the stage. Has to be a string literal.
+ * \param start_ns When the stage started, from now.
+ * \param end_ns When the stage ended, from now.
+ */
+void trace_profiler::record(const char* name, const uint64_t start_ns, const uint64_t end_ns)
+{
+    if (!recording_.load(std::memory_order_relaxed))
+    {
+        return;
+    }
+
+    auto* buffer = get_buffer();
+    if (!buffer)
+    {
+        return;
+    }
+
+    const auto count = buffer->m_count.load(std::memory_order_relaxed);
+    if (count >= buffer->m_events.size())
+    {
+        return;
+    }
+
+    buffer->m_events[count] = event{name, start_ns, end_ns - start_ns};
+    buffer->m_count.store(count + 1, std::memory_order_release);
+}
+
+/**
+ * \brief Gets the time events are stamped with.
+ * \return Nanoseconds since tracing started.
+ */
+uint64_t trace_profiler::now()
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - origin_).count());
+}
+
+/**
+ * \brief Gets the buffer of the calling thread, handing it one the first time it asks.
+ * \return The buffer, or nullptr if tracing has not started or every buffer is taken.
+ */
+trace_profiler::thread_buffer* trace_profiler::get_buffer()
+{
+    // Set once per thread. A thread that missed out keeps missing out.
+    thread_local thread_buffer* buffer = nullptr;
+    thread_local auto asked = false;
+
+    if (!asked && buffers_)
+    {
+        asked = true;
+        const auto index = num_buffers_.fetch_add(1, std::memory_order_acq_rel);
+        if (index < max_threads)
+        {
+            buffer = &buffers_[index];
+        }
+    }
+
+    return buffer;
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * \brief Records how long named stages take on every thread and writes them out as Chrome trace events, which Perfetto
+ * and chrome://tracing can open. Each thread writes into a buffer of its own that is allocated when tracing starts, so
+ * recording never locks or allocates. Once a buffer fills up that thread stops recording.
+ *
+ * Only compiled in when WESTONS_TRACE is defined. Otherwise TRACE_SCOPE and TRACE_THREAD are empty and cost nothing.
+ */
+class trace_profiler
+{
+public:
+    static bool start(uint32_t events_per_thread = default_events_per_thread);
+
+    static void stop();
+
+    static bool write(const std::string& path);
+
+    static void name_thread(const char* name);
+
+    static void record(const char* name, uint64_t start_ns, uint64_t end_ns);
+
+    static uint64_t now();
+
+    // Most threads that can record. Threads past this are left out.
+    const static uint32_t max_threads = 16;
+
+    const static uint32_t default_events_per_thread = 65536;
+
+private:
+    /**
+     * \brief A stage that finished.
+     */
+    struct event
+    {
+        // Has to outlive the profiler. Always a string literal.
+        const char* m_name;
+        uint64_t m_start_ns;
+        uint64_t m_duration_ns;
+    };
+
+    /**
+     * \brief Events from one thread. Only that thread writes to it.
+     */
+    struct thread_buffer
+    {
+        std::vector<event> m_events;
+
+        // Events written so far. Bumped after each event is filled in so the writer only sees whole events.
+        std::atomic<uint32_t> m_count{0};
+
+        std::atomic<const char*> m_name{nullptr};
+    };
+
+    static thread_buffer* get_buffer();
+
+    static std::unique_ptr<thread_buffer[]> buffers_;
+    static std::atomic<uint32_t> num_buffers_;
+    static std::atomic<bool> recording_;
+    static std::chrono::steady_clock::time_point origin_;
+};
+
+/**
+ * \brief Records the time from when it is made to when it goes out of scope.
+ */
+class trace_scope
+{
+public:
+    explicit trace_scope(const char* name) :
+        m_name_(name),
+        m_start_(trace_profiler::now())
+    {
+    }
+
+    ~trace_scope()
+    {
+        trace_profiler::record(m_name_, m_start_, trace_profiler::now());
+    }
+
+    trace_scope(const trace_scope&) = delete;
+    trace_scope& operator=(const trace_scope&) = delete;
+
+private:
+    const char* m_name_;
+    uint64_t m_start_;
+};
+
+#ifdef WESTONS_TRACE
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+// Times the rest of the enclosing scope under the given name. The name has to be a string literal.
+#define TRACE_SCOPE(name) trace_scope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+// Names the calling thread in the trace. The name has to be a string literal.
+#define TRACE_THREAD(name) trace_profiler::name_thread(name)
+#else
+#define TRACE_SCOPE(name) static_cast<void>(0)
+#define TRACE_THREAD(name) static_cast<void>(0)
+#endif
@@ -0,0 +1,112 @@
+#include "work_stealing_pool.h"
+
+#include <algorithm>
+#include <thread>
+
+/**
+ * \brief Construct a pool.
+ * \param num_threads Number of threads to run tasks on, counting the one that calls run. 0 uses one per core.
+ */
+work_stealing_pool::work_stealing_pool(const uint32_t num_threads) :
+    m_num_threads_(num_threads),
+    m_steal_count_(0)
+{
+    if (m_num_threads_ == 0)
+    {
+        m_num_threads_ = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    for (uint32_t i = 0; i < m_num_threads_; ++i)
+    {
+        m_queues_.emplace_back(new task_queue());
+    }
+}
+
+/**
+ * \brief Runs every task and waits for them to finish. The calling thread runs tasks too. Tasks are dealt out in
+ * order, so put the longest ones first to keep the threads evenly loaded.
+ * \param num_tasks Number of tasks. Each one is run once with its index.
+ * \param task Runs one task. Called from several threads at once, and given the thread it is running on.
+ */
+void work_stealing_pool::run(const uint32_t num_tasks, const std::function<void(uint32_t task, uint32_t thread)>& task)
+{
+    for (uint32_t i = 0; i < num_tasks; ++i)
+    {
+        m_queues_[i % m_num_threads_]->m_tasks.push_back(i);
+    }
+
+    // No point waking threads that would have nothing to do.
+    const auto num_threads = std::min(m_num_threads_, std::max(num_tasks, 1u));
+
+    std::vector<std::thread> threads;
+    for (uint32_t thread = 1; thread < num_threads; ++thread)
+    {
+        threads.emplace_back(&work_stealing_pool::work, this, thread, std::cref(task));
+    }
+
+    work(0, task);
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+}
+
+uint32_t work_stealing_pool::get_thread_count() const
+{
+    return m_num_threads_;
+}
+
+/**
+ * \brief Gets how many tasks were run by a thread other than the one they were dealt to.
+ * \return Number of tasks stolen over every run.
+ */
+uint64_t work_stealing_pool::get_steal_count() const
+{
+    return m_steal_count_.load();
+}
+
+/**
+ * \brief Gets the next task for a thread. Its own tasks are taken from the front, others are taken from the back.
+ * \param thread Thread that wants a task.
+ * \param task Filled with the task.
+ * \return False once every queue is empty.
+ */
+bool work_stealing_pool::take_task(const uint32_t thread, uint32_t& task)
+{
+    {
+        auto& own = *m_queues_[thread];
+        std::lock_guard<std::mutex> lock(own.m_mutex);
+        if (!own.m_tasks.empty())
+        {
+            task = own.m_tasks.front();
+            own.m_tasks.pop_front();
+            return true;
+        }
+    }
+
+    for (uint32_t offset = 1; offset < m_num_threads_; ++offset)
+    {
+        auto& other = *m_queues_[(thread + offset) % m_num_threads_];
+        std::lock_guard<std::mutex> lock(other.m_mutex);
+        if (!other.m_tasks.empty())
+        {
+            task = other.m_tasks.back();
+            other.m_tasks.pop_back();
+            m_steal_count_.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+
+    // Tasks are only added before the threads start, so empty queues stay empty.
+    return false;
+}
+
+void work_stealing_pool::work(const uint32_t thread, const std::function<void(uint32_t task, uint32_t thread)>& task)
+{
+    uint32_t next;
+    while (take_task(thread, next))
+    {
+        task(next, thread);
+    }
+}
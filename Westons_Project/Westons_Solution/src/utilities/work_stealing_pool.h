@@ -0,0 +1,43 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+ * \brief Runs a batch of independent tasks over a set of threads. Tasks are dealt out to every thread up front, and a
+ * thread that runs out takes the last task of another. Meant for coarse tasks, each queue is guarded by its own lock.
+ */
+class work_stealing_pool
+{
+public:
+    explicit work_stealing_pool(uint32_t num_threads = 0);
+
+    void run(uint32_t num_tasks, const std::function<void(uint32_t task, uint32_t thread)>& task);
+
+    uint32_t get_thread_count() const;
+
+    uint64_t get_steal_count() const;
+
+private:
+    /**
+     * \brief Tasks waiting on one thread. Kept apart from the other queues so their locks do not share a cache line.
+     */
+    struct alignas(64) task_queue
+    {
+        std::mutex m_mutex;
+        std::deque<uint32_t> m_tasks;
+    };
+
+    bool take_task(uint32_t thread, uint32_t& task);
+
+    void work(uint32_t thread, const std::function<void(uint32_t task, uint32_t thread)>& task);
+
+    uint32_t m_num_threads_;
+    std::vector<std::unique_ptr<task_queue>> m_queues_;
+    std::atomic<uint64_t> m_steal_count_;
+};